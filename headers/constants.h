@@ -5,15 +5,112 @@
 #include <array>
 #include <string>
 
+#include "vertex_packing.h"
+
 constexpr uint32_t WIDTH = 800;
 constexpr uint32_t HEIGHT = 600;
 
-constexpr std::string_view MODEL_PATH = "assets/models/Windmill.obj";
-constexpr std::string_view MODELS_FOLDER = "assets/models/";
-constexpr std::string_view TEXTURE_PATH = "assets/textures/windmill.png";
+// meshes, texture and instances that are rendered, see scene.h
+constexpr std::string_view SCENE_PATH = "assets/scenes/windmill.scene";
+
+// the loader output is cached next to every model, bump the version whenever the
+// loader starts producing different geometry for the same source and options
+constexpr std::string_view MESH_CACHE_EXTENSION = ".meshcache";
+constexpr uint64_t MESH_LOADER_VERSION = 11;
+
+// the mip chain of the scene texture is baked next to it, see texture_cache.h
+constexpr std::string_view TEXTURE_CACHE_EXTENSION = ".texcache";
+
+// textures are block compressed on their cold start when the device supports it, colour that
+// falls below MIN_TEXTURE_PSNR dB as BC1 or BC3 is stored as BC7 instead
+constexpr bool COMPRESS_TEXTURES = true;
+constexpr double MIN_TEXTURE_PSNR = 36.0;
+
+// size of the bindless texture array, the scene texture and one slot for every 12 bit texture
+// index of PackedMaterial
+constexpr uint32_t MAX_SCENE_TEXTURES = 4096;
+
+// Textures with levels larger than a tile are virtual, see virtual_texture.h. Their tiles are
+// streamed into a physical cache of VIRTUAL_TILE_CACHE_TILES x VIRTUAL_TILE_CACHE_TILES tiles
+// per block format as the closest hit shader asks for them, at most VIRTUAL_TILE_BUDGET a frame.
+// The page table has room for VIRTUAL_PAGE_TABLE_ENTRIES tiles of all textures and every frame
+// reports up to VIRTUAL_FEEDBACK_CAPACITY tile requests. The sizes are repeated in
+// shaders/virtual_texture.h.
+constexpr bool VIRTUAL_TEXTURES = true;
+constexpr uint32_t VIRTUAL_TILE_CACHE_TILES = 32;
+constexpr uint32_t VIRTUAL_TILE_BUDGET = 64;
+constexpr uint32_t VIRTUAL_PAGE_TABLE_ENTRIES = 1 << 18;
+constexpr uint32_t VIRTUAL_FEEDBACK_CAPACITY = 1 << 16;
+
+// Textures rendered at runtime rebuild their mip chain with one compute dispatch, see
+// shaders/downsample.comp, which writes at most DOWNSAMPLE_MAX_LEVELS levels below level 0. The
+// chain of textures larger than 4096 texels along an axis ends there. Up to
+// MAX_DOWNSAMPLED_TEXTURES such textures exist at a time.
+constexpr uint32_t DOWNSAMPLE_MAX_LEVELS = 12;
+constexpr uint32_t MAX_DOWNSAMPLED_TEXTURES = 16;
 
 constexpr int MAX_FRAMES_IN_FLIGHT = 2;
 
+// vertical field of view of the camera in degrees
+constexpr float FIELD_OF_VIEW = 45.0f;
+
+// vertices closer than this are merged while loading models, 0 only merges exact duplicates
+constexpr float WELD_POSITION_EPSILON = 0.0f;
+
+// reorder triangles and vertices for vertex fetch locality after loading, see mesh_optimizer.h
+constexpr bool OPTIMIZE_MESH = true;
+
+// group the triangles of every part by material after optimizing, see material_table.h. The
+// triangles of one material keep their spatial order, but regions where materials alternate
+// are pulled apart, so it only pays off for models with large single material regions.
+constexpr bool SORT_TRIANGLES_BY_MATERIAL = false;
+
+// OBJ corners without a normal get a smooth one, triangles around a position that are bent by
+// more than this many degrees are not smoothed across, see normal_generator.h
+constexpr float NORMAL_CREASE_ANGLE = 60.0f;
+
+// triangles of a model part whose bounding box diagonal is more than this many times the median
+// of the part are split before the BVH is built, see triangle_splitter.h. The split is kept when
+// it lowers the estimated SAH cost of the part, 0 turns it off.
+constexpr float SPLIT_TRIANGLE_FACTOR = 16.0f;
+
+// OBJ shapes that are rigid copies of each other get one BLAS and a TLAS instance per copy,
+// see shape_instancer.h. Every prototype is a mesh of its own and counts against
+// MAX_SCENE_MESHES, at most MAX_SHAPE_PROTOTYPES are kept per model.
+constexpr bool INSTANCE_DUPLICATE_SHAPES = true;
+constexpr uint32_t MAX_SHAPE_PROTOTYPES = 32;
+
+// every part of at least LOD_MIN_TRIANGLES triangles gets up to LOD_LEVELS - 1 simplified
+// versions with a BLAS each, every one with about LOD_REDUCTION of the triangles of the one
+// before, see mesh_simplifier.h. The TLAS picks a level per instance every frame, the largest
+// error on screen is set in the options dialog.
+constexpr uint32_t LOD_LEVELS = 4;
+constexpr float LOD_REDUCTION = 0.25f;
+constexpr uint32_t LOD_MIN_TRIANGLES = 1024;
+
+// meshes are cut into BLASes of at most this many triangles, or the device limit if that is
+// lower. Consecutive triangles are close in space after OPTIMIZE_MESH, so every cut is a
+// spatially coherent chunk.
+constexpr uint32_t MAX_BLAS_TRIANGLES = 1u << 20;
+
+// BLASes are built in batches that share one scratch buffer of at most this size
+constexpr VkDeviceSize BLAS_SCRATCH_BUDGET = 256ull << 20;
+
+// geometry is streamed to the device through a staging buffer of this size, one model at a
+// time, and the host copy of every model is dropped once it is uploaded
+constexpr VkDeviceSize GEOMETRY_STAGING_SIZE = 64ull << 20;
+
+// upload 16 bit indices when the model has at most 65536 vertices
+constexpr bool SHORT_INDICES = true;
+
+// layout of the vertices the closest hit shader reads, see vertex_packing.h
+constexpr RTVertexFormat RT_VERTEX_FORMAT = RTVertexFormat::Full;
+
+// the closest hit shader reads the normals, texture coordinates and material of a hit from one
+// TriangleRecord per triangle, see vertex_packing.h, instead of the indices and vertices in
+// RT_VERTEX_FORMAT
+constexpr bool RT_TRIANGLE_RECORDS = true;
+
 constexpr std::array<const char *, 1> validationLayers = {"VK_LAYER_KHRONOS_validation"};
 
 constexpr std::array<const char *, 2> deviceExtensions = {VK_KHR_SWAPCHAIN_EXTENSION_NAME,
@@ -0,0 +1,51 @@
+#ifndef GEOMETRY_VIEW_H
+#define GEOMETRY_VIEW_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "vertex.h"
+
+// non owning view of loaded geometry, a mapped mesh cache or a model on the heap.
+// The view of the uploaded scene geometry only holds the counts.
+struct GeometryView
+{
+    const Vertex *vertices = nullptr;
+    size_t vertexCount = 0;
+
+    const uint32_t *indices = nullptr;
+    size_t indexCount = 0;
+
+    // one entry per triangle
+    const uint32_t *materialIndices = nullptr;
+    size_t materialIndexCount = 0;
+};
+
+// simplified version of a part, see mesh_simplifier.h. Its indices point into the vertices of
+// the part and its triangles have material indices like the full resolution ones.
+struct GeometryLevel
+{
+    uint32_t firstIndex = 0;
+    uint32_t indexCount = 0;
+    // distance from the full resolution surface in model units
+    float error = 0.0f;
+};
+
+// range of a loaded model that gets a BLAS of its own, one per MAX_BLAS_TRIANGLES triangles, it
+// is drawn once per transform. The indices of a part point into the vertices of the whole model.
+struct GeometryPart
+{
+    uint32_t firstVertex = 0;
+    uint32_t vertexCount = 0;
+    uint32_t firstIndex = 0;
+    uint32_t indexCount = 0;
+    // relative to the model, see shape_instancer.h
+    std::vector<glm::mat4> transforms;
+    // coarser levels of detail, each one with fewer triangles than the one before
+    std::vector<GeometryLevel> levels;
+    // bounding sphere of the vertices, center and radius
+    glm::vec4 bounds = glm::vec4(0.0f);
+};
+
+#endif  // GEOMETRY_VIEW_H
@@ -0,0 +1,47 @@
+#ifndef MAPPED_FILE_H
+#define MAPPED_FILE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// read only memory mapping of a whole file
+class MappedFile
+{
+public:
+    MappedFile() = default;
+    ~MappedFile();
+
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+    MappedFile(MappedFile &&other) noexcept;
+    MappedFile &operator=(MappedFile &&other) noexcept;
+
+    bool open(const std::string &path);
+    void close();
+
+    bool isOpen() const { return mapping != nullptr; }
+    const uint8_t *data() const { return static_cast<const uint8_t *>(mapping); }
+    size_t size() const { return length; }
+
+private:
+    void *mapping = nullptr;
+    size_t length = 0;
+};
+
+struct FileStamp
+{
+    uint64_t size = 0;
+    int64_t modified = 0;
+};
+
+// size and modification time of a file, returns false if it does not exist
+bool getFileStamp(const std::string &path, FileStamp &stamp);
+
+// 64 bit hash of a block of memory, used to key on-disk caches by their source contents
+uint64_t hashBytes(const void *data, size_t size, uint64_t seed = 0);
+
+// hashes the contents of a file, returns false if it can not be read
+bool hashFile(const std::string &path, uint64_t &hash);
+
+#endif  // MAPPED_FILE_H
@@ -0,0 +1,75 @@
+#ifndef MATERIAL_TABLE_H
+#define MATERIAL_TABLE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "tiny_obj_loader.h"
+#include "vertex.h"
+
+enum MaterialFlags : uint32_t
+{
+    // illum 3 and 5, reflective surface
+    MaterialMirror = 1,
+    // dissolve below 1 or a refracting illum model
+    MaterialTransparent = 2,
+    MaterialEmissive = 4,
+};
+
+// diffuseTexture of materials without a diffuse texture
+constexpr uint32_t NO_MATERIAL_TEXTURE = 0xfff;
+
+// GPU material, four to a cache line, decoded by shaders/material_packing.h. The ambient
+// colour of MTL files is dropped, the renderer computes ambient occlusion instead.
+struct PackedMaterial
+{
+    // RGB9E5
+    uint32_t diffuse;
+    uint32_t specular;
+    uint32_t emission;
+    // roughness and metalness as unorm8 in bits 0-7 and 8-15, the diffuse texture index in bits
+    // 16-27 and MaterialFlags in bits 28-31
+    uint32_t parameters;
+
+    bool operator==(const PackedMaterial &other) const
+    {
+        return diffuse == other.diffuse && specular == other.specular && emission == other.emission &&
+               parameters == other.parameters;
+    }
+};
+static_assert(sizeof(PackedMaterial) == 16, "materials are read as one uvec4");
+
+struct MaterialTable
+{
+    // unique materials, a single default one when there are none so the buffer is never empty
+    std::vector<PackedMaterial> materials;
+    // unique diffuse textures, resolved paths
+    std::vector<std::string> textures;
+    // entry in materials of every input material
+    std::vector<uint32_t> remap;
+    // materials whose diffuse texture did not fit into the texture index range, they keep their
+    // colour and get NO_MATERIAL_TEXTURE
+    size_t droppedTextures = 0;
+    double milliseconds = 0.0;
+};
+
+// shared exponent colour, three 9 bit mantissas and a 5 bit exponent, negative values are
+// clamped to 0 and values above 65408 to 65408
+uint32_t packRGB9E5(const glm::vec3 &color);
+glm::vec3 unpackRGB9E5(uint32_t packed);
+
+// Packs the materials and merges the ones that end up with identical packed values, so scenes
+// with thousands of copied MTL entries upload a handful of materials. Texture names are
+// resolved against textureFolders, one per material, and deduplicated as well. At most
+// NO_MATERIAL_TEXTURE textures are kept, the index after them means no texture. Roughness comes
+// from the PBR extension when it is set and from the shininess otherwise.
+MaterialTable buildMaterialTable(const std::vector<tinyobj::material_t> &materials,
+                                 const std::vector<std::string> &textureFolders);
+
+// Stable sorts the triangles by material, so the triangles of a material, and the rays hitting
+// them, share their records. Triangles keep their order within a material.
+void sortTrianglesByMaterial(std::vector<uint32_t> &indices, std::vector<uint32_t> &materialIndices);
+
+#endif  // MATERIAL_TABLE_H
@@ -0,0 +1,42 @@
+#ifndef MESH_CACHE_H
+#define MESH_CACHE_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "geometry_view.h"
+#include "mapped_file.h"
+#include "tiny_obj_loader.h"
+
+// Versioned binary snapshot of the loader output (final vertices, indices,
+// material table, per face material indices and the parts the model is split
+// into) stored next to the
+// source model. The file is memory mapped on open and the arrays are used in
+// place, so a warm start skips OBJ parsing and vertex welding entirely.
+class MeshCache
+{
+public:
+    // maps the cache, returns false if it is missing, was written by another
+    // version / with other loader options, or any of its source files changed
+    bool open(const std::string &cachePath, uint64_t optionsHash);
+    void close();
+
+    bool isOpen() const { return file.isOpen(); }
+
+    GeometryView view() const;
+    std::vector<tinyobj::material_t> materials() const;
+    std::vector<GeometryPart> parts() const;
+
+    static bool write(const std::string &cachePath, uint64_t optionsHash, const std::vector<std::string> &sources,
+                      const GeometryView &geometry, const std::vector<tinyobj::material_t> &materials,
+                      const std::vector<GeometryPart> &parts);
+
+    // the OBJ itself plus every MTL library it references
+    static std::vector<std::string> objSources(const std::string &objPath, const std::string &mtlSearchPath);
+
+private:
+    MappedFile file;
+};
+
+#endif  // MESH_CACHE_H
@@ -0,0 +1,42 @@
+#ifndef MESH_OPTIMIZER_H
+#define MESH_OPTIMIZER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "thread_pool.h"
+#include "vertex.h"
+
+// how well an index buffer reuses recently fetched vertices
+struct VertexFetchStats
+{
+    // vertices transformed per triangle with a 32 entry FIFO cache, 0.5 is ideal, 3 is no reuse
+    double acmr = 0.0;
+    // 64 byte lines missed per triangle in a 4 KB FIFO cache of the vertex buffer
+    double linesPerTriangle = 0.0;
+};
+
+struct MeshOptimizeStats
+{
+    VertexFetchStats before;
+    VertexFetchStats after;
+    size_t removedVertices = 0;
+    double milliseconds = 0.0;
+};
+
+// simulates fetching the vertices of every triangle in order, vertexStride is the size of
+// one vertex in the buffer the shader reads
+VertexFetchStats analyzeVertexFetch(const uint32_t *indices, size_t indexCount, size_t vertexCount,
+                                    size_t vertexStride);
+
+// Reorders the triangles along a Morton curve over their centroids, so triangles that are close
+// in space, and therefore close in the BVH, are close in the index buffer. The curve is cut into
+// clusters which are reordered for vertex reuse with Tipsify in parallel. Vertices are then
+// renumbered in the order the triangles first use them, which makes the vertex fetches of
+// neighbouring triangles hit the same cache lines. Unreferenced vertices are dropped.
+// triangleData holds one entry per triangle (material ids) and is permuted along.
+MeshOptimizeStats optimizeMesh(std::vector<Vertex> &vertices, std::vector<uint32_t> &indices,
+                               std::vector<uint32_t> &triangleData, size_t vertexStride, ThreadPool &pool);
+
+#endif  // MESH_OPTIMIZER_H
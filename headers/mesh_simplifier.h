@@ -0,0 +1,33 @@
+#ifndef MESH_SIMPLIFIER_H
+#define MESH_SIMPLIFIER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "vertex.h"
+
+// coarser version of a mesh, its indices point into the vertices of the mesh it was made from
+struct SimplifiedMesh
+{
+    std::vector<uint32_t> indices;
+    // the triangleData entries of the triangles that are left
+    std::vector<uint32_t> triangleData;
+    // estimated largest distance of the simplified surface from the input, in model units
+    float error = 0.0f;
+    double milliseconds = 0.0;
+};
+
+// Simplifies a mesh with half edge collapses in the order of their quadric error. A vertex is
+// only ever moved onto one of its neighbours, so every corner keeps the normal and texture
+// coordinates of an input vertex and no attributes have to be interpolated. Positions shared by
+// several vertices are attribute seams (normal, texture or material discontinuities), they only
+// collapse along the seam with both of their vertices. Open borders only collapse along the
+// border and both are kept in place by extra quadrics, positions with more than two vertices,
+// corners and non manifold edges are locked. Collapses that flip a triangle are rejected.
+// Collapses stop once at most targetIndexCount indices are left or the next one would move the
+// surface by more than maxError. triangleData holds one entry per triangle (material ids).
+SimplifiedMesh simplifyMesh(const std::vector<Vertex> &vertices, const std::vector<uint32_t> &indices,
+                            const std::vector<uint32_t> &triangleData, size_t targetIndexCount, float maxError);
+
+#endif  // MESH_SIMPLIFIER_H
@@ -0,0 +1,41 @@
+#ifndef NORMAL_GENERATOR_H
+#define NORMAL_GENERATOR_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "thread_pool.h"
+#include "tiny_obj_loader.h"
+#include "vertex.h"
+
+// normals for the OBJ corners that have none, empty when every corner has a normal
+struct GeneratedNormals
+{
+    // index of the first corner of every shape in normals
+    std::vector<size_t> firstCorner;
+    // one per corner of all shapes, only the ones of corners without a normal are set
+    std::vector<glm::vec3> normals;
+    size_t generatedCorners = 0;
+    double milliseconds = 0.0;
+
+    bool empty() const { return normals.empty(); }
+    const glm::vec3 *shape(size_t s) const { return empty() ? nullptr : normals.data() + firstCorner[s]; }
+};
+
+// Smooth normals for the corners of the shapes that have no normal index. The normal of a corner
+// is the sum of the normals of the triangles around its position weighted by their angle at the
+// corner, triangles whose normal is more than creaseAngle degrees off the one of the corner
+// triangle are left out so hard edges stay hard. Positions are the OBJ position indices, so
+// triangles are smoothed across shapes. Every corner gathers from a position to triangle table,
+// the triangles are processed in parallel without locks or atomics.
+GeneratedNormals generateObjNormals(const tinyobj::attrib_t &attrib, const std::vector<tinyobj::shape_t> &shapes,
+                                    float creaseAngle, ThreadPool &pool);
+
+// Sets the tangent of every vertex from the texture coordinates of the triangles around it,
+// orthogonal to its normal and with the handedness of the texture mapping in the bitangent
+// sign. Vertices without a usable texture mapping get any tangent orthogonal to their normal.
+// Like the normals every vertex gathers from its triangles in parallel. Returns milliseconds.
+double generateTangents(std::vector<Vertex> &vertices, const std::vector<uint32_t> &indices, ThreadPool &pool);
+
+#endif  // NORMAL_GENERATOR_H
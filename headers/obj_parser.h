@@ -0,0 +1,65 @@
+#ifndef OBJ_PARSER_H
+#define OBJ_PARSER_H
+
+#include <algorithm>
+#include <cstddef>
+#include <string>
+#include <vector>
+
+#include "thread_pool.h"
+#include "tiny_obj_loader.h"
+
+struct ObjParseStats
+{
+    size_t bytes = 0;
+    size_t chunks = 0;
+    double milliseconds = 0.0;
+
+    double megabytesPerSecond() const
+    {
+        return milliseconds > 0.0 ? (bytes / (1024.0 * 1024.0)) / (milliseconds / 1000.0) : 0.0;
+    }
+};
+
+// Wavefront OBJ reader producing the same attrib / shapes / materials as tinyobj::ObjReader
+// with its default config (triangulation and vertex colors on). The file is memory mapped and
+// cut into line aligned chunks which are parsed on the thread pool. Relative indices and the
+// state that carries over chunk boundaries (current material, smoothing group, object and
+// group names, material libraries) are resolved in a stitching pass afterwards.
+// Lines, points, tags and skin weights are not needed by the renderer and are skipped.
+class ObjParser
+{
+public:
+    // files smaller than minChunkBytes are parsed as a single chunk
+    static constexpr size_t defaultMinChunkBytes = 1 << 20;
+
+    explicit ObjParser(ThreadPool &threadPool, size_t minChunkBytes = defaultMinChunkBytes)
+        : pool(threadPool), minChunkBytes(std::max<size_t>(minChunkBytes, 1))
+    {
+    }
+
+    // with an empty mtlSearchPath material libraries are looked up next to the OBJ
+    bool parseFromFile(const std::string &path, const std::string &mtlSearchPath = "");
+
+    const tinyobj::attrib_t &attrib() const { return objAttrib; }
+    const std::vector<tinyobj::shape_t> &shapes() const { return objShapes; }
+    const std::vector<tinyobj::material_t> &materials() const { return objMaterials; }
+
+    const std::string &warning() const { return warnings; }
+    const std::string &error() const { return errors; }
+    const ObjParseStats &stats() const { return parseStats; }
+
+private:
+    ThreadPool &pool;
+    size_t minChunkBytes;
+
+    tinyobj::attrib_t objAttrib;
+    std::vector<tinyobj::shape_t> objShapes;
+    std::vector<tinyobj::material_t> objMaterials;
+
+    std::string warnings;
+    std::string errors;
+    ObjParseStats parseStats;
+};
+
+#endif  // OBJ_PARSER_H
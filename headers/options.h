@@ -18,6 +18,8 @@ public:
     double getAOtMin();
     double getAOtMax();
     uint getAORays();
+    bool getLOD();
+    double getLODError();
 
 private:
     Ui::Options *ui;
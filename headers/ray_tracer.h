@@ -31,7 +31,9 @@
 #include <cstring>
 #include <fstream>
 #include <functional>
+#include <future>
 #include <iostream>
+#include <mutex>
 #include <optional>
 #include <set>
 #include <stdexcept>
@@ -39,7 +41,24 @@
 #include <vector>
 #include "constants.h"
 #include "extension_functions.h"
+#include "geometry_view.h"
+#include "material_table.h"
+#include "mesh_cache.h"
+#include "mesh_optimizer.h"
+#include "mesh_simplifier.h"
+#include "normal_generator.h"
+#include "obj_parser.h"
+#include "scene.h"
+#include "shape_instancer.h"
+#include "startup_timeline.h"
+#include "thread_pool.h"
+#include "texture_cache.h"
+#include "texture_compressor.h"
+#include "triangle_splitter.h"
 #include "vertex.h"
+#include "vertex_packing.h"
+#include "vertex_welder.h"
+#include "virtual_texture.h"
 
 /*
 - scalars have to be aligned by N (= 4 bytes for 32bit floats)
@@ -56,6 +75,9 @@ struct UniformBufferObject
     alignas(16) glm::mat4 proj;
     alignas(16) glm::mat4 inv_proj;
     alignas(16) glm::vec4 ao_opt;
+    // dequantization of RTVertexFormat::Quantized positions
+    alignas(16) glm::vec4 positionOffset;
+    alignas(16) glm::vec4 positionScale;
 };
 
 struct SwapChainSupportDetails
@@ -78,14 +100,179 @@ struct Model
 {
     std::vector<Vertex> vertices;
     std::vector<uint32_t> indices;
+    // OBJ material of every triangle, -1 for triangles without one
+    std::vector<uint32_t> materialIndices;
     std::vector<tinyobj::material_t> materials;
-    std::vector<uint32_t> materials_indices;
+    // ranges that get a BLAS each, at least one
+    std::vector<GeometryPart> parts;
 };
 
-struct Rt_model
+enum GeometrySection
 {
-    std::vector<float> vertices;
-    std::vector<uint32_t> indices;
+    VerticesSection,
+    IndicesSection,
+    // TriangleRecord of every triangle in IndicesSection, which holds its material
+    TrianglesSection,
+    // vertices in RT_VERTEX_FORMAT, empty for RTVertexFormat::Full which reads VerticesSection
+    // and with RT_TRIANGLE_RECORDS
+    ShadingVerticesSection,
+    // first triangle of every mesh in IndicesSection
+    MeshesSection,
+    // box around the unit sphere, the BLAS input of SphereMesh
+    SphereBoundsSection,
+    GeometrySectionCount
+};
+
+// placement of the sections in geometryBuffer
+struct GeometryLayout
+{
+    std::array<VkDeviceSize, GeometrySectionCount> offsets{};
+    std::array<VkDeviceSize, GeometrySectionCount> sizes{};
+    VkDeviceSize size = 0;
+};
+
+// state of the geometry upload between createGeometryBuffer and finishGeometryUpload
+struct GeometryUpload
+{
+    VkBuffer stagingBuffer = VK_NULL_HANDLE;
+    VkDeviceMemory stagingBufferMemory = VK_NULL_HANDLE;
+    // the loader writes straight into geometryMemory, nothing to copy
+    bool inPlace = false;
+    // geometryMemory when inPlace, the staging buffer otherwise
+    uint8_t *mapped = nullptr;
+    // the staging buffer is used as two halves, one is filled while the other one is copied,
+    // a half is busy while its command buffer is set
+    VkDeviceSize halfSize = 0;
+    uint32_t nextHalf = 0;
+    std::array<VkCommandBuffer, 2> commandBuffers{};
+    std::array<VkFence, 2> fences{};
+    VkDeviceSize streamedBytes = 0;
+};
+
+// part of the geometry buffer one mesh covers, the indices point into the whole vertex section
+struct MeshRange
+{
+    uint32_t firstVertex = 0;
+    uint32_t vertexCount = 0;
+    uint32_t firstIndex = 0;
+    uint32_t indexCount = 0;
+};
+
+// consecutive meshes that together make up one level of detail of a part
+struct MeshLevel
+{
+    uint32_t firstMesh;
+    uint32_t meshCount;
+    // see GeometryLevel, 0 for the full resolution
+    float error;
+};
+
+// one part drawn by every instance of a scene mesh, at the level of detail picked for the
+// instance, relative to the instance transform
+struct MeshPlacement
+{
+    // the full resolution first, it has the most meshes
+    std::vector<MeshLevel> levels;
+    glm::mat4 transform;
+    // see GeometryPart
+    glm::vec4 bounds;
+};
+
+// TLAS instances of one placement of a scene instance. The meshes of the picked level fill the
+// first slots, the others keep a mesh of the full resolution and are masked out, so the
+// instance count never changes.
+struct PlacedInstance
+{
+    glm::mat4 transform;
+    uint32_t materialId;
+    uint32_t sceneMesh;
+    uint32_t placement;
+    uint32_t firstSlot;
+    uint32_t slotCount;
+    uint32_t level;
+};
+
+// the meshes of the scene description between loading and uploading them, GeometryView
+// sources point into the mapped caches or the models
+struct SceneGeometry
+{
+    std::vector<MeshCache> caches;
+    std::vector<Model> models;
+    std::vector<GeometryView> sources;
+    // set once the meshes are placed in the geometry buffer
+    std::vector<MeshRange> ranges;
+    std::vector<uint32_t> firstMaterials;
+};
+
+// mip chain of an image file, read from its texture cache or baked on a cold start off the main
+// thread and uploaded on it
+struct DecodedImage
+{
+    // tightly packed levels of texels or 4x4 blocks, owns the mapped cache or the baked chain
+    std::shared_ptr<const uint8_t> pixels;
+    TextureFormat format = TextureFormat::RGBA8;
+    uint64_t size = 0;
+    std::vector<TextureLevel> levels;
+};
+
+// sampled image with its whole mip chain, one slot of the bindless texture array
+struct Texture
+{
+    VkImage image = VK_NULL_HANDLE;
+    VkDeviceMemory memory = VK_NULL_HANDLE;
+    VkImageView view = VK_NULL_HANDLE;
+};
+
+// texture a worker decoded into its own staging buffer, waiting for the main thread to record
+// its upload
+struct StagedTexture
+{
+    uint32_t slot = 0;
+    Texture texture;
+    VkBuffer stagingBuffer = VK_NULL_HANDLE;
+    VkDeviceMemory stagingBufferMemory = VK_NULL_HANDLE;
+    std::vector<TextureLevel> levels;
+    // a virtual texture only uploads its mip tail here, the whole chain stays with it for the
+    // tiles of the levels above
+    uint32_t tiledLevels = 0;
+    TextureFormat format = TextureFormat::RGBA8;
+    std::shared_ptr<const uint8_t> chainPixels;
+    std::vector<TextureLevel> chainLevels;
+};
+
+// virtual texture tiles a worker gathered into one staging buffer, one after the other
+struct StagedTiles
+{
+    std::vector<TileLoad> tiles;
+    VkBuffer stagingBuffer = VK_NULL_HANDLE;
+    VkDeviceMemory stagingBufferMemory = VK_NULL_HANDLE;
+};
+
+// Texture rendered at runtime whose levels below level 0 are rebuilt by recordMipDownsample. The
+// image stays in the general layout, level 0 is sampled through texture.view and the levels below
+// are written through storage views in the UNORM format of sRGB formats.
+struct DownsampledTexture
+{
+    Texture texture;
+    VkFormat format;
+    uint32_t width;
+    uint32_t height;
+    uint32_t mipLevels;
+    // level i + 1 is levelViews[i]
+    std::vector<VkImageView> levelViews;
+    VkDescriptorSet descriptorSet = VK_NULL_HANDLE;
+    // counter of the groups that finished and the sum of the level 0 block of every group
+    VkBuffer scratchBuffer = VK_NULL_HANDLE;
+    VkDeviceMemory scratchBufferMemory = VK_NULL_HANDLE;
+};
+
+// staged textures copied by one submit, they are bound once its fence signals
+struct TextureUploadBatch
+{
+    VkCommandBuffer commandBuffer = VK_NULL_HANDLE;
+    VkFence fence = VK_NULL_HANDLE;
+    std::vector<StagedTexture> textures;
+    std::vector<StagedTiles> tiles;
 };
 
 struct Camera
@@ -96,14 +283,8 @@ struct Camera
     bool mouse_pressed = false;
     float last_mouse_x, last_mouse_y;
     float rotation_x = 0.0f, rotation_y = 0.0f;
-};
-
-struct Material
-{
-    alignas(16) float ambient[3];
-    alignas(16) float diffuse[3];
-    alignas(16) float specular[3];
-    alignas(16) float emission[3];
+    // world space position, set together with the view matrix
+    glm::vec3 eye = {0.0f, 0.0f, 0.0f};
 };
 
 struct RayTracerApp
@@ -147,30 +328,34 @@ struct RayTracerApp
     size_t currentFrame = 0;
     bool framebufferResized = false;
 
-    static constexpr int RTShadersCount = 3;
+    // raygen, miss, triangle hit group and sphere hit group
+    static constexpr int RTShadersCount = 4;
 
     // unused, but may be useful if we will want to change architecture
     // std::vector<VkImageView> raytracedImagesViews;
     // std::vector<VkImage> raytracedImages;
     // std::vector<VkDeviceMemory> raytracedImagesMemory;
 
-    VkBuffer vertexBuffer;
-    VkDeviceMemory vertexBufferMemory;
-
-    VkBuffer vertexRTDataBuffer;
-    VkDeviceMemory vertexRTDataBufferMemory;
-
-    VkBuffer vertexRTBuffer;
-    VkDeviceMemory vertexRTBufferMemory;
-
-    VkBuffer indexBuffer;
-    VkDeviceMemory indexBufferMemory;
-
-    VkBuffer indexRTDataBuffer;
-    VkDeviceMemory indexRTDataBufferMemory;
-
-    VkBuffer indexRTBuffer;
-    VkDeviceMemory indexRTBufferMemory;
+    // vertices, indices and triangle records for rasterization, the BLAS build and the
+    // ray tracing shaders, one section per array
+    VkBuffer geometryBuffer;
+    VkDeviceMemory geometryMemory;
+    VkDeviceAddress geometryBufferAddress;
+    GeometryLayout geometryLayout;
+    GeometryUpload geometryUpload;
+    // one range per BLAS, the parts of every mesh of the scene description in its order
+    std::vector<MeshRange> meshes;
+    // the parts every mesh of the scene description is made of
+    std::vector<std::vector<MeshPlacement>> meshPlacements;
+    std::vector<PlacedInstance> placedInstances;
+    // what instancesBuffer holds once per frame in flight, it stays mapped to update the levels of
+    // detail
+    std::vector<VkAccelerationStructureInstanceKHR> tlasInstances;
+    VkAccelerationStructureInstanceKHR *mappedInstances = nullptr;
+    // the TLAS update of every frame in flight that changed a level of detail, submitted with the
+    // frame and freed once its fence is waited for
+    std::array<VkCommandBuffer, MAX_FRAMES_IN_FLIGHT> tlasUpdates{};
+    std::vector<VkDeviceAddress> blasAddresses;
 
     VkBuffer blasBuffer;
     VkDeviceMemory blasBufferMemory;
@@ -184,9 +369,6 @@ struct RayTracerApp
     VkBuffer blasScratchBuffer;
     VkDeviceMemory blasScratchBufferMemory;
 
-    VkBuffer materialIndexBuffer;
-    VkDeviceMemory materialIndexBufferMemory;
-
     VkBuffer materialBuffer;
     VkDeviceMemory materialBufferMemory;
 
@@ -196,28 +378,65 @@ struct RayTracerApp
     VkBuffer instancesBuffer;
     VkDeviceMemory instancesBufferMemory;
 
-    VkAccelerationStructureKHR blas;
+    // one BLAS per mesh, all stored in blasBuffer
+    std::vector<VkAccelerationStructureKHR> blases;
     VkAccelerationStructureKHR tlas;
 
-    VkDeviceAddress vertexRTBufferAddress;
-    VkDeviceAddress indexRTBufferAddress;
-
     std::vector<VkBuffer> uniformBuffers;
     std::vector<VkDeviceMemory> uniformBuffersMemory;
     VkDescriptorPool descriptorPool;
     std::vector<VkDescriptorSet> descriptorSets;
-    uint32_t mipLevels;
-    VkImage textureImage;
-    VkDeviceMemory textureImageMemory;
-    VkImageView textureImageView;
+    // bound as one array, slot 0 is the scene texture and the textures of materialTable follow it.
+    // Slots are empty and bound to the placeholder until their texture is uploaded, the ones of
+    // textures that failed to load stay that way.
+    std::vector<Texture> textures;
+    Texture placeholderTexture;
     VkSampler textureSampler;
+    // textures are uploaded block compressed when the device samples BC formats
+    bool textureCompressionBC = false;
+    // textures are decoded on the pool and staged here, every frame records one batched upload of
+    // what arrived since the last one
+    std::vector<std::future<void>> textureStreams;
+    std::mutex stagedTexturesMutex;
+    std::vector<StagedTexture> stagedTextures;
+    std::vector<TextureUploadBatch> textureUploads;
+    // slots in the order their textures were uploaded and how many of them every descriptor set
+    // has bound, a set is only written once the frame that last used it has finished
+    std::vector<uint32_t> readyTextureSlots;
+    std::vector<size_t> boundTextureSlots;
+    // virtual textures, see virtual_texture.h. One physical tile cache per block format that can
+    // occur, the others are bound to the placeholder. Every image has its own copy of the page
+    // table, refreshed before its frame, and its own feedback buffer, read once the frame is done.
+    std::unique_ptr<VirtualTextureTable> virtualTextures;
+    std::array<Texture, 5> tileCaches;
+    VkSampler tileSampler;
+    std::vector<StagedTiles> stagedTiles;
+    std::vector<VkBuffer> pageTableBuffers;
+    std::vector<VkDeviceMemory> pageTableBuffersMemory;
+    std::vector<VkBuffer> feedbackBuffers;
+    std::vector<VkDeviceMemory> feedbackBuffersMemory;
+    std::vector<uint64_t> boundPageTableVersions;
+    // single pass mip downsampler of the runtime rendered textures
+    VkDescriptorSetLayout downsampleDescriptorSetLayout;
+    VkPipelineLayout downsamplePipelineLayout;
+    VkPipeline downsamplePipeline;
+    VkDescriptorPool downsampleDescriptorPool;
     VkImage depthImage;
     VkDeviceMemory depthImageMemory;
     VkImageView depthImageView;
+    SceneDescription scene;
     Model model;
-    Rt_model ray_model;
+    // what the geometry buffers hold, see GeometryView
+    GeometryView geometry;
+    PositionQuantization vertexQuantization;
+    // unique materials of all meshes, the triangle records point into it
+    MaterialTable materialTable;
+    // VK_INDEX_TYPE_UINT16 when every vertex can be addressed with 16 bits
+    VkIndexType geometryIndexType = VK_INDEX_TYPE_UINT32;
     Camera camera;
     std::thread opt;
+    StartupTimeline startupTimeline;
+    ThreadPool threadPool;
 
     std::unique_ptr<QApplication> app;
     std::unique_ptr<Options> options;
@@ -228,35 +447,48 @@ struct RayTracerApp
     void initVulkan();
     void transitionImageLayout(VkImage image, VkFormat format, VkImageLayout oldLayout, VkImageLayout newLayout,
                                uint32_t mipLevels);
-    void copyBufferToImage(VkBuffer buffer, VkImage image, uint32_t width, uint32_t height);
+    void copyBufferToImage(VkBuffer buffer, VkImage image, const std::vector<VkBufferImageCopy> &regions);
     void createImage(uint32_t width, uint32_t height, uint32_t mipLevels, VkFormat format, VkImageTiling tiling,
                      VkImageUsageFlags usage, VkMemoryPropertyFlags properties, VkImage &image,
                      VkDeviceMemory &imageMemory);
+    void createMipDownsampler();
+    DownsampledTexture createDownsampledTexture(uint32_t width, uint32_t height, VkFormat format);
+    void recordMipDownsample(VkCommandBuffer commandBuffer, const DownsampledTexture &texture);
+    void destroyDownsampledTexture(DownsampledTexture &texture);
     VkFormat findSupportedFormat(const std::vector<VkFormat> &candidates, VkImageTiling tiling,
                                  VkFormatFeatureFlags features);
     bool hasStencilComponent(VkFormat format);
     VkFormat findDepthFormat();
     void createDepthResources();
-    void generateMipmaps(VkImage image, VkFormat imageFormat, int32_t texWidth, int32_t texHeight, uint32_t mipLevels);
-    void createTextureImage();
+    DecodedImage decodeImage(const std::string &path, TextureRole role);
+    Texture createTextureImage(const DecodedImage &image);
+    void createPlaceholderTexture();
+    void streamTexture(uint32_t slot, const std::string &path, TextureRole role);
+    void uploadStagedTextures();
+    void bindUploadedTextures(uint32_t imageIndex);
+    void destroyTextureStreams();
+    void createTileCaches();
+    void createVirtualTextureBuffers();
+    void streamVirtualTiles(uint32_t imageIndex);
     VkImageView createImageView(VkImage image, VkFormat format, VkImageAspectFlags aspectFlags, uint32_t mipLevels);
-    void createTextureImageView();
     void createTextureSampler();
     void createRayTracedImages();
     void createDescriptorPool();
     void createUniformBuffers();
     void createDescriptorSetLayout();
 
-    void createIndexBuffer();
-    void createVertexBuffer();
+    void createGeometryBuffer(size_t vertexCount, size_t indexCount);
+    void writeGeometry(GeometrySection section, size_t firstElement, size_t count, size_t elementSize,
+                       const std::function<void(size_t, size_t, uint8_t *)> &fill);
+    void waitGeometryHalf(uint32_t half);
+    void finishGeometryUpload();
     void createMaterialsBuffer();
 
-    void createRTIndexBuffer();
-    void createRTVertexBuffer();
-    void createRTDataVertexBuffer();
-    void createRTDataIndexBuffer();
     void createRT_BLAS();
     void createRT_TLAS();
+    void writeInstanceSlots(const PlacedInstance &placed);
+    void recordTLASBuild(VkCommandBuffer commandBuffer, VkBuildAccelerationStructureModeKHR mode, uint32_t frame);
+    void updateLevelsOfDetail();
 
     void recreateSwapChain();
     void createDescriptorSets();
@@ -307,6 +539,7 @@ struct RayTracerApp
     // vulkan utils
     VkCommandBuffer beginSingleTimeCommands(VkCommandPool commandPool);
     void endSingleTimeCommands(VkCommandPool commandPool, VkCommandBuffer commandBuffer, VkQueue queue);
+    bool tryFindMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties, uint32_t &typeIndex);
     uint32_t findMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties);
 
     void copyBuffer(VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize size);
@@ -320,21 +553,24 @@ struct RayTracerApp
                       VkMemoryAllocateFlags allocFlags = VK_MEMORY_ALLOCATE_FLAG_BITS_MAX_ENUM);
     // asset utils
     std::vector<char> readFile(const std::string &filename);
-    void loadRTGeometry(Rt_model &m, std::string path);
 
-    void loadModel(Model &m, Rt_model &rt_m);
+    void loadSceneDescription();
+    // the scene is loaded on a worker, placed on the calling thread, which decides the geometry
+    // layout and creates the geometry buffer, and then streamed into it
+    SceneGeometry loadSceneMeshes();
+    void placeSceneMeshes(SceneGeometry &loaded, Model &m);
+    void uploadSceneGeometry(SceneGeometry &loaded);
+    GeometryView loadMesh(const std::string &path, MeshCache &cache, Model &loaded);
+    uint64_t loaderOptionsHash();
 
-    void loadVertex(Vertex &vertex, Model &m, Rt_model &rt_m, std::map<Vertex, uint32_t> &uniqueVertices);
-    void loadVertices(std::vector<Vertex> &vertices, Model &m, Rt_model &rt_m, std::map<Vertex, uint32_t> &uniqueVertices);
-    void loadIndex(uint32_t index, std::vector<Vertex> &vertices, Model &m, Rt_model &rt_m, std::map<Vertex, uint32_t> &uniqueVertices);
-    void loadIndices(std::vector<uint32_t> &indices, std::vector<Vertex> &vertices, Model &m, Rt_model &rt_m, std::map<Vertex, uint32_t> &uniqueVertices);
+    WeldStats loadObjShapes(const tinyobj::attrib_t &attrib, const std::vector<tinyobj::shape_t> &shapes,
+                            const GeneratedNormals &normals, const std::vector<size_t> &shapeIds, Model &m,
+                            VertexWelder &welder);
+    PositionQuantization sceneQuantization(const std::vector<GeometryView> &sources);
 
-    void loadPlane(glm::vec3 center, glm::vec3 rotation, float height, float width, Model &m, Rt_model &rt_m, std::map<Vertex, uint32_t> &uniqueVertices, uint32_t materialId);
-    std::vector<Vertex> getSphereVertices(glm::vec3 center, float radius, int n, int m, uint32_t materialId);
-    std::vector<uint32_t> getSphereIndices(int n, int m, std::vector<Vertex> &vertices, std::map<Vertex, uint32_t> &uniqueVertices);
-    void loadSphere(glm::vec3 center, float radius, Model &m, Rt_model &rt_m, std::map<Vertex, uint32_t> &uniqueVertices, uint32_t materialId);
+    std::vector<uint32_t> loadVertices(const std::vector<Vertex> &vertices, VertexWelder &welder);
 
-    void loadGeneratedShapes(Model &m, Rt_model &rt_m, std::map<Vertex, uint32_t> &uniqueVertices);
+    void loadUnitPlane(Model &m);
 };
 
 #endif  // ray_tracer_H
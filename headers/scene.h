@@ -0,0 +1,72 @@
+#ifndef SCENE_H
+#define SCENE_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "vertex.h"
+
+// unit sized meshes every scene has, OBJ meshes follow them
+enum BuiltinMesh : uint32_t
+{
+    // sphere of radius 1, intersected analytically by shaders/raytrace.rint
+    SphereMesh,
+    // 1 x 1 square in the xz plane facing +y
+    PlaneMesh,
+    BuiltinMeshCount
+};
+
+// ids the closest hit shader switches on
+enum SceneMaterial : uint32_t
+{
+    TexturedMaterial = 0,
+    MirrorMaterial = 1,
+};
+
+// meshes are numbered by their position in the description. They are split into parts and BLAS
+// sized chunks while loading, the id of every chunk is stored in 16 bits of the instance custom
+// index next to the 8 bit material.
+constexpr size_t MAX_SCENE_MESHES = 65536;
+
+struct SceneMesh
+{
+    std::string name;
+    // OBJ file, empty for the built in meshes
+    std::string path;
+};
+
+struct SceneInstance
+{
+    uint32_t mesh;
+    uint32_t materialId;
+    glm::mat4 transform;
+};
+
+// Text description of what is rendered, one statement per line, # starts a comment:
+//   mesh <name> <obj path>
+//   texture <image path>
+//   instance <mesh> <textured|mirror> [translate x y z | rotate degrees x y z | scale s | scale x y z]...
+// Paths are relative to the working directory like every other asset path. sphere and plane
+// name the built in meshes, meshes declared twice with the same file are loaded once. The
+// transforms of an instance are applied in the order they are written.
+class SceneDescription
+{
+public:
+    bool parseFromFile(const std::string &path);
+
+    const std::vector<SceneMesh> &meshes() const { return sceneMeshes; }
+    const std::vector<SceneInstance> &instances() const { return sceneInstances; }
+    const std::string &texture() const { return texturePath; }
+
+    const std::string &error() const { return errors; }
+
+private:
+    std::vector<SceneMesh> sceneMeshes;
+    std::vector<SceneInstance> sceneInstances;
+    std::string texturePath;
+
+    std::string errors;
+};
+
+#endif  // SCENE_H
@@ -0,0 +1,50 @@
+#ifndef SHAPE_INSTANCER_H
+#define SHAPE_INSTANCER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "thread_pool.h"
+#include "tiny_obj_loader.h"
+#include "vertex.h"
+
+// one shape that occurs several times in the OBJ, the other occurrences are dropped and
+// drawn as instances of it
+struct ShapePrototype
+{
+    size_t shape;
+    // rigid transforms from the prototype to every occurrence, the first one is the identity
+    std::vector<glm::mat4> transforms;
+};
+
+struct ShapeInstancingStats
+{
+    size_t shapes = 0;
+    // occurrences that are replaced by an instance of their prototype
+    size_t duplicateShapes = 0;
+    size_t triangles = 0;
+    size_t duplicateTriangles = 0;
+    double milliseconds = 0.0;
+};
+
+struct ShapeInstancing
+{
+    // shapes that occur once, they are flattened into one mesh like before
+    std::vector<size_t> uniqueShapes;
+    std::vector<ShapePrototype> prototypes;
+    ShapeInstancingStats stats;
+};
+
+// Finds shapes that are copies of each other under a rotation and translation. Every shape is
+// reduced to a signature that does not change under rigid transforms: its face topology,
+// material ids and the eigenvalues of the covariance of its positions. Shapes with equal
+// signatures are compared in their canonical frames (centroid and principal axes) and the
+// transform between the frames is verified on every corner, positions within a small fraction
+// of the shape size, normals and texture coordinates have to match as well. Shapes whose
+// principal axes are ambiguous (equal eigenvalues) are only matched under translation. At most
+// maxPrototypes prototypes are kept, the ones removing the most triangles.
+ShapeInstancing findDuplicateShapes(const tinyobj::attrib_t &attrib, const std::vector<tinyobj::shape_t> &shapes,
+                                    size_t maxPrototypes, ThreadPool &pool);
+
+#endif  // SHAPE_INSTANCER_H
@@ -0,0 +1,66 @@
+#ifndef STARTUP_TIMELINE_H
+#define STARTUP_TIMELINE_H
+
+#include <chrono>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Wall clock record of the startup phases. Phases may run on any thread, the report lists them
+// in start order together with the thread that ran them. Time spent waiting on other threads is
+// recorded as a phase of its own, so the critical path can be read off the rows of thread 0.
+class StartupTimeline
+{
+public:
+    // records the time from its construction to its destruction
+    class Phase
+    {
+    public:
+        Phase(StartupTimeline &timeline, std::string name);
+        ~Phase();
+
+        Phase(const Phase &) = delete;
+        Phase &operator=(const Phase &) = delete;
+
+    private:
+        StartupTimeline &timeline;
+        std::string name;
+        double begin;
+    };
+
+    StartupTimeline();
+
+    // forgets all phases, the report starts from here
+    void restart();
+
+    // runs task as one phase and returns its result
+    template <typename F>
+    auto time(const char *name, F &&task)
+    {
+        Phase phase(*this, name);
+        return task();
+    }
+
+    void report(std::ostream &out) const;
+
+private:
+    struct Record
+    {
+        std::string name;
+        std::thread::id thread;
+        double begin;
+        double end;
+    };
+
+    double now() const;
+    void record(std::string name, double begin);
+
+    std::chrono::high_resolution_clock::time_point start;
+    std::thread::id owner;
+    mutable std::mutex mutex;
+    std::vector<Record> records;
+};
+
+#endif  // STARTUP_TIMELINE_H
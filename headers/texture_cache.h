@@ -0,0 +1,76 @@
+#ifndef TEXTURE_CACHE_H
+#define TEXTURE_CACHE_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "mapped_file.h"
+#include "thread_pool.h"
+
+// how the texels of a chain are stored, the block formats are written by texture_compressor.h
+enum class TextureFormat : uint32_t
+{
+    // sRGB colour and linear alpha, 4 bytes per texel
+    RGBA8,
+    // 8 byte 4x4 blocks of opaque sRGB colour
+    BC1,
+    // 16 byte blocks, BC1 colour and BC4 alpha
+    BC3,
+    // 16 byte blocks, two BC4 channels of a tangent space normal map
+    BC5,
+    // 16 byte blocks of sRGB colour and alpha
+    BC7,
+};
+
+// bytes of a width x height level, block formats round up to whole 4x4 blocks
+uint64_t textureLevelSize(TextureFormat format, uint32_t width, uint32_t height);
+
+// one level of a mip chain, offset of its tightly packed texels or blocks in the chain
+struct TextureLevel
+{
+    uint64_t offset;
+    uint32_t width;
+    uint32_t height;
+};
+
+// every level of an image down to 1x1, level i is max(1, size >> i) texels along each axis
+struct MipChain
+{
+    TextureFormat format = TextureFormat::RGBA8;
+    std::vector<uint8_t> pixels;
+    std::vector<TextureLevel> levels;
+};
+
+// Builds the full RGBA8 mip chain of an image on the CPU. Every texel of a level is the box
+// filtered footprint of the level above, weighted by coverage so odd sizes lose no rows or
+// columns. With srgb colour is averaged in linear space and encoded back to sRGB, without it,
+// for normal maps, all channels are averaged as they are. Alpha is linear. The rows of a level
+// are filtered in parallel.
+MipChain buildMipChain(const uint8_t *pixels, uint32_t width, uint32_t height, bool srgb, ThreadPool &pool);
+
+// Versioned mip chain of an image file stored next to it. The file is memory mapped on open and
+// the levels are copied straight from the mapping into the staging buffer, so a warm start skips
+// PNG decoding, mip generation and block compression.
+class TextureCache
+{
+public:
+    // maps the cache, returns false if it is missing, was written by another version, the source
+    // image changed or it is block compressed when compressed is false and the other way round
+    bool open(const std::string &cachePath, const std::string &sourcePath, bool compressed);
+    void close();
+
+    bool isOpen() const { return file.isOpen(); }
+
+    TextureFormat format() const;
+    const uint8_t *pixels() const;
+    uint64_t pixelSize() const;
+    std::vector<TextureLevel> levels() const;
+
+    static bool write(const std::string &cachePath, const std::string &sourcePath, const MipChain &chain);
+
+private:
+    MappedFile file;
+};
+
+#endif  // TEXTURE_CACHE_H
@@ -0,0 +1,54 @@
+#ifndef TEXTURE_COMPRESSOR_H
+#define TEXTURE_COMPRESSOR_H
+
+#include <cstdint>
+
+#include "texture_cache.h"
+#include "thread_pool.h"
+
+// what a material uses an image for, known from the slot of the material that names it
+enum class TextureRole
+{
+    // diffuse and other colour textures
+    Colour,
+    // normal_texname and bump_texname
+    NormalMap,
+};
+
+// what the texels of an image are, decides the block format it is compressed to
+enum class TextureContent
+{
+    Colour,
+    // any texel with alpha below 255
+    ColourAlpha,
+    // tangent space normal map, unit length vectors pointing out of the surface
+    NormalMap,
+};
+
+// Normal maps are only ever told by their role, colour that happens to look like unit vectors,
+// e.g. a blue sky, stays colour. The texels of a width x height RGBA8 colour image only decide
+// whether it has alpha.
+TextureContent classifyTexture(const uint8_t *pixels, uint32_t width, uint32_t height, TextureRole role);
+
+struct TextureCompressionStats
+{
+    TextureFormat format = TextureFormat::RGBA8;
+    // of the top level over the channels the format keeps, RGB for colour, RGBA with alpha and
+    // RG for normal maps
+    double psnr = 0.0;
+    uint64_t uncompressedBytes = 0;
+    uint64_t compressedBytes = 0;
+    double milliseconds = 0.0;
+};
+
+const char *textureFormatName(TextureFormat format);
+
+// Block compresses every level of an RGBA8 chain. Normal maps are stored as BC5, colour as BC1
+// and colour with alpha as BC3. When the top level comes out below minPsnr dB, e.g. for smooth
+// gradients the 565 endpoints of BC1 band, colour is stored as BC7 instead. Endpoints are fit
+// along the principal axis of every block and refined by least squares, BC7 uses mode 6 only.
+// The block rows of a level are encoded in parallel.
+MipChain compressMipChain(const MipChain &chain, TextureContent content, double minPsnr, ThreadPool &pool,
+                          TextureCompressionStats &stats);
+
+#endif  // TEXTURE_COMPRESSOR_H
@@ -0,0 +1,54 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+// fixed size pool of worker threads used by the asset loaders
+class ThreadPool
+{
+public:
+    explicit ThreadPool(unsigned threadCount = std::thread::hardware_concurrency());
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool &) = delete;
+    ThreadPool &operator=(const ThreadPool &) = delete;
+
+    size_t size() const { return workers.size(); }
+
+    template <typename F>
+    std::future<std::invoke_result_t<F>> submit(F &&task)
+    {
+        using Result = std::invoke_result_t<F>;
+        auto packaged = std::make_shared<std::packaged_task<Result()>>(std::forward<F>(task));
+        std::future<Result> result = packaged->get_future();
+        enqueue([packaged]() { (*packaged)(); });
+        return result;
+    }
+
+    // splits [begin, end) into ranges of at most grainSize elements and calls body(rangeBegin, rangeEnd)
+    // for each of them. The calling thread takes part in the work, so it is safe to call from a worker.
+    // When body throws, the ranges not yet started are skipped and the first exception is rethrown
+    // here once the running ones are done.
+    void parallelFor(size_t begin, size_t end, size_t grainSize, const std::function<void(size_t, size_t)> &body);
+
+private:
+    void enqueue(std::function<void()> task);
+    void workerLoop();
+
+    std::vector<std::thread> workers;
+    std::queue<std::function<void()>> tasks;
+    std::mutex tasksMutex;
+    std::condition_variable tasksAvailable;
+    bool stopping = false;
+};
+
+#endif  // THREAD_POOL_H
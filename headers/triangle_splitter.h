@@ -0,0 +1,41 @@
+#ifndef TRIANGLE_SPLITTER_H
+#define TRIANGLE_SPLITTER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "vertex.h"
+
+struct TriangleSplitStats
+{
+    size_t triangles = 0;
+    // input triangles with a bounding box diagonal above the limit
+    size_t oversizedTriangles = 0;
+    size_t outputTriangles = 0;
+    double milliseconds = 0.0;
+};
+
+// median bounding box diagonal of the triangles, at most maxSamples evenly spread triangles
+// are measured
+float medianTriangleDiagonal(const Vertex *vertices, const uint32_t *indices, size_t indexCount,
+                             size_t maxSamples);
+
+// number of triangles whose bounding box diagonal is longer than maxDiagonal
+size_t countLargeTriangles(const Vertex *vertices, const uint32_t *indices, size_t indexCount, float maxDiagonal);
+
+// Splits every triangle whose bounding box diagonal is longer than maxDiagonal by halving its
+// longest edge until none is left. Huge triangles make the boxes of BVH nodes overlap, smaller
+// pieces can be bounded tightly. Edges are split in every triangle that uses them, also across
+// attribute seams, so no T-junctions appear and the surface stays watertight. New vertices
+// interpolate the attributes of their edge. triangleData holds one entry per triangle (material
+// ids) and is copied to the pieces.
+TriangleSplitStats splitLargeTriangles(std::vector<Vertex> &vertices, std::vector<uint32_t> &indices,
+                                       std::vector<uint32_t> &triangleData, float maxDiagonal);
+
+// Expected cost of tracing a ray through a BVH over the triangles built with the binned surface
+// area heuristic, relative to a ray that hits the root box. Node visits and triangle tests
+// count 1 each. Compares the traversal cost of a mesh before and after splitting on the CPU.
+double estimateSahCost(const Vertex *vertices, const uint32_t *indices, size_t indexCount);
+
+#endif  // TRIANGLE_SPLITTER_H
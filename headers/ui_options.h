@@ -41,6 +41,13 @@ public:
     QLabel *label_4;
     QLabel *label_5;
     QLabel *label_6;
+    QGroupBox *groupBox_5;
+    QVBoxLayout *verticalLayout_6;
+    QFormLayout *formLayout_4;
+    QCheckBox *LODcheckBox;
+    QLabel *label_7;
+    QDoubleSpinBox *LODErrorSpinBox;
+    QLabel *label_8;
     QGroupBox *groupBox;
     QVBoxLayout *verticalLayout_4;
     QFormLayout *formLayout_2;
@@ -116,6 +123,42 @@ public:
 
         verticalLayout_2->addWidget(groupBox_4);
 
+        groupBox_5 = new QGroupBox(Options);
+        groupBox_5->setObjectName(QString::fromUtf8("groupBox_5"));
+        verticalLayout_6 = new QVBoxLayout(groupBox_5);
+        verticalLayout_6->setObjectName(QString::fromUtf8("verticalLayout_6"));
+        formLayout_4 = new QFormLayout();
+        formLayout_4->setObjectName(QString::fromUtf8("formLayout_4"));
+        LODcheckBox = new QCheckBox(groupBox_5);
+        LODcheckBox->setObjectName(QString::fromUtf8("LODcheckBox"));
+        LODcheckBox->setChecked(true);
+
+        formLayout_4->setWidget(0, QFormLayout::LabelRole, LODcheckBox);
+
+        label_7 = new QLabel(groupBox_5);
+        label_7->setObjectName(QString::fromUtf8("label_7"));
+
+        formLayout_4->setWidget(0, QFormLayout::FieldRole, label_7);
+
+        LODErrorSpinBox = new QDoubleSpinBox(groupBox_5);
+        LODErrorSpinBox->setObjectName(QString::fromUtf8("LODErrorSpinBox"));
+        LODErrorSpinBox->setMinimum(0.100000000000000);
+        LODErrorSpinBox->setSingleStep(0.500000000000000);
+        LODErrorSpinBox->setValue(1.000000000000000);
+
+        formLayout_4->setWidget(1, QFormLayout::LabelRole, LODErrorSpinBox);
+
+        label_8 = new QLabel(groupBox_5);
+        label_8->setObjectName(QString::fromUtf8("label_8"));
+
+        formLayout_4->setWidget(1, QFormLayout::FieldRole, label_8);
+
+
+        verticalLayout_6->addLayout(formLayout_4);
+
+
+        verticalLayout_2->addWidget(groupBox_5);
+
         groupBox = new QGroupBox(Options);
         groupBox->setObjectName(QString::fromUtf8("groupBox"));
         verticalLayout_4 = new QVBoxLayout(groupBox);
@@ -190,6 +233,10 @@ public:
         label_4->setText(QCoreApplication::translate("Options", "tMin", nullptr));
         label_5->setText(QCoreApplication::translate("Options", "tMax", nullptr));
         label_6->setText(QCoreApplication::translate("Options", "Number of rays", nullptr));
+        groupBox_5->setTitle(QCoreApplication::translate("Options", "Level of Detail", nullptr));
+        LODcheckBox->setText(QString());
+        label_7->setText(QCoreApplication::translate("Options", "Enabled", nullptr));
+        label_8->setText(QCoreApplication::translate("Options", "Max error (px)", nullptr));
         groupBox->setTitle(QCoreApplication::translate("Options", "Indirect Lighting", nullptr));
         checkBox_2->setText(QString());
         label_2->setText(QCoreApplication::translate("Options", "Enabled", nullptr));
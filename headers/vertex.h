@@ -17,6 +17,9 @@ struct Vertex
     alignas(16) glm::vec3 normal;
     alignas(8) glm::vec2 texCoord;
     alignas(4) uint32_t materialId;
+    // tangent and bitangent sign, see packTangent in vertex_packing.h. It takes the padding at
+    // the end of the struct, so the vertex stays 48 bytes
+    alignas(4) uint32_t tangent;
 
     Vertex();
     Vertex(const glm::vec3 &pos, const glm::vec3 &normal, const glm::vec2 &texCoord, uint32_t materialId);
@@ -35,7 +38,11 @@ struct hash<Vertex>
 {
     size_t operator()(Vertex const &vertex) const
     {
-        return hash<glm::vec3>()(vertex.pos) ^ hash<glm::vec3>()(vertex.normal) ^ hash<glm::vec2>()(vertex.texCoord);
+        size_t seed = hash<glm::vec3>()(vertex.pos);
+        glm::detail::hash_combine(seed, hash<glm::vec3>()(vertex.normal));
+        glm::detail::hash_combine(seed, hash<glm::vec2>()(vertex.texCoord));
+        glm::detail::hash_combine(seed, hash<uint32_t>()(vertex.materialId));
+        return seed;
     }
 };
 }  // namespace std
@@ -0,0 +1,71 @@
+#ifndef VERTEX_PACKING_H
+#define VERTEX_PACKING_H
+
+#include <cstddef>
+#include <cstdint>
+
+#include "vertex.h"
+
+// layout of the vertices the closest hit shader fetches, decoded by shaders/vertex_packing.h
+// Full      48 bytes, Vertex as is
+// Packed    24 bytes, float position, octahedral normal (2 x snorm16), half texcoords, 16 bit material
+// Quantized 16 bytes, like Packed but with the position as 3 x unorm16 inside the model bounds
+enum class RTVertexFormat : uint32_t
+{
+    Full = 0,
+    Packed = 1,
+    Quantized = 2
+};
+
+// unit tangent in 32 bits, octahedral x and y as unorm15 in bits 0-14 and 15-29 and the sign of
+// the bitangent, cross(normal, tangent) * sign, in bit 31. Only the Full format carries it.
+uint32_t packTangent(const glm::vec3 &tangent, float bitangentSign);
+
+// tangent in xyz and the bitangent sign in w
+glm::vec4 unpackTangent(uint32_t packed);
+
+// bytes per vertex of the format
+size_t rtVertexStride(RTVertexFormat format);
+
+// quantized positions are decoded as offset + scale * unorm16
+struct PositionQuantization
+{
+    glm::vec3 offset = glm::vec3(0.0f);
+    glm::vec3 scale = glm::vec3(0.0f);
+};
+
+// the quantization covering the box from minimum to maximum
+PositionQuantization positionQuantization(const glm::vec3 &minimum, const glm::vec3 &maximum);
+
+// writes count vertices in the given format to output, which has to hold count * rtVertexStride(format)
+// bytes, the quantization is only used by the Quantized format
+void packVertices(RTVertexFormat format, const PositionQuantization &quantization, const Vertex *vertices,
+                  size_t count, void *output);
+
+// Everything the closest hit shader reads of a triangle in one aligned 32 byte record, so a hit
+// costs one fetch by primitive instead of three indices and three dependent vertex fetches.
+// Decoded by shaders/vertex_packing.h.
+struct TriangleRecord
+{
+    // octahedral normal of every corner, 2 x snorm16
+    uint32_t normals[3];
+    // material of the triangle in the material table, -1 for none
+    uint32_t material;
+    // texture coordinates of every corner, 2 x half
+    uint32_t texCoords[3];
+    // texture independent part of the ray cone mip level, see triangleLodConstant
+    float lodConstant;
+};
+static_assert(sizeof(TriangleRecord) == 32, "triangle records are read as two uvec4");
+
+// 0.5 * log2 of the texture coordinate area of a triangle over its object space area. The mip
+// level a ray cone of width w hitting the triangle at an angle theta to its normal samples from a
+// width x height texture is this plus log2(w / |cos theta|) + 0.5 * log2(width * height).
+float triangleLodConstant(const Vertex &v0, const Vertex &v1, const Vertex &v2);
+
+// writes the records of count triangles, indices holds 3 * count indices into vertices and
+// materials one material per triangle, which is looked up in materialRemap unless it is -1
+void packTriangles(const Vertex *vertices, const uint32_t *indices, const uint32_t *materials,
+                   const uint32_t *materialRemap, size_t count, TriangleRecord *output);
+
+#endif  // VERTEX_PACKING_H
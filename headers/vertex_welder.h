@@ -0,0 +1,74 @@
+#ifndef VERTEX_WELDER_H
+#define VERTEX_WELDER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "vertex.h"
+
+struct WeldStats
+{
+    size_t inputVertices = 0;
+    size_t uniqueVertices = 0;
+    double milliseconds = 0.0;
+
+    size_t weldedVertices() const { return inputVertices - uniqueVertices; }
+};
+
+// Deduplicates vertices with an open addressing (linear probing) hash table.
+// Unique vertices are appended to the vector passed to the constructor and the
+// returned indices point into it. Two vertices are merged when all attributes,
+// including materialId, are equal. With a positive positionEpsilon a vertex is
+// instead merged into the closest vertex seen before it whose other attributes
+// are equal and whose position is at most positionEpsilon away. Positions are
+// hashed by their cell of a grid of that size and the 27 cells around a vertex
+// are searched, so neighbours on either side of a cell boundary are found. The
+// vertices of the output are the representatives, they never move and merged
+// vertices are not added, so a vertex is always compared against the position
+// it is merged into and merges cannot chain. Feeding the output of another
+// epsilon welder in would chain them, pre-merge with an epsilon of 0 instead.
+class VertexWelder
+{
+public:
+    explicit VertexWelder(std::vector<Vertex> &vertices, float positionEpsilon = 0.0f, size_t expectedVertices = 0);
+
+    // returns the index of the vertex in the output vector, inserted is set to true
+    // if the vertex was not seen before and has just been appended
+    uint32_t weld(const Vertex &vertex, bool *inserted = nullptr);
+
+    const std::vector<Vertex> &vertices() const { return output; }
+    float positionEpsilon() const { return epsilon; }
+
+private:
+    static constexpr uint32_t emptySlot = UINT32_MAX;
+
+    struct Slot
+    {
+        uint32_t hash;
+        uint32_t index;
+    };
+
+    // grid cell of a position, 64 bits so large coordinates or tiny epsilons do not overflow
+    struct Cell
+    {
+        int64_t x;
+        int64_t y;
+        int64_t z;
+    };
+
+    Cell cellOf(const glm::vec3 &pos) const;
+    // the cell is only hashed with a positive epsilon, the exact position otherwise
+    uint32_t hashVertex(const Vertex &vertex, const Cell &cell) const;
+    bool equalAttributes(const Vertex &a, const Vertex &b) const;
+    uint32_t findWithin(const Vertex &vertex, const Cell &cell) const;
+    void rehash(size_t slotCount);
+
+    std::vector<Vertex> &output;
+    std::vector<Slot> slots;
+    size_t mask = 0;
+    float epsilon;
+    float inverseEpsilon;
+};
+
+#endif  // VERTEX_WELDER_H
@@ -0,0 +1,148 @@
+#ifndef VIRTUAL_TEXTURE_H
+#define VIRTUAL_TEXTURE_H
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "texture_cache.h"
+
+// A tile holds VIRTUAL_TILE_TEXELS texels of a level along each axis and a border of
+// VIRTUAL_TILE_BORDER texels on every side, so bilinear filtering never reads a neighbouring tile
+// of the physical cache. The border is a whole 4x4 block so block compressed tiles are copied as
+// they are.
+constexpr uint32_t VIRTUAL_TILE_TEXELS = 120;
+constexpr uint32_t VIRTUAL_TILE_BORDER = 4;
+constexpr uint32_t VIRTUAL_TILE_SIZE = VIRTUAL_TILE_TEXELS + 2 * VIRTUAL_TILE_BORDER;
+
+// levels of a chain larger than one tile along either axis, they are streamed as tiles and the
+// levels below them, the mip tail, stay resident as an ordinary texture
+uint32_t tiledLevelCount(const std::vector<TextureLevel> &levels);
+
+// bytes of one tile in the format
+uint64_t virtualTileSize(TextureFormat format);
+
+// Copies tile (tileX, tileY) of a level of the chain with its border to out, which holds
+// virtualTileSize bytes. Texels past the edges wrap around like the repeat sampler, block formats
+// wrap by whole blocks, which is off by the padding of the last block for sizes that are not a
+// multiple of 4.
+void gatherTile(const uint8_t *pixels, TextureFormat format, const TextureLevel &level, uint32_t tileX,
+                uint32_t tileY, uint8_t *out);
+
+// a tile to read from the chain of its texture and upload to the physical cache of its format
+struct TileLoad
+{
+    // page table entry of the tile
+    uint32_t entry;
+    TextureFormat format;
+    // tile of the physical cache, x is physical % cacheTiles and y physical / cacheTiles
+    uint32_t physical;
+    std::shared_ptr<const uint8_t> pixels;
+    TextureLevel level;
+    uint32_t tileX;
+    uint32_t tileY;
+};
+
+// Page table, residency and replacement of the virtual textures. The table the shader reads, see
+// shaders/virtual_texture.h, is one array of uints:
+//   4 per texture slot  first page table entry of level 0, width | height << 16 of level 0,
+//                       tiled levels | format << 8 (0 tiled levels for ordinary textures), 0
+//   then one per tile   0 while the tile is not resident, else its physical tile + 1
+// The tiles of a level follow each other row by row and the levels of a texture follow each
+// other. Only the thread that renders uses the table.
+class VirtualTextureTable
+{
+public:
+    // cacheTiles x cacheTiles tiles per physical cache, room for pageCapacity tiles of all
+    // textures
+    VirtualTextureTable(uint32_t slotCount, uint32_t cacheTiles, uint32_t pageCapacity);
+
+    // Registers the tiled levels of the texture in slot, levels is the whole chain and pixels
+    // keeps it alive for the tile loads. Returns false when the page table is full, the texture
+    // then only shows its mip tail.
+    bool add(uint32_t slot, TextureFormat format, std::shared_ptr<const uint8_t> pixels,
+             const std::vector<TextureLevel> &levels, uint32_t tiledLevels);
+
+    // page table entries the shader asked for in the last frame, entries out of range are skipped
+    void request(const uint32_t *entries, size_t count);
+
+    // Up to budget requested tiles that are not resident, coarser levels first so something close
+    // shows up soon, each with the physical tile it is loaded into. The physical tiles of tiles
+    // that were not requested for the longest time are evicted when a cache is full, but only
+    // once no frame can read their old page table entries any more: safeVersion is the oldest
+    // version() any frame in flight was recorded with. Advances the frame.
+    std::vector<TileLoad> schedule(uint32_t budget, uint64_t safeVersion);
+
+    // the load finished, its page table entry points at the physical tile from now on
+    void makeResident(const TileLoad &load);
+
+    const std::vector<uint32_t> &data() const { return table; }
+    // words of data() in use, the page table only grows
+    size_t usedWords() const { return firstPageWord + pageCount; }
+    // changes with every change of data()
+    uint64_t version() const { return tableVersion; }
+
+    uint32_t residentTiles() const { return resident; }
+
+private:
+    enum class TileState : uint8_t
+    {
+        Absent,
+        Requested,
+        Loading,
+        Resident,
+    };
+
+    struct Tile
+    {
+        uint32_t texture;
+        uint8_t level;
+        TileState state = TileState::Absent;
+        uint16_t tileX;
+        uint16_t tileY;
+        uint32_t physical = 0;
+        uint64_t lastRequested = 0;
+    };
+
+    struct Source
+    {
+        TextureFormat format;
+        std::shared_ptr<const uint8_t> pixels;
+        std::vector<TextureLevel> levels;
+    };
+
+    // physical tile freed by an eviction, reusable once every frame in flight has the version
+    // without the evicted entry
+    struct FreedTile
+    {
+        uint32_t physical;
+        uint64_t version;
+    };
+
+    struct PhysicalCache
+    {
+        // tiles never used so far
+        uint32_t unused = 0;
+        std::vector<FreedTile> freed;
+        // page table entry of every physical tile in use
+        std::vector<uint32_t> entries;
+    };
+
+    bool allocatePhysical(TextureFormat format, uint64_t safeVersion, uint32_t &physical);
+
+    uint32_t cacheTiles;
+    uint32_t pageCapacity;
+    uint32_t firstPageWord;
+    uint32_t pageCount = 0;
+    std::vector<uint32_t> table;
+    uint64_t tableVersion = 1;
+    uint64_t frame = 1;
+    uint32_t resident = 0;
+
+    std::vector<Source> sources;
+    std::vector<Tile> tiles;
+    std::vector<uint32_t> requested;
+    PhysicalCache caches[5];
+};
+
+#endif  // VIRTUAL_TEXTURE_H
@@ -0,0 +1,49 @@
+#ifndef MATERIAL_PACKING_H
+#define MATERIAL_PACKING_H
+
+//-----------------------------------------------------------------------------
+// Decoding of the PackedMaterial written by sources/material_table.cpp, one
+// uvec4 per material:
+//   x y z  diffuse, specular and emission as RGB9E5
+//   w      roughness and metalness as unorm8, the diffuse texture in bits
+//          16-27 (0xfff for none) and the flags in bits 28-31
+// Texture t of a material is slot t + 1 of the bindless texture array, slot 0
+// holds the scene texture.
+
+const uint MATERIAL_MIRROR = 1u;
+const uint MATERIAL_TRANSPARENT = 2u;
+const uint MATERIAL_EMISSIVE = 4u;
+const uint NO_MATERIAL_TEXTURE = 0xfffu;
+
+struct Material
+{
+  vec3 diffuse;
+  vec3 specular;
+  vec3 emission;
+  float roughness;
+  float metalness;
+  uint texture;
+  uint flags;
+};
+
+vec3 DecodeRGB9E5(uint packed)
+{
+  float scale = exp2(float(int(packed >> 27) - 15 - 9));
+  return vec3(packed & 0x1ffu, (packed >> 9) & 0x1ffu, (packed >> 18) & 0x1ffu) * scale;
+}
+
+Material DecodeMaterial(uint material)
+{
+  uvec4 packed = materialBuffer.data[material];
+  Material m;
+  m.diffuse = DecodeRGB9E5(packed.x);
+  m.specular = DecodeRGB9E5(packed.y);
+  m.emission = DecodeRGB9E5(packed.z);
+  m.roughness = float(packed.w & 0xffu) / 255.0;
+  m.metalness = float((packed.w >> 8) & 0xffu) / 255.0;
+  m.texture = (packed.w >> 16) & 0xfffu;
+  m.flags = packed.w >> 28;
+  return m;
+}
+
+#endif  // MATERIAL_PACKING_H
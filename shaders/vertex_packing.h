@@ -0,0 +1,129 @@
+#ifndef VERTEX_PACKING_H
+#define VERTEX_PACKING_H
+
+//-----------------------------------------------------------------------------
+// Decoding of the vertex formats written by sources/vertex_packing.cpp.
+// The vertex buffer is read as plain uints so that one declaration serves
+// all formats, RT_VERTEX_FORMAT is set when the pipeline is created:
+//   0 Full      12 uints, the C++ Vertex struct (std430 with vec3 padding),
+//               the last one is the packed tangent
+//   1 Packed     6 uints, float xyz, octahedral normal, half uv, material
+//   2 Quantized  4 uints, unorm16 xyz inside the model bounds with the
+//                material in the upper half of z, octahedral normal, half uv
+// The index buffer holds two 16 bit indices per uint when RT_SHORT_INDICES
+// is set. With RT_TRIANGLE_RECORDS the closest hit shader reads the
+// TriangleRecord of the hit instead, two uvec4 per triangle:
+//   x y z  octahedral normals of the corners, w material, -1 for none
+//   x y z  half uv of the corners, w float ray cone LOD constant
+
+layout(constant_id = 0) const uint RT_VERTEX_FORMAT = 0;
+layout(constant_id = 1) const uint RT_SHORT_INDICES = 0;
+layout(constant_id = 2) const uint RT_TRIANGLE_RECORDS = 0;
+
+struct Vertex
+{
+    vec3 pos;
+    vec3 normal;
+    vec2 texCoord;
+    int materialId;
+};
+
+uint FetchIndex(uint i)
+{
+  if (RT_SHORT_INDICES == 1) {
+    uint word = indexBuffer.data[i >> 1];
+    return (i & 1) == 0 ? word & 0xffffu : word >> 16;
+  }
+  return indexBuffer.data[i];
+}
+
+uvec3 FetchTriangle(uint primitive)
+{
+  return uvec3(FetchIndex(3 * primitive + 0), FetchIndex(3 * primitive + 1), FetchIndex(3 * primitive + 2));
+}
+
+vec3 OctahedralDecode(uint packed)
+{
+  vec2 e = unpackSnorm2x16(packed);
+  vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+  // unfold the lower hemisphere
+  float t = max(-n.z, 0.0);
+  n.x += n.x >= 0.0 ? -t : t;
+  n.y += n.y >= 0.0 ? -t : t;
+  return normalize(n);
+}
+
+// positionOffset and positionScale are only used by the Quantized format
+Vertex DecodeVertex(uint index, vec3 positionOffset, vec3 positionScale)
+{
+  Vertex v;
+  if (RT_VERTEX_FORMAT == 1) {
+    uint base = 6 * index;
+    v.pos = uintBitsToFloat(uvec3(vertexBuffer.data[base + 0], vertexBuffer.data[base + 1], vertexBuffer.data[base + 2]));
+    v.normal = OctahedralDecode(vertexBuffer.data[base + 3]);
+    v.texCoord = unpackHalf2x16(vertexBuffer.data[base + 4]);
+    v.materialId = int(vertexBuffer.data[base + 5]);
+  } else if (RT_VERTEX_FORMAT == 2) {
+    uint base = 4 * index;
+    uint xy = vertexBuffer.data[base + 0];
+    uint zm = vertexBuffer.data[base + 1];
+    vec3 q = vec3(xy & 0xffffu, xy >> 16, zm & 0xffffu);
+    v.pos = positionOffset + positionScale * q;
+    v.materialId = int(zm >> 16);
+    v.normal = OctahedralDecode(vertexBuffer.data[base + 2]);
+    v.texCoord = unpackHalf2x16(vertexBuffer.data[base + 3]);
+  } else {
+    uint base = 12 * index;
+    v.pos = uintBitsToFloat(uvec3(vertexBuffer.data[base + 0], vertexBuffer.data[base + 1], vertexBuffer.data[base + 2]));
+    v.normal = uintBitsToFloat(uvec3(vertexBuffer.data[base + 4], vertexBuffer.data[base + 5], vertexBuffer.data[base + 6]));
+    v.texCoord = uintBitsToFloat(uvec2(vertexBuffer.data[base + 8], vertexBuffer.data[base + 9]));
+    v.materialId = int(vertexBuffer.data[base + 10]);
+  }
+  return v;
+}
+
+struct TriangleRecord
+{
+  vec3 normals[3];
+  vec2 texCoords[3];
+  uint material;
+  float lodConstant;
+};
+
+TriangleRecord DecodeTriangle(uint triangle)
+{
+  uvec4 normals = triangleBuffer.data[2 * triangle + 0];
+  uvec4 texCoords = triangleBuffer.data[2 * triangle + 1];
+  TriangleRecord t;
+  t.normals[0] = OctahedralDecode(normals.x);
+  t.normals[1] = OctahedralDecode(normals.y);
+  t.normals[2] = OctahedralDecode(normals.z);
+  t.material = normals.w;
+  t.texCoords[0] = unpackHalf2x16(texCoords.x);
+  t.texCoords[1] = unpackHalf2x16(texCoords.y);
+  t.texCoords[2] = unpackHalf2x16(texCoords.z);
+  t.lodConstant = uintBitsToFloat(texCoords.w);
+  return t;
+}
+
+// material of a triangle without decoding the rest of its record, the records are written for
+// the vertex formats too
+uint TriangleMaterial(uint triangle)
+{
+  return triangleBuffer.data[2 * triangle + 0].w;
+}
+
+// triangleLodConstant of sources/vertex_packing.cpp for the vertex formats
+float TriangleLodConstant(Vertex v0, Vertex v1, Vertex v2)
+{
+  vec2 uv1 = v1.texCoord - v0.texCoord;
+  vec2 uv2 = v2.texCoord - v0.texCoord;
+  float texCoordArea = abs(uv1.x * uv2.y - uv1.y * uv2.x);
+  float area = length(cross(v1.pos - v0.pos, v2.pos - v0.pos));
+  if (!(texCoordArea > 0.0) || !(area > 0.0)) {
+    return -64.0;
+  }
+  return 0.5 * log2(texCoordArea / area);
+}
+
+#endif  // VERTEX_PACKING_H
@@ -0,0 +1,86 @@
+#ifndef VIRTUAL_TEXTURE_H
+#define VIRTUAL_TEXTURE_H
+
+//-----------------------------------------------------------------------------
+// Sampling of the bindless textures through the page table written by
+// sources/virtual_texture.cpp, the words of the table are:
+//   4 per texture slot  first page table entry of level 0, width | height
+//                       << 16 of level 0, tiled levels | format << 8, 0
+//   then one per tile   0 while the tile is not resident, else its physical
+//                       tile + 1
+// The tiled levels of a virtual texture are read from the tile cache of its
+// format, the slot of the texture array only holds the mip tail below them.
+// Textures without tiled levels are sampled as they are. The requested tiles
+// are written to the feedback buffer for every 4x4th pixel, the renderer
+// streams them in before the next frame of the same swapchain image. The
+// constants repeat MAX_SCENE_TEXTURES and the VIRTUAL_ ones of
+// headers/constants.h and headers/virtual_texture.h.
+
+const uint VIRTUAL_SLOT_WORDS = 4u * 4096u;
+const uint VIRTUAL_TILE_TEXELS = 120u;
+const uint VIRTUAL_TILE_BORDER = 4u;
+const uint VIRTUAL_TILE_SIZE = 128u;
+const uint VIRTUAL_CACHE_TILES = 32u;
+const uint VIRTUAL_FEEDBACK_CAPACITY = 65536u;
+
+uint TilesAlong(uint texels)
+{
+  return (texels + VIRTUAL_TILE_TEXELS - 1u) / VIRTUAL_TILE_TEXELS;
+}
+
+void RequestTile(uint entry)
+{
+  if ((gl_LaunchIDEXT.x & 3u) != 0u || (gl_LaunchIDEXT.y & 3u) != 0u)
+    return;
+  uint i = atomicAdd(feedback.count, 1u);
+  if (i < VIRTUAL_FEEDBACK_CAPACITY)
+    feedback.entries[i] = entry;
+}
+
+// lod is the ray cone LOD without the texture size, log2 of texels per unit uv
+// squared is added here
+vec4 SampleTexture(uint slot, vec2 uv, float lod)
+{
+  uvec4 header = uvec4(pageTable.data[4u * slot], pageTable.data[4u * slot + 1u],
+                       pageTable.data[4u * slot + 2u], 0u);
+  uint tiledLevels = header.z & 0xffu;
+  if (tiledLevels == 0u) {
+    vec2 size = vec2(textureSize(textures[nonuniformEXT(slot)], 0));
+    return textureLod(textures[nonuniformEXT(slot)], uv, lod + 0.5 * log2(size.x * size.y));
+  }
+
+  uvec2 size0 = uvec2(header.y & 0xffffu, header.y >> 16);
+  float level = max(lod + 0.5 * log2(float(size0.x) * float(size0.y)), 0.0);
+  uint wanted = uint(level);
+  if (wanted >= tiledLevels)
+    return textureLod(textures[nonuniformEXT(slot)], uv, level - float(tiledLevels));
+
+  // the wanted level is requested, until it is resident the closest coarser
+  // resident tile is sampled
+  uint format = header.z >> 8;
+  uint entry = header.x;
+  vec2 wrapped = fract(uv);
+  for (uint l = 0u; l < tiledLevels; ++l) {
+    uvec2 size = max(size0 >> l, uvec2(1u));
+    uvec2 tiles = uvec2(TilesAlong(size.x), TilesAlong(size.y));
+    if (l >= wanted) {
+      vec2 texel = wrapped * vec2(size);
+      uvec2 tile = min(uvec2(texel) / VIRTUAL_TILE_TEXELS, tiles - 1u);
+      uint tileEntry = entry + tile.y * tiles.x + tile.x;
+      if (l == wanted)
+        RequestTile(tileEntry);
+      uint physical = pageTable.data[VIRTUAL_SLOT_WORDS + tileEntry];
+      if (physical != 0u) {
+        physical -= 1u;
+        vec2 origin = vec2(physical % VIRTUAL_CACHE_TILES, physical / VIRTUAL_CACHE_TILES) * float(VIRTUAL_TILE_SIZE);
+        vec2 inTile = texel - vec2(tile * VIRTUAL_TILE_TEXELS) + float(VIRTUAL_TILE_BORDER);
+        return textureLod(tileCaches[nonuniformEXT(format)],
+                          (origin + inTile) / float(VIRTUAL_CACHE_TILES * VIRTUAL_TILE_SIZE), 0.0);
+      }
+    }
+    entry += tiles.x * tiles.y;
+  }
+  return textureLod(textures[nonuniformEXT(slot)], uv, 0.0);
+}
+
+#endif  // VIRTUAL_TEXTURE_H
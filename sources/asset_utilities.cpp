@@ -1,233 +1,779 @@
 #include "ray_tracer.h"
 
-void RayTracerApp::loadIndex(uint32_t index, std::vector<Vertex> &vertices, Model &m, Rt_model &rt_m, std::map<Vertex, uint32_t> &uniqueVertices) {
+namespace
+{
+// materialId is the material of the face the corner belongs to, so corners of faces with different
+// materials are never welded into one vertex
+Vertex getObjVertex(const tinyobj::attrib_t &attrib, const tinyobj::index_t &index, const glm::vec3 &generatedNormal,
+                    int materialId)
+{
+    Vertex vertex{};
+    vertex.materialId = static_cast<uint32_t>(materialId);
 
-    m.indices.push_back(uniqueVertices[vertices[index]]);
-    rt_m.indices.push_back(uniqueVertices[vertices[index]]);
-}
+    vertex.pos = {attrib.vertices[3 * index.vertex_index + 0], attrib.vertices[3 * index.vertex_index + 1],
+                  attrib.vertices[3 * index.vertex_index + 2]};
 
-void RayTracerApp::loadIndices(std::vector<uint32_t> &indices, std::vector<Vertex> &vertices, Model &m, Rt_model &rt_m, std::map<Vertex, uint32_t> &uniqueVertices) {
+    // corners without texture coordinates get 0, without a normal the generated one
+    if (index.texcoord_index >= 0)
+    {
+        vertex.texCoord = {attrib.texcoords[2 * index.texcoord_index + 0],
+                           // we have 0 at the top while obj 0 at
+                           // the bottom
+                           1.0f - attrib.texcoords[2 * index.texcoord_index + 1]};
+    }
+    else
+    {
+        vertex.texCoord = {0.0f, 0.0f};
+    }
 
-    for (uint32_t index : indices) {
-        loadIndex(index, vertices, m, rt_m, uniqueVertices);
+    if (index.normal_index >= 0)
+    {
+        vertex.normal = {attrib.normals[3 * index.normal_index], attrib.normals[3 * index.normal_index + 1],
+                         attrib.normals[3 * index.normal_index + 2]};
+    }
+    else
+    {
+        vertex.normal = generatedNormal;
     }
+
+    return vertex;
 }
 
-void RayTracerApp::loadVertex(Vertex &vertex, Model &m, Rt_model &rt_m, std::map<Vertex, uint32_t> &uniqueVertices) {
+// center of the bounding box and the largest distance of a vertex from it
+glm::vec4 boundingSphere(const std::vector<Vertex> &vertices)
+{
+    if (vertices.empty())
+        return glm::vec4(0.0f);
 
-    if (uniqueVertices.count(vertex) == 0)
+    glm::vec3 minimum = vertices[0].pos;
+    glm::vec3 maximum = vertices[0].pos;
+    for (const Vertex &vertex : vertices)
     {
-        uniqueVertices[vertex] = static_cast<uint32_t>(m.vertices.size());
-        m.vertices.push_back(vertex);
-        rt_m.vertices.push_back(vertex.pos.x);
-        rt_m.vertices.push_back(vertex.pos.y);
-        rt_m.vertices.push_back(vertex.pos.z);
+        minimum = glm::min(minimum, vertex.pos);
+        maximum = glm::max(maximum, vertex.pos);
     }
+    const glm::vec3 center = 0.5f * (minimum + maximum);
+    float radius = 0.0f;
+    for (const Vertex &vertex : vertices)
+        radius = std::max(radius, glm::length(vertex.pos - center));
+    return glm::vec4(center, radius);
 }
+}  // namespace
 
-void RayTracerApp::loadVertices(std::vector<Vertex> &vertices, Model &m, Rt_model &rt_m, std::map<Vertex, uint32_t> &uniqueVertices) {
+std::vector<uint32_t> RayTracerApp::loadVertices(const std::vector<Vertex> &vertices, VertexWelder &welder) {
 
-    for (Vertex &vertex : vertices) {
-        loadVertex(vertex, m, rt_m, uniqueVertices);
+    // maps indices into vertices to indices into the welded model
+    std::vector<uint32_t> remap;
+    remap.reserve(vertices.size());
+    for (const Vertex &vertex : vertices) {
+        remap.push_back(welder.weld(vertex));
     }
+    return remap;
 }
 
-void RayTracerApp::loadPlane(glm::vec3 center, glm::vec3 rotation, float height, float width, Model &m, Rt_model &rt_m, std::map<Vertex, uint32_t> &uniqueVertices, uint32_t materialId) {
+void RayTracerApp::loadUnitPlane(Model &m)
+{
+    const glm::vec3 up = {0.0f, 1.0f, 0.0f};
+    m.vertices = {
+        {{+0.5f, 0.0f, +0.5f}, up, {0.0f, 0.0f}, 0},
+        {{+0.5f, 0.0f, -0.5f}, up, {0.0f, 0.0f}, 0},
+        {{-0.5f, 0.0f, -0.5f}, up, {0.0f, 0.0f}, 0},
+        {{-0.5f, 0.0f, +0.5f}, up, {0.0f, 0.0f}, 0},
+    };
+    m.indices = {0, 1, 2, 0, 2, 3};
+    m.materialIndices.assign(2, static_cast<uint32_t>(-1));
+    for (Vertex &vertex : m.vertices)
+        vertex.tangent = packTangent({1.0f, 0.0f, 0.0f}, 1.0f);
+    m.parts = {{0, 4, 0, 6, {glm::mat4(1.0f)}}};
+}
 
-    auto mtx = glm::mat4(1);
-    mtx = glm::translate(mtx, center);
-    mtx = glm::rotate(mtx, rotation.x, {1, 0, 0});
-    mtx = glm::rotate(mtx, rotation.y, {0, 1, 0});
-    mtx = glm::rotate(mtx, rotation.z, {0, 0, 1});
+uint64_t RayTracerApp::loaderOptionsHash()
+{
+    // everything that changes the loader output has to be part of the mesh cache key
+    struct LoaderOptions
+    {
+        float weldPositionEpsilon;
+        float splitTriangleFactor;
+        float normalCreaseAngle;
+        uint32_t optimizeMesh;
+        uint32_t sortTrianglesByMaterial;
+        uint32_t instanceDuplicateShapes;
+        uint32_t maxShapePrototypes;
+        uint32_t lodLevels;
+        float lodReduction;
+        uint32_t lodMinTriangles;
+    } options{WELD_POSITION_EPSILON, SPLIT_TRIANGLE_FACTOR, NORMAL_CREASE_ANGLE, OPTIMIZE_MESH,
+              SORT_TRIANGLES_BY_MATERIAL, INSTANCE_DUPLICATE_SHAPES, MAX_SHAPE_PROTOTYPES, LOD_LEVELS,
+              LOD_REDUCTION, LOD_MIN_TRIANGLES};
+
+    return hashBytes(&options, sizeof(options), MESH_LOADER_VERSION);
+}
 
-    glm::vec3 normal = glm::vec3(mtx * glm::vec4(0.0f, 1.0f, 0.0f, 0.0f));
+void RayTracerApp::loadSceneDescription()
+{
+    if (!scene.parseFromFile(std::string(SCENE_PATH)))
+    {
+        throw std::runtime_error("failed to load scene: " + scene.error());
+    }
+}
 
-    std::vector<Vertex> vertices = {
-        { glm::vec3(mtx * glm::vec4(+width / 2, 0.0f, +height / 2, 1.0f)), normal, { 0.0f, 0.0f }, materialId },
-        { glm::vec3(mtx * glm::vec4(+width / 2, 0.0f, -height / 2, 1.0f)), normal, { 0.0f, 0.0f }, materialId },
-        { glm::vec3(mtx * glm::vec4(-width / 2, 0.0f, -height / 2, 1.0f)), normal, { 0.0f, 0.0f }, materialId },
-        { glm::vec3(mtx * glm::vec4(-width / 2, 0.0f, +height / 2, 1.0f)), normal, { 0.0f, 0.0f }, materialId },
-    };
+SceneGeometry RayTracerApp::loadSceneMeshes()
+{
+    auto start = std::chrono::high_resolution_clock::now();
 
-    loadVertices(vertices, m, rt_m, uniqueVertices);
+    // every mesh is either a mapped cache or loaded into the heap
+    const auto &sceneMeshes = scene.meshes();
+    SceneGeometry loaded;
+    loaded.caches.resize(sceneMeshes.size());
+    loaded.models.resize(sceneMeshes.size());
+    loaded.sources.resize(sceneMeshes.size());
 
-    std::vector<uint32_t> indices = {
-        0, 1, 2,
-        0, 2, 3,
-    };
+    loadUnitPlane(loaded.models[PlaneMesh]);
+    for (uint32_t mesh = 0; mesh < BuiltinMeshCount; ++mesh)
+    {
+        const Model &model = loaded.models[mesh];
+        GeometryView &source = loaded.sources[mesh];
+        source.vertices = model.vertices.data();
+        source.vertexCount = model.vertices.size();
+        source.indices = model.indices.data();
+        source.indexCount = model.indices.size();
+        source.materialIndices = model.materialIndices.data();
+        source.materialIndexCount = model.materialIndices.size();
+        if (model.parts.empty())
+            loaded.models[mesh].parts = {{0, 0, 0, 0, {glm::mat4(1.0f)}}};
+    }
+    for (size_t mesh = BuiltinMeshCount; mesh < sceneMeshes.size(); ++mesh)
+    {
+        loaded.sources[mesh] = loadMesh(sceneMeshes[mesh].path, loaded.caches[mesh], loaded.models[mesh]);
+    }
 
-    loadIndices(indices, vertices, m, rt_m, uniqueVertices);
+    std::cout << "loaded " << sceneMeshes.size() << " meshes of " << SCENE_PATH << " in "
+              << std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count()
+              << " ms" << std::endl;
+    return loaded;
 }
 
-std::vector<Vertex> RayTracerApp::getSphereVertices(glm::vec3 center, float radius, int n, int m, uint32_t materialId) {
+void RayTracerApp::placeSceneMeshes(SceneGeometry &loaded, Model &m)
+{
+    m.vertices.clear();
+    m.indices.clear();
+    m.materialIndices.clear();
+    m.materials.clear();
 
-    std::vector<Vertex> vertices;
+    // large parts are cut into chunks of consecutive triangles with a BLAS each, which bounds the
+    // scratch memory and the length of a single build. The optimizer sorts the triangles of a part
+    // along a Morton curve, so every chunk covers a compact region and the TLAS can cull it.
+    VkPhysicalDeviceAccelerationStructurePropertiesKHR asProperties{
+        VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_ACCELERATION_STRUCTURE_PROPERTIES_KHR};
+    VkPhysicalDeviceProperties2 deviceProperties{VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2};
+    deviceProperties.pNext = &asProperties;
+    vkGetPhysicalDeviceProperties2(physicalDevice, &deviceProperties);
+    const uint64_t chunkTriangles =
+        std::max<uint64_t>(1, std::min<uint64_t>(MAX_BLAS_TRIANGLES, asProperties.maxPrimitiveCount));
+
+    // the models are placed in order, their OBJ materials are appended into one table. Every chunk
+    // of every level of a part of a model becomes a mesh, the built in meshes keep their ids.
+    const size_t modelCount = loaded.models.size();
+    loaded.ranges.assign(modelCount, {});
+    loaded.firstMaterials.assign(modelCount, 0);
+    meshes.clear();
+    meshPlacements.assign(modelCount, {});
+    size_t vertexCount = 0;
+    size_t indexCount = 0;
+    size_t chunkedParts = 0;
+    size_t levelCount = 0;
+    for (size_t mesh = 0; mesh < modelCount; ++mesh)
+    {
+        MeshRange &range = loaded.ranges[mesh];
+        range.firstVertex = static_cast<uint32_t>(vertexCount);
+        range.vertexCount = static_cast<uint32_t>(loaded.sources[mesh].vertexCount);
+        range.firstIndex = static_cast<uint32_t>(indexCount);
+        range.indexCount = static_cast<uint32_t>(loaded.sources[mesh].indexCount);
+        vertexCount += loaded.sources[mesh].vertexCount;
+        indexCount += loaded.sources[mesh].indexCount;
+
+        for (const GeometryPart &part : loaded.models[mesh].parts)
+        {
+            // every level of a part is chunked on its own, empty parts like the one of the
+            // sphere still get their mesh
+            MeshPlacement placement;
+            placement.bounds = part.bounds;
+            const auto placeLevel = [&](uint32_t levelFirstIndex, uint32_t levelIndexCount, float error) {
+                const uint32_t triangles = levelIndexCount / 3;
+                chunkedParts += triangles > chunkTriangles;
+                MeshLevel level{static_cast<uint32_t>(meshes.size()), 0, error};
+                uint32_t first = 0;
+                do
+                {
+                    const uint32_t count =
+                        static_cast<uint32_t>(std::min<uint64_t>(chunkTriangles, triangles - first));
+                    meshes.push_back({range.firstVertex + part.firstVertex, part.vertexCount,
+                                      range.firstIndex + levelFirstIndex + 3 * first, 3 * count});
+                    ++level.meshCount;
+                    first += count;
+                } while (first < triangles);
+                placement.levels.push_back(level);
+            };
+            placeLevel(part.firstIndex, part.indexCount, 0.0f);
+            for (const GeometryLevel &level : part.levels)
+                placeLevel(level.firstIndex, level.indexCount, level.error);
+            levelCount += part.levels.size();
+
+            for (const glm::mat4 &transform : part.transforms)
+            {
+                placement.transform = transform;
+                meshPlacements[mesh].push_back(placement);
+            }
+        }
 
-    vertices.push_back({ {center.x, center.y + radius, center.z }, {0.0f, 1.0f, 0.0f}, { 0.0f, 0.0f }, materialId });
+        const auto &materials = loaded.models[mesh].materials;
+        loaded.firstMaterials[mesh] = static_cast<uint32_t>(m.materials.size());
+        m.materials.insert(m.materials.end(), materials.begin(), materials.end());
+    }
 
-    float alphaDelta = M_PI / n;
-    float alpha = alphaDelta;
-    for (int i = 0; i < n - 1; i++) {
+    if (meshes.size() > MAX_SCENE_MESHES)
+    {
+        throw std::runtime_error("the scene is split into " + std::to_string(meshes.size()) + " meshes, at most " +
+                                 std::to_string(MAX_SCENE_MESHES) +
+                                 " are supported, lower MAX_SHAPE_PROTOTYPES or raise MAX_BLAS_TRIANGLES");
+    }
 
-        float betaDelta = 2.0f * M_PI / m;
-        float beta = 0.0f;
-        for (int j = 0; j < m; j++) {
+    std::cout << "placed " << modelCount << " meshes in " << meshes.size() << " parts (" << levelCount
+              << " levels of detail, " << chunkedParts << " split into chunks of at most " << chunkTriangles
+              << " triangles), " << scene.instances().size() << " instances" << std::endl;
 
-            glm::vec3 position = { radius * sinf(alpha) * cosf(beta), radius * cosf(alpha), radius * sinf(alpha) * sinf(beta) };
-            position += center;
-            glm::vec3 normal = { sinf(alpha) * cosf(beta), cosf(alpha), sinf(alpha) * sinf(beta) };
+    // texture names in MTL files are relative to the OBJ
+    std::vector<std::string> textureFolders;
+    textureFolders.reserve(m.materials.size());
+    for (size_t mesh = 0; mesh < modelCount; ++mesh)
+    {
+        const std::string &path = scene.meshes()[mesh].path;
+        textureFolders.resize(textureFolders.size() + loaded.models[mesh].materials.size(),
+                              path.substr(0, path.find_last_of('/') + 1));
+    }
+    materialTable = buildMaterialTable(m.materials, textureFolders);
+    std::cout << "packed " << m.materials.size() << " materials into " << materialTable.materials.size()
+              << " unique ones of " << sizeof(PackedMaterial) << " bytes with " << materialTable.textures.size()
+              << " textures in " << materialTable.milliseconds << " ms" << std::endl;
+    if (materialTable.droppedTextures > 0)
+    {
+        std::cerr << materialTable.droppedTextures << " materials lost their texture, only "
+                  << NO_MATERIAL_TEXTURE << " textures can be indexed" << std::endl;
+    }
 
-            vertices.push_back({ position, normal, { 0.0f, 0.0f }, materialId });
+    createGeometryBuffer(vertexCount, indexCount);
+}
 
-            beta += betaDelta;
+// Streams the placed meshes into the geometry buffer one model after the other. Every model is
+// released right after it is written, a mapped cache is unmapped, so the pages of a model are
+// touched once and the host memory of the upload is bounded by the staging buffer.
+void RayTracerApp::uploadSceneGeometry(SceneGeometry &loaded)
+{
+    auto start = std::chrono::high_resolution_clock::now();
+
+    // the quantization has to cover all meshes before the first vertex is packed
+    vertexQuantization = {};
+    if (!RT_TRIANGLE_RECORDS && RT_VERTEX_FORMAT == RTVertexFormat::Quantized)
+        vertexQuantization = sceneQuantization(loaded.sources);
+
+    std::vector<uint32_t> firstTriangles(meshes.size());
+    for (size_t mesh = 0; mesh < meshes.size(); ++mesh)
+        firstTriangles[mesh] = meshes[mesh].firstIndex / 3;
+    writeGeometry(MeshesSection, 0, firstTriangles.size(), sizeof(uint32_t),
+                  [&](size_t first, size_t last, uint8_t *out) {
+                      memcpy(out, firstTriangles.data() + first, (last - first) * sizeof(uint32_t));
+                  });
+    const VkAabbPositionsKHR sphereBounds = {-1.0f, -1.0f, -1.0f, 1.0f, 1.0f, 1.0f};
+    writeGeometry(SphereBoundsSection, 0, 1, sizeof(sphereBounds),
+                  [&](size_t, size_t, uint8_t *out) { memcpy(out, &sphereBounds, sizeof(sphereBounds)); });
+
+    // the output is usually write combined memory, every byte is written exactly once and in
+    // order. The source pages of a mapped mesh cache are faulted in by several threads at once.
+    constexpr size_t grainVertices = 1 << 16;
+    constexpr size_t grainIndices = 1 << 18;
+    constexpr size_t grainTriangles = 1 << 16;
+    const bool shortIndices = geometryIndexType == VK_INDEX_TYPE_UINT16;
+    const size_t stride = rtVertexStride(RT_VERTEX_FORMAT);
+
+    for (size_t mesh = 0; mesh < loaded.models.size(); ++mesh)
+    {
+        const GeometryView &source = loaded.sources[mesh];
+        const MeshRange &range = loaded.ranges[mesh];
+
+        writeGeometry(VerticesSection, range.firstVertex, source.vertexCount, sizeof(Vertex),
+                      [&](size_t first, size_t last, uint8_t *out) {
+                          threadPool.parallelFor(first, last, grainVertices, [&](size_t begin, size_t end) {
+                              memcpy(out + (begin - first) * sizeof(Vertex), source.vertices + begin,
+                                     (end - begin) * sizeof(Vertex));
+                          });
+                      });
+
+        // the indices of every mesh start at 0 and are moved behind the vertices of the meshes before it
+        writeGeometry(IndicesSection, range.firstIndex, source.indexCount,
+                      shortIndices ? sizeof(uint16_t) : sizeof(uint32_t), [&](size_t first, size_t last, uint8_t *out) {
+                          threadPool.parallelFor(first, last, grainIndices, [&](size_t begin, size_t end) {
+                              if (shortIndices)
+                              {
+                                  uint16_t *indices = reinterpret_cast<uint16_t *>(out) - first;
+                                  for (size_t i = begin; i < end; ++i)
+                                      indices[i] = static_cast<uint16_t>(source.indices[i] + range.firstVertex);
+                              }
+                              else
+                              {
+                                  uint32_t *indices = reinterpret_cast<uint32_t *>(out) - first;
+                                  for (size_t i = begin; i < end; ++i)
+                                      indices[i] = source.indices[i] + range.firstVertex;
+                              }
+                          });
+                      });
+
+        // the records hold the materials, they are written for the vertex path too
+        const uint32_t *materialRemap = materialTable.remap.data() + loaded.firstMaterials[mesh];
+        writeGeometry(TrianglesSection, range.firstIndex / 3, source.indexCount / 3, sizeof(TriangleRecord),
+                      [&](size_t first, size_t last, uint8_t *out) {
+                          threadPool.parallelFor(first, last, grainTriangles, [&](size_t begin, size_t end) {
+                              packTriangles(source.vertices, source.indices + 3 * begin,
+                                            source.materialIndices + begin, materialRemap, end - begin,
+                                            reinterpret_cast<TriangleRecord *>(out) + (begin - first));
+                          });
+                      });
+
+        if (!RT_TRIANGLE_RECORDS && RT_VERTEX_FORMAT != RTVertexFormat::Full)
+        {
+            writeGeometry(ShadingVerticesSection, range.firstVertex, source.vertexCount, stride,
+                          [&](size_t first, size_t last, uint8_t *out) {
+                              threadPool.parallelFor(first, last, grainVertices, [&](size_t begin, size_t end) {
+                                  packVertices(RT_VERTEX_FORMAT, vertexQuantization, source.vertices + begin,
+                                               end - begin, out + (begin - first) * stride);
+                              });
+                          });
         }
-        alpha += alphaDelta;
-    }
 
-    vertices.push_back({ {center.x, center.y - radius, center.z }, {0.0f, -1.0f, 0.0f}, { 0.0f, 0.0f }, materialId });
+        loaded.caches[mesh].close();
+        loaded.models[mesh] = {};
+        loaded.sources[mesh] = {};
+    }
 
-    return vertices;
+    const auto &upload = geometryUpload;
+    std::cout << (upload.inPlace ? "wrote " : "streamed ") << upload.streamedBytes / (1024.0 * 1024.0)
+              << " MB of geometry ";
+    if (upload.inPlace)
+        std::cout << "in place";
+    else
+        std::cout << "through a " << 2 * upload.halfSize / (1024.0 * 1024.0) << " MB staging buffer";
+    std::cout << " in "
+              << std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count()
+              << " ms" << std::endl;
 }
 
-std::vector<uint32_t> RayTracerApp::getSphereIndices(int n, int m, std::vector<Vertex> &vertices, std::map<Vertex, uint32_t> &uniqueVertices) {
-
-    int verticesCount = (n - 1) * m + 2;
+GeometryView RayTracerApp::loadMesh(const std::string &path, MeshCache &cache, Model &loaded)
+{
+    auto start = std::chrono::high_resolution_clock::now();
 
-    std::vector<uint32_t> indices;
-    int i, j;
+    const std::string cachePath = path + std::string(MESH_CACHE_EXTENSION);
+    const uint64_t optionsHash = loaderOptionsHash();
 
-    for (j = 0; j < m - 1; j++) {
-        indices.push_back(0);
-        indices.push_back(j + 2);
-        indices.push_back(j + 1);
+    if (cache.open(cachePath, optionsHash))
+    {
+        // warm start, the mapped file is streamed straight into the geometry buffer
+        loaded.materials = cache.materials();
+        loaded.parts = cache.parts();
+        std::cout << "opened " << cachePath << " in "
+                  << std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count()
+                  << " ms" << std::endl;
+        return cache.view();
     }
-    indices.push_back(0);
-    indices.push_back(1);
-    indices.push_back(m);
 
-    for (i = 0; i < n - 2; i++) {
-        for (j = 0; j < m - 1; j++) {
-            indices.push_back(i * m + j + 1);
-            indices.push_back(i * m + j + 2);
-            indices.push_back((i + 1) * m + j + 2);
-            indices.push_back(i * m + j + 1);
-            indices.push_back((i + 1) * m + j + 2);
-            indices.push_back((i + 1) * m + j + 1);
+    // material libraries are looked up next to the OBJ
+    const std::string folder = path.substr(0, path.find_last_of('/') + 1);
+
+    ObjParser parser(threadPool);
+    if (!parser.parseFromFile(path, folder))
+    {
+        if (!parser.error().empty())
+        {
+            std::cerr << "OBJ READER: " << parser.error();
         }
-        indices.push_back(i * m + j + 1);
-        indices.push_back(i * m + 1);
-        indices.push_back((i + 1) * m + 1);
-        indices.push_back(i * m + j + 1);
-        indices.push_back((i + 1) * m + 1);
-        indices.push_back((i + 1) * m + j + 1);
+        exit(1);
     }
+    if (!parser.warning().empty())
+    {
+        std::cerr << "OBJ READER: " << parser.warning();
+    }
+
+    const ObjParseStats &parseStats = parser.stats();
+    std::cout << "parsed " << path << " (" << parseStats.bytes / (1024.0 * 1024.0) << " MB) in "
+              << parseStats.milliseconds << " ms, " << parseStats.megabytesPerSecond() << " MB/s using "
+              << parseStats.chunks << " chunks" << std::endl;
+
+    loaded.materials = parser.materials();
 
-    for (j = 0; j < m - 1; j++) {
-        indices.push_back(i * m + j + 1);
-        indices.push_back(i * m + j + 2);
-        indices.push_back(verticesCount - 1);
+    const auto &attrib = parser.attrib();
+    const auto &shapes = parser.shapes();
+
+    // raw scans often come without normals, the missing ones are generated before welding so
+    // vertices split at creases like authored ones
+    const GeneratedNormals normals = generateObjNormals(attrib, shapes, NORMAL_CREASE_ANGLE, threadPool);
+    if (!normals.empty())
+    {
+        std::cout << "generated normals for " << normals.generatedCorners << " of " << normals.normals.size()
+                  << " corners in " << normals.milliseconds << " ms" << std::endl;
     }
-    indices.push_back((i + 1) * m);
-    indices.push_back(i * m + 1);
-    indices.push_back(verticesCount - 1);
 
-    return indices;
-}
+    // shapes that are copies of each other are split off into parts of their own, every part is
+    // welded and optimized separately so its vertices and triangles stay contiguous
+    ShapeInstancing instancing;
+    if (INSTANCE_DUPLICATE_SHAPES)
+    {
+        instancing = findDuplicateShapes(attrib, shapes, MAX_SHAPE_PROTOTYPES, threadPool);
+    }
+    else
+    {
+        for (size_t s = 0; s < shapes.size(); ++s)
+            instancing.uniqueShapes.push_back(s);
+    }
 
-void RayTracerApp::loadSphere(glm::vec3 center, float radius, Model &m, Rt_model &rt_m, std::map<Vertex, uint32_t> &uniqueVertices, uint32_t materialId) {
+    std::vector<std::vector<size_t>> partShapes;
+    std::vector<std::vector<glm::mat4>> partTransforms;
+    if (!instancing.uniqueShapes.empty())
+    {
+        partShapes.push_back(instancing.uniqueShapes);
+        partTransforms.push_back({glm::mat4(1.0f)});
+    }
+    for (const auto &prototype : instancing.prototypes)
+    {
+        partShapes.push_back({prototype.shape});
+        partTransforms.push_back(prototype.transforms);
+    }
+
+    WeldStats weldStats;
+    MeshOptimizeStats optimizeStats;
+    size_t optimizedTriangles = 0;
+    size_t savedBytes = 0;
+    size_t lodParts = 0;
+    size_t lodTriangles = 0;
+    double lodMilliseconds = 0.0;
+    double tangentMilliseconds = 0.0;
+    TriangleSplitStats splitStats;
+    size_t splitParts = 0;
+    double sahBefore = 0.0;
+    double sahAfter = 0.0;
+    for (size_t p = 0; p < partShapes.size(); ++p)
+    {
+        Model part;
+        VertexWelder welder(part.vertices, WELD_POSITION_EPSILON);
+        const WeldStats partWeldStats = loadObjShapes(attrib, shapes, normals, partShapes[p], part, welder);
+        weldStats.inputVertices += partWeldStats.inputVertices;
+        weldStats.uniqueVertices += partWeldStats.uniqueVertices;
+        weldStats.milliseconds += partWeldStats.milliseconds;
+
+        // triangles far larger than the typical one of the part are split before the optimizer
+        // sorts the triangles, the split is only kept when it lowers the estimated BVH cost
+        const float splitLimit =
+            SPLIT_TRIANGLE_FACTOR *
+            medianTriangleDiagonal(part.vertices.data(), part.indices.data(), part.indices.size(), 1u << 16);
+        if (SPLIT_TRIANGLE_FACTOR > 0.0f &&
+            countLargeTriangles(part.vertices.data(), part.indices.data(), part.indices.size(), splitLimit) > 0)
+        {
+            std::vector<Vertex> vertices = part.vertices;
+            std::vector<uint32_t> indices = part.indices;
+            std::vector<uint32_t> materialIndices = part.materialIndices;
+            const TriangleSplitStats partStats = splitLargeTriangles(vertices, indices, materialIndices, splitLimit);
+            const double before = estimateSahCost(part.vertices.data(), part.indices.data(), part.indices.size());
+            const double after = estimateSahCost(vertices.data(), indices.data(), indices.size());
+            splitStats.milliseconds += partStats.milliseconds;
+            if (after < before)
+            {
+                part.vertices = std::move(vertices);
+                part.indices = std::move(indices);
+                part.materialIndices = std::move(materialIndices);
+                splitStats.triangles += partStats.triangles;
+                splitStats.oversizedTriangles += partStats.oversizedTriangles;
+                splitStats.outputTriangles += partStats.outputTriangles;
+                ++splitParts;
+                sahBefore += before;
+                sahAfter += after;
+            }
+        }
 
-    int N = 20;
-    int M = 20;
+        // after splitting, which interpolates everything but the tangents
+        tangentMilliseconds += generateTangents(part.vertices, part.indices, threadPool);
 
-    std::vector<Vertex> vertices = getSphereVertices(center, radius, N, M, materialId);
-    loadVertices(vertices, m, rt_m, uniqueVertices);
+        if (OPTIMIZE_MESH)
+        {
+            const MeshOptimizeStats partStats = optimizeMesh(part.vertices, part.indices, part.materialIndices,
+                                                             rtVertexStride(RT_VERTEX_FORMAT), threadPool);
+            // the fetch statistics of all parts are averaged per triangle
+            const double triangles = static_cast<double>(part.materialIndices.size());
+            optimizeStats.before.acmr += partStats.before.acmr * triangles;
+            optimizeStats.before.linesPerTriangle += partStats.before.linesPerTriangle * triangles;
+            optimizeStats.after.acmr += partStats.after.acmr * triangles;
+            optimizeStats.after.linesPerTriangle += partStats.after.linesPerTriangle * triangles;
+            optimizeStats.removedVertices += partStats.removedVertices;
+            optimizeStats.milliseconds += partStats.milliseconds;
+            optimizedTriangles += part.materialIndices.size();
+        }
 
-    std::vector<uint32_t> indices = getSphereIndices(N, M, vertices, uniqueVertices);
-    loadIndices(indices, vertices, m, rt_m, uniqueVertices);
-}
+        if (SORT_TRIANGLES_BY_MATERIAL)
+            sortTrianglesByMaterial(part.indices, part.materialIndices);
+
+        GeometryPart range;
+        range.firstVertex = static_cast<uint32_t>(loaded.vertices.size());
+        range.vertexCount = static_cast<uint32_t>(part.vertices.size());
+        range.firstIndex = static_cast<uint32_t>(loaded.indices.size());
+        range.indexCount = static_cast<uint32_t>(part.indices.size());
+        range.transforms = partTransforms[p];
+        range.bounds = boundingSphere(part.vertices);
+
+        // the indices of every part start at 0, they are moved behind the parts before it
+        for (uint32_t index : part.indices)
+            loaded.indices.push_back(index + range.firstVertex);
+        loaded.vertices.insert(loaded.vertices.end(), part.vertices.begin(), part.vertices.end());
+        loaded.materialIndices.insert(loaded.materialIndices.end(), part.materialIndices.begin(),
+                                      part.materialIndices.end());
+
+        // every level is simplified from the one before, the errors add up. The chain ends early
+        // when seams and borders lock too much of the part to get a real reduction.
+        if (LOD_LEVELS > 1 && part.materialIndices.size() >= LOD_MIN_TRIANGLES)
+        {
+            SimplifiedMesh level;
+            const std::vector<uint32_t> *indices = &part.indices;
+            const std::vector<uint32_t> *triangleData = &part.materialIndices;
+            float error = 0.0f;
+            for (uint32_t l = 1; l < LOD_LEVELS; ++l)
+            {
+                const size_t target = static_cast<size_t>(indices->size() / 3 * LOD_REDUCTION) * 3;
+                SimplifiedMesh next = simplifyMesh(part.vertices, *indices, *triangleData, target, range.bounds.w);
+                lodMilliseconds += next.milliseconds;
+                if (next.indices.empty() || next.indices.size() > indices->size() * 3 / 4)
+                    break;
+
+                error += next.error;
+                range.levels.push_back({static_cast<uint32_t>(loaded.indices.size()),
+                                        static_cast<uint32_t>(next.indices.size()), error});
+                for (uint32_t index : next.indices)
+                    loaded.indices.push_back(index + range.firstVertex);
+                loaded.materialIndices.insert(loaded.materialIndices.end(), next.triangleData.begin(),
+                                              next.triangleData.end());
+                lodTriangles += next.triangleData.size();
+
+                level = std::move(next);
+                indices = &level.indices;
+                triangleData = &level.triangleData;
+            }
+        }
+        lodParts += !range.levels.empty();
+        loaded.parts.push_back(range);
+
+        savedBytes += (range.transforms.size() - 1) *
+                      (part.vertices.size() * sizeof(Vertex) + part.indices.size() * sizeof(uint32_t) +
+                       part.materialIndices.size() * sizeof(uint32_t));
+    }
+
+    std::cout << "welded " << weldStats.weldedVertices() << " of " << weldStats.inputVertices << " vertices ("
+              << weldStats.uniqueVertices << " unique) in " << weldStats.milliseconds << " ms using "
+              << threadPool.size() << " threads" << std::endl;
+    std::cout << "generated tangents in " << tangentMilliseconds << " ms" << std::endl;
+
+    if (OPTIMIZE_MESH && optimizedTriangles > 0)
+    {
+        const double triangles = static_cast<double>(optimizedTriangles);
+        std::cout << "optimized mesh in " << optimizeStats.milliseconds << " ms, ACMR "
+                  << optimizeStats.before.acmr / triangles << " -> " << optimizeStats.after.acmr / triangles
+                  << ", vertex fetch " << optimizeStats.before.linesPerTriangle / triangles << " -> "
+                  << optimizeStats.after.linesPerTriangle / triangles << " cache lines per triangle, "
+                  << optimizeStats.removedVertices << " unused vertices removed" << std::endl;
+    }
+
+    if (SPLIT_TRIANGLE_FACTOR > 0.0f)
+    {
+        // the SAH costs are the expected node visits and triangle tests of a ray through the part,
+        // summed over the parts that were split
+        std::cout << "split " << splitStats.oversizedTriangles << " oversized triangles of " << splitParts
+                  << " parts, " << splitStats.triangles << " -> " << splitStats.outputTriangles << " triangles in "
+                  << splitStats.milliseconds << " ms, estimated SAH cost " << sahBefore << " -> "
+                  << sahAfter << std::endl;
+    }
 
-void RayTracerApp::loadGeneratedShapes(Model &m, Rt_model &rt_m, std::map<Vertex, uint32_t> &uniqueVertices) {
+    if (INSTANCE_DUPLICATE_SHAPES)
+    {
+        // BLAS builds are linear in the triangle count, the share of dropped triangles is the
+        // share of build time saved
+        const ShapeInstancingStats &stats = instancing.stats;
+        std::cout << "instanced " << stats.duplicateShapes << " of " << stats.shapes << " shapes as copies of "
+                  << instancing.prototypes.size() << " prototypes in " << stats.milliseconds << " ms, "
+                  << stats.duplicateTriangles << " of " << stats.triangles << " triangles ("
+                  << (stats.triangles > 0 ? 100.0 * stats.duplicateTriangles / stats.triangles : 0.0)
+                  << "% of the BLAS build input) and " << savedBytes / 1024 << " KB of geometry saved" << std::endl;
+    }
 
-    //ground
-    loadPlane({0.0f, -0.2f, 0.0f}, {0.0f, 0.0f, 0.0f}, 20.0f, 20.0f, m, rt_m, uniqueVertices, 0);
+    if (LOD_LEVELS > 1)
+    {
+        std::cout << "simplified " << lodParts << " of " << partShapes.size() << " parts into up to "
+                  << LOD_LEVELS - 1 << " levels of detail with " << lodTriangles << " triangles in "
+                  << lodMilliseconds << " ms" << std::endl;
+    }
 
-    //mirrors
-    loadPlane({10.0f, 10.0f - 0.2f, 0.0f}, {0.0f, 0.0f, M_PI_2}, 20.0f, 20.0f, m, rt_m, uniqueVertices, 1);
-    loadPlane({-10.0f, 10.0f - 0.2f, 0.0f}, {0.0f, 0.0f, -M_PI_2}, 20.0f, 20.0f, m, rt_m, uniqueVertices, 1);
+    GeometryView view;
+    view.vertices = loaded.vertices.data();
+    view.vertexCount = loaded.vertices.size();
+    view.indices = loaded.indices.data();
+    view.indexCount = loaded.indices.size();
+    view.materialIndices = loaded.materialIndices.data();
+    view.materialIndexCount = loaded.materialIndices.size();
 
-    loadSphere({5.0f, 5.0f, 5.0f}, 3.0f, m, rt_m, uniqueVertices, 1);
-    loadSphere({-7.0f, 5.0f, -7.0f}, 1.5f, m, rt_m, uniqueVertices, 1);
-    loadSphere({7.0f, 1.5f, -7.0f}, 1.0f, m, rt_m, uniqueVertices, 1);
-    loadSphere({-7.0f, 3.0f, 7.0f}, 1.5f, m, rt_m, uniqueVertices, 1);
-    loadSphere({0.0f, 9.5f, 0.0f}, 1.0f, m, rt_m, uniqueVertices, 1);
+    const auto sources = MeshCache::objSources(path, folder);
+    if (!MeshCache::write(cachePath, optionsHash, sources, view, loaded.materials, loaded.parts))
+    {
+        std::cerr << "failed to write mesh cache " << cachePath << std::endl;
+    }
+    else if (cache.open(cachePath, optionsHash))
+    {
+        // the geometry is streamed from the cache like on a warm start, its pages are still in the
+        // page cache and can be evicted under pressure, the heap copy is released right away
+        std::vector<Vertex>().swap(loaded.vertices);
+        std::vector<uint32_t>().swap(loaded.indices);
+        std::vector<uint32_t>().swap(loaded.materialIndices);
+        view = cache.view();
+    }
+
+    std::cout << "loaded " << path << " in "
+              << std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count()
+              << " ms" << std::endl;
+    return view;
 }
 
-void RayTracerApp::loadModel(Model &m, Rt_model &rt_m)
+WeldStats RayTracerApp::loadObjShapes(const tinyobj::attrib_t &attrib, const std::vector<tinyobj::shape_t> &shapes,
+                                      const GeneratedNormals &normals, const std::vector<size_t> &shapeIds, Model &m,
+                                      VertexWelder &welder)
 {
-    tinyobj::ObjReaderConfig config;
-    config.mtl_search_path = MODELS_FOLDER;
-    tinyobj::ObjReader reader;
-    if (!reader.ParseFromFile(std::string(MODEL_PATH), config))
+    auto start = std::chrono::high_resolution_clock::now();
+
+    // shapes are cut into blocks of whole triangles and every block is welded into its own table
+    // on the thread pool, so single shape files are parallel too. The block results are merged in
+    // order afterwards, which keeps the output independent of scheduling. Blocks only merge equal
+    // vertices, the position epsilon is applied once when merging, so every vertex ends up within
+    // the epsilon of the vertex it was merged into and distances cannot add up over two merges.
+    constexpr size_t blockCorners = 3 * 65536;
+
+    struct WeldBlock
     {
-        if (reader.Error().empty())
+        size_t shape;
+        size_t firstCorner;
+        size_t lastCorner;
+        std::vector<Vertex> vertices;
+        std::vector<uint32_t> indices;
+    };
+    std::vector<WeldBlock> blocks;
+
+    for (size_t s : shapeIds)
+    {
+        const size_t corners = shapes[s].mesh.indices.size();
+        for (size_t first = 0; first < corners; first += blockCorners)
         {
-            std::cerr << "OBJ READER: " << reader.Error();
+            blocks.push_back({s, first, std::min(corners, first + blockCorners), {}, {}});
         }
-        exit(1);
     }
 
-    const auto &materials = reader.GetMaterials();
-    const auto &shapes = reader.GetShapes();
-    const auto &attrib = reader.GetAttrib();
+    threadPool.parallelFor(0, blocks.size(), 1, [&](size_t first, size_t last) {
+        for (size_t b = first; b < last; ++b)
+        {
+            auto &block = blocks[b];
+            const auto &mesh = shapes[block.shape].mesh;
+            const glm::vec3 *shapeNormals = normals.shape(block.shape);
+            block.indices.reserve(block.lastCorner - block.firstCorner);
 
-    m.vertices.clear();
-    m.indices.clear();
-    m.materials.clear();
-    m.materials_indices.clear();
-    rt_m.vertices.clear();
-    rt_m.indices.clear();
+            VertexWelder blockWelder(block.vertices, 0.0f, block.lastCorner - block.firstCorner);
+            for (size_t corner = block.firstCorner; corner < block.lastCorner; ++corner)
+            {
+                const glm::vec3 normal = shapeNormals ? shapeNormals[corner] : glm::vec3(0.0f);
+                block.indices.push_back(blockWelder.weld(
+                    getObjVertex(attrib, mesh.indices[corner], normal, mesh.material_ids[corner / 3])));
+            }
+        }
+    });
 
-    std::map<Vertex, uint32_t> uniqueVertices{};
-    m.materials = materials;
+    WeldStats stats;
+    const size_t verticesBefore = m.vertices.size();
 
-    loadGeneratedShapes(m, rt_m, uniqueVertices);
+    for (size_t s : shapeIds)
+    {
+        for (int material_idx : shapes[s].mesh.material_ids)
+            m.materialIndices.push_back(static_cast<uint32_t>(material_idx));
+    }
 
-    for (const auto &shape : shapes)
+    // the blocks are welded into the model in order, then their indices are remapped into
+    // place in parallel
+    std::vector<std::vector<uint32_t>> remaps;
+    std::vector<size_t> offsets;
+    remaps.reserve(blocks.size());
+    offsets.reserve(blocks.size());
+    size_t indexCount = m.indices.size();
+    for (auto &block : blocks)
     {
-        for (const auto &index : shape.mesh.indices)
-        {
-            Vertex vertex{};
+        remaps.push_back(loadVertices(block.vertices, welder));
+        offsets.push_back(indexCount);
+        indexCount += block.indices.size();
+        stats.inputVertices += block.lastCorner - block.firstCorner;
+        block.vertices = {};
+    }
 
-            vertex.pos = {attrib.vertices[3 * index.vertex_index + 0], attrib.vertices[3 * index.vertex_index + 1],
-                          attrib.vertices[3 * index.vertex_index + 2]};
+    m.indices.resize(indexCount);
+    threadPool.parallelFor(0, blocks.size(), 1, [&](size_t first, size_t last) {
+        for (size_t b = first; b < last; ++b)
+        {
+            uint32_t *out = m.indices.data() + offsets[b];
+            for (uint32_t index : blocks[b].indices)
+                *out++ = remaps[b][index];
+        }
+    });
 
-            vertex.texCoord = {attrib.texcoords[2 * index.texcoord_index + 0],
-                               // we have 0 at the top while obj 0 at
-                               // the bottom
-                               1.0f - attrib.texcoords[2 * index.texcoord_index + 1]};
+    stats.uniqueVertices = m.vertices.size() - verticesBefore;
+    stats.milliseconds =
+        std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+    return stats;
+}
 
-            vertex.normal = {attrib.normals[3 * index.normal_index], attrib.normals[3 * index.normal_index + 1],
-                             attrib.normals[3 * index.normal_index + 2]};
-            // vertex.normal = {1.0f, 1.0f, 1.0f};
+PositionQuantization RayTracerApp::sceneQuantization(const std::vector<GeometryView> &sources)
+{
+    // one quantization covers all meshes, bounds per grain are reduced in order afterwards
+    constexpr size_t grainVertices = 1 << 16;
 
-            if (uniqueVertices.count(vertex) == 0)
+    bool empty = true;
+    glm::vec3 minimum(0.0f);
+    glm::vec3 maximum(0.0f);
+    for (const GeometryView &source : sources)
+    {
+        const size_t count = source.vertexCount;
+        if (count == 0)
+            continue;
+
+        const Vertex *vertices = source.vertices;
+        const size_t grains = (count + grainVertices - 1) / grainVertices;
+        std::vector<glm::vec3> minimums(grains, vertices[0].pos);
+        std::vector<glm::vec3> maximums(grains, vertices[0].pos);
+        threadPool.parallelFor(0, count, grainVertices, [&](size_t first, size_t last) {
+            const size_t grain = first / grainVertices;
+            for (size_t i = first; i < last; ++i)
             {
-                uniqueVertices[vertex] = static_cast<uint32_t>(m.vertices.size());
-                m.vertices.push_back(vertex);
-
-                rt_m.vertices.push_back(vertex.pos.x);
-                rt_m.vertices.push_back(vertex.pos.y);
-                rt_m.vertices.push_back(vertex.pos.z);
+                minimums[grain] = glm::min(minimums[grain], vertices[i].pos);
+                maximums[grain] = glm::max(maximums[grain], vertices[i].pos);
             }
+        });
 
-            m.indices.push_back(uniqueVertices[vertex]);
-            rt_m.indices.push_back(uniqueVertices[vertex]);
+        if (empty)
+        {
+            minimum = minimums[0];
+            maximum = maximums[0];
+            empty = false;
+        }
+        for (size_t grain = 0; grain < grains; ++grain)
+        {
+            minimum = glm::min(minimum, minimums[grain]);
+            maximum = glm::max(maximum, maximums[grain]);
         }
-
-        for (const auto &material_idx : shape.mesh.material_ids)
-            m.materials_indices.push_back(material_idx);
     }
-    return;
+    return positionQuantization(minimum, maximum);
 }
 
 VkFormat RayTracerApp::findSupportedFormat(const std::vector<VkFormat> &candidates, VkImageTiling tiling,
@@ -290,87 +836,284 @@ void RayTracerApp::createImage(uint32_t width, uint32_t height, uint32_t mipLeve
     vkBindImageMemory(device, image, imageMemory, 0);
 }
 
-void RayTracerApp::generateMipmaps(VkImage image, VkFormat imageFormat, int32_t texWidth, int32_t texHeight,
-                                   uint32_t mipLevels)
+void RayTracerApp::createMipDownsampler()
+{
+    std::array<VkDescriptorSetLayoutBinding, 3> bindings{};
+    bindings[0].binding = 0;  // level 0
+    bindings[0].descriptorCount = 1;
+    bindings[0].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    bindings[0].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+
+    bindings[1].binding = 1;  // levels below it
+    bindings[1].descriptorCount = DOWNSAMPLE_MAX_LEVELS;
+    bindings[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+    bindings[1].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+
+    bindings[2].binding = 2;  // scratch
+    bindings[2].descriptorCount = 1;
+    bindings[2].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    bindings[2].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+
+    VkDescriptorSetLayoutCreateInfo layoutInfo{};
+    layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    layoutInfo.bindingCount = static_cast<uint32_t>(bindings.size());
+    layoutInfo.pBindings = bindings.data();
+    if (vkCreateDescriptorSetLayout(device, &layoutInfo, nullptr, &downsampleDescriptorSetLayout) != VK_SUCCESS)
+    {
+        throw std::runtime_error("failed to create downsample descriptor set layout");
+    }
+
+    // size of level 0, the levels to write and whether they are sRGB
+    VkPushConstantRange pushConstantRange{};
+    pushConstantRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    pushConstantRange.offset = 0;
+    pushConstantRange.size = 4 * sizeof(uint32_t);
+
+    VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+    pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    pipelineLayoutInfo.setLayoutCount = 1;
+    pipelineLayoutInfo.pSetLayouts = &downsampleDescriptorSetLayout;
+    pipelineLayoutInfo.pushConstantRangeCount = 1;
+    pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
+    if (vkCreatePipelineLayout(device, &pipelineLayoutInfo, nullptr, &downsamplePipelineLayout) != VK_SUCCESS)
+    {
+        throw std::runtime_error("failed to create downsample pipeline layout");
+    }
+
+    VkShaderModule shaderModule = createShaderModule(readFile("shaders/downsample.comp.spv"));
+    VkComputePipelineCreateInfo pipelineInfo{};
+    pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+    pipelineInfo.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    pipelineInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+    pipelineInfo.stage.module = shaderModule;
+    pipelineInfo.stage.pName = "main";
+    pipelineInfo.layout = downsamplePipelineLayout;
+    if (vkCreateComputePipelines(device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &downsamplePipeline) !=
+        VK_SUCCESS)
+    {
+        throw std::runtime_error("failed to create downsample pipeline");
+    }
+    vkDestroyShaderModule(device, shaderModule, nullptr);
+
+    // sets are freed with their texture
+    std::array<VkDescriptorPoolSize, 3> poolSizes{};
+    poolSizes[0].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    poolSizes[0].descriptorCount = MAX_DOWNSAMPLED_TEXTURES;
+    poolSizes[1].type = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+    poolSizes[1].descriptorCount = DOWNSAMPLE_MAX_LEVELS * MAX_DOWNSAMPLED_TEXTURES;
+    poolSizes[2].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    poolSizes[2].descriptorCount = MAX_DOWNSAMPLED_TEXTURES;
+
+    VkDescriptorPoolCreateInfo poolInfo{};
+    poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    poolInfo.flags = VK_DESCRIPTOR_POOL_CREATE_FREE_DESCRIPTOR_SET_BIT;
+    poolInfo.poolSizeCount = static_cast<uint32_t>(poolSizes.size());
+    poolInfo.pPoolSizes = poolSizes.data();
+    poolInfo.maxSets = MAX_DOWNSAMPLED_TEXTURES;
+    if (vkCreateDescriptorPool(device, &poolInfo, nullptr, &downsampleDescriptorPool) != VK_SUCCESS)
+    {
+        throw std::runtime_error("failed to create downsample descriptor pool");
+    }
+}
+
+DownsampledTexture RayTracerApp::createDownsampledTexture(uint32_t width, uint32_t height, VkFormat format)
 {
-    // Check if image format support linear blitting
+    DownsampledTexture texture;
+    texture.format = format;
+    texture.width = width;
+    texture.height = height;
+    // one dispatch writes at most DOWNSAMPLE_MAX_LEVELS levels, the chain of larger textures ends
+    // before 1x1
+    texture.mipLevels = 1;
+    while ((std::max(width, height) >> texture.mipLevels) > 0 && texture.mipLevels <= DOWNSAMPLE_MAX_LEVELS)
+        ++texture.mipLevels;
+
+    // storage images can not be sRGB, the levels are written through UNORM views of the same texels
+    VkFormat storageFormat = format;
+    if (format == VK_FORMAT_R8G8B8A8_SRGB)
+        storageFormat = VK_FORMAT_R8G8B8A8_UNORM;
+    else if (format == VK_FORMAT_B8G8R8A8_SRGB)
+        storageFormat = VK_FORMAT_B8G8R8A8_UNORM;
+
     VkFormatProperties formatProperties;
-    vkGetPhysicalDeviceFormatProperties(physicalDevice, imageFormat, &formatProperties);
-    if (!(formatProperties.optimalTilingFeatures & VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT))
+    vkGetPhysicalDeviceFormatProperties(physicalDevice, storageFormat, &formatProperties);
+    if (!(formatProperties.optimalTilingFeatures & VK_FORMAT_FEATURE_STORAGE_IMAGE_BIT))
     {
-        throw std::runtime_error(
-            "texture image format does not support"
-            "linear blitting!");
+        throw std::runtime_error("downsampled texture format does not support storage images");
     }
 
-    VkCommandBuffer commandBuffer = beginSingleTimeCommands(graphicsCommandPool);
+    VkImageCreateInfo imageInfo{};
+    imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+    imageInfo.imageType = VK_IMAGE_TYPE_2D;
+    imageInfo.extent = {width, height, 1};
+    imageInfo.mipLevels = texture.mipLevels;
+    imageInfo.arrayLayers = 1;
+    imageInfo.format = format;
+    imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+    imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    imageInfo.usage = VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT |
+                      VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+    imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+    imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    imageInfo.flags =
+        storageFormat != format ? VK_IMAGE_CREATE_MUTABLE_FORMAT_BIT | VK_IMAGE_CREATE_EXTENDED_USAGE_BIT : 0;
+    if (vkCreateImage(device, &imageInfo, nullptr, &texture.texture.image) != VK_SUCCESS)
+    {
+        throw std::runtime_error("failed to create downsampled texture image");
+    }
+
+    VkMemoryRequirements memRequirements;
+    vkGetImageMemoryRequirements(device, texture.texture.image, &memRequirements);
+    VkMemoryAllocateInfo allocInfo{};
+    allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+    allocInfo.allocationSize = memRequirements.size;
+    allocInfo.memoryTypeIndex = findMemoryType(memRequirements.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+    if (vkAllocateMemory(device, &allocInfo, nullptr, &texture.texture.memory) != VK_SUCCESS)
+    {
+        throw std::runtime_error("failed to allocate downsampled texture memory");
+    }
+    vkBindImageMemory(device, texture.texture.image, texture.texture.memory, 0);
+
+    texture.texture.view =
+        createImageView(texture.texture.image, format, VK_IMAGE_ASPECT_COLOR_BIT, texture.mipLevels);
+    for (uint32_t level = 1; level < texture.mipLevels; ++level)
+    {
+        VkImageViewCreateInfo viewInfo{};
+        viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+        viewInfo.image = texture.texture.image;
+        viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+        viewInfo.format = storageFormat;
+        viewInfo.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, level, 1, 0, 1};
+
+        VkImageView view;
+        if (vkCreateImageView(device, &viewInfo, nullptr, &view) != VK_SUCCESS)
+        {
+            throw std::runtime_error("failed to create downsampled texture level view");
+        }
+        texture.levelViews.push_back(view);
+    }
 
+    // the sum of the 64x64 block of level 0 of every group
+    const VkDeviceSize groups = ((width + 63) / 64) * ((height + 63) / 64);
+    createBuffer(4 * sizeof(uint32_t) + groups * 4 * sizeof(float),
+                 VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                 VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, texture.scratchBuffer, texture.scratchBufferMemory);
+
+    VkCommandBuffer commandBuffer = beginSingleTimeCommands(graphicsCommandPool);
     VkImageMemoryBarrier barrier{};
     barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
-    barrier.image = image;
+    barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    barrier.newLayout = VK_IMAGE_LAYOUT_GENERAL;
     barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
     barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-    barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-    barrier.subresourceRange.baseArrayLayer = 0;
-    barrier.subresourceRange.layerCount = 1;
-    barrier.subresourceRange.levelCount = 1;
+    barrier.image = texture.texture.image;
+    barrier.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, 0, texture.mipLevels, 0, 1};
+    barrier.srcAccessMask = 0;
+    barrier.dstAccessMask = VK_ACCESS_MEMORY_READ_BIT | VK_ACCESS_MEMORY_WRITE_BIT;
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0, 0,
+                         nullptr, 0, nullptr, 1, &barrier);
+    // the shader counts the finished groups from 0 and resets the counter when it is done
+    vkCmdFillBuffer(commandBuffer, texture.scratchBuffer, 0, sizeof(uint32_t), 0);
+    endSingleTimeCommands(graphicsCommandPool, commandBuffer, graphicsQueue);
 
-    int32_t mipWidth = texWidth;
-    int32_t mipHeight = texHeight;
+    if (texture.mipLevels == 1)
+        return texture;
 
-    for (uint32_t i = 1; i < mipLevels; ++i)
+    VkDescriptorSetAllocateInfo setInfo{};
+    setInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    setInfo.descriptorPool = downsampleDescriptorPool;
+    setInfo.descriptorSetCount = 1;
+    setInfo.pSetLayouts = &downsampleDescriptorSetLayout;
+    if (vkAllocateDescriptorSets(device, &setInfo, &texture.descriptorSet) != VK_SUCCESS)
     {
-        barrier.subresourceRange.baseMipLevel = i - 1;
-        barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
-        barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
-        barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-        barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
-
-        // blit command will wait on this transition
-        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0,
-                             nullptr, 0, nullptr, 1, &barrier);
-
-        VkImageBlit blit{};
-        blit.srcOffsets[0] = {0, 0, 0};
-        blit.srcOffsets[1] = {mipWidth, mipHeight, 1};
-        blit.srcSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-        blit.srcSubresource.mipLevel = i - 1;
-        blit.srcSubresource.baseArrayLayer = 0;
-        blit.srcSubresource.layerCount = 1;
-        blit.dstOffsets[0] = {0, 0, 0};
-        blit.dstOffsets[1] = {mipWidth > 1 ? mipWidth / 2 : 1, mipHeight > 1 ? mipHeight / 2 : 1, 1};
-        blit.dstSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-        blit.dstSubresource.mipLevel = i;
-        blit.dstSubresource.baseArrayLayer = 0;
-        blit.dstSubresource.layerCount = 1;
-
-        vkCmdBlitImage(commandBuffer, image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, image,
-                       VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &blit, VK_FILTER_LINEAR);
-
-        barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
-        barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-        barrier.srcAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
-        barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+        throw std::runtime_error("failed to allocate downsample descriptor set");
+    }
 
-        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0,
-                             nullptr, 0, nullptr, 1, &barrier);
+    VkDescriptorImageInfo sourceInfo{};
+    sourceInfo.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+    sourceInfo.imageView = texture.texture.view;
+    sourceInfo.sampler = textureSampler;
 
-        if (mipWidth > 1)
-            mipWidth /= 2;
-        if (mipHeight > 1)
-            mipHeight /= 2;
+    // levels past the chain are never written, they repeat the last one
+    std::array<VkDescriptorImageInfo, DOWNSAMPLE_MAX_LEVELS> levelInfos{};
+    for (uint32_t i = 0; i < DOWNSAMPLE_MAX_LEVELS; ++i)
+    {
+        levelInfos[i].imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+        levelInfos[i].imageView = texture.levelViews[std::min<size_t>(i, texture.levelViews.size() - 1)];
     }
 
-    barrier.subresourceRange.baseMipLevel = mipLevels - 1;
-    barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
-    barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-    barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+    VkDescriptorBufferInfo scratchInfo{};
+    scratchInfo.buffer = texture.scratchBuffer;
+    scratchInfo.offset = 0;
+    scratchInfo.range = VK_WHOLE_SIZE;
 
-    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0,
-                         nullptr, 0, nullptr, 1, &barrier);
+    std::array<VkWriteDescriptorSet, 3> writes{};
+    for (uint32_t i = 0; i < writes.size(); ++i)
+    {
+        writes[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        writes[i].dstSet = texture.descriptorSet;
+        writes[i].dstBinding = i;
+        writes[i].dstArrayElement = 0;
+    }
+    writes[0].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    writes[0].descriptorCount = 1;
+    writes[0].pImageInfo = &sourceInfo;
+    writes[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+    writes[1].descriptorCount = DOWNSAMPLE_MAX_LEVELS;
+    writes[1].pImageInfo = levelInfos.data();
+    writes[2].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    writes[2].descriptorCount = 1;
+    writes[2].pBufferInfo = &scratchInfo;
+    vkUpdateDescriptorSets(device, static_cast<uint32_t>(writes.size()), writes.data(), 0, nullptr);
+
+    return texture;
+}
 
-    endSingleTimeCommands(graphicsCommandPool, commandBuffer, graphicsQueue);
+void RayTracerApp::recordMipDownsample(VkCommandBuffer commandBuffer, const DownsampledTexture &texture)
+{
+    if (texture.mipLevels == 1)
+        return;
+
+    // The image never leaves the general layout, so memory barriers cover it: level 0 is complete
+    // and the last readers of the levels below are done. The scratch counter of an earlier
+    // dispatch is visible.
+    VkMemoryBarrier before{};
+    before.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    before.srcAccessMask = VK_ACCESS_MEMORY_WRITE_BIT;
+    before.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1,
+                         &before, 0, nullptr, 0, nullptr);
+
+    const bool srgb = texture.format == VK_FORMAT_R8G8B8A8_SRGB || texture.format == VK_FORMAT_B8G8R8A8_SRGB;
+    const std::array<uint32_t, 4> parameters = {texture.width, texture.height, texture.mipLevels - 1,
+                                                srgb ? 1u : 0u};
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, downsamplePipeline);
+    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, downsamplePipelineLayout, 0, 1,
+                            &texture.descriptorSet, 0, nullptr);
+    vkCmdPushConstants(commandBuffer, downsamplePipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(parameters),
+                       parameters.data());
+    vkCmdDispatch(commandBuffer, (texture.width + 63) / 64, (texture.height + 63) / 64, 1);
+
+    VkMemoryBarrier after{};
+    after.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    after.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    after.dstAccessMask = VK_ACCESS_MEMORY_READ_BIT;
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0, 1,
+                         &after, 0, nullptr, 0, nullptr);
+}
+
+void RayTracerApp::destroyDownsampledTexture(DownsampledTexture &texture)
+{
+    if (texture.descriptorSet != VK_NULL_HANDLE)
+        vkFreeDescriptorSets(device, downsampleDescriptorPool, 1, &texture.descriptorSet);
+    for (VkImageView view : texture.levelViews)
+        vkDestroyImageView(device, view, nullptr);
+    vkDestroyImageView(device, texture.texture.view, nullptr);
+    vkDestroyImage(device, texture.texture.image, nullptr);
+    vkFreeMemory(device, texture.texture.memory, nullptr);
+    vkDestroyBuffer(device, texture.scratchBuffer, nullptr);
+    vkFreeMemory(device, texture.scratchBufferMemory, nullptr);
+    texture = DownsampledTexture{};
 }
 
 void RayTracerApp::transitionImageLayout(VkImage image, VkFormat format, VkImageLayout oldLayout,
@@ -458,26 +1201,13 @@ void RayTracerApp::transitionImageLayout(VkImage image, VkFormat format, VkImage
     endSingleTimeCommands(graphicsCommandPool, commandBuffer, graphicsQueue);
 }
 
-void RayTracerApp::copyBufferToImage(VkBuffer buffer, VkImage image, uint32_t width, uint32_t height)
+void RayTracerApp::copyBufferToImage(VkBuffer buffer, VkImage image, const std::vector<VkBufferImageCopy> &regions)
 {
     VkCommandBuffer commandBuffer = beginSingleTimeCommands(graphicsCommandPool);
-    // which part of buffer will be copied to which part of image
-    VkBufferImageCopy region{};
-    region.bufferOffset = 0;
-
-    // 0 means tightly packed in memory
-    region.bufferRowLength = 0;
-    region.bufferImageHeight = 0;
-
-    region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-    region.imageSubresource.mipLevel = 0;
-    region.imageSubresource.baseArrayLayer = 0;
-    region.imageSubresource.layerCount = 1;
-
-    region.imageOffset = {0, 0, 0};
-    region.imageExtent = {width, height, 1};
-
-    vkCmdCopyBufferToImage(commandBuffer, buffer, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
+    // which parts of buffer will be copied to which parts of image, a bufferRowLength and
+    // bufferImageHeight of 0 mean tightly packed in memory
+    vkCmdCopyBufferToImage(commandBuffer, buffer, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                           static_cast<uint32_t>(regions.size()), regions.data());
 
     endSingleTimeCommands(graphicsCommandPool, commandBuffer, graphicsQueue);
 }
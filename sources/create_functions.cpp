@@ -90,6 +90,7 @@ void RayTracerApp::createLogicalDevice()
 
     // Query supported features
     vkGetPhysicalDeviceFeatures2(physicalDevice, &features2);
+    textureCompressionBC = features2.features.textureCompressionBC == VK_TRUE;
 
     // END OF RAY TRACING
 
@@ -144,19 +145,99 @@ void RayTracerApp::createLogicalDevice()
 }
 
 // create asset objects
-void RayTracerApp::createTextureImage()
+namespace
 {
-    int texWidth, texHeight, texChannels;
-    stbi_uc *pixels = stbi_load(std::string(TEXTURE_PATH).c_str(), &texWidth, &texHeight, &texChannels, STBI_rgb_alpha);
-
-    mipLevels = static_cast<uint32_t>(std::floor(std::log2(std::max(texWidth, texHeight)))) + 1;
+// colour formats sample as sRGB, the normal map channels of BC5 are linear
+VkFormat textureVkFormat(TextureFormat format)
+{
+    switch (format)
+    {
+    case TextureFormat::BC1:
+        return VK_FORMAT_BC1_RGB_SRGB_BLOCK;
+    case TextureFormat::BC3:
+        return VK_FORMAT_BC3_SRGB_BLOCK;
+    case TextureFormat::BC5:
+        return VK_FORMAT_BC5_UNORM_BLOCK;
+    case TextureFormat::BC7:
+        return VK_FORMAT_BC7_SRGB_BLOCK;
+    default:
+        return VK_FORMAT_R8G8B8A8_SRGB;
+    }
+}
+}  // namespace
 
-    VkDeviceSize imageSize = texWidth * texHeight * 4;
+DecodedImage RayTracerApp::decodeImage(const std::string &path, TextureRole role)
+{
+    auto start = std::chrono::high_resolution_clock::now();
+
+    // an image used as colour and as normal map is baked once for each
+    const std::string cachePath =
+        path + (role == TextureRole::NormalMap ? ".normal" : "") + std::string(TEXTURE_CACHE_EXTENSION);
+    auto cache = std::make_shared<TextureCache>();
+    const bool compress = COMPRESS_TEXTURES && textureCompressionBC;
+    DecodedImage image;
+    if (cache->open(cachePath, path, compress))
+    {
+        // warm start, the levels are copied from the mapping into the staging buffer
+        image.pixels = std::shared_ptr<const uint8_t>(cache, cache->pixels());
+        image.format = cache->format();
+        image.size = cache->pixelSize();
+        image.levels = cache->levels();
+        const auto elapsed = std::chrono::high_resolution_clock::now() - start;
+        std::cout << "opened " << cachePath << " in " << std::chrono::duration<double, std::milli>(elapsed).count()
+                  << " ms" << std::endl;
+        return image;
+    }
 
+    int width, height, channels;
+    stbi_uc *pixels = stbi_load(path.c_str(), &width, &height, &channels, STBI_rgb_alpha);
     if (!pixels)
     {
         throw std::runtime_error("failed to load texture image");
     }
+    const TextureContent content =
+        classifyTexture(pixels, static_cast<uint32_t>(width), static_cast<uint32_t>(height), role);
+    // normal maps are filtered as plain vectors, without compression they still sample as sRGB
+    const bool srgb = !compress || content != TextureContent::NormalMap;
+    auto chain = std::make_shared<MipChain>(
+        buildMipChain(pixels, static_cast<uint32_t>(width), static_cast<uint32_t>(height), srgb, threadPool));
+    stbi_image_free(pixels);
+
+    if (compress)
+    {
+        TextureCompressionStats stats;
+        *chain = compressMipChain(*chain, content, MIN_TEXTURE_PSNR, threadPool, stats);
+        std::cout << "compressed " << path << " to " << textureFormatName(stats.format) << " at " << stats.psnr
+                  << " dB, " << stats.uncompressedBytes / 1.0e6 << " MB -> " << stats.compressedBytes / 1.0e6
+                  << " MB, saved " << (stats.uncompressedBytes - stats.compressedBytes) / 1.0e6 << " MB in "
+                  << stats.milliseconds << " ms" << std::endl;
+    }
+
+    if (!TextureCache::write(cachePath, path, *chain))
+    {
+        std::cerr << "failed to write texture cache " << cachePath << std::endl;
+    }
+
+    image.pixels = std::shared_ptr<const uint8_t>(chain, chain->pixels.data());
+    image.format = chain->format;
+    image.size = chain->pixels.size();
+    image.levels = chain->levels;
+    std::cout << "baked " << image.levels.size() << " mip levels of " << path << " in "
+              << std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count()
+              << " ms" << std::endl;
+    return image;
+}
+
+Texture RayTracerApp::createTextureImage(const DecodedImage &image)
+{
+    Texture texture;
+    const uint32_t texWidth = image.levels[0].width;
+    const uint32_t texHeight = image.levels[0].height;
+
+    const uint32_t mipLevels = static_cast<uint32_t>(image.levels.size());
+    const VkFormat format = textureVkFormat(image.format);
+
+    VkDeviceSize imageSize = image.size;
 
     VkBuffer stagingBuffer;
     VkDeviceMemory stagingBufferMemory;
@@ -166,26 +247,487 @@ void RayTracerApp::createTextureImage()
 
     void *data;
     vkMapMemory(device, stagingBufferMemory, 0, imageSize, 0, &data);
-    memcpy(data, pixels, static_cast<size_t>(imageSize));
+    memcpy(data, image.pixels.get(), static_cast<size_t>(imageSize));
     vkUnmapMemory(device, stagingBufferMemory);
 
-    stbi_image_free(pixels);
+    createImage(texWidth, texHeight, mipLevels, format, VK_IMAGE_TILING_OPTIMAL,
+                VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+                texture.image, texture.memory);
 
-    createImage(texWidth, texHeight, mipLevels, VK_FORMAT_R8G8B8A8_SRGB, VK_IMAGE_TILING_OPTIMAL,
-                VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
-                VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, textureImage, textureImageMemory);
+    // every level is prebaked, one copy with a region per level fills the whole chain
+    std::vector<VkBufferImageCopy> regions(mipLevels);
+    for (uint32_t i = 0; i < mipLevels; ++i)
+    {
+        regions[i].bufferOffset = image.levels[i].offset;
+        regions[i].imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        regions[i].imageSubresource.mipLevel = i;
+        regions[i].imageSubresource.baseArrayLayer = 0;
+        regions[i].imageSubresource.layerCount = 1;
+        regions[i].imageExtent = {image.levels[i].width, image.levels[i].height, 1};
+    }
 
-    transitionImageLayout(textureImage, VK_FORMAT_R8G8B8A8_SRGB, VK_IMAGE_LAYOUT_UNDEFINED,
-                          VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, mipLevels);
-    copyBufferToImage(stagingBuffer, textureImage, static_cast<uint32_t>(texWidth), static_cast<uint32_t>(texHeight));
-    // transitioned to VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL while
-    // generating mipmaps
-    generateMipmaps(textureImage, VK_FORMAT_R8G8B8A8_SRGB, texWidth, texHeight, mipLevels);
+    transitionImageLayout(texture.image, format, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                          mipLevels);
+    copyBufferToImage(stagingBuffer, texture.image, regions);
+    transitionImageLayout(texture.image, format, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                          VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, mipLevels);
 
     // cleanup
     vkDestroyBuffer(device, stagingBuffer, nullptr);
     vkFreeMemory(device, stagingBufferMemory, nullptr);
+
+    texture.view = createImageView(texture.image, format, VK_IMAGE_ASPECT_COLOR_BIT, mipLevels);
+    return texture;
+}
+
+void RayTracerApp::createPlaceholderTexture()
+{
+    // white, so materials show their plain diffuse colour until their texture arrives
+    static const uint8_t white[4] = {255, 255, 255, 255};
+    DecodedImage image;
+    image.pixels = std::shared_ptr<const uint8_t>(std::shared_ptr<const uint8_t>(), white);
+    image.size = sizeof(white);
+    image.levels = {{0, 1, 1}};
+    placeholderTexture = createTextureImage(image);
+}
+
+void RayTracerApp::streamTexture(uint32_t slot, const std::string &path, TextureRole role)
+{
+    // the worker creates the image and fills a staging buffer of its own, both only need the
+    // device, the main thread records the copy with the next frame
+    textureStreams.push_back(threadPool.submit([this, slot, path, role]() {
+        DecodedImage image;
+        try
+        {
+            image = startupTimeline.time("decode texture", [&]() { return decodeImage(path, role); });
+        }
+        catch (const std::runtime_error &error)
+        {
+            std::cerr << "failed to load " << path << ": " << error.what() << std::endl;
+            return;
+        }
+
+        // the levels of a virtual texture larger than a tile are streamed as tiles later, only its
+        // mip tail is uploaded as a texture
+        StagedTexture staged;
+        staged.slot = slot;
+        staged.tiledLevels = VIRTUAL_TEXTURES ? tiledLevelCount(image.levels) : 0;
+        const uint64_t tailOffset = image.levels[staged.tiledLevels].offset;
+        const uint64_t tailSize = image.size - tailOffset;
+        staged.levels.assign(image.levels.begin() + staged.tiledLevels, image.levels.end());
+        for (TextureLevel &level : staged.levels)
+            level.offset -= tailOffset;
+        if (staged.tiledLevels > 0)
+        {
+            staged.format = image.format;
+            staged.chainPixels = image.pixels;
+            staged.chainLevels = image.levels;
+        }
+
+        createBuffer(tailSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+                     VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, staged.stagingBuffer,
+                     staged.stagingBufferMemory);
+        void *data;
+        vkMapMemory(device, staged.stagingBufferMemory, 0, tailSize, 0, &data);
+        memcpy(data, image.pixels.get() + tailOffset, static_cast<size_t>(tailSize));
+        vkUnmapMemory(device, staged.stagingBufferMemory);
+
+        const uint32_t mipLevels = static_cast<uint32_t>(staged.levels.size());
+        const VkFormat format = textureVkFormat(image.format);
+        createImage(staged.levels[0].width, staged.levels[0].height, mipLevels, format, VK_IMAGE_TILING_OPTIMAL,
+                    VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+                    staged.texture.image, staged.texture.memory);
+        staged.texture.view = createImageView(staged.texture.image, format, VK_IMAGE_ASPECT_COLOR_BIT, mipLevels);
+
+        std::lock_guard<std::mutex> lock(stagedTexturesMutex);
+        stagedTextures.push_back(std::move(staged));
+    }));
+}
+
+void RayTracerApp::uploadStagedTextures()
+{
+    // retire the batches the device is done with, their textures can be bound from now on
+    for (auto batch = textureUploads.begin(); batch != textureUploads.end();)
+    {
+        if (vkGetFenceStatus(device, batch->fence) != VK_SUCCESS)
+        {
+            ++batch;
+            continue;
+        }
+
+        for (StagedTexture &staged : batch->textures)
+        {
+            vkDestroyBuffer(device, staged.stagingBuffer, nullptr);
+            vkFreeMemory(device, staged.stagingBufferMemory, nullptr);
+            textures[staged.slot] = staged.texture;
+            readyTextureSlots.push_back(staged.slot);
+            if (staged.tiledLevels == 0)
+                continue;
+            const bool cached = tileCaches[static_cast<uint32_t>(staged.format)].image != VK_NULL_HANDLE;
+            if (!cached || !virtualTextures->add(staged.slot, staged.format, std::move(staged.chainPixels),
+                                                 staged.chainLevels, staged.tiledLevels))
+            {
+                std::cerr << "no room for the tiles of texture slot " << staged.slot << ", it only has its mip tail"
+                          << std::endl;
+            }
+        }
+        for (const StagedTiles &staged : batch->tiles)
+        {
+            vkDestroyBuffer(device, staged.stagingBuffer, nullptr);
+            vkFreeMemory(device, staged.stagingBufferMemory, nullptr);
+            for (const TileLoad &load : staged.tiles)
+                virtualTextures->makeResident(load);
+        }
+        vkFreeCommandBuffers(device, graphicsCommandPool, 1, &batch->commandBuffer);
+        vkDestroyFence(device, batch->fence, nullptr);
+        batch = textureUploads.erase(batch);
+    }
+
+    TextureUploadBatch batch;
+    {
+        std::lock_guard<std::mutex> lock(stagedTexturesMutex);
+        batch.textures.swap(stagedTextures);
+        batch.tiles.swap(stagedTiles);
+    }
+    if (batch.textures.empty() && batch.tiles.empty())
+        return;
+
+    // every texture that arrived since the last frame in one submit, the layout transitions of
+    // all of them share a barrier before and after the copies
+    std::vector<VkImageMemoryBarrier> barriers(batch.textures.size());
+    for (size_t t = 0; t < batch.textures.size(); ++t)
+    {
+        VkImageMemoryBarrier &barrier = barriers[t];
+        barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+        barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+        barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.image = batch.textures[t].texture.image;
+        barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        barrier.subresourceRange.baseMipLevel = 0;
+        barrier.subresourceRange.levelCount = static_cast<uint32_t>(batch.textures[t].levels.size());
+        barrier.subresourceRange.baseArrayLayer = 0;
+        barrier.subresourceRange.layerCount = 1;
+        barrier.srcAccessMask = 0;
+        barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    }
+
+    // the tile caches keep their contents, earlier frames may still sample them
+    std::vector<VkImageMemoryBarrier> cacheBarriers;
+    for (const StagedTiles &staged : batch.tiles)
+    {
+        for (const TileLoad &load : staged.tiles)
+        {
+            const VkImage cache = tileCaches[static_cast<uint32_t>(load.format)].image;
+            if (std::any_of(cacheBarriers.begin(), cacheBarriers.end(),
+                            [&](const VkImageMemoryBarrier &barrier) { return barrier.image == cache; }))
+                continue;
+
+            VkImageMemoryBarrier barrier{};
+            barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+            barrier.oldLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+            barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+            barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+            barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+            barrier.image = cache;
+            barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+            barrier.subresourceRange.baseMipLevel = 0;
+            barrier.subresourceRange.levelCount = 1;
+            barrier.subresourceRange.baseArrayLayer = 0;
+            barrier.subresourceRange.layerCount = 1;
+            barrier.srcAccessMask = VK_ACCESS_SHADER_READ_BIT;
+            barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+            cacheBarriers.push_back(barrier);
+        }
+    }
+
+    batch.commandBuffer = beginSingleTimeCommands(graphicsCommandPool);
+    if (!barriers.empty())
+    {
+        vkCmdPipelineBarrier(batch.commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0,
+                             0, nullptr, 0, nullptr, static_cast<uint32_t>(barriers.size()), barriers.data());
+    }
+    if (!cacheBarriers.empty())
+    {
+        vkCmdPipelineBarrier(batch.commandBuffer, VK_PIPELINE_STAGE_RAY_TRACING_SHADER_BIT_KHR,
+                             VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr,
+                             static_cast<uint32_t>(cacheBarriers.size()), cacheBarriers.data());
+    }
+
+    std::vector<VkBufferImageCopy> regions;
+    for (const StagedTexture &staged : batch.textures)
+    {
+        regions.assign(staged.levels.size(), VkBufferImageCopy{});
+        for (uint32_t i = 0; i < regions.size(); ++i)
+        {
+            regions[i].bufferOffset = staged.levels[i].offset;
+            regions[i].imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+            regions[i].imageSubresource.mipLevel = i;
+            regions[i].imageSubresource.baseArrayLayer = 0;
+            regions[i].imageSubresource.layerCount = 1;
+            regions[i].imageExtent = {staged.levels[i].width, staged.levels[i].height, 1};
+        }
+        vkCmdCopyBufferToImage(batch.commandBuffer, staged.stagingBuffer, staged.texture.image,
+                               VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, static_cast<uint32_t>(regions.size()),
+                               regions.data());
+    }
+
+    // every tile to its place in the cache of its format, in the order the worker gathered them
+    for (const StagedTiles &staged : batch.tiles)
+    {
+        VkDeviceSize offset = 0;
+        for (const TileLoad &load : staged.tiles)
+        {
+            VkBufferImageCopy region{};
+            region.bufferOffset = offset;
+            region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+            region.imageSubresource.mipLevel = 0;
+            region.imageSubresource.baseArrayLayer = 0;
+            region.imageSubresource.layerCount = 1;
+            const uint32_t tileX = load.physical % VIRTUAL_TILE_CACHE_TILES;
+            const uint32_t tileY = load.physical / VIRTUAL_TILE_CACHE_TILES;
+            region.imageOffset = {static_cast<int32_t>(tileX * VIRTUAL_TILE_SIZE),
+                                  static_cast<int32_t>(tileY * VIRTUAL_TILE_SIZE), 0};
+            region.imageExtent = {VIRTUAL_TILE_SIZE, VIRTUAL_TILE_SIZE, 1};
+            vkCmdCopyBufferToImage(batch.commandBuffer, staged.stagingBuffer,
+                                   tileCaches[static_cast<uint32_t>(load.format)].image,
+                                   VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
+            offset += virtualTileSize(load.format);
+        }
+    }
+
+    barriers.insert(barriers.end(), cacheBarriers.begin(), cacheBarriers.end());
+    for (VkImageMemoryBarrier &barrier : barriers)
+    {
+        barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+        barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+        barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+    }
+    vkCmdPipelineBarrier(batch.commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                         VK_PIPELINE_STAGE_RAY_TRACING_SHADER_BIT_KHR, 0, 0, nullptr, 0, nullptr,
+                         static_cast<uint32_t>(barriers.size()), barriers.data());
+    vkEndCommandBuffer(batch.commandBuffer);
+
+    VkFenceCreateInfo fenceInfo{};
+    fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+    if (vkCreateFence(device, &fenceInfo, nullptr, &batch.fence) != VK_SUCCESS)
+    {
+        throw std::runtime_error("failed to create texture upload fence!");
+    }
+
+    VkSubmitInfo submitInfo{VK_STRUCTURE_TYPE_SUBMIT_INFO};
+    submitInfo.commandBufferCount = 1;
+    submitInfo.pCommandBuffers = &batch.commandBuffer;
+    if (vkQueueSubmit(graphicsQueue, 1, &submitInfo, batch.fence) != VK_SUCCESS)
+    {
+        throw std::runtime_error("failed to submit texture upload");
+    }
+    textureUploads.push_back(std::move(batch));
+}
+
+void RayTracerApp::bindUploadedTextures(uint32_t imageIndex)
+{
+    size_t &bound = boundTextureSlots[imageIndex];
+    if (bound == readyTextureSlots.size())
+        return;
+
+    // the binding is update after bind, the recorded command buffer picks the new views up
+    std::vector<VkDescriptorImageInfo> imageInfos(readyTextureSlots.size() - bound);
+    std::vector<VkWriteDescriptorSet> writes(imageInfos.size());
+    for (size_t i = 0; i < imageInfos.size(); ++i)
+    {
+        const uint32_t slot = readyTextureSlots[bound + i];
+        imageInfos[i].imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+        imageInfos[i].imageView = textures[slot].view;
+        imageInfos[i].sampler = textureSampler;
+
+        writes[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        writes[i].dstSet = descriptorSets[imageIndex];
+        writes[i].dstBinding = 1;
+        writes[i].dstArrayElement = slot;
+        writes[i].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+        writes[i].descriptorCount = 1;
+        writes[i].pImageInfo = &imageInfos[i];
+    }
+    vkUpdateDescriptorSets(device, static_cast<uint32_t>(writes.size()), writes.data(), 0, nullptr);
+    bound = readyTextureSlots.size();
+}
+
+void RayTracerApp::destroyTextureStreams()
+{
+    // workers still decoding create device objects, they have to finish first
+    for (auto &stream : textureStreams)
+        stream.wait();
+    textureStreams.clear();
+
+    for (TextureUploadBatch &batch : textureUploads)
+    {
+        vkWaitForFences(device, 1, &batch.fence, VK_TRUE, UINT64_MAX);
+        vkFreeCommandBuffers(device, graphicsCommandPool, 1, &batch.commandBuffer);
+        vkDestroyFence(device, batch.fence, nullptr);
+        stagedTextures.insert(stagedTextures.end(), batch.textures.begin(), batch.textures.end());
+        stagedTiles.insert(stagedTiles.end(), batch.tiles.begin(), batch.tiles.end());
+    }
+    textureUploads.clear();
+
+    for (const StagedTiles &staged : stagedTiles)
+    {
+        vkDestroyBuffer(device, staged.stagingBuffer, nullptr);
+        vkFreeMemory(device, staged.stagingBufferMemory, nullptr);
+    }
+    stagedTiles.clear();
+
+    for (const StagedTexture &staged : stagedTextures)
+    {
+        vkDestroyBuffer(device, staged.stagingBuffer, nullptr);
+        vkFreeMemory(device, staged.stagingBufferMemory, nullptr);
+        vkDestroyImageView(device, staged.texture.view, nullptr);
+        vkDestroyImage(device, staged.texture.image, nullptr);
+        vkFreeMemory(device, staged.texture.memory, nullptr);
+    }
+    stagedTextures.clear();
 }
+
+void RayTracerApp::createTileCaches()
+{
+    virtualTextures =
+        std::make_unique<VirtualTextureTable>(MAX_SCENE_TEXTURES, VIRTUAL_TILE_CACHE_TILES, VIRTUAL_PAGE_TABLE_ENTRIES);
+
+    // a cache for each format decodeImage produces, colour and normal maps are block compressed
+    // whenever the device supports it
+    std::vector<TextureFormat> formats;
+    if (VIRTUAL_TEXTURES && COMPRESS_TEXTURES && textureCompressionBC)
+        formats = {TextureFormat::BC1, TextureFormat::BC3, TextureFormat::BC5, TextureFormat::BC7};
+    else if (VIRTUAL_TEXTURES)
+        formats = {TextureFormat::RGBA8};
+
+    const uint32_t size = VIRTUAL_TILE_CACHE_TILES * VIRTUAL_TILE_SIZE;
+    for (TextureFormat format : formats)
+    {
+        Texture &cache = tileCaches[static_cast<uint32_t>(format)];
+        const VkFormat vkFormat = textureVkFormat(format);
+        createImage(size, size, 1, vkFormat, VK_IMAGE_TILING_OPTIMAL,
+                    VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+                    cache.image, cache.memory);
+        // the shader never reads a tile before it is uploaded, the contents only need a defined layout
+        transitionImageLayout(cache.image, vkFormat, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                              1);
+        transitionImageLayout(cache.image, vkFormat, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                              VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, 1);
+        cache.view = createImageView(cache.image, vkFormat, VK_IMAGE_ASPECT_COLOR_BIT, 1);
+    }
+
+    // the tiles carry their own border, filtering must not reach past it into the next tile
+    VkSamplerCreateInfo samplerInfo{};
+    samplerInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+    samplerInfo.magFilter = VK_FILTER_LINEAR;
+    samplerInfo.minFilter = VK_FILTER_LINEAR;
+    samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    samplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    samplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    samplerInfo.anisotropyEnable = VK_FALSE;
+    samplerInfo.borderColor = VK_BORDER_COLOR_INT_OPAQUE_BLACK;
+    samplerInfo.unnormalizedCoordinates = VK_FALSE;
+    samplerInfo.compareEnable = VK_FALSE;
+    samplerInfo.compareOp = VK_COMPARE_OP_ALWAYS;
+    samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+    samplerInfo.minLod = 0.0f;
+    samplerInfo.maxLod = 0.0f;
+
+    if (vkCreateSampler(device, &samplerInfo, nullptr, &tileSampler) != VK_SUCCESS)
+    {
+        throw std::runtime_error("failed to create tile cache sampler");
+    }
+}
+
+void RayTracerApp::createVirtualTextureBuffers()
+{
+    const VkDeviceSize pageTableSize = virtualTextures->data().size() * sizeof(uint32_t);
+    const VkDeviceSize feedbackSize = (1 + VIRTUAL_FEEDBACK_CAPACITY) * sizeof(uint32_t);
+
+    pageTableBuffers.resize(swapChainImages.size());
+    pageTableBuffersMemory.resize(swapChainImages.size());
+    feedbackBuffers.resize(swapChainImages.size());
+    feedbackBuffersMemory.resize(swapChainImages.size());
+    // no image has a page table yet, the first frame of each copies it
+    boundPageTableVersions.assign(swapChainImages.size(), 0);
+
+    for (size_t i = 0; i < swapChainImages.size(); ++i)
+    {
+        createBuffer(pageTableSize, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+                     VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, pageTableBuffers[i],
+                     pageTableBuffersMemory[i]);
+        createBuffer(feedbackSize, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+                     VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, feedbackBuffers[i],
+                     feedbackBuffersMemory[i]);
+
+        void *data;
+        vkMapMemory(device, feedbackBuffersMemory[i], 0, sizeof(uint32_t), 0, &data);
+        *static_cast<uint32_t *>(data) = 0;
+        vkUnmapMemory(device, feedbackBuffersMemory[i]);
+    }
+}
+
+void RayTracerApp::streamVirtualTiles(uint32_t imageIndex)
+{
+    // the last frame of this image is done, the tiles it asked for are complete
+    void *data;
+    vkMapMemory(device, feedbackBuffersMemory[imageIndex], 0, VK_WHOLE_SIZE, 0, &data);
+    uint32_t *feedback = static_cast<uint32_t *>(data);
+    virtualTextures->request(feedback + 1, std::min(feedback[0], VIRTUAL_FEEDBACK_CAPACITY));
+    feedback[0] = 0;
+    vkUnmapMemory(device, feedbackBuffersMemory[imageIndex]);
+
+    // the page table this frame reads
+    if (boundPageTableVersions[imageIndex] != virtualTextures->version())
+    {
+        vkMapMemory(device, pageTableBuffersMemory[imageIndex], 0, VK_WHOLE_SIZE, 0, &data);
+        memcpy(data, virtualTextures->data().data(), virtualTextures->usedWords() * sizeof(uint32_t));
+        vkUnmapMemory(device, pageTableBuffersMemory[imageIndex]);
+        boundPageTableVersions[imageIndex] = virtualTextures->version();
+    }
+
+    // tiles the frames in flight may still read through an older page table are not reused
+    const uint64_t safeVersion = *std::min_element(boundPageTableVersions.begin(), boundPageTableVersions.end());
+    std::vector<TileLoad> loads = virtualTextures->schedule(VIRTUAL_TILE_BUDGET, safeVersion);
+
+    textureStreams.erase(std::remove_if(textureStreams.begin(), textureStreams.end(),
+                                        [](const std::future<void> &stream) {
+                                            return stream.wait_for(std::chrono::seconds(0)) ==
+                                                   std::future_status::ready;
+                                        }),
+                         textureStreams.end());
+    if (loads.empty())
+        return;
+
+    // the tiles are read from the texture caches on the pool and uploaded with the textures
+    textureStreams.push_back(threadPool.submit([this, loads = std::move(loads)]() mutable {
+        VkDeviceSize size = 0;
+        for (const TileLoad &load : loads)
+            size += virtualTileSize(load.format);
+
+        StagedTiles staged;
+        createBuffer(size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+                     VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, staged.stagingBuffer,
+                     staged.stagingBufferMemory);
+        void *data;
+        vkMapMemory(device, staged.stagingBufferMemory, 0, size, 0, &data);
+        uint8_t *out = static_cast<uint8_t *>(data);
+        for (const TileLoad &load : loads)
+        {
+            gatherTile(load.pixels.get(), load.format, load.level, load.tileX, load.tileY, out);
+            out += virtualTileSize(load.format);
+        }
+        vkUnmapMemory(device, staged.stagingBufferMemory);
+        staged.tiles = std::move(loads);
+
+        std::lock_guard<std::mutex> lock(stagedTexturesMutex);
+        stagedTiles.push_back(std::move(staged));
+    }));
+}
+
 VkImageView RayTracerApp::createImageView(VkImage image, VkFormat format, VkImageAspectFlags aspectFlags,
                                           uint32_t mipLevels)
 {
@@ -198,7 +740,9 @@ VkImageView RayTracerApp::createImageView(VkImage image, VkFormat format, VkImag
 
     viewInfo.components.r = VK_COMPONENT_SWIZZLE_IDENTITY;
     viewInfo.components.g = VK_COMPONENT_SWIZZLE_IDENTITY;
-    viewInfo.components.b = VK_COMPONENT_SWIZZLE_IDENTITY;
+    // BC5 keeps x and y of a normal map, blue reads as 1 which is close to z of most texels
+    viewInfo.components.b =
+        format == VK_FORMAT_BC5_UNORM_BLOCK ? VK_COMPONENT_SWIZZLE_ONE : VK_COMPONENT_SWIZZLE_IDENTITY;
     viewInfo.components.a = VK_COMPONENT_SWIZZLE_IDENTITY;
 
     viewInfo.subresourceRange.aspectMask = aspectFlags;
@@ -216,10 +760,6 @@ VkImageView RayTracerApp::createImageView(VkImage image, VkFormat format, VkImag
     return imageView;
 }
 
-void RayTracerApp::createTextureImageView()
-{
-    textureImageView = createImageView(textureImage, VK_FORMAT_R8G8B8A8_SRGB, VK_IMAGE_ASPECT_COLOR_BIT, mipLevels);
-}
 void RayTracerApp::createTextureSampler()
 {
     VkSamplerCreateInfo samplerInfo{};
@@ -238,7 +778,8 @@ void RayTracerApp::createTextureSampler()
     samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR;
     samplerInfo.mipLodBias = 0.0f;
     samplerInfo.minLod = 0.0f;
-    samplerInfo.maxLod = static_cast<float>(mipLevels);
+    // shared by every texture, each has as many levels as its size needs
+    samplerInfo.maxLod = VK_LOD_CLAMP_NONE;
 
     if (vkCreateSampler(device, &samplerInfo, nullptr, &textureSampler) != VK_SUCCESS)
     {
@@ -340,8 +881,11 @@ void RayTracerApp::createDescriptorPool()
     poolSizes[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
     poolSizes[0].descriptorCount = static_cast<uint32_t>(swapChainImages.size());
 
+    // the whole texture array of every set, slots past the scene textures are never written
     poolSizes[1].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-    poolSizes[1].descriptorCount = static_cast<uint32_t>(swapChainImages.size());
+    // and the tile cache of every format
+    poolSizes[1].descriptorCount =
+        static_cast<uint32_t>((MAX_SCENE_TEXTURES + tileCaches.size()) * swapChainImages.size());
 
     poolSizes[2].type = VK_DESCRIPTOR_TYPE_ACCELERATION_STRUCTURE_KHR;
     poolSizes[2].descriptorCount = static_cast<uint32_t>(swapChainImages.size());
@@ -350,9 +894,10 @@ void RayTracerApp::createDescriptorPool()
     poolSizes[3].type = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
     poolSizes[3].descriptorCount = static_cast<uint32_t>(swapChainImages.size());
 
-    // for vertex indices, vertex positions, material indices, and materials
+    // for vertex indices, vertex positions, triangle records, materials, the mesh table, the page
+    // table and the tile feedback
     poolSizes[4].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
-    poolSizes[4].descriptorCount = static_cast<uint32_t>(4 * swapChainImages.size());
+    poolSizes[4].descriptorCount = static_cast<uint32_t>(7 * swapChainImages.size());
 
     VkDescriptorPoolCreateInfo poolInfo{};
     poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
@@ -397,9 +942,27 @@ void RayTracerApp::createDescriptorSets()
         throw std::runtime_error("failed to allocate descriptor sets");
     }
 
+    // every slot starts out as the placeholder, bindUploadedTextures binds the uploaded ones
+    // again with the next frame of each set
+    VkDescriptorImageInfo placeholderInfo{};
+    placeholderInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+    placeholderInfo.imageView = placeholderTexture.view;
+    placeholderInfo.sampler = textureSampler;
+    const std::vector<VkDescriptorImageInfo> textureInfos(textures.size(), placeholderInfo);
+    // formats without a cache are never sampled, they only need a valid descriptor
+    std::array<VkDescriptorImageInfo, 5> tileCacheInfos{};
+    for (size_t c = 0; c < tileCaches.size(); ++c)
+    {
+        const VkImageView view = tileCaches[c].view;
+        tileCacheInfos[c].imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+        tileCacheInfos[c].imageView = view != VK_NULL_HANDLE ? view : placeholderTexture.view;
+        tileCacheInfos[c].sampler = tileSampler;
+    }
+    boundTextureSlots.assign(swapChainImages.size(), 0);
+
     for (size_t i = 0; i < swapChainImages.size(); ++i)
     {
-        std::array<VkWriteDescriptorSet, 8> descriptorWrites{};
+        std::array<VkWriteDescriptorSet, 12> descriptorWrites{};
 
         // uniform
         VkDescriptorBufferInfo bufferInfo{};
@@ -415,19 +978,14 @@ void RayTracerApp::createDescriptorSets()
         descriptorWrites[0].descriptorCount = 1;
         descriptorWrites[0].pBufferInfo = &bufferInfo;
 
-        // sampler
-        VkDescriptorImageInfo imageSamplerInfo{};
-        imageSamplerInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-        imageSamplerInfo.imageView = textureImageView;
-        imageSamplerInfo.sampler = textureSampler;
-
+        // textures
         descriptorWrites[1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
         descriptorWrites[1].dstSet = descriptorSets[i];
         descriptorWrites[1].dstBinding = 1;
         descriptorWrites[1].dstArrayElement = 0;
         descriptorWrites[1].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-        descriptorWrites[1].descriptorCount = 1;
-        descriptorWrites[1].pImageInfo = &imageSamplerInfo;
+        descriptorWrites[1].descriptorCount = static_cast<uint32_t>(textureInfos.size());
+        descriptorWrites[1].pImageInfo = textureInfos.data();
 
         // acceleration structures
         VkWriteDescriptorSetAccelerationStructureKHR descriptorSetAccelerationStructure = {};
@@ -458,9 +1016,9 @@ void RayTracerApp::createDescriptorSets()
 
         // vertex indices
         VkDescriptorBufferInfo vertexIndexBufferInfo = {};
-        vertexIndexBufferInfo.buffer = indexRTDataBuffer;
-        vertexIndexBufferInfo.offset = 0;
-        vertexIndexBufferInfo.range = VK_WHOLE_SIZE;
+        vertexIndexBufferInfo.buffer = geometryBuffer;
+        vertexIndexBufferInfo.offset = geometryLayout.offsets[IndicesSection];
+        vertexIndexBufferInfo.range = geometryLayout.sizes[IndicesSection];
 
         descriptorWrites[4].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
         descriptorWrites[4].dstSet = descriptorSets[i];
@@ -471,10 +1029,12 @@ void RayTracerApp::createDescriptorSets()
         descriptorWrites[4].pBufferInfo = &vertexIndexBufferInfo;
 
         // vertices
+        const GeometrySection shadingVertices =
+            RT_VERTEX_FORMAT == RTVertexFormat::Full ? VerticesSection : ShadingVerticesSection;
         VkDescriptorBufferInfo vertexBufferInfo = {};
-        vertexBufferInfo.buffer = vertexRTDataBuffer;
-        vertexBufferInfo.offset = 0;
-        vertexBufferInfo.range = VK_WHOLE_SIZE;
+        vertexBufferInfo.buffer = geometryBuffer;
+        vertexBufferInfo.offset = geometryLayout.offsets[shadingVertices];
+        vertexBufferInfo.range = geometryLayout.sizes[shadingVertices];
 
         descriptorWrites[5].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
         descriptorWrites[5].dstSet = descriptorSets[i];
@@ -484,11 +1044,11 @@ void RayTracerApp::createDescriptorSets()
         descriptorWrites[5].descriptorCount = 1;
         descriptorWrites[5].pBufferInfo = &vertexBufferInfo;
 
-        // materials indices
-        VkDescriptorBufferInfo materialIndexBufferInfo = {};
-        materialIndexBufferInfo.buffer = materialIndexBuffer;
-        materialIndexBufferInfo.offset = 0;
-        materialIndexBufferInfo.range = VK_WHOLE_SIZE;
+        // triangle records
+        VkDescriptorBufferInfo triangleBufferInfo = {};
+        triangleBufferInfo.buffer = geometryBuffer;
+        triangleBufferInfo.offset = geometryLayout.offsets[TrianglesSection];
+        triangleBufferInfo.range = geometryLayout.sizes[TrianglesSection];
 
         descriptorWrites[6].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
         descriptorWrites[6].dstSet = descriptorSets[i];
@@ -496,7 +1056,7 @@ void RayTracerApp::createDescriptorSets()
         descriptorWrites[6].dstArrayElement = 0;
         descriptorWrites[6].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
         descriptorWrites[6].descriptorCount = 1;
-        descriptorWrites[6].pBufferInfo = &materialIndexBufferInfo;
+        descriptorWrites[6].pBufferInfo = &triangleBufferInfo;
 
         // materials
         VkDescriptorBufferInfo materialBufferInfo = {};
@@ -512,6 +1072,57 @@ void RayTracerApp::createDescriptorSets()
         descriptorWrites[7].descriptorCount = 1;
         descriptorWrites[7].pBufferInfo = &materialBufferInfo;
 
+        // first triangle of every mesh
+        VkDescriptorBufferInfo meshBufferInfo = {};
+        meshBufferInfo.buffer = geometryBuffer;
+        meshBufferInfo.offset = geometryLayout.offsets[MeshesSection];
+        meshBufferInfo.range = geometryLayout.sizes[MeshesSection];
+
+        descriptorWrites[8].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        descriptorWrites[8].dstSet = descriptorSets[i];
+        descriptorWrites[8].dstBinding = 8;
+        descriptorWrites[8].dstArrayElement = 0;
+        descriptorWrites[8].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        descriptorWrites[8].descriptorCount = 1;
+        descriptorWrites[8].pBufferInfo = &meshBufferInfo;
+
+        // page table of the virtual textures
+        VkDescriptorBufferInfo pageTableBufferInfo = {};
+        pageTableBufferInfo.buffer = pageTableBuffers[i];
+        pageTableBufferInfo.offset = 0;
+        pageTableBufferInfo.range = VK_WHOLE_SIZE;
+
+        descriptorWrites[9].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        descriptorWrites[9].dstSet = descriptorSets[i];
+        descriptorWrites[9].dstBinding = 9;
+        descriptorWrites[9].dstArrayElement = 0;
+        descriptorWrites[9].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        descriptorWrites[9].descriptorCount = 1;
+        descriptorWrites[9].pBufferInfo = &pageTableBufferInfo;
+
+        // tiles the frame asked for
+        VkDescriptorBufferInfo feedbackBufferInfo = {};
+        feedbackBufferInfo.buffer = feedbackBuffers[i];
+        feedbackBufferInfo.offset = 0;
+        feedbackBufferInfo.range = VK_WHOLE_SIZE;
+
+        descriptorWrites[10].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        descriptorWrites[10].dstSet = descriptorSets[i];
+        descriptorWrites[10].dstBinding = 10;
+        descriptorWrites[10].dstArrayElement = 0;
+        descriptorWrites[10].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        descriptorWrites[10].descriptorCount = 1;
+        descriptorWrites[10].pBufferInfo = &feedbackBufferInfo;
+
+        // tile caches
+        descriptorWrites[11].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        descriptorWrites[11].dstSet = descriptorSets[i];
+        descriptorWrites[11].dstBinding = 11;
+        descriptorWrites[11].dstArrayElement = 0;
+        descriptorWrites[11].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+        descriptorWrites[11].descriptorCount = static_cast<uint32_t>(tileCacheInfos.size());
+        descriptorWrites[11].pImageInfo = tileCacheInfos.data();
+
         vkUpdateDescriptorSets(device, static_cast<uint32_t>(descriptorWrites.size()), descriptorWrites.data(), 0,
                                nullptr);
     }
@@ -519,7 +1130,7 @@ void RayTracerApp::createDescriptorSets()
 
 void RayTracerApp::createDescriptorSetLayout()
 {
-    std::array<VkDescriptorSetLayoutBinding, 8> bindings;
+    std::array<VkDescriptorSetLayoutBinding, 12> bindings;
 
     // NOTE: more stageFlags may be needed but vertex and fragment shader will be removed, VK_SHADER_STAGE_ALL in two
     // first is only for debug for now
@@ -530,8 +1141,8 @@ void RayTracerApp::createDescriptorSetLayout()
     bindings[0].stageFlags = VK_SHADER_STAGE_ALL | VK_SHADER_STAGE_RAYGEN_BIT_KHR | VK_SHADER_STAGE_CLOSEST_HIT_BIT_KHR;
     bindings[0].pImmutableSamplers = nullptr;
 
-    bindings[1].binding = 1;  // sampler
-    bindings[1].descriptorCount = 1;
+    bindings[1].binding = 1;  // textures, bindless array indexed by material
+    bindings[1].descriptorCount = MAX_SCENE_TEXTURES;
     bindings[1].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
     bindings[1].pImmutableSamplers = nullptr;
     bindings[1].stageFlags = VK_SHADER_STAGE_ALL | VK_SHADER_STAGE_RAYGEN_BIT_KHR | VK_SHADER_STAGE_CLOSEST_HIT_BIT_KHR;
@@ -560,7 +1171,7 @@ void RayTracerApp::createDescriptorSetLayout()
     bindings[5].pImmutableSamplers = nullptr;
     bindings[5].stageFlags = VK_SHADER_STAGE_ALL | VK_SHADER_STAGE_RAYGEN_BIT_KHR | VK_SHADER_STAGE_CLOSEST_HIT_BIT_KHR;
 
-    bindings[6].binding = 6;  // material indices
+    bindings[6].binding = 6;  // triangle records, read for the material by every vertex format
     bindings[6].descriptorCount = 1;
     bindings[6].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
     bindings[6].pImmutableSamplers = nullptr;
@@ -572,8 +1183,45 @@ void RayTracerApp::createDescriptorSetLayout()
     bindings[7].pImmutableSamplers = nullptr;
     bindings[7].stageFlags = VK_SHADER_STAGE_ALL | VK_SHADER_STAGE_CLOSEST_HIT_BIT_KHR;
 
+    bindings[8].binding = 8;  // mesh table
+    bindings[8].descriptorCount = 1;
+    bindings[8].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    bindings[8].pImmutableSamplers = nullptr;
+    bindings[8].stageFlags = VK_SHADER_STAGE_ALL | VK_SHADER_STAGE_CLOSEST_HIT_BIT_KHR;
+
+    bindings[9].binding = 9;  // virtual texture page table
+    bindings[9].descriptorCount = 1;
+    bindings[9].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    bindings[9].pImmutableSamplers = nullptr;
+    bindings[9].stageFlags = VK_SHADER_STAGE_ALL | VK_SHADER_STAGE_CLOSEST_HIT_BIT_KHR;
+
+    bindings[10].binding = 10;  // virtual texture feedback
+    bindings[10].descriptorCount = 1;
+    bindings[10].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    bindings[10].pImmutableSamplers = nullptr;
+    bindings[10].stageFlags = VK_SHADER_STAGE_ALL | VK_SHADER_STAGE_CLOSEST_HIT_BIT_KHR;
+
+    bindings[11].binding = 11;  // tile caches, one per texture format
+    bindings[11].descriptorCount = static_cast<uint32_t>(tileCaches.size());
+    bindings[11].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    bindings[11].pImmutableSamplers = nullptr;
+    bindings[11].stageFlags = VK_SHADER_STAGE_ALL | VK_SHADER_STAGE_CLOSEST_HIT_BIT_KHR;
+
+    // slots of the texture array are only read once they are written and can be written while the
+    // set is in use. A variable count is only allowed on the last binding, so the array keeps its
+    // full size.
+    std::array<VkDescriptorBindingFlags, 12> bindingFlags{};
+    bindingFlags[1] = VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT | VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT;
+
+    VkDescriptorSetLayoutBindingFlagsCreateInfo bindingFlagsInfo{};
+    bindingFlagsInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO;
+    bindingFlagsInfo.bindingCount = static_cast<uint32_t>(bindingFlags.size());
+    bindingFlagsInfo.pBindingFlags = bindingFlags.data();
+
     VkDescriptorSetLayoutCreateInfo layoutInfo{};
     layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    layoutInfo.pNext = &bindingFlagsInfo;
+    layoutInfo.flags = VK_DESCRIPTOR_SET_LAYOUT_CREATE_UPDATE_AFTER_BIND_POOL_BIT;
     layoutInfo.bindingCount = static_cast<uint32_t>(bindings.size());
     layoutInfo.pBindings = bindings.data();
 
@@ -585,175 +1233,289 @@ void RayTracerApp::createDescriptorSetLayout()
     }
 }
 
-// geometry layouts
-void RayTracerApp::createIndexBuffer()
+// geometry layouts and TLAS build inputs
+namespace
 {
-    VkDeviceSize bufferSize = sizeof(model.indices[0]) * model.indices.size();
-
-    VkBuffer stagingBuffer;
-    VkDeviceMemory stagingBufferMemory;
-
-    createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-                 VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, stagingBuffer,
-                 stagingBufferMemory);
-
-    void *data;
-    vkMapMemory(device, stagingBufferMemory, 0, bufferSize, 0, &data);
-    memcpy(data, model.indices.data(), (size_t)bufferSize);
-    vkUnmapMemory(device, stagingBufferMemory);
-
-    createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT,
-                 VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, indexBuffer, indexBufferMemory);
-
-    copyBuffer(stagingBuffer, indexBuffer, bufferSize);
-
-    vkDestroyBuffer(device, stagingBuffer, nullptr);
-    vkFreeMemory(device, stagingBufferMemory, nullptr);
+VkDeviceSize alignUp(VkDeviceSize value, VkDeviceSize alignment)
+{
+    return (value + alignment - 1) / alignment * alignment;
 }
 
-void RayTracerApp::createVertexBuffer()
+// instances of the TLAS, read from buffer
+VkAccelerationStructureGeometryKHR tlasGeometry(VkDevice device, VkBuffer buffer)
 {
-    VkDeviceSize bufferSize = sizeof(model.vertices[0]) * model.vertices.size();
+    VkAccelerationStructureGeometryInstancesDataKHR instancesVk{
+        VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_GEOMETRY_INSTANCES_DATA_KHR};
+    instancesVk.arrayOfPointers = VK_FALSE;
 
-    VkBuffer stagingBuffer;
-    VkDeviceMemory stagingBufferMemory;
-    createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-                 VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, stagingBuffer,
-                 stagingBufferMemory);
+    VkBufferDeviceAddressInfo insAddress{VK_STRUCTURE_TYPE_BUFFER_DEVICE_ADDRESS_INFO};
+    insAddress.buffer = buffer;
+    instancesVk.data.deviceAddress = ExtFun::vkGetBufferDeviceAddress(device, &insAddress);
+    VkAccelerationStructureGeometryKHR geometry{VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_GEOMETRY_KHR};
+    geometry.geometryType = VK_GEOMETRY_TYPE_INSTANCES_KHR;
+    geometry.geometry.instances = instancesVk;
+    return geometry;
+}
 
-    void *data;
-    vkMapMemory(device, stagingBufferMemory, 0, bufferSize, 0, &data);
-    memcpy(data, model.vertices.data(), (size_t)bufferSize);
-    // no need to wait for cache flush because
-    // VK_MEMORY_PROPERTY_HOST_COHERENT_BIT was
-    // specified
-    vkUnmapMemory(device, stagingBufferMemory);
+// dstAccelerationStructure, srcAccelerationStructure of updates and scratchData are set by the
+// caller, the TLAS allows updates so level of detail changes only refit it
+VkAccelerationStructureBuildGeometryInfoKHR tlasBuildInfo(const VkAccelerationStructureGeometryKHR &geometry,
+                                                          VkBuildAccelerationStructureModeKHR mode)
+{
+    VkAccelerationStructureBuildGeometryInfoKHR buildInfo{
+        VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_BUILD_GEOMETRY_INFO_KHR};
+    buildInfo.flags = VK_BUILD_ACCELERATION_STRUCTURE_PREFER_FAST_TRACE_BIT_KHR |
+                      VK_BUILD_ACCELERATION_STRUCTURE_ALLOW_UPDATE_BIT_KHR;
+    buildInfo.geometryCount = 1;
+    buildInfo.pGeometries = &geometry;
+    buildInfo.mode = mode;
+    buildInfo.type = VK_ACCELERATION_STRUCTURE_TYPE_TOP_LEVEL_KHR;
+    buildInfo.srcAccelerationStructure = VK_NULL_HANDLE;
+    return buildInfo;
+}
+}  // namespace
+
+// Creates the geometry buffer, the loader streams the final geometry into it with writeGeometry.
+// One buffer created with the union of all usages serves as raster vertex and index input, BLAS
+// build input (the positions are read with a stride through the full vertices) and storage
+// buffer for the closest hit shader, so every vertex and index is stored and transferred once.
+// On unified memory devices the buffer memory is host visible and the loader writes straight
+// into it, otherwise through a staging buffer of at most GEOMETRY_STAGING_SIZE, so the host
+// memory the upload needs does not grow with the scene.
+void RayTracerApp::createGeometryBuffer(size_t vertexCount, size_t indexCount)
+{
+    geometryIndexType = SHORT_INDICES && vertexCount <= 65536 ? VK_INDEX_TYPE_UINT16 : VK_INDEX_TYPE_UINT32;
+    const bool shortIndices = geometryIndexType == VK_INDEX_TYPE_UINT16;
+    const bool shadingVertices = !RT_TRIANGLE_RECORDS && RT_VERTEX_FORMAT != RTVertexFormat::Full;
+
+    std::array<VkDeviceSize, GeometrySectionCount> sizes;
+    sizes[VerticesSection] = sizeof(Vertex) * vertexCount;
+    sizes[IndicesSection] = (shortIndices ? sizeof(uint16_t) : sizeof(uint32_t)) * indexCount;
+    sizes[TrianglesSection] = sizeof(TriangleRecord) * (indexCount / 3);
+    sizes[ShadingVerticesSection] = shadingVertices ? rtVertexStride(RT_VERTEX_FORMAT) * vertexCount : 0;
+    sizes[MeshesSection] = sizeof(uint32_t) * meshes.size();
+    sizes[SphereBoundsSection] = sizeof(VkAabbPositionsKHR);
+
+    // every section is bound as a storage buffer, which has the strictest offset alignment, and
+    // is at least one word long since empty descriptor ranges are not allowed
+    VkPhysicalDeviceProperties deviceProperties;
+    vkGetPhysicalDeviceProperties(physicalDevice, &deviceProperties);
+    const VkDeviceSize sectionAlignment =
+        std::max<VkDeviceSize>(deviceProperties.limits.minStorageBufferOffsetAlignment, 16);
+
+    auto &layout = geometryLayout;
+    layout = {};
+    for (int section = 0; section < GeometrySectionCount; ++section)
+    {
+        layout.offsets[section] = layout.size;
+        layout.sizes[section] = alignUp(std::max<VkDeviceSize>(sizes[section], 4), sizeof(uint32_t));
+        layout.size = alignUp(layout.size + layout.sizes[section], sectionAlignment);
+    }
 
-    // memory transfer is async
-    // but the standard guarantees that it will be
-    // complete by the next call to vkQueueSubmit
-    //
-    createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
-                 VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, vertexBuffer, vertexBufferMemory);
-    copyBuffer(stagingBuffer, vertexBuffer, bufferSize);
+    VkBufferCreateInfo bufferInfo{};
+    bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    bufferInfo.size = layout.size;
+    bufferInfo.usage = VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT |
+                       VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT |
+                       VK_BUFFER_USAGE_ACCELERATION_STRUCTURE_BUILD_INPUT_READ_ONLY_BIT_KHR |
+                       VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+    bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
 
-    vkDestroyBuffer(device, stagingBuffer, nullptr);
-    vkFreeMemory(device, stagingBufferMemory, nullptr);
-}
+    if (vkCreateBuffer(device, &bufferInfo, nullptr, &geometryBuffer) != VK_SUCCESS)
+    {
+        throw std::runtime_error("failed to create geometry buffer!");
+    }
 
-void RayTracerApp::createRTVertexBuffer()
-{
-    VkDeviceSize bufferSize = sizeof(ray_model.vertices[0]) * ray_model.vertices.size();
+    VkMemoryRequirements memRequirements;
+    vkGetBufferMemoryRequirements(device, geometryBuffer, &memRequirements);
 
-    VkBuffer stagingBuffer;
-    VkDeviceMemory stagingBufferMemory;
-    createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-                 VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, stagingBuffer,
-                 stagingBufferMemory, VK_MEMORY_ALLOCATE_DEVICE_ADDRESS_BIT);
+    // on unified memory the buffer can live in host visible memory without any penalty, the
+    // loader only ever writes to it
+    auto &upload = geometryUpload;
+    upload = {};
 
-    void *data;
-    vkMapMemory(device, stagingBufferMemory, 0, bufferSize, 0, &data);
-    memcpy(data, ray_model.vertices.data(), (size_t)bufferSize);
-    // no need to wait for cache flush because
-    // VK_MEMORY_PROPERTY_HOST_COHERENT_BIT was
-    // specified
-    vkUnmapMemory(device, stagingBufferMemory);
+    uint32_t memoryType = 0;
+    if (deviceProperties.deviceType == VK_PHYSICAL_DEVICE_TYPE_INTEGRATED_GPU)
+    {
+        upload.inPlace =
+            tryFindMemoryType(memRequirements.memoryTypeBits,
+                              VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT | VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+                                  VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                              memoryType) ||
+            tryFindMemoryType(memRequirements.memoryTypeBits,
+                              VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, memoryType);
+    }
+    if (!upload.inPlace)
+    {
+        memoryType = findMemoryType(memRequirements.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+    }
 
-    // memory transfer is async
-    // but the standard guarantees that it will be
-    // complete by the next call to vkQueueSubmit
-    //
-    createBuffer(bufferSize,
-                 VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT |
-                     VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT |
-                     VK_BUFFER_USAGE_ACCELERATION_STRUCTURE_BUILD_INPUT_READ_ONLY_BIT_KHR,
-                 VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, vertexRTBuffer, vertexRTBufferMemory,
-                 VK_MEMORY_ALLOCATE_DEVICE_ADDRESS_BIT);
-    copyBuffer(stagingBuffer, vertexRTBuffer, bufferSize);
+    VkMemoryAllocateFlagsInfo allocFlags{};
+    allocFlags.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_FLAGS_INFO;
+    allocFlags.flags = VK_MEMORY_ALLOCATE_DEVICE_ADDRESS_BIT;
 
-    VkBufferDeviceAddressInfo addressInfo{};
-    addressInfo.sType = VK_STRUCTURE_TYPE_BUFFER_DEVICE_ADDRESS_INFO;
-    addressInfo.buffer = vertexRTBuffer;
-    vertexRTBufferAddress = ExtFun::vkGetBufferDeviceAddress(device, &addressInfo);
+    VkMemoryAllocateInfo allocInfo{};
+    allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+    allocInfo.pNext = &allocFlags;
+    allocInfo.allocationSize = memRequirements.size;
+    allocInfo.memoryTypeIndex = memoryType;
 
-    vkDestroyBuffer(device, stagingBuffer, nullptr);
-    vkFreeMemory(device, stagingBufferMemory, nullptr);
-}
+    if (vkAllocateMemory(device, &allocInfo, nullptr, &geometryMemory) != VK_SUCCESS)
+    {
+        throw std::runtime_error("failed to allocate geometry memory!");
+    }
+    vkBindBufferMemory(device, geometryBuffer, geometryMemory, 0);
 
-void RayTracerApp::createRTIndexBuffer()
-{
-    VkDeviceSize bufferSize = sizeof(ray_model.indices[0]) * ray_model.indices.size();
+    if (upload.inPlace)
+    {
+        vkMapMemory(device, geometryMemory, 0, layout.size, 0, reinterpret_cast<void **>(&upload.mapped));
+    }
+    else
+    {
+        // both halves hold a whole number of the largest element
+        upload.halfSize = alignUp(std::min(layout.size, GEOMETRY_STAGING_SIZE) / 2, 64 * sizeof(Vertex));
 
-    VkBuffer stagingBuffer;
-    VkDeviceMemory stagingBufferMemory;
+        VkBufferCreateInfo stagingInfo{};
+        stagingInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+        stagingInfo.size = 2 * upload.halfSize;
+        stagingInfo.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+        stagingInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
 
-    createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-                 VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, stagingBuffer,
-                 stagingBufferMemory, VK_MEMORY_ALLOCATE_DEVICE_ADDRESS_BIT);
+        if (vkCreateBuffer(device, &stagingInfo, nullptr, &upload.stagingBuffer) != VK_SUCCESS)
+        {
+            throw std::runtime_error("failed to create geometry staging buffer!");
+        }
 
-    void *data;
-    vkMapMemory(device, stagingBufferMemory, 0, bufferSize, 0, &data);
-    memcpy(data, ray_model.indices.data(), (size_t)bufferSize);
-    vkUnmapMemory(device, stagingBufferMemory);
+        VkMemoryRequirements stagingRequirements;
+        vkGetBufferMemoryRequirements(device, upload.stagingBuffer, &stagingRequirements);
 
-    createBuffer(
-        bufferSize,
-        VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT |
-            VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_ACCELERATION_STRUCTURE_BUILD_INPUT_READ_ONLY_BIT_KHR |
-            VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
-        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, indexRTBuffer, indexRTBufferMemory, VK_MEMORY_ALLOCATE_DEVICE_ADDRESS_BIT);
+        VkMemoryAllocateInfo stagingAllocInfo{};
+        stagingAllocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+        stagingAllocInfo.allocationSize = stagingRequirements.size;
+        stagingAllocInfo.memoryTypeIndex =
+            findMemoryType(stagingRequirements.memoryTypeBits,
+                           VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
 
-    copyBuffer(stagingBuffer, indexRTBuffer, bufferSize);
+        if (vkAllocateMemory(device, &stagingAllocInfo, nullptr, &upload.stagingBufferMemory) != VK_SUCCESS)
+        {
+            throw std::runtime_error("failed to allocate geometry staging memory!");
+        }
+        vkBindBufferMemory(device, upload.stagingBuffer, upload.stagingBufferMemory, 0);
+        vkMapMemory(device, upload.stagingBufferMemory, 0, stagingInfo.size, 0,
+                    reinterpret_cast<void **>(&upload.mapped));
 
-    VkBufferDeviceAddressInfo addressInfo{};
-    addressInfo.sType = VK_STRUCTURE_TYPE_BUFFER_DEVICE_ADDRESS_INFO;
-    addressInfo.buffer = indexRTBuffer;
-    indexRTBufferAddress = ExtFun::vkGetBufferDeviceAddress(device, &addressInfo);
+        VkFenceCreateInfo fenceInfo{VK_STRUCTURE_TYPE_FENCE_CREATE_INFO};
+        for (VkFence &fence : upload.fences)
+        {
+            if (vkCreateFence(device, &fenceInfo, nullptr, &fence) != VK_SUCCESS)
+            {
+                throw std::runtime_error("failed to create geometry upload fence!");
+            }
+        }
+    }
 
-    vkDestroyBuffer(device, stagingBuffer, nullptr);
-    vkFreeMemory(device, stagingBufferMemory, nullptr);
+    geometry = {};
+    geometry.vertexCount = vertexCount;
+    geometry.indexCount = indexCount;
+    geometry.materialIndexCount = indexCount / 3;
 }
 
-void RayTracerApp::createMaterialsBuffer()
+// count elements of elementSize bytes starting at element firstElement of section. fill(first,
+// last, out) writes the elements [first, last) of the range to out. Through a staging buffer the
+// range is cut into windows of one staging half, the copy of a window runs while the next one is
+// filled.
+void RayTracerApp::writeGeometry(GeometrySection section, size_t firstElement, size_t count, size_t elementSize,
+                                 const std::function<void(size_t, size_t, uint8_t *)> &fill)
 {
-    {
-        VkDeviceSize materialIndexBufferSize = sizeof(model.materials_indices[0]) * model.materials_indices.size();
+    auto &upload = geometryUpload;
+    const VkDeviceSize offset = geometryLayout.offsets[section] + firstElement * elementSize;
+    if (count == 0)
+        return;
 
-        VkBuffer materialIndexStagingBuffer;
-        VkDeviceMemory materialIndexStagingBufferMemory;
+    if (upload.inPlace)
+    {
+        fill(0, count, upload.mapped + offset);
+        upload.streamedBytes += count * elementSize;
+        return;
+    }
 
-        createBuffer(materialIndexBufferSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-                     VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-                     materialIndexStagingBuffer, materialIndexStagingBufferMemory);
+    const size_t windowElements = std::max<size_t>(1, upload.halfSize / elementSize);
+    for (size_t first = 0; first < count; first += windowElements)
+    {
+        const size_t last = std::min(count, first + windowElements);
+        const uint32_t half = upload.nextHalf;
+        upload.nextHalf ^= 1;
+
+        waitGeometryHalf(half);
+        uint8_t *window = upload.mapped + half * upload.halfSize;
+        fill(first, last, window);
+
+        VkCommandBuffer commandBuffer = beginSingleTimeCommands(graphicsCommandPool);
+        VkBufferCopy copyRegion{};
+        copyRegion.srcOffset = half * upload.halfSize;
+        copyRegion.dstOffset = offset + first * elementSize;
+        copyRegion.size = (last - first) * elementSize;
+        vkCmdCopyBuffer(commandBuffer, upload.stagingBuffer, geometryBuffer, 1, &copyRegion);
+        vkEndCommandBuffer(commandBuffer);
 
-        void *data;
-        vkMapMemory(device, materialIndexStagingBufferMemory, 0, materialIndexBufferSize, 0, &data);
-        memcpy(data, model.materials_indices.data(), (size_t)materialIndexBufferSize);
-        vkUnmapMemory(device, materialIndexStagingBufferMemory);
+        VkSubmitInfo submitInfo{VK_STRUCTURE_TYPE_SUBMIT_INFO};
+        submitInfo.commandBufferCount = 1;
+        submitInfo.pCommandBuffers = &commandBuffer;
+        if (vkQueueSubmit(graphicsQueue, 1, &submitInfo, upload.fences[half]) != VK_SUCCESS)
+        {
+            throw std::runtime_error("failed to submit geometry copy");
+        }
+        upload.commandBuffers[half] = commandBuffer;
+        upload.streamedBytes += copyRegion.size;
+    }
+}
 
-        createBuffer(materialIndexBufferSize,
-                     VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT |
-                         VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT,
-                     VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, materialIndexBuffer, materialIndexBufferMemory,
-                     VK_MEMORY_ALLOCATE_DEVICE_ADDRESS_BIT);
+void RayTracerApp::waitGeometryHalf(uint32_t half)
+{
+    auto &upload = geometryUpload;
+    if (upload.commandBuffers[half] == VK_NULL_HANDLE)
+        return;
+
+    vkWaitForFences(device, 1, &upload.fences[half], VK_TRUE, UINT64_MAX);
+    vkResetFences(device, 1, &upload.fences[half]);
+    vkFreeCommandBuffers(device, graphicsCommandPool, 1, &upload.commandBuffers[half]);
+    upload.commandBuffers[half] = VK_NULL_HANDLE;
+}
 
-        copyBuffer(materialIndexStagingBuffer, materialIndexBuffer, materialIndexBufferSize);
+void RayTracerApp::finishGeometryUpload()
+{
+    auto &upload = geometryUpload;
 
-        vkDestroyBuffer(device, materialIndexStagingBuffer, nullptr);
-        vkFreeMemory(device, materialIndexStagingBufferMemory, nullptr);
+    if (upload.inPlace)
+    {
+        // coherent memory, the writes are visible to the device with the next submit
+        vkUnmapMemory(device, geometryMemory);
     }
-
+    else
     {
-        VkDeviceSize materialBufferSize = sizeof(Material) * model.materials.size();
+        // the copies are done once both halves are free again
+        waitGeometryHalf(0);
+        waitGeometryHalf(1);
+        for (VkFence fence : upload.fences)
+            vkDestroyFence(device, fence, nullptr);
+
+        vkUnmapMemory(device, upload.stagingBufferMemory);
+        vkDestroyBuffer(device, upload.stagingBuffer, nullptr);
+        vkFreeMemory(device, upload.stagingBufferMemory, nullptr);
+    }
+    upload = {};
 
-        std::vector<Material> materials(model.materials.size());
-        for (int i = 0; i < model.materials.size(); i++)
-        {
-            memcpy(materials[i].ambient, model.materials[i].ambient, sizeof(float) * 3);
-            memcpy(materials[i].diffuse, model.materials[i].diffuse, sizeof(float) * 3);
-            memcpy(materials[i].specular, model.materials[i].specular, sizeof(float) * 3);
-            memcpy(materials[i].emission, model.materials[i].emission, sizeof(float) * 3);
-        }
+    VkBufferDeviceAddressInfo addressInfo{};
+    addressInfo.sType = VK_STRUCTURE_TYPE_BUFFER_DEVICE_ADDRESS_INFO;
+    addressInfo.buffer = geometryBuffer;
+    geometryBufferAddress = ExtFun::vkGetBufferDeviceAddress(device, &addressInfo);
+}
+
+void RayTracerApp::createMaterialsBuffer()
+{
+    {
+        const std::vector<PackedMaterial> &materials = materialTable.materials;
+        VkDeviceSize materialBufferSize = sizeof(PackedMaterial) * materials.size();
 
         VkBuffer materialStagingBuffer;
         VkDeviceMemory materialStagingBufferMemory;
@@ -780,64 +1542,119 @@ void RayTracerApp::createMaterialsBuffer()
     }
 }
 
+// Builds one BLAS per scene mesh with a single command. The generated shapes are unit sized and
+// shared by all of their instances, so adding shapes only adds TLAS instances. All BLASes live in
+// one buffer and are built with one scratch buffer, both cut at the alignments the device needs.
 void RayTracerApp::createRT_BLAS()
 {
-    VkAccelerationStructureGeometryTrianglesDataKHR triangles{
-        VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_GEOMETRY_TRIANGLES_DATA_KHR};
-    triangles.vertexFormat = VK_FORMAT_R32G32B32_SFLOAT;
-    triangles.vertexData.deviceAddress = vertexRTBufferAddress;
-    triangles.vertexStride = 3 * sizeof(float);
-    triangles.indexType = VK_INDEX_TYPE_UINT32;
-    triangles.indexData.deviceAddress = indexRTBufferAddress;
-    triangles.maxVertex = uint32_t(ray_model.vertices.size() - 1);
-    triangles.transformData = {0};  // NO TRANSFORM
-
-    VkAccelerationStructureGeometryKHR geometry{VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_GEOMETRY_KHR};
-    geometry.geometryType = VK_GEOMETRY_TYPE_TRIANGLES_KHR;
-    geometry.geometry.triangles = triangles;
-    geometry.flags = VK_GEOMETRY_OPAQUE_BIT_KHR;  // turn off any hit shaders
+    VkPhysicalDeviceAccelerationStructurePropertiesKHR asProperties{
+        VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_ACCELERATION_STRUCTURE_PROPERTIES_KHR};
+    VkPhysicalDeviceProperties2 deviceProperties{VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2};
+    deviceProperties.pNext = &asProperties;
+    vkGetPhysicalDeviceProperties2(physicalDevice, &deviceProperties);
+    // acceleration structure offsets have to be multiples of 256
+    constexpr VkDeviceSize blasAlignment = 256;
+    const VkDeviceSize scratchAlignment =
+        std::max<VkDeviceSize>(asProperties.minAccelerationStructureScratchOffsetAlignment, 1);
+
+    const VkDeviceSize indexSize = geometryIndexType == VK_INDEX_TYPE_UINT16 ? sizeof(uint16_t) : sizeof(uint32_t);
+
+    const size_t meshCount = meshes.size();
+    std::vector<VkAccelerationStructureGeometryKHR> geometries(meshCount);
+    std::vector<VkAccelerationStructureBuildRangeInfoKHR> rangeInfos(meshCount);
+    std::vector<VkAccelerationStructureBuildGeometryInfoKHR> buildInfos(meshCount);
+    std::vector<VkAccelerationStructureBuildSizesInfoKHR> sizeInfos(meshCount);
+    std::vector<VkDeviceSize> blasOffsets(meshCount);
+    std::vector<VkDeviceSize> scratchOffsets(meshCount);
+    // the builds are submitted in batches whose scratch memory fits into BLAS_SCRATCH_BUDGET, a
+    // batch that is larger on its own gets a batch of its own. Every batch starts with the index
+    // of its first mesh, the scratch buffer is reused by all of them.
+    std::vector<size_t> batches;
+    VkDeviceSize blasSize = 0;
+    VkDeviceSize batchScratchSize = 0;
+    VkDeviceSize scratchSize = 0;
+    uint32_t triangleCount = 0;
+
+    for (size_t mesh = 0; mesh < meshCount; ++mesh)
+    {
+        const MeshRange &range = meshes[mesh];
 
-    VkAccelerationStructureBuildRangeInfoKHR rangeInfo;
-    rangeInfo.firstVertex = 0;
-    rangeInfo.primitiveCount = static_cast<uint32_t>(ray_model.indices.size() / 3);
-    rangeInfo.primitiveOffset = 0;
-    rangeInfo.transformOffset = 0;
+        geometries[mesh].sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_GEOMETRY_KHR;
+        geometries[mesh].flags = VK_GEOMETRY_OPAQUE_BIT_KHR;  // turn off any hit shaders
+        rangeInfos[mesh].firstVertex = 0;
+        rangeInfos[mesh].transformOffset = 0;
 
-    // check worst case memory need
-    VkAccelerationStructureBuildGeometryInfoKHR buildInfo{
-        VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_BUILD_GEOMETRY_INFO_KHR};
-    buildInfo.flags = VK_BUILD_ACCELERATION_STRUCTURE_PREFER_FAST_TRACE_BIT_KHR;
-    buildInfo.geometryCount = 1;
-    buildInfo.pGeometries = &geometry;
-    buildInfo.mode = VK_BUILD_ACCELERATION_STRUCTURE_MODE_BUILD_KHR;
-    buildInfo.type = VK_ACCELERATION_STRUCTURE_TYPE_BOTTOM_LEVEL_KHR;
-    buildInfo.srcAccelerationStructure = VK_NULL_HANDLE;
-    // dstaccelerationStructure and scratchData will be set once created
-
-    VkAccelerationStructureBuildSizesInfoKHR sizeInfo{VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_BUILD_SIZES_INFO_KHR};
+        if (mesh == SphereMesh)
+        {
+            // a single box, the intersection shader finds the sphere inside
+            VkAccelerationStructureGeometryAabbsDataKHR aabbs{
+                VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_GEOMETRY_AABBS_DATA_KHR};
+            aabbs.data.deviceAddress = geometryBufferAddress + geometryLayout.offsets[SphereBoundsSection];
+            aabbs.stride = sizeof(VkAabbPositionsKHR);
+
+            geometries[mesh].geometryType = VK_GEOMETRY_TYPE_AABBS_KHR;
+            geometries[mesh].geometry.aabbs = aabbs;
+            rangeInfos[mesh].primitiveCount = 1;
+            rangeInfos[mesh].primitiveOffset = 0;
+        }
+        else
+        {
+            VkAccelerationStructureGeometryTrianglesDataKHR triangles{
+                VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_GEOMETRY_TRIANGLES_DATA_KHR};
+            triangles.vertexFormat = VK_FORMAT_R32G32B32_SFLOAT;
+            // the positions are the first member of every vertex, the indices of every mesh point
+            // into the whole vertex section
+            triangles.vertexData.deviceAddress = geometryBufferAddress + geometryLayout.offsets[VerticesSection];
+            triangles.vertexStride = sizeof(Vertex);
+            triangles.indexType = geometryIndexType;
+            triangles.indexData.deviceAddress = geometryBufferAddress + geometryLayout.offsets[IndicesSection];
+            triangles.maxVertex = range.firstVertex + range.vertexCount - 1;
+            triangles.transformData = {0};  // NO TRANSFORM
+
+            geometries[mesh].geometryType = VK_GEOMETRY_TYPE_TRIANGLES_KHR;
+            geometries[mesh].geometry.triangles = triangles;
+            rangeInfos[mesh].primitiveCount = range.indexCount / 3;
+            rangeInfos[mesh].primitiveOffset = static_cast<uint32_t>(range.firstIndex * indexSize);
+            triangleCount += rangeInfos[mesh].primitiveCount;
+        }
 
-    ExtFun::vkGetAccelerationStructureBuildSizesKHR(device, VK_ACCELERATION_STRUCTURE_BUILD_TYPE_DEVICE_KHR, &buildInfo,
-                                                    &rangeInfo.primitiveCount, &sizeInfo);
+        // check worst case memory need
+        auto &buildInfo = buildInfos[mesh];
+        buildInfo.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_BUILD_GEOMETRY_INFO_KHR;
+        buildInfo.flags = VK_BUILD_ACCELERATION_STRUCTURE_PREFER_FAST_TRACE_BIT_KHR;
+        buildInfo.geometryCount = 1;
+        buildInfo.pGeometries = &geometries[mesh];
+        buildInfo.mode = VK_BUILD_ACCELERATION_STRUCTURE_MODE_BUILD_KHR;
+        buildInfo.type = VK_ACCELERATION_STRUCTURE_TYPE_BOTTOM_LEVEL_KHR;
+        buildInfo.srcAccelerationStructure = VK_NULL_HANDLE;
+        // dstaccelerationStructure and scratchData will be set once created
+
+        sizeInfos[mesh].sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_BUILD_SIZES_INFO_KHR;
+        ExtFun::vkGetAccelerationStructureBuildSizesKHR(device, VK_ACCELERATION_STRUCTURE_BUILD_TYPE_DEVICE_KHR,
+                                                        &buildInfo, &rangeInfos[mesh].primitiveCount,
+                                                        &sizeInfos[mesh]);
+
+        blasOffsets[mesh] = alignUp(blasSize, blasAlignment);
+        blasSize = blasOffsets[mesh] + sizeInfos[mesh].accelerationStructureSize;
+        scratchOffsets[mesh] = alignUp(batchScratchSize, scratchAlignment);
+        if (batches.empty() || scratchOffsets[mesh] + sizeInfos[mesh].buildScratchSize > BLAS_SCRATCH_BUDGET)
+        {
+            batches.push_back(mesh);
+            scratchOffsets[mesh] = 0;
+        }
+        batchScratchSize = scratchOffsets[mesh] + sizeInfos[mesh].buildScratchSize;
+        scratchSize = std::max(scratchSize, batchScratchSize);
+    }
+    batches.push_back(meshCount);
 
-    createBuffer(sizeInfo.accelerationStructureSize,
+    createBuffer(blasSize,
                  VK_BUFFER_USAGE_ACCELERATION_STRUCTURE_STORAGE_BIT_KHR | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT |
                      VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
                  VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, blasBuffer, blasBufferMemory,
                  VK_MEMORY_ALLOCATE_DEVICE_ADDRESS_BIT);
 
-    VkAccelerationStructureCreateInfoKHR createInfo{VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_CREATE_INFO_KHR};
-    createInfo.type = buildInfo.type;
-    createInfo.size = sizeInfo.accelerationStructureSize;
-    createInfo.buffer = blasBuffer;
-    createInfo.offset = 0;
-    if (ExtFun::vkCreateAccelerationStructureKHR(device, &createInfo, nullptr, &blas) != VK_SUCCESS)
-    {
-        throw std::runtime_error("failed to create acceleration structure");
-    }
-
-    buildInfo.dstAccelerationStructure = blas;
-
-    createBuffer(sizeInfo.buildScratchSize,
+    // the scratch buffer base has to be aligned too, it is over allocated to align it by hand
+    createBuffer(scratchSize + scratchAlignment,
                  VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
                  VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, blasScratchBuffer, blasScratchBufferMemory,
                  VK_MEMORY_ALLOCATE_DEVICE_ADDRESS_BIT);
@@ -845,80 +1662,106 @@ void RayTracerApp::createRT_BLAS()
     VkBufferDeviceAddressInfo addressInfo{};
     addressInfo.sType = VK_STRUCTURE_TYPE_BUFFER_DEVICE_ADDRESS_INFO;
     addressInfo.buffer = blasScratchBuffer;
-    VkDeviceAddress scratchAddress = ExtFun::vkGetBufferDeviceAddress(device, &addressInfo);
+    const VkDeviceAddress scratchAddress =
+        alignUp(ExtFun::vkGetBufferDeviceAddress(device, &addressInfo), scratchAlignment);
 
-    buildInfo.scratchData.deviceAddress = scratchAddress;
+    blases.assign(meshCount, VK_NULL_HANDLE);
+    std::vector<VkAccelerationStructureBuildRangeInfoKHR *> pRangeInfos(meshCount);
+    for (size_t mesh = 0; mesh < meshCount; ++mesh)
+    {
+        VkAccelerationStructureCreateInfoKHR createInfo{VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_CREATE_INFO_KHR};
+        createInfo.type = VK_ACCELERATION_STRUCTURE_TYPE_BOTTOM_LEVEL_KHR;
+        createInfo.size = sizeInfos[mesh].accelerationStructureSize;
+        createInfo.buffer = blasBuffer;
+        createInfo.offset = blasOffsets[mesh];
+        if (ExtFun::vkCreateAccelerationStructureKHR(device, &createInfo, nullptr, &blases[mesh]) != VK_SUCCESS)
+        {
+            throw std::runtime_error("failed to create acceleration structure");
+        }
 
-    VkCommandBuffer acc_buffer = beginSingleTimeCommands(computeCommandPool);
-    VkAccelerationStructureBuildRangeInfoKHR *pRangeInfo = &rangeInfo;
-    ExtFun::vkCmdBuildAccelerationStructuresKHR(device,        // for our wrapper only
-                                                acc_buffer,    // command buffer
-                                                1,             // number of acc structures
-                                                &buildInfo,    // array of BuildGeometryInfoKHR
-                                                &pRangeInfo);  // arr of RangeInfoKHR objects
-    endSingleTimeCommands(computeCommandPool, acc_buffer, computeQueue);
-}
-void RayTracerApp::createRT_TLAS()
-{
-    VkAccelerationStructureDeviceAddressInfoKHR addressInfo{
-        VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_DEVICE_ADDRESS_INFO_KHR};
-    addressInfo.accelerationStructure = blas;
-    VkDeviceAddress blasAddress{ExtFun::vkGetAccelerationStructureDeviceAddressKHR(device, &addressInfo)};
-    VkAccelerationStructureInstanceKHR instance{};
-    // 135 degree rotation around the y axis
-    const float rcpSqrt2 = sqrtf(0.5f);
-    instance.transform.matrix[0][0] = -rcpSqrt2;
-    instance.transform.matrix[0][2] = rcpSqrt2;
-    instance.transform.matrix[1][1] = 1.0f;
-    instance.transform.matrix[2][0] = -rcpSqrt2;
-    instance.transform.matrix[2][2] = -rcpSqrt2;
-
-    instance.instanceCustomIndex = 0;                     // arbitrary field that shaders can access
-    instance.mask = 0xFF;                                 // ray can intersect an instance only if the bitwise and of
-                                                          // this mask and ray's mask is nonzero
-    instance.instanceShaderBindingTableRecordOffset = 0;  // aplied when looking for shaders
-                                                          // in the table
-    instance.flags = VK_GEOMETRY_INSTANCE_TRIANGLE_FACING_CULL_DISABLE_BIT_KHR;
-    instance.accelerationStructureReference = blasAddress;
-
-    createBuffer(sizeof(instance),
-                 VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT |
-                     VK_BUFFER_USAGE_ACCELERATION_STRUCTURE_BUILD_INPUT_READ_ONLY_BIT_KHR,
-                 VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, instancesBuffer, instancesBufferMemory,
-                 VK_MEMORY_ALLOCATE_DEVICE_ADDRESS_BIT);
+        buildInfos[mesh].dstAccelerationStructure = blases[mesh];
+        buildInfos[mesh].scratchData.deviceAddress = scratchAddress + scratchOffsets[mesh];
+        pRangeInfos[mesh] = &rangeInfos[mesh];
+    }
 
-    copyHtoDSync(sizeof(instance), &instance, instancesBuffer, instancesBufferMemory);
+    auto start = std::chrono::high_resolution_clock::now();
 
-    VkAccelerationStructureBuildRangeInfoKHR rangeInfo{};
-    rangeInfo.primitiveOffset = 0;
-    rangeInfo.primitiveCount = 1;  // number of instances
-    rangeInfo.firstVertex = 0;
-    rangeInfo.transformOffset = 0;
+    // the queue is idle after every batch, so the next one can reuse the scratch memory
+    for (size_t batch = 0; batch + 1 < batches.size(); ++batch)
+    {
+        const size_t first = batches[batch];
+        VkCommandBuffer acc_buffer = beginSingleTimeCommands(computeCommandPool);
+        ExtFun::vkCmdBuildAccelerationStructuresKHR(device,                      // for our wrapper only
+                                                    acc_buffer,                  // command buffer
+                                                    batches[batch + 1] - first,  // number of acc structures
+                                                    buildInfos.data() + first,   // array of BuildGeometryInfoKHR
+                                                    pRangeInfos.data() + first);  // arr of RangeInfoKHR objects
+        endSingleTimeCommands(computeCommandPool, acc_buffer, computeQueue);
+    }
 
-    VkAccelerationStructureGeometryInstancesDataKHR instancesVk{
-        VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_GEOMETRY_INSTANCES_DATA_KHR};
-    instancesVk.arrayOfPointers = VK_FALSE;
+    std::cout << "built " << meshCount << " BLASes over " << triangleCount << " triangles and 1 sphere ("
+              << blasSize / 1024 << " KB) in " << batches.size() - 1 << " batches with " << scratchSize / 1024
+              << " KB of scratch memory in "
+              << std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count()
+              << " ms" << (OPTIMIZE_MESH ? " (optimized triangle order)" : " (authored triangle order)") << std::endl;
+}
+void RayTracerApp::createRT_TLAS()
+{
+    blasAddresses.resize(blases.size());
+    for (size_t mesh = 0; mesh < blases.size(); ++mesh)
+    {
+        VkAccelerationStructureDeviceAddressInfoKHR addressInfo{
+            VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_DEVICE_ADDRESS_INFO_KHR};
+        addressInfo.accelerationStructure = blases[mesh];
+        blasAddresses[mesh] = ExtFun::vkGetAccelerationStructureDeviceAddressKHR(device, &addressInfo);
+    }
 
-    VkBufferDeviceAddressInfo insAddress{VK_STRUCTURE_TYPE_BUFFER_DEVICE_ADDRESS_INFO};
-    insAddress.buffer = instancesBuffer;
-    instancesVk.data.deviceAddress = ExtFun::vkGetBufferDeviceAddress(device, &insAddress);
-    VkAccelerationStructureGeometryKHR geometry{VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_GEOMETRY_KHR};
-    geometry.geometryType = VK_GEOMETRY_TYPE_INSTANCES_KHR;
-    geometry.geometry.instances = instancesVk;
+    // every scene instance places all parts of its mesh, at full resolution until the first
+    // frame picks the levels of detail
+    placedInstances.clear();
+    uint32_t slotCount = 0;
+    for (const SceneInstance &sceneInstance : scene.instances())
+    {
+        const auto &placements = meshPlacements[sceneInstance.mesh];
+        for (size_t p = 0; p < placements.size(); ++p)
+        {
+            PlacedInstance placed;
+            placed.transform = sceneInstance.transform * placements[p].transform;
+            placed.materialId = sceneInstance.materialId;
+            placed.sceneMesh = sceneInstance.mesh;
+            placed.placement = static_cast<uint32_t>(p);
+            placed.firstSlot = slotCount;
+            placed.slotCount = placements[p].levels[0].meshCount;
+            placed.level = 0;
+            placedInstances.push_back(placed);
+            slotCount += placed.slotCount;
+        }
+    }
+    tlasInstances.assign(slotCount, {});
+    for (const PlacedInstance &placed : placedInstances)
+        writeInstanceSlots(placed);
+
+    // the host rewrites the instances whenever a level of detail changes, every frame in flight
+    // has a copy of its own so the update of one frame never reads what the next one writes
+    const VkDeviceSize instancesSize =
+        sizeof(VkAccelerationStructureInstanceKHR) * tlasInstances.size() * MAX_FRAMES_IN_FLIGHT;
+    createBuffer(instancesSize,
+                 VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT |
+                     VK_BUFFER_USAGE_ACCELERATION_STRUCTURE_BUILD_INPUT_READ_ONLY_BIT_KHR,
+                 VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, instancesBuffer,
+                 instancesBufferMemory, VK_MEMORY_ALLOCATE_DEVICE_ADDRESS_BIT);
+    vkMapMemory(device, instancesBufferMemory, 0, instancesSize, 0, reinterpret_cast<void **>(&mappedInstances));
+    memcpy(mappedInstances, tlasInstances.data(), sizeof(VkAccelerationStructureInstanceKHR) * tlasInstances.size());
 
-    VkAccelerationStructureBuildGeometryInfoKHR buildInfo{
-        VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_BUILD_GEOMETRY_INFO_KHR};
-    buildInfo.flags = VK_BUILD_ACCELERATION_STRUCTURE_PREFER_FAST_TRACE_BIT_KHR;
-    buildInfo.geometryCount = 1;
-    buildInfo.pGeometries = &geometry;
-    buildInfo.mode = VK_BUILD_ACCELERATION_STRUCTURE_MODE_BUILD_KHR;
-    buildInfo.type = VK_ACCELERATION_STRUCTURE_TYPE_TOP_LEVEL_KHR;
-    buildInfo.srcAccelerationStructure = VK_NULL_HANDLE;
+    VkAccelerationStructureGeometryKHR geometry = tlasGeometry(device, instancesBuffer);
+    VkAccelerationStructureBuildGeometryInfoKHR buildInfo =
+        tlasBuildInfo(geometry, VK_BUILD_ACCELERATION_STRUCTURE_MODE_BUILD_KHR);
 
     // query the worst case size
+    const uint32_t instanceCount = static_cast<uint32_t>(tlasInstances.size());
     VkAccelerationStructureBuildSizesInfoKHR sizeInfo{VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_BUILD_SIZES_INFO_KHR};
     ExtFun::vkGetAccelerationStructureBuildSizesKHR(device, VK_ACCELERATION_STRUCTURE_BUILD_TYPE_DEVICE_KHR, &buildInfo,
-                                                    &rangeInfo.primitiveCount, &sizeInfo);
+                                                    &instanceCount, &sizeInfo);
 
     // allocate a buffer for the acceleration structure
     createBuffer(sizeInfo.accelerationStructureSize,
@@ -939,98 +1782,115 @@ void RayTracerApp::createRT_TLAS()
         throw std::runtime_error("failed to create a TLAS");
     }
 
-    buildInfo.dstAccelerationStructure = tlas;
-    createBuffer(sizeInfo.buildScratchSize,
+    // kept for the updates after level of detail changes
+    createBuffer(std::max(sizeInfo.buildScratchSize, sizeInfo.updateScratchSize),
                  VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
                  VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, tlasScratchBuffer, tlasScratchBufferMemory,
                  VK_MEMORY_ALLOCATE_DEVICE_ADDRESS_BIT);
 
-    VkBufferDeviceAddressInfo scrInfo{VK_STRUCTURE_TYPE_BUFFER_DEVICE_ADDRESS_INFO};
-    scrInfo.buffer = tlasScratchBuffer;
-    buildInfo.scratchData.deviceAddress = ExtFun::vkGetBufferDeviceAddress(device, &scrInfo);
-
-    // create a one-element array of pointers to range info objects
-    VkCommandBuffer acc_buffer = beginSingleTimeCommands(computeCommandPool);
-    VkAccelerationStructureBuildRangeInfoKHR *pRangeInfo = &rangeInfo;
-
-    ExtFun::vkCmdBuildAccelerationStructuresKHR(device,        // for our wrapper only
-                                                acc_buffer,    // command buffer
-                                                1,             // number of acc structures
-                                                &buildInfo,    // array of BuildGeometryInfoKHR
-                                                &pRangeInfo);  // arr of RangeInfoKHR objects
-    endSingleTimeCommands(computeCommandPool, acc_buffer, computeQueue);
+    VkCommandBuffer commandBuffer = beginSingleTimeCommands(computeCommandPool);
+    recordTLASBuild(commandBuffer, VK_BUILD_ACCELERATION_STRUCTURE_MODE_BUILD_KHR, 0);
+    endSingleTimeCommands(computeCommandPool, commandBuffer, computeQueue);
 }
 
-void RayTracerApp::copyHtoDSync(VkDeviceSize bufferSize, void *trData, VkBuffer dBuffer, VkDeviceMemory bufferMemory)
+// fills the slots of a placed instance with the meshes of its current level
+void RayTracerApp::writeInstanceSlots(const PlacedInstance &placed)
 {
-    VkBuffer stagingBuffer;
-    VkDeviceMemory stagingBufferMemory;
-    createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-                 VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, stagingBuffer,
-                 stagingBufferMemory);
+    const MeshPlacement &placement = meshPlacements[placed.sceneMesh][placed.placement];
+    const MeshLevel &level = placement.levels[placed.level];
+    const MeshLevel &full = placement.levels[0];
 
-    void *data;
-    vkMapMemory(device, stagingBufferMemory, 0, bufferSize, 0, &data);
-    memcpy(data, trData, (size_t)bufferSize);
-    vkUnmapMemory(device, stagingBufferMemory);
+    for (uint32_t slot = 0; slot < placed.slotCount; ++slot)
+    {
+        const bool active = slot < level.meshCount;
+        const uint32_t mesh = active ? level.firstMesh + slot : full.firstMesh + slot;
 
-    copyBuffer(stagingBuffer, dBuffer, bufferSize);
+        VkAccelerationStructureInstanceKHR &instance = tlasInstances[placed.firstSlot + slot];
+        instance = {};
 
-    vkDestroyBuffer(device, stagingBuffer, nullptr);
-    vkFreeMemory(device, stagingBufferMemory, nullptr);
+        // glm is column major, the instance transform is a row major 3x4 matrix
+        for (int row = 0; row < 3; ++row)
+        {
+            for (int column = 0; column < 4; ++column)
+                instance.transform.matrix[row][column] = placed.transform[column][row];
+        }
+
+        // arbitrary field that shaders can access, the material in the low and the mesh in
+        // the high bits
+        instance.instanceCustomIndex = (placed.materialId & 0xFF) | (mesh << 8);
+        // ray can intersect an instance only if the bitwise and of this mask and ray's mask is
+        // nonzero, unused slots stay in the TLAS but are never hit
+        instance.mask = active ? 0xFF : 0x00;
+        // aplied when looking for shaders in the table, spheres use the second hit group
+        instance.instanceShaderBindingTableRecordOffset = mesh == SphereMesh ? 1 : 0;
+        instance.flags = VK_GEOMETRY_INSTANCE_TRIANGLE_FACING_CULL_DISABLE_BIT_KHR;
+        instance.accelerationStructureReference = blasAddresses[mesh];
+    }
 }
 
-void RayTracerApp::createRTDataVertexBuffer()
+// Records a build or an in place update of the TLAS from the instances of one frame in flight.
+// The barriers order it after the traces and builds of earlier submits and before the traces
+// that follow it, the host writes of the instances are visible to every later submit.
+void RayTracerApp::recordTLASBuild(VkCommandBuffer commandBuffer, VkBuildAccelerationStructureModeKHR mode,
+                                   uint32_t frame)
 {
-    VkDeviceSize bufferSize = sizeof(model.vertices[0]) * model.vertices.size();
+    VkAccelerationStructureBuildRangeInfoKHR rangeInfo{};
+    rangeInfo.primitiveOffset =
+        static_cast<uint32_t>(sizeof(VkAccelerationStructureInstanceKHR) * tlasInstances.size() * frame);
+    rangeInfo.primitiveCount = static_cast<uint32_t>(tlasInstances.size());  // number of instances
+    rangeInfo.firstVertex = 0;
+    rangeInfo.transformOffset = 0;
 
-    VkBuffer stagingBuffer;
-    VkDeviceMemory stagingBufferMemory;
-    createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-                 VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, stagingBuffer,
-                 stagingBufferMemory);
+    VkAccelerationStructureGeometryKHR geometry = tlasGeometry(device, instancesBuffer);
+    VkAccelerationStructureBuildGeometryInfoKHR buildInfo = tlasBuildInfo(geometry, mode);
+    if (mode == VK_BUILD_ACCELERATION_STRUCTURE_MODE_UPDATE_KHR)
+        buildInfo.srcAccelerationStructure = tlas;
+    buildInfo.dstAccelerationStructure = tlas;
 
-    void *data;
-    vkMapMemory(device, stagingBufferMemory, 0, bufferSize, 0, &data);
-    memcpy(data, model.vertices.data(), (size_t)bufferSize);
-    vkUnmapMemory(device, stagingBufferMemory);
+    VkBufferDeviceAddressInfo scrInfo{VK_STRUCTURE_TYPE_BUFFER_DEVICE_ADDRESS_INFO};
+    scrInfo.buffer = tlasScratchBuffer;
+    buildInfo.scratchData.deviceAddress = ExtFun::vkGetBufferDeviceAddress(device, &scrInfo);
 
-    createBuffer(bufferSize,
-                 VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT |
-                     VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT,
-                 VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, vertexRTDataBuffer, vertexRTDataBufferMemory,
-                 VK_MEMORY_ALLOCATE_DEVICE_ADDRESS_BIT);
-    copyBuffer(stagingBuffer, vertexRTDataBuffer, bufferSize);
+    VkMemoryBarrier barrier{VK_STRUCTURE_TYPE_MEMORY_BARRIER};
+    barrier.srcAccessMask =
+        VK_ACCESS_ACCELERATION_STRUCTURE_READ_BIT_KHR | VK_ACCESS_ACCELERATION_STRUCTURE_WRITE_BIT_KHR;
+    barrier.dstAccessMask =
+        VK_ACCESS_ACCELERATION_STRUCTURE_READ_BIT_KHR | VK_ACCESS_ACCELERATION_STRUCTURE_WRITE_BIT_KHR;
+    vkCmdPipelineBarrier(commandBuffer,
+                         VK_PIPELINE_STAGE_RAY_TRACING_SHADER_BIT_KHR |
+                             VK_PIPELINE_STAGE_ACCELERATION_STRUCTURE_BUILD_BIT_KHR,
+                         VK_PIPELINE_STAGE_ACCELERATION_STRUCTURE_BUILD_BIT_KHR, 0, 1, &barrier, 0, nullptr, 0,
+                         nullptr);
 
-    vkDestroyBuffer(device, stagingBuffer, nullptr);
-    vkFreeMemory(device, stagingBufferMemory, nullptr);
+    // create a one-element array of pointers to range info objects
+    VkAccelerationStructureBuildRangeInfoKHR *pRangeInfo = &rangeInfo;
+
+    ExtFun::vkCmdBuildAccelerationStructuresKHR(device,         // for our wrapper only
+                                                commandBuffer,  // command buffer
+                                                1,              // number of acc structures
+                                                &buildInfo,     // array of BuildGeometryInfoKHR
+                                                &pRangeInfo);   // arr of RangeInfoKHR objects
+
+    barrier.srcAccessMask = VK_ACCESS_ACCELERATION_STRUCTURE_WRITE_BIT_KHR;
+    barrier.dstAccessMask = VK_ACCESS_ACCELERATION_STRUCTURE_READ_BIT_KHR;
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_ACCELERATION_STRUCTURE_BUILD_BIT_KHR,
+                         VK_PIPELINE_STAGE_RAY_TRACING_SHADER_BIT_KHR, 0, 1, &barrier, 0, nullptr, 0, nullptr);
 }
 
-void RayTracerApp::createRTDataIndexBuffer()
+void RayTracerApp::copyHtoDSync(VkDeviceSize bufferSize, void *trData, VkBuffer dBuffer, VkDeviceMemory bufferMemory)
 {
-    VkDeviceSize bufferSize = sizeof(model.indices[0]) * model.indices.size();
-
     VkBuffer stagingBuffer;
     VkDeviceMemory stagingBufferMemory;
-
     createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
                  VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, stagingBuffer,
-                 stagingBufferMemory, VK_MEMORY_ALLOCATE_DEVICE_ADDRESS_BIT);
+                 stagingBufferMemory);
 
     void *data;
     vkMapMemory(device, stagingBufferMemory, 0, bufferSize, 0, &data);
-    memcpy(data, model.indices.data(), (size_t)bufferSize);
+    memcpy(data, trData, (size_t)bufferSize);
     vkUnmapMemory(device, stagingBufferMemory);
 
-    createBuffer(bufferSize,
-                 VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT |
-                     VK_BUFFER_USAGE_INDEX_BUFFER_BIT |
-                     VK_BUFFER_USAGE_ACCELERATION_STRUCTURE_BUILD_INPUT_READ_ONLY_BIT_KHR |
-                     VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
-                 VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, indexRTDataBuffer, indexRTDataBufferMemory,
-                 VK_MEMORY_ALLOCATE_DEVICE_ADDRESS_BIT);
-
-    copyBuffer(stagingBuffer, indexRTDataBuffer, bufferSize);
+    copyBuffer(stagingBuffer, dBuffer, bufferSize);
 
     vkDestroyBuffer(device, stagingBuffer, nullptr);
     vkFreeMemory(device, stagingBufferMemory, nullptr);
@@ -1133,6 +1993,7 @@ void RayTracerApp::recreateSwapChain()
     createDepthResources();
     createFramebuffers();
     createUniformBuffers();
+    createVirtualTextureBuffers();
     createDescriptorPool();
     createDescriptorSets();
     // createCommandBuffers();
@@ -1226,11 +2087,12 @@ void RayTracerApp::createCommandBuffers()
         vkCmdBeginRenderPass(commandBuffers[i], &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
         vkCmdBindPipeline(commandBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, graphicsPipeline);
 
-        VkBuffer vertexBuffers[] = {vertexBuffer};
-        VkDeviceSize offsets[] = {0};
+        VkBuffer vertexBuffers[] = {geometryBuffer};
+        VkDeviceSize offsets[] = {geometryLayout.offsets[VerticesSection]};
         vkCmdBindVertexBuffers(commandBuffers[i], 0, 1, vertexBuffers, offsets);
 
-        vkCmdBindIndexBuffer(commandBuffers[i], indexBuffer, 0, VK_INDEX_TYPE_UINT32);
+        vkCmdBindIndexBuffer(commandBuffers[i], geometryBuffer, geometryLayout.offsets[IndicesSection],
+                             geometryIndexType);
         vkCmdBindDescriptorSets(commandBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 1,
                                 &descriptorSets[i], 0, nullptr);
 
@@ -1239,7 +2101,20 @@ void RayTracerApp::createCommandBuffers()
         // 2. instanceCount
         // 3. firstVertex
         // 4. firstInstance
-        vkCmdDrawIndexed(commandBuffers[i], static_cast<uint32_t>(model.indices.size()), 1, 0, 0, 0);
+        // instances only exist in the TLAS, the raster path draws the full resolution of every
+        // part once untransformed
+        for (const auto &placements : meshPlacements)
+        {
+            for (size_t p = 0; p < placements.size(); ++p)
+            {
+                // copies of a part share their meshes
+                const MeshLevel &full = placements[p].levels[0];
+                if (p > 0 && placements[p - 1].levels[0].firstMesh == full.firstMesh)
+                    continue;
+                for (uint32_t mesh = full.firstMesh; mesh < full.firstMesh + full.meshCount; ++mesh)
+                    vkCmdDrawIndexed(commandBuffers[i], meshes[mesh].indexCount, 1, meshes[mesh].firstIndex, 0, 0);
+            }
+        }
         vkCmdEndRenderPass(commandBuffers[i]);
 
         if (vkEndCommandBuffer(commandBuffers[i]) != VK_SUCCESS)
@@ -1310,7 +2185,6 @@ void RayTracerApp::createRTCommandBuffers()
         commandBufferBeginCreateInfo.pInheritanceInfo = nullptr;
 
         VkDeviceSize progSize = rayTracingProperties.shaderGroupBaseAlignment;
-        VkDeviceSize sbtSize = progSize * (VkDeviceSize)RTShadersCount;
 
         VkBufferDeviceAddressInfo shaderBindingTableBufferDeviceAddressInfo = {};
         shaderBindingTableBufferDeviceAddressInfo.sType = VK_STRUCTURE_TYPE_BUFFER_DEVICE_ADDRESS_INFO;
@@ -1321,18 +2195,19 @@ void RayTracerApp::createRTCommandBuffers()
 
         const VkStridedDeviceAddressRegionKHR rgenShaderBindingTable = {
             .deviceAddress = shaderBindingTableBufferDeviceAddress + 0u * progSize,
-            .stride = sbtSize,
-            .size = sbtSize * 1};
+            .stride = progSize,
+            .size = progSize * 1};
 
         const VkStridedDeviceAddressRegionKHR rmissShaderBindingTable = {
             .deviceAddress = shaderBindingTableBufferDeviceAddress + 1u * progSize,
             .stride = progSize,
-            .size = sbtSize * 1};
+            .size = progSize * 1};
 
+        // triangle and sphere hit groups, picked by the instance record offset
         const VkStridedDeviceAddressRegionKHR rchitShaderBindingTable = {
             .deviceAddress = shaderBindingTableBufferDeviceAddress + 2u * progSize,
             .stride = progSize,
-            .size = sbtSize * 1};
+            .size = progSize * 2};
 
         const VkStridedDeviceAddressRegionKHR callableShaderBindingTable = {};
 
@@ -1716,10 +2591,12 @@ void RayTracerApp::createRTPipeline()
     const std::vector<char> rgenShaderCode = readFile("shaders/raytrace.rgen.spv");
     const std::vector<char> rmissShaderCode = readFile("shaders/raytrace.rmiss.spv");
     const std::vector<char> rchitShaderCode = readFile("shaders/raytrace.rchit.spv");
+    const std::vector<char> rintShaderCode = readFile("shaders/raytrace.rint.spv");
 
     VkShaderModule rgenShaderModule = createShaderModule(rgenShaderCode);
     VkShaderModule rmissShaderModule = createShaderModule(rmissShaderCode);
     VkShaderModule rchitShaderModule = createShaderModule(rchitShaderCode);
+    VkShaderModule rintShaderModule = createShaderModule(rintShaderCode);
 
     VkPipelineShaderStageCreateInfo rgenShaderStageInfo = {};
     rgenShaderStageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
@@ -1739,10 +2616,36 @@ void RayTracerApp::createRTPipeline()
     rchitShaderStageInfo.module = rchitShaderModule;
     rchitShaderStageInfo.pName = "main";
 
-    std::array<VkPipelineShaderStageCreateInfo, 3> shaderStages = {rgenShaderStageInfo, rmissShaderStageInfo,
-                                                                   rchitShaderStageInfo};
+    VkPipelineShaderStageCreateInfo rintShaderStageInfo = {};
+    rintShaderStageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    rintShaderStageInfo.stage = VK_SHADER_STAGE_INTERSECTION_BIT_KHR;
+    rintShaderStageInfo.module = rintShaderModule;
+    rintShaderStageInfo.pName = "main";
+
+    // RT_VERTEX_FORMAT, RT_SHORT_INDICES and RT_TRIANGLE_RECORDS in shaders/vertex_packing.h, the
+    // index type is only known once the model is loaded
+    const std::array<uint32_t, 3> geometryLayout = {static_cast<uint32_t>(RT_VERTEX_FORMAT),
+                                                    geometryIndexType == VK_INDEX_TYPE_UINT16 ? 1u : 0u,
+                                                    RT_TRIANGLE_RECORDS ? 1u : 0u};
+    std::array<VkSpecializationMapEntry, 3> geometryLayoutEntries{};
+    for (uint32_t i = 0; i < geometryLayoutEntries.size(); ++i)
+    {
+        geometryLayoutEntries[i].constantID = i;
+        geometryLayoutEntries[i].offset = i * sizeof(uint32_t);
+        geometryLayoutEntries[i].size = sizeof(uint32_t);
+    }
+
+    VkSpecializationInfo rchitSpecializationInfo{};
+    rchitSpecializationInfo.mapEntryCount = static_cast<uint32_t>(geometryLayoutEntries.size());
+    rchitSpecializationInfo.pMapEntries = geometryLayoutEntries.data();
+    rchitSpecializationInfo.dataSize = sizeof(geometryLayout);
+    rchitSpecializationInfo.pData = geometryLayout.data();
+    rchitShaderStageInfo.pSpecializationInfo = &rchitSpecializationInfo;
+
+    std::array<VkPipelineShaderStageCreateInfo, 4> shaderStages = {rgenShaderStageInfo, rmissShaderStageInfo,
+                                                                   rchitShaderStageInfo, rintShaderStageInfo};
 
-    std::array<VkRayTracingShaderGroupCreateInfoKHR, 3> shaderGroupCreateInfos;
+    std::array<VkRayTracingShaderGroupCreateInfoKHR, RTShadersCount> shaderGroupCreateInfos;
     shaderGroupCreateInfos[0].sType = VK_STRUCTURE_TYPE_RAY_TRACING_SHADER_GROUP_CREATE_INFO_KHR;
     shaderGroupCreateInfos[0].pNext = nullptr;
     shaderGroupCreateInfos[0].type = VK_RAY_TRACING_SHADER_GROUP_TYPE_GENERAL_KHR;
@@ -1765,12 +2668,22 @@ void RayTracerApp::createRTPipeline()
     shaderGroupCreateInfos[2].pNext = nullptr;
     shaderGroupCreateInfos[2].type =
         VK_RAY_TRACING_SHADER_GROUP_TYPE_TRIANGLES_HIT_GROUP_KHR;  // triangles_hit - only in rchit shader
-    shaderGroupCreateInfos[2].generalShader = 2;
-    shaderGroupCreateInfos[2].closestHitShader = VK_SHADER_UNUSED_KHR;
+    shaderGroupCreateInfos[2].generalShader = VK_SHADER_UNUSED_KHR;
+    shaderGroupCreateInfos[2].closestHitShader = 2;
     shaderGroupCreateInfos[2].anyHitShader = VK_SHADER_UNUSED_KHR;
     shaderGroupCreateInfos[2].intersectionShader = VK_SHADER_UNUSED_KHR;
     shaderGroupCreateInfos[2].pShaderGroupCaptureReplayHandle = nullptr;
 
+    // analytic spheres, the same closest hit shader tells them apart by gl_HitKindEXT
+    shaderGroupCreateInfos[3].sType = VK_STRUCTURE_TYPE_RAY_TRACING_SHADER_GROUP_CREATE_INFO_KHR;
+    shaderGroupCreateInfos[3].pNext = nullptr;
+    shaderGroupCreateInfos[3].type = VK_RAY_TRACING_SHADER_GROUP_TYPE_PROCEDURAL_HIT_GROUP_KHR;
+    shaderGroupCreateInfos[3].generalShader = VK_SHADER_UNUSED_KHR;
+    shaderGroupCreateInfos[3].closestHitShader = 2;
+    shaderGroupCreateInfos[3].anyHitShader = VK_SHADER_UNUSED_KHR;
+    shaderGroupCreateInfos[3].intersectionShader = 3;
+    shaderGroupCreateInfos[3].pShaderGroupCaptureReplayHandle = nullptr;
+
     VkPipelineLayoutCreateInfo pipelineLayoutCreateInfo = {};
     pipelineLayoutCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
     pipelineLayoutCreateInfo.setLayoutCount = 1;
@@ -1810,6 +2723,7 @@ void RayTracerApp::createRTPipeline()
     vkDestroyShaderModule(device, rgenShaderModule, nullptr);
     vkDestroyShaderModule(device, rmissShaderModule, nullptr);
     vkDestroyShaderModule(device, rchitShaderModule, nullptr);
+    vkDestroyShaderModule(device, rintShaderModule, nullptr);
 }
 
 void RayTracerApp::createShaderBindingTable()
@@ -1824,16 +2738,18 @@ void RayTracerApp::createShaderBindingTable()
 
     vkGetPhysicalDeviceProperties2(physicalDevice, &properties);
 
-    VkDeviceSize shaderBindingTableSize = rayTracingProperties.shaderGroupHandleSize * RTShadersCount;
+    // every group starts at a multiple of the base alignment
+    VkDeviceSize shaderBindingTableSize = rayTracingProperties.shaderGroupBaseAlignment * RTShadersCount;
+    VkDeviceSize handlesSize = rayTracingProperties.shaderGroupHandleSize * RTShadersCount;
 
     createBuffer(shaderBindingTableSize,
                  VK_BUFFER_USAGE_SHADER_BINDING_TABLE_BIT_KHR | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT,
                  VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT, shaderBindingTableBuffer, shaderBindingTableBufferMemory,
                  VK_MEMORY_ALLOCATE_DEVICE_ADDRESS_BIT);
 
-    std::vector<uint8_t> shaderStorage(shaderBindingTableSize);
-    if (ExtFun::vkGetRayTracingShaderGroupHandlesKHR(device, graphicsPipeline, 0, RTShadersCount,
-                                                     shaderBindingTableSize, shaderStorage.data()) != VK_SUCCESS)
+    std::vector<uint8_t> shaderStorage(handlesSize);
+    if (ExtFun::vkGetRayTracingShaderGroupHandlesKHR(device, graphicsPipeline, 0, RTShadersCount, handlesSize,
+                                                     shaderStorage.data()) != VK_SUCCESS)
     {
         throw std::runtime_error("error creating raytracing shader binding table");
     }
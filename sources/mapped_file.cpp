@@ -0,0 +1,115 @@
+#include "mapped_file.h"
+
+#include <cstring>
+#include <utility>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+MappedFile::~MappedFile()
+{
+    close();
+}
+
+MappedFile::MappedFile(MappedFile &&other) noexcept
+    : mapping(std::exchange(other.mapping, nullptr)), length(std::exchange(other.length, 0))
+{
+}
+
+MappedFile &MappedFile::operator=(MappedFile &&other) noexcept
+{
+    if (this != &other)
+    {
+        close();
+        mapping = std::exchange(other.mapping, nullptr);
+        length = std::exchange(other.length, 0);
+    }
+    return *this;
+}
+
+bool MappedFile::open(const std::string &path)
+{
+    close();
+
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+        return false;
+
+    struct stat info;
+    if (fstat(fd, &info) != 0 || info.st_size == 0)
+    {
+        ::close(fd);
+        return false;
+    }
+
+    void *address = mmap(nullptr, static_cast<size_t>(info.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+    // the mapping keeps its own reference to the file
+    ::close(fd);
+
+    if (address == MAP_FAILED)
+        return false;
+
+    mapping = address;
+    length = static_cast<size_t>(info.st_size);
+    return true;
+}
+
+void MappedFile::close()
+{
+    if (mapping)
+    {
+        munmap(mapping, length);
+        mapping = nullptr;
+        length = 0;
+    }
+}
+
+bool getFileStamp(const std::string &path, FileStamp &stamp)
+{
+    struct stat info;
+    if (stat(path.c_str(), &info) != 0)
+        return false;
+
+    stamp.size = static_cast<uint64_t>(info.st_size);
+    stamp.modified = static_cast<int64_t>(info.st_mtime);
+    return true;
+}
+
+uint64_t hashBytes(const void *data, size_t size, uint64_t seed)
+{
+    // word at a time multiply-xorshift, fast enough to be bound by memory bandwidth
+    constexpr uint64_t prime = 0x9e3779b97f4a7c15ull;
+    const uint8_t *bytes = static_cast<const uint8_t *>(data);
+    uint64_t h = seed ^ (size * prime);
+
+    size_t i = 0;
+    for (; i + 8 <= size; i += 8)
+    {
+        uint64_t word;
+        memcpy(&word, bytes + i, sizeof(word));
+        word *= prime;
+        word ^= word >> 32;
+        h = (h ^ word) * prime;
+    }
+
+    uint64_t tail = 0;
+    memcpy(&tail, bytes + i, size - i);
+    h = (h ^ tail) * prime;
+
+    h ^= h >> 29;
+    h *= 0xbf58476d1ce4e5b9ull;
+    h ^= h >> 32;
+    return h;
+}
+
+bool hashFile(const std::string &path, uint64_t &hash)
+{
+    MappedFile file;
+    if (!file.open(path))
+        return false;
+
+    hash = hashBytes(file.data(), file.size());
+    return true;
+}
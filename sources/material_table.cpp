@@ -0,0 +1,161 @@
+#include "material_table.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <numeric>
+#include <unordered_map>
+
+namespace
+{
+constexpr int mantissaBits = 9;
+constexpr int exponentBias = 15;
+constexpr int maxExponent = 31;
+// largest value with a 9 bit mantissa and the largest exponent
+const float maxRGB9E5 = static_cast<float>((1 << mantissaBits) - 1) / (1 << mantissaBits) *
+                        std::ldexp(1.0f, maxExponent - exponentBias);
+
+uint32_t toUnorm8(float f)
+{
+    return static_cast<uint32_t>(std::lround(std::min(1.0f, std::max(0.0f, f)) * 255.0f));
+}
+
+struct PackedMaterialHash
+{
+    size_t operator()(const PackedMaterial &material) const
+    {
+        size_t seed = material.diffuse;
+        seed = seed * 31 + material.specular;
+        seed = seed * 31 + material.emission;
+        return seed * 31 + material.parameters;
+    }
+};
+
+PackedMaterial packMaterial(const tinyobj::material_t &material, uint32_t texture)
+{
+    const glm::vec3 diffuse(material.diffuse[0], material.diffuse[1], material.diffuse[2]);
+    const glm::vec3 specular(material.specular[0], material.specular[1], material.specular[2]);
+    const glm::vec3 emission(material.emission[0], material.emission[1], material.emission[2]);
+
+    // Blinn-Phong exponent to the roughness of a matching microfacet distribution
+    const bool pbr = material.roughness > 0.0f || material.metallic > 0.0f;
+    const float roughness = pbr ? material.roughness : std::sqrt(2.0f / (std::max(material.shininess, 0.0f) + 2.0f));
+    const float metalness = pbr ? material.metallic : 0.0f;
+
+    uint32_t flags = 0;
+    if (material.illum == 3 || material.illum == 5)
+        flags |= MaterialMirror;
+    if (material.dissolve < 1.0f || material.illum == 4 || material.illum == 6 || material.illum == 7 ||
+        material.illum == 9)
+        flags |= MaterialTransparent;
+    if (emission != glm::vec3(0.0f))
+        flags |= MaterialEmissive;
+
+    PackedMaterial packed;
+    packed.diffuse = packRGB9E5(diffuse);
+    packed.specular = packRGB9E5(specular);
+    packed.emission = packRGB9E5(emission);
+    packed.parameters = toUnorm8(roughness) | (toUnorm8(metalness) << 8) | (texture << 16) | (flags << 28);
+    return packed;
+}
+}  // namespace
+
+uint32_t packRGB9E5(const glm::vec3 &color)
+{
+    // EXT_texture_shared_exponent, the exponent fits the largest channel
+    const float r = std::min(std::max(color.x, 0.0f), maxRGB9E5);
+    const float g = std::min(std::max(color.y, 0.0f), maxRGB9E5);
+    const float b = std::min(std::max(color.z, 0.0f), maxRGB9E5);
+    const float largest = std::max(r, std::max(g, b));
+    if (!(largest > 0.0f))
+        return 0;
+
+    int exponent = std::max(-exponentBias - 1, static_cast<int>(std::floor(std::log2(largest)))) + 1 + exponentBias;
+    float scale = std::ldexp(1.0f, exponent - exponentBias - mantissaBits);
+    if (static_cast<int>(std::floor(largest / scale + 0.5f)) == (1 << mantissaBits))
+    {
+        scale *= 2.0f;
+        ++exponent;
+    }
+
+    const uint32_t mr = static_cast<uint32_t>(std::floor(r / scale + 0.5f));
+    const uint32_t mg = static_cast<uint32_t>(std::floor(g / scale + 0.5f));
+    const uint32_t mb = static_cast<uint32_t>(std::floor(b / scale + 0.5f));
+    return mr | (mg << 9) | (mb << 18) | (static_cast<uint32_t>(exponent) << 27);
+}
+
+glm::vec3 unpackRGB9E5(uint32_t packed)
+{
+    const float scale = std::ldexp(1.0f, static_cast<int>(packed >> 27) - exponentBias - mantissaBits);
+    return glm::vec3(packed & 0x1ffu, (packed >> 9) & 0x1ffu, (packed >> 18) & 0x1ffu) * scale;
+}
+
+MaterialTable buildMaterialTable(const std::vector<tinyobj::material_t> &materials,
+                                 const std::vector<std::string> &textureFolders)
+{
+    auto start = std::chrono::high_resolution_clock::now();
+
+    MaterialTable table;
+    std::unordered_map<std::string, uint32_t> textureIds;
+    std::unordered_map<PackedMaterial, uint32_t, PackedMaterialHash> materialIds;
+    table.remap.reserve(materials.size());
+    for (size_t i = 0; i < materials.size(); ++i)
+    {
+        uint32_t texture = NO_MATERIAL_TEXTURE;
+        if (!materials[i].diffuse_texname.empty())
+        {
+            const std::string path = textureFolders[i] + materials[i].diffuse_texname;
+            const auto found = textureIds.find(path);
+            if (found != textureIds.end())
+            {
+                texture = found->second;
+            }
+            else if (table.textures.size() < NO_MATERIAL_TEXTURE)
+            {
+                texture = static_cast<uint32_t>(table.textures.size());
+                textureIds.emplace(path, texture);
+                table.textures.push_back(path);
+            }
+            else
+            {
+                // textures past the index range are dropped, the material keeps its colour
+                ++table.droppedTextures;
+            }
+        }
+
+        const PackedMaterial packed = packMaterial(materials[i], texture);
+        const auto inserted = materialIds.emplace(packed, static_cast<uint32_t>(table.materials.size()));
+        if (inserted.second)
+            table.materials.push_back(packed);
+        table.remap.push_back(inserted.first->second);
+    }
+
+    if (table.materials.empty())
+    {
+        // white and fully rough, the colour comes from the scene texture
+        table.materials.push_back(
+            {packRGB9E5(glm::vec3(1.0f)), 0, 0, toUnorm8(1.0f) | (NO_MATERIAL_TEXTURE << 16)});
+    }
+
+    table.milliseconds =
+        std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+    return table;
+}
+
+void sortTrianglesByMaterial(std::vector<uint32_t> &indices, std::vector<uint32_t> &materialIndices)
+{
+    std::vector<uint32_t> order(materialIndices.size());
+    std::iota(order.begin(), order.end(), 0u);
+    std::stable_sort(order.begin(), order.end(),
+                     [&](uint32_t a, uint32_t b) { return materialIndices[a] < materialIndices[b]; });
+
+    std::vector<uint32_t> sortedIndices(indices.size());
+    std::vector<uint32_t> sortedMaterials(materialIndices.size());
+    for (size_t t = 0; t < order.size(); ++t)
+    {
+        std::copy_n(indices.begin() + 3 * order[t], 3, sortedIndices.begin() + 3 * t);
+        sortedMaterials[t] = materialIndices[order[t]];
+    }
+    indices.swap(sortedIndices);
+    materialIndices.swap(sortedMaterials);
+}
@@ -0,0 +1,422 @@
+#include "mesh_cache.h"
+
+#include <cstdio>
+#include <stdexcept>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+namespace
+{
+constexpr char cacheMagic[8] = {'R', 'T', 'X', 'M', 'E', 'S', 'H', '\0'};
+constexpr uint32_t cacheVersion = 4;
+constexpr uint64_t sectionAlignment = 16;
+
+struct Section
+{
+    uint64_t offset;
+    uint64_t size;
+};
+
+struct MeshCacheHeader
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t vertexSize;
+    uint64_t optionsHash;
+
+    uint64_t vertexCount;
+    uint64_t indexCount;
+    uint64_t materialIndexCount;
+    uint32_t materialCount;
+    uint32_t sourceCount;
+    uint32_t partCount;
+    uint32_t reserved;
+
+    Section vertices;
+    Section indices;
+    Section materialIndices;
+    Section materials;
+    Section sources;
+    Section parts;
+};
+
+// append only little serializer for the variable sized sections
+class Blob
+{
+public:
+    template <typename T>
+    void put(const T &value)
+    {
+        const uint8_t *bytes = reinterpret_cast<const uint8_t *>(&value);
+        data.insert(data.end(), bytes, bytes + sizeof(T));
+    }
+
+    void put(const std::string &value)
+    {
+        put(static_cast<uint32_t>(value.size()));
+        data.insert(data.end(), value.begin(), value.end());
+    }
+
+    std::vector<uint8_t> data;
+};
+
+class BlobReader
+{
+public:
+    BlobReader(const uint8_t *data, size_t size) : cursor(data), end(data + size) {}
+
+    template <typename T>
+    bool get(T &value)
+    {
+        if (cursor + sizeof(T) > end)
+            return false;
+        memcpy(&value, cursor, sizeof(T));
+        cursor += sizeof(T);
+        return true;
+    }
+
+    bool get(std::string &value)
+    {
+        uint32_t length;
+        if (!get(length) || cursor + length > end)
+            return false;
+        value.assign(reinterpret_cast<const char *>(cursor), length);
+        cursor += length;
+        return true;
+    }
+
+private:
+    const uint8_t *cursor;
+    const uint8_t *end;
+};
+
+void putMaterial(Blob &blob, const tinyobj::material_t &material)
+{
+    blob.put(material.name);
+    for (int i = 0; i < 3; ++i)
+    {
+        blob.put(material.ambient[i]);
+        blob.put(material.diffuse[i]);
+        blob.put(material.specular[i]);
+        blob.put(material.transmittance[i]);
+        blob.put(material.emission[i]);
+    }
+    blob.put(material.shininess);
+    blob.put(material.ior);
+    blob.put(material.dissolve);
+    blob.put(material.illum);
+    blob.put(material.roughness);
+    blob.put(material.metallic);
+    blob.put(material.ambient_texname);
+    blob.put(material.diffuse_texname);
+    blob.put(material.specular_texname);
+    blob.put(material.specular_highlight_texname);
+    blob.put(material.bump_texname);
+    blob.put(material.displacement_texname);
+    blob.put(material.alpha_texname);
+    blob.put(material.normal_texname);
+}
+
+bool getMaterial(BlobReader &reader, tinyobj::material_t &material)
+{
+    bool ok = reader.get(material.name);
+    for (int i = 0; i < 3; ++i)
+    {
+        ok = ok && reader.get(material.ambient[i]);
+        ok = ok && reader.get(material.diffuse[i]);
+        ok = ok && reader.get(material.specular[i]);
+        ok = ok && reader.get(material.transmittance[i]);
+        ok = ok && reader.get(material.emission[i]);
+    }
+    return ok && reader.get(material.shininess) && reader.get(material.ior) && reader.get(material.dissolve) &&
+           reader.get(material.illum) && reader.get(material.roughness) && reader.get(material.metallic) &&
+           reader.get(material.ambient_texname) && reader.get(material.diffuse_texname) &&
+           reader.get(material.specular_texname) && reader.get(material.specular_highlight_texname) &&
+           reader.get(material.bump_texname) && reader.get(material.displacement_texname) &&
+           reader.get(material.alpha_texname) && reader.get(material.normal_texname);
+}
+
+void putPart(Blob &blob, const GeometryPart &part)
+{
+    blob.put(part.firstVertex);
+    blob.put(part.vertexCount);
+    blob.put(part.firstIndex);
+    blob.put(part.indexCount);
+    blob.put(static_cast<uint32_t>(part.transforms.size()));
+    for (const glm::mat4 &transform : part.transforms)
+    {
+        for (int column = 0; column < 4; ++column)
+        {
+            for (int row = 0; row < 4; ++row)
+                blob.put(transform[column][row]);
+        }
+    }
+    blob.put(static_cast<uint32_t>(part.levels.size()));
+    for (const GeometryLevel &level : part.levels)
+    {
+        blob.put(level.firstIndex);
+        blob.put(level.indexCount);
+        blob.put(level.error);
+    }
+    for (int i = 0; i < 4; ++i)
+        blob.put(part.bounds[i]);
+}
+
+bool getPart(BlobReader &reader, GeometryPart &part)
+{
+    uint32_t transformCount;
+    if (!reader.get(part.firstVertex) || !reader.get(part.vertexCount) || !reader.get(part.firstIndex) ||
+        !reader.get(part.indexCount) || !reader.get(transformCount))
+        return false;
+
+    part.transforms.assign(transformCount, glm::mat4(1.0f));
+    for (glm::mat4 &transform : part.transforms)
+    {
+        for (int column = 0; column < 4; ++column)
+        {
+            for (int row = 0; row < 4; ++row)
+            {
+                if (!reader.get(transform[column][row]))
+                    return false;
+            }
+        }
+    }
+
+    uint32_t levelCount;
+    if (!reader.get(levelCount))
+        return false;
+    part.levels.resize(levelCount);
+    for (GeometryLevel &level : part.levels)
+    {
+        if (!reader.get(level.firstIndex) || !reader.get(level.indexCount) || !reader.get(level.error))
+            return false;
+    }
+    for (int i = 0; i < 4; ++i)
+    {
+        if (!reader.get(part.bounds[i]))
+            return false;
+    }
+    return true;
+}
+
+uint64_t alignUp(uint64_t value, uint64_t alignment)
+{
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+bool sectionInFile(const Section &section, size_t fileSize)
+{
+    return section.offset % sectionAlignment == 0 && section.offset <= fileSize &&
+           section.size <= fileSize - section.offset;
+}
+}  // namespace
+
+bool MeshCache::open(const std::string &cachePath, uint64_t optionsHash)
+{
+    close();
+    if (!file.open(cachePath))
+        return false;
+
+    const auto *header = reinterpret_cast<const MeshCacheHeader *>(file.data());
+    bool valid = file.size() >= sizeof(MeshCacheHeader) && memcmp(header->magic, cacheMagic, sizeof(cacheMagic)) == 0 &&
+                 header->version == cacheVersion && header->vertexSize == sizeof(Vertex) &&
+                 header->optionsHash == optionsHash;
+
+    valid = valid && sectionInFile(header->vertices, file.size()) &&
+            header->vertices.size == header->vertexCount * sizeof(Vertex) &&
+            sectionInFile(header->indices, file.size()) &&
+            header->indices.size == header->indexCount * sizeof(uint32_t) &&
+            sectionInFile(header->materialIndices, file.size()) &&
+            header->materialIndices.size == header->materialIndexCount * sizeof(uint32_t) &&
+            sectionInFile(header->materials, file.size()) && sectionInFile(header->sources, file.size()) &&
+            sectionInFile(header->parts, file.size());
+
+    // every source is checked by size and modification time first, the contents
+    // are only hashed again when those differ (e.g. after a fresh checkout)
+    BlobReader sources(file.data() + (valid ? header->sources.offset : 0), valid ? header->sources.size : 0);
+    for (uint32_t i = 0; valid && i < header->sourceCount; ++i)
+    {
+        std::string path;
+        FileStamp cachedStamp;
+        uint64_t cachedHash;
+        valid = sources.get(path) && sources.get(cachedStamp.size) && sources.get(cachedStamp.modified) &&
+                sources.get(cachedHash);
+
+        FileStamp stamp;
+        valid = valid && getFileStamp(path, stamp);
+        if (valid && (stamp.size != cachedStamp.size || stamp.modified != cachedStamp.modified))
+        {
+            uint64_t hash;
+            valid = hashFile(path, hash) && hash == cachedHash;
+        }
+    }
+
+    if (!valid)
+        close();
+    return valid;
+}
+
+void MeshCache::close()
+{
+    file.close();
+}
+
+GeometryView MeshCache::view() const
+{
+    GeometryView view{};
+    if (!file.isOpen())
+        return view;
+
+    const auto *header = reinterpret_cast<const MeshCacheHeader *>(file.data());
+    view.vertices = reinterpret_cast<const Vertex *>(file.data() + header->vertices.offset);
+    view.vertexCount = header->vertexCount;
+    view.indices = reinterpret_cast<const uint32_t *>(file.data() + header->indices.offset);
+    view.indexCount = header->indexCount;
+    view.materialIndices = reinterpret_cast<const uint32_t *>(file.data() + header->materialIndices.offset);
+    view.materialIndexCount = header->materialIndexCount;
+    return view;
+}
+
+std::vector<tinyobj::material_t> MeshCache::materials() const
+{
+    std::vector<tinyobj::material_t> materials;
+    if (!file.isOpen())
+        return materials;
+
+    const auto *header = reinterpret_cast<const MeshCacheHeader *>(file.data());
+    BlobReader reader(file.data() + header->materials.offset, header->materials.size);
+    materials.resize(header->materialCount);
+    for (auto &material : materials)
+    {
+        if (!getMaterial(reader, material))
+            throw std::runtime_error("corrupted material table in mesh cache");
+    }
+    return materials;
+}
+
+std::vector<GeometryPart> MeshCache::parts() const
+{
+    std::vector<GeometryPart> parts;
+    if (!file.isOpen())
+        return parts;
+
+    const auto *header = reinterpret_cast<const MeshCacheHeader *>(file.data());
+    BlobReader reader(file.data() + header->parts.offset, header->parts.size);
+    parts.resize(header->partCount);
+    for (auto &part : parts)
+    {
+        if (!getPart(reader, part) || uint64_t(part.firstVertex) + part.vertexCount > header->vertexCount ||
+            uint64_t(part.firstIndex) + part.indexCount > header->indexCount)
+            throw std::runtime_error("corrupted part table in mesh cache");
+        for (const GeometryLevel &level : part.levels)
+        {
+            if (uint64_t(level.firstIndex) + level.indexCount > header->indexCount)
+                throw std::runtime_error("corrupted part table in mesh cache");
+        }
+    }
+    return parts;
+}
+
+bool MeshCache::write(const std::string &cachePath, uint64_t optionsHash, const std::vector<std::string> &sources,
+                      const GeometryView &geometry, const std::vector<tinyobj::material_t> &materials,
+                      const std::vector<GeometryPart> &parts)
+{
+    Blob materialBlob;
+    for (const auto &material : materials)
+        putMaterial(materialBlob, material);
+
+    Blob partBlob;
+    for (const auto &part : parts)
+        putPart(partBlob, part);
+
+    Blob sourceBlob;
+    for (const auto &path : sources)
+    {
+        FileStamp stamp;
+        uint64_t hash;
+        if (!getFileStamp(path, stamp) || !hashFile(path, hash))
+            return false;
+        sourceBlob.put(path);
+        sourceBlob.put(stamp.size);
+        sourceBlob.put(stamp.modified);
+        sourceBlob.put(hash);
+    }
+
+    MeshCacheHeader header{};
+    memcpy(header.magic, cacheMagic, sizeof(cacheMagic));
+    header.version = cacheVersion;
+    header.vertexSize = sizeof(Vertex);
+    header.optionsHash = optionsHash;
+    header.vertexCount = geometry.vertexCount;
+    header.indexCount = geometry.indexCount;
+    header.materialIndexCount = geometry.materialIndexCount;
+    header.materialCount = static_cast<uint32_t>(materials.size());
+    header.sourceCount = static_cast<uint32_t>(sources.size());
+    header.partCount = static_cast<uint32_t>(parts.size());
+
+    struct Payload
+    {
+        Section *section;
+        const void *data;
+        uint64_t size;
+    };
+    const Payload payloads[] = {
+        {&header.vertices, geometry.vertices, geometry.vertexCount * sizeof(Vertex)},
+        {&header.indices, geometry.indices, geometry.indexCount * sizeof(uint32_t)},
+        {&header.materialIndices, geometry.materialIndices, geometry.materialIndexCount * sizeof(uint32_t)},
+        {&header.materials, materialBlob.data.data(), materialBlob.data.size()},
+        {&header.sources, sourceBlob.data.data(), sourceBlob.data.size()},
+        {&header.parts, partBlob.data.data(), partBlob.data.size()},
+    };
+
+    uint64_t offset = alignUp(sizeof(MeshCacheHeader), sectionAlignment);
+    for (const auto &payload : payloads)
+    {
+        *payload.section = {offset, payload.size};
+        offset = alignUp(offset + payload.size, sectionAlignment);
+    }
+
+    // written to a temporary file first so a crash never leaves a torn cache behind
+    const std::string tempPath = cachePath + ".tmp";
+    {
+        std::ofstream out(tempPath, std::ios::binary | std::ios::trunc);
+        if (!out.is_open())
+            return false;
+
+        const char padding[sectionAlignment] = {};
+        out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+        uint64_t written = sizeof(header);
+        for (const auto &payload : payloads)
+        {
+            out.write(padding, static_cast<std::streamsize>(payload.section->offset - written));
+            if (payload.size > 0)
+                out.write(static_cast<const char *>(payload.data), static_cast<std::streamsize>(payload.size));
+            written = payload.section->offset + payload.size;
+        }
+
+        if (!out.good())
+            return false;
+    }
+
+    return std::rename(tempPath.c_str(), cachePath.c_str()) == 0;
+}
+
+std::vector<std::string> MeshCache::objSources(const std::string &objPath, const std::string &mtlSearchPath)
+{
+    std::vector<std::string> sources = {objPath};
+
+    std::ifstream obj(objPath);
+    std::string line;
+    while (std::getline(obj, line))
+    {
+        if (line.compare(0, 7, "mtllib ") != 0)
+            continue;
+
+        std::string name = line.substr(7);
+        while (!name.empty() && (name.back() == '\r' || name.back() == ' '))
+            name.pop_back();
+        sources.push_back(mtlSearchPath + name);
+    }
+    return sources;
+}
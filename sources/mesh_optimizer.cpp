@@ -0,0 +1,333 @@
+#include "mesh_optimizer.h"
+
+#include <algorithm>
+#include <chrono>
+
+namespace
+{
+constexpr uint32_t unused = UINT32_MAX;
+
+// spreads the lower 10 bits so that there are two zero bits between each of them
+uint32_t expandBits(uint32_t v)
+{
+    v &= 0x3ffu;
+    v = (v | (v << 16)) & 0x030000ffu;
+    v = (v | (v << 8)) & 0x0300f00fu;
+    v = (v | (v << 4)) & 0x030c30c3u;
+    v = (v | (v << 2)) & 0x09249249u;
+    return v;
+}
+
+uint32_t morton(const glm::vec3 &unit)
+{
+    const auto cell = [](float f) { return static_cast<uint32_t>(std::min(1023.0f, std::max(0.0f, f * 1024.0f))); };
+    return (expandBits(cell(unit.x)) << 2) | (expandBits(cell(unit.y)) << 1) | expandBits(cell(unit.z));
+}
+
+// stable LSD radix sort of the keys by the 30 bits above bit 32, the lower half carries the triangle
+void sortByCode(std::vector<uint64_t> &keys)
+{
+    constexpr int digitBits = 11;
+    constexpr uint32_t digitMask = (1u << digitBits) - 1;
+
+    std::vector<uint64_t> scratch(keys.size());
+    std::vector<size_t> offsets(size_t(1) << digitBits);
+    for (int shift = 32; shift < 62; shift += digitBits)
+    {
+        std::fill(offsets.begin(), offsets.end(), 0);
+        for (uint64_t key : keys)
+            ++offsets[(key >> shift) & digitMask];
+
+        size_t sum = 0;
+        for (size_t &offset : offsets)
+        {
+            const size_t count = offset;
+            offset = sum;
+            sum += count;
+        }
+
+        for (uint64_t key : keys)
+            scratch[offsets[(key >> shift) & digitMask]++] = key;
+        keys.swap(scratch);
+    }
+}
+
+// Tipsify (Sander, Nehab and Barczak, "Fast Triangle Reordering for Vertex Locality and Reduced
+// Overdraw") over one cluster of triangles. Fans around the current vertex are emitted, the next
+// vertex is the one that stays longest in a FIFO cache of cacheSize entries. Appends the cluster
+// triangles, as indices into triangles, to order.
+void tipsify(const uint32_t *indices, const uint32_t *triangles, size_t triangleCount, size_t cacheSize,
+             std::vector<uint32_t> &order)
+{
+    // local vertex ids for the cluster
+    std::vector<uint32_t> vertices(3 * triangleCount);
+    for (size_t t = 0; t < triangleCount; ++t)
+    {
+        for (int c = 0; c < 3; ++c)
+            vertices[3 * t + c] = indices[3 * triangles[t] + c];
+    }
+    std::vector<uint32_t> unique = vertices;
+    std::sort(unique.begin(), unique.end());
+    unique.erase(std::unique(unique.begin(), unique.end()), unique.end());
+    for (uint32_t &v : vertices)
+        v = static_cast<uint32_t>(std::lower_bound(unique.begin(), unique.end(), v) - unique.begin());
+
+    // triangles around every vertex
+    const size_t vertexCount = unique.size();
+    std::vector<uint32_t> adjacencyOffsets(vertexCount + 1, 0);
+    for (uint32_t v : vertices)
+        ++adjacencyOffsets[v + 1];
+    for (size_t v = 0; v < vertexCount; ++v)
+        adjacencyOffsets[v + 1] += adjacencyOffsets[v];
+    std::vector<uint32_t> adjacency(vertices.size());
+    std::vector<uint32_t> fill(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+    for (size_t corner = 0; corner < vertices.size(); ++corner)
+        adjacency[fill[vertices[corner]]++] = static_cast<uint32_t>(corner / 3);
+
+    std::vector<uint32_t> live(vertexCount);
+    for (size_t v = 0; v < vertexCount; ++v)
+        live[v] = adjacencyOffsets[v + 1] - adjacencyOffsets[v];
+
+    std::vector<size_t> cacheTime(vertexCount, 0);
+    std::vector<bool> emitted(triangleCount, false);
+    std::vector<uint32_t> deadEnd;
+    std::vector<uint32_t> candidates;
+    size_t time = cacheSize + 1;
+    size_t cursor = 0;
+
+    int64_t fan = 0;
+    while (fan >= 0)
+    {
+        candidates.clear();
+        for (uint32_t a = adjacencyOffsets[fan]; a < adjacencyOffsets[fan + 1]; ++a)
+        {
+            const uint32_t t = adjacency[a];
+            if (emitted[t])
+                continue;
+
+            for (int c = 0; c < 3; ++c)
+            {
+                const uint32_t v = vertices[3 * t + c];
+                deadEnd.push_back(v);
+                candidates.push_back(v);
+                --live[v];
+                if (time - cacheTime[v] > cacheSize)
+                    cacheTime[v] = time++;
+            }
+            emitted[t] = true;
+            order.push_back(triangles[t]);
+        }
+
+        // the candidate that stays in the cache the longest while still having triangles left
+        fan = -1;
+        int64_t best = -1;
+        for (uint32_t v : candidates)
+        {
+            if (live[v] == 0)
+                continue;
+            int64_t priority = 0;
+            if (time - cacheTime[v] + 2 * live[v] <= cacheSize)
+                priority = static_cast<int64_t>(time - cacheTime[v]);
+            if (priority > best)
+            {
+                best = priority;
+                fan = v;
+            }
+        }
+
+        // dead end, go back to a recently used vertex or scan for any vertex with triangles left
+        while (fan < 0 && !deadEnd.empty())
+        {
+            const uint32_t v = deadEnd.back();
+            deadEnd.pop_back();
+            if (live[v] > 0)
+                fan = v;
+        }
+        while (fan < 0 && cursor < vertexCount)
+        {
+            if (live[cursor] > 0)
+                fan = static_cast<int64_t>(cursor);
+            ++cursor;
+        }
+    }
+}
+
+// cache holding the last size entries inserted, an entry is cached if it was inserted less
+// than size insertions ago
+class FifoCache
+{
+public:
+    FifoCache(size_t entries, size_t size) : stamps(entries, 0), capacity(size) {}
+
+    // returns true on a miss
+    bool fetch(size_t entry)
+    {
+        if (stamps[entry] != 0 && time - stamps[entry] < capacity)
+            return false;
+        stamps[entry] = ++time;
+        return true;
+    }
+
+private:
+    std::vector<size_t> stamps;
+    size_t capacity;
+    size_t time = 0;
+};
+}  // namespace
+
+VertexFetchStats analyzeVertexFetch(const uint32_t *indices, size_t indexCount, size_t vertexCount,
+                                    size_t vertexStride)
+{
+    constexpr size_t transformCacheSize = 32;
+    constexpr size_t lineBytes = 64;
+    constexpr size_t lineCacheSize = 4096 / lineBytes;
+
+    VertexFetchStats stats;
+    const size_t triangleCount = indexCount / 3;
+    if (triangleCount == 0)
+        return stats;
+
+    FifoCache transformCache(vertexCount, transformCacheSize);
+    FifoCache lineCache((vertexCount * vertexStride + lineBytes - 1) / lineBytes, lineCacheSize);
+
+    size_t transformed = 0;
+    size_t linesMissed = 0;
+    for (size_t i = 0; i < 3 * triangleCount; ++i)
+    {
+        const size_t vertex = indices[i];
+        transformed += transformCache.fetch(vertex);
+
+        const size_t firstLine = vertex * vertexStride / lineBytes;
+        const size_t lastLine = (vertex * vertexStride + vertexStride - 1) / lineBytes;
+        for (size_t line = firstLine; line <= lastLine; ++line)
+            linesMissed += lineCache.fetch(line);
+    }
+
+    stats.acmr = static_cast<double>(transformed) / triangleCount;
+    stats.linesPerTriangle = static_cast<double>(linesMissed) / triangleCount;
+    return stats;
+}
+
+MeshOptimizeStats optimizeMesh(std::vector<Vertex> &vertices, std::vector<uint32_t> &indices,
+                               std::vector<uint32_t> &triangleData, size_t vertexStride, ThreadPool &pool)
+{
+    auto start = std::chrono::high_resolution_clock::now();
+
+    constexpr size_t grainTriangles = 1 << 16;
+    constexpr size_t clusterTriangles = 4096;
+    constexpr size_t tipsifyCacheSize = 16;
+
+    MeshOptimizeStats stats;
+    stats.before = analyzeVertexFetch(indices.data(), indices.size(), vertices.size(), vertexStride);
+
+    const size_t triangleCount = indices.size() / 3;
+    const bool permuteData = triangleData.size() == triangleCount;
+
+    if (triangleCount > 0)
+    {
+        // centroid bounds per grain, reduced in order afterwards
+        const auto centroid = [&](size_t triangle) {
+            return (vertices[indices[3 * triangle + 0]].pos + vertices[indices[3 * triangle + 1]].pos +
+                    vertices[indices[3 * triangle + 2]].pos) /
+                   3.0f;
+        };
+
+        const size_t grains = (triangleCount + grainTriangles - 1) / grainTriangles;
+        std::vector<glm::vec3> minimums(grains, centroid(0));
+        std::vector<glm::vec3> maximums(grains, centroid(0));
+        pool.parallelFor(0, triangleCount, grainTriangles, [&](size_t first, size_t last) {
+            const size_t grain = first / grainTriangles;
+            for (size_t t = first; t < last; ++t)
+            {
+                const glm::vec3 c = centroid(t);
+                minimums[grain] = glm::min(minimums[grain], c);
+                maximums[grain] = glm::max(maximums[grain], c);
+            }
+        });
+
+        glm::vec3 minimum = minimums[0];
+        glm::vec3 maximum = maximums[0];
+        for (size_t grain = 1; grain < grains; ++grain)
+        {
+            minimum = glm::min(minimum, minimums[grain]);
+            maximum = glm::max(maximum, maximums[grain]);
+        }
+
+        // one scale for all axes keeps the cells cubic
+        const glm::vec3 extent = maximum - minimum;
+        const float largest = std::max(extent.x, std::max(extent.y, extent.z));
+        const float inverseExtent = largest > 0.0f ? 1.0f / largest : 0.0f;
+
+        std::vector<uint64_t> keys(triangleCount);
+        pool.parallelFor(0, triangleCount, grainTriangles, [&](size_t first, size_t last) {
+            for (size_t t = first; t < last; ++t)
+                keys[t] = (static_cast<uint64_t>(morton((centroid(t) - minimum) * inverseExtent)) << 32) | t;
+        });
+
+        sortByCode(keys);
+
+        // the curve keeps clusters compact in space, inside a cluster the triangles are ordered
+        // for vertex reuse
+        std::vector<uint32_t> mortonOrder(triangleCount);
+        for (size_t t = 0; t < triangleCount; ++t)
+            mortonOrder[t] = static_cast<uint32_t>(keys[t]);
+
+        std::vector<uint32_t> order(triangleCount);
+        const size_t clusters = (triangleCount + clusterTriangles - 1) / clusterTriangles;
+        pool.parallelFor(0, clusters, 1, [&](size_t first, size_t last) {
+            std::vector<uint32_t> clusterOrder;
+            for (size_t cluster = first; cluster < last; ++cluster)
+            {
+                const size_t begin = cluster * clusterTriangles;
+                const size_t count = std::min(clusterTriangles, triangleCount - begin);
+                clusterOrder.clear();
+                tipsify(indices.data(), mortonOrder.data() + begin, count, tipsifyCacheSize, clusterOrder);
+                std::copy(clusterOrder.begin(), clusterOrder.end(), order.begin() + begin);
+            }
+        });
+
+        std::vector<uint32_t> sortedIndices(indices.size());
+        std::vector<uint32_t> sortedData(permuteData ? triangleCount : 0);
+        pool.parallelFor(0, triangleCount, grainTriangles, [&](size_t first, size_t last) {
+            for (size_t t = first; t < last; ++t)
+            {
+                const size_t source = order[t];
+                sortedIndices[3 * t + 0] = indices[3 * source + 0];
+                sortedIndices[3 * t + 1] = indices[3 * source + 1];
+                sortedIndices[3 * t + 2] = indices[3 * source + 2];
+                if (permuteData)
+                    sortedData[t] = triangleData[source];
+            }
+        });
+        indices.swap(sortedIndices);
+        if (permuteData)
+            triangleData.swap(sortedData);
+    }
+
+    // first use order, inherently sequential but a single pass over the indices
+    std::vector<uint32_t> remap(vertices.size(), unused);
+    uint32_t nextVertex = 0;
+    for (uint32_t &index : indices)
+    {
+        if (remap[index] == unused)
+            remap[index] = nextVertex++;
+        index = remap[index];
+    }
+
+    std::vector<Vertex> reordered(nextVertex);
+    pool.parallelFor(0, vertices.size(), grainTriangles, [&](size_t first, size_t last) {
+        for (size_t v = first; v < last; ++v)
+        {
+            if (remap[v] != unused)
+                reordered[remap[v]] = vertices[v];
+        }
+    });
+
+    stats.removedVertices = vertices.size() - nextVertex;
+    vertices.swap(reordered);
+
+    stats.after = analyzeVertexFetch(indices.data(), indices.size(), vertices.size(), vertexStride);
+    stats.milliseconds =
+        std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+    return stats;
+}
@@ -0,0 +1,464 @@
+#include "mesh_simplifier.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <numeric>
+#include <unordered_map>
+
+namespace
+{
+// border edges are kept in place by planes through them that are this much stronger than the
+// planes of the triangles
+constexpr double borderWeight = 10.0;
+
+enum VertexKind : uint8_t
+{
+    // one vertex at the position, surrounded by triangles, collapses onto any neighbour
+    Manifold,
+    // one vertex on an open border, collapses along the border
+    Border,
+    // two vertices at the position, split by an attribute seam, collapse along the seam together
+    Seam,
+    Locked,
+};
+
+// plane distances squared, summed with weights and evaluated as weighted mean
+struct Quadric
+{
+    double a00 = 0.0, a01 = 0.0, a02 = 0.0, a11 = 0.0, a12 = 0.0, a22 = 0.0;
+    double b0 = 0.0, b1 = 0.0, b2 = 0.0;
+    double c = 0.0;
+    double weight = 0.0;
+
+    // n has unit length, the plane holds the points p with dot(n, p) + d = 0
+    void addPlane(const glm::vec3 &n, double d, double w)
+    {
+        a00 += w * n.x * n.x;
+        a01 += w * n.x * n.y;
+        a02 += w * n.x * n.z;
+        a11 += w * n.y * n.y;
+        a12 += w * n.y * n.z;
+        a22 += w * n.z * n.z;
+        b0 += w * n.x * d;
+        b1 += w * n.y * d;
+        b2 += w * n.z * d;
+        c += w * d * d;
+        weight += w;
+    }
+
+    void add(const Quadric &q)
+    {
+        a00 += q.a00;
+        a01 += q.a01;
+        a02 += q.a02;
+        a11 += q.a11;
+        a12 += q.a12;
+        a22 += q.a22;
+        b0 += q.b0;
+        b1 += q.b1;
+        b2 += q.b2;
+        c += q.c;
+        weight += q.weight;
+    }
+
+    double error(const glm::vec3 &p) const
+    {
+        const double x = p.x, y = p.y, z = p.z;
+        const double e = a00 * x * x + a11 * y * y + a22 * z * z + 2.0 * (a01 * x * y + a02 * x * z + a12 * y * z) +
+                         2.0 * (b0 * x + b1 * y + b2 * z) + c;
+        return weight > 0.0 ? std::max(e, 0.0) / weight : 0.0;
+    }
+};
+
+struct PositionKey
+{
+    uint32_t bits[3];
+
+    bool operator==(const PositionKey &other) const { return memcmp(bits, other.bits, sizeof(bits)) == 0; }
+};
+
+struct PositionKeyHash
+{
+    size_t operator()(const PositionKey &key) const
+    {
+        return (key.bits[0] * 73856093u) ^ (key.bits[1] * 19349663u) ^ (key.bits[2] * 83492791u);
+    }
+};
+
+struct Collapse
+{
+    uint32_t from;
+    uint32_t to;
+    double cost;
+};
+
+// the first corner of a triangle at the given position, or 3
+int cornerAt(const uint32_t *triangle, const std::vector<uint32_t> &positionOf, uint32_t position)
+{
+    for (int c = 0; c < 3; ++c)
+    {
+        if (positionOf[triangle[c]] == position)
+            return c;
+    }
+    return 3;
+}
+
+glm::vec3 triangleNormal(const glm::vec3 &a, const glm::vec3 &b, const glm::vec3 &c)
+{
+    return glm::cross(b - a, c - a);
+}
+}  // namespace
+
+SimplifiedMesh simplifyMesh(const std::vector<Vertex> &vertices, const std::vector<uint32_t> &indices,
+                            const std::vector<uint32_t> &triangleData, size_t targetIndexCount, float maxError)
+{
+    auto start = std::chrono::high_resolution_clock::now();
+
+    // vertices that only differ in their attributes share a position, the topology is built
+    // over positions
+    const size_t vertexCount = vertices.size();
+    std::vector<uint32_t> positionOf(vertexCount);
+    std::vector<glm::vec3> positions;
+    std::vector<uint32_t> wedgeCounts;
+    {
+        std::unordered_map<PositionKey, uint32_t, PositionKeyHash> ids;
+        ids.reserve(vertexCount);
+        for (size_t v = 0; v < vertexCount; ++v)
+        {
+            PositionKey key;
+            memcpy(key.bits, &vertices[v].pos, sizeof(key.bits));
+            const auto inserted = ids.emplace(key, static_cast<uint32_t>(positions.size()));
+            if (inserted.second)
+            {
+                positions.push_back(vertices[v].pos);
+                wedgeCounts.push_back(0);
+            }
+            positionOf[v] = inserted.first->second;
+        }
+    }
+    const size_t positionCount = positions.size();
+
+    // triangles that are degenerate in position are dropped right away
+    SimplifiedMesh result;
+    std::vector<uint32_t> &triangles = result.indices;
+    std::vector<uint32_t> &data = result.triangleData;
+    triangles.reserve(indices.size());
+    data.reserve(indices.size() / 3);
+    for (size_t t = 0; t < indices.size() / 3; ++t)
+    {
+        const uint32_t *triangle = indices.data() + 3 * t;
+        const uint32_t p0 = positionOf[triangle[0]], p1 = positionOf[triangle[1]], p2 = positionOf[triangle[2]];
+        if (p0 == p1 || p1 == p2 || p2 == p0)
+            continue;
+        triangles.insert(triangles.end(), triangle, triangle + 3);
+        data.push_back(triangleData[t]);
+    }
+
+    // edges between two positions, the corners of the first triangle tell seams apart
+    struct EdgeInfo
+    {
+        uint32_t count = 0;
+        uint32_t wedges[2] = {0, 0};
+        bool seam = false;
+    };
+    std::unordered_map<uint64_t, EdgeInfo> edges;
+    edges.reserve(triangles.size());
+    std::vector<uint8_t> usedWedges(vertexCount, 0);
+    std::vector<Quadric> quadrics(positionCount);
+    for (size_t t = 0; t < triangles.size() / 3; ++t)
+    {
+        const uint32_t *triangle = triangles.data() + 3 * t;
+        const glm::vec3 &a = positions[positionOf[triangle[0]]];
+        const glm::vec3 &b = positions[positionOf[triangle[1]]];
+        const glm::vec3 &c = positions[positionOf[triangle[2]]];
+        const glm::vec3 normal = triangleNormal(a, b, c);
+        const float length = glm::length(normal);
+        if (length > 0.0f)
+        {
+            const glm::vec3 n = normal / length;
+            for (int corner = 0; corner < 3; ++corner)
+                quadrics[positionOf[triangle[corner]]].addPlane(n, -glm::dot(n, a), 0.5 * length);
+        }
+
+        for (int corner = 0; corner < 3; ++corner)
+        {
+            const uint32_t w0 = triangle[corner];
+            const uint32_t w1 = triangle[(corner + 1) % 3];
+            usedWedges[w0] = 1;
+            const bool flipped = positionOf[w0] > positionOf[w1];
+            const uint32_t low = flipped ? w1 : w0;
+            const uint32_t high = flipped ? w0 : w1;
+            EdgeInfo &edge = edges[(uint64_t(positionOf[low]) << 32) | positionOf[high]];
+            if (edge.count == 0)
+            {
+                edge.wedges[0] = low;
+                edge.wedges[1] = high;
+            }
+            else if (edge.wedges[0] != low || edge.wedges[1] != high)
+            {
+                edge.seam = true;
+            }
+            ++edge.count;
+        }
+    }
+    for (size_t v = 0; v < vertexCount; ++v)
+        wedgeCounts[positionOf[v]] += usedWedges[v];
+
+    std::vector<uint8_t> borderEdges(positionCount, 0);
+    std::vector<uint8_t> seamEdges(positionCount, 0);
+    std::vector<uint8_t> kinds(positionCount, Manifold);
+    for (const auto &entry : edges)
+    {
+        const uint32_t p[2] = {static_cast<uint32_t>(entry.first >> 32), static_cast<uint32_t>(entry.first)};
+        const EdgeInfo &edge = entry.second;
+        for (uint32_t position : p)
+        {
+            if (edge.count > 2)
+                kinds[position] = Locked;
+            borderEdges[position] = static_cast<uint8_t>(std::min(borderEdges[position] + (edge.count == 1), 255));
+            seamEdges[position] =
+                static_cast<uint8_t>(std::min(seamEdges[position] + (edge.count == 2 && edge.seam), 255));
+        }
+    }
+    for (size_t p = 0; p < positionCount; ++p)
+    {
+        if (kinds[p] == Locked)
+            continue;
+        if (wedgeCounts[p] == 1 && borderEdges[p] == 0)
+            kinds[p] = Manifold;
+        else if (wedgeCounts[p] == 1 && borderEdges[p] == 2)
+            kinds[p] = Border;
+        else if (wedgeCounts[p] == 2 && borderEdges[p] == 0 && seamEdges[p] == 2)
+            kinds[p] = Seam;
+        else
+            kinds[p] = Locked;
+    }
+
+    // the planes through the border edges keep the outline of open meshes
+    for (size_t t = 0; t < triangles.size() / 3; ++t)
+    {
+        const uint32_t *triangle = triangles.data() + 3 * t;
+        const glm::vec3 normal = triangleNormal(positions[positionOf[triangle[0]]], positions[positionOf[triangle[1]]],
+                                                positions[positionOf[triangle[2]]]);
+        for (int corner = 0; corner < 3; ++corner)
+        {
+            const uint32_t p0 = positionOf[triangle[corner]];
+            const uint32_t p1 = positionOf[triangle[(corner + 1) % 3]];
+            if (edges[(uint64_t(std::min(p0, p1)) << 32) | std::max(p0, p1)].count != 1)
+                continue;
+
+            const glm::vec3 edge = positions[p1] - positions[p0];
+            const glm::vec3 plane = glm::cross(edge, normal);
+            const float length = glm::length(plane);
+            if (length == 0.0f)
+                continue;
+            const glm::vec3 n = plane / length;
+            const double w = borderWeight * glm::dot(edge, edge);
+            quadrics[p0].addPlane(n, -glm::dot(n, positions[p0]), w);
+            quadrics[p1].addPlane(n, -glm::dot(n, positions[p0]), w);
+        }
+    }
+    edges.clear();
+
+    // Collapses run in passes. Every pass ranks all edges, then applies the cheapest valid
+    // collapses whose neighbourhood has not changed in this pass yet, and rebuilds the triangles.
+    const double maxCost = static_cast<double>(maxError) * maxError;
+    double appliedCost = 0.0;
+    std::vector<uint32_t> fanOffsets(positionCount + 1);
+    std::vector<uint32_t> fans;
+    std::vector<Collapse> collapses;
+    std::vector<uint8_t> dirty(positionCount);
+    std::vector<uint32_t> remap(vertexCount);
+    std::vector<std::pair<uint32_t, uint32_t>> wedgeMap;
+    std::vector<uint32_t> fromNeighbours;
+
+    // checks the collapse of from onto to against the current triangles and fills wedgeMap
+    const auto canCollapse = [&](uint32_t from, uint32_t to) {
+        wedgeMap.clear();
+        fromNeighbours.clear();
+        uint32_t shared = 0;
+        for (uint32_t f = fanOffsets[from]; f < fanOffsets[from + 1]; ++f)
+        {
+            const uint32_t *triangle = triangles.data() + 3 * fans[f];
+            const int corner = cornerAt(triangle, positionOf, from);
+            const int target = cornerAt(triangle, positionOf, to);
+            for (int c = 0; c < 3; ++c)
+            {
+                if (c != corner)
+                    fromNeighbours.push_back(positionOf[triangle[c]]);
+            }
+            if (target == 3)
+                continue;
+
+            // every vertex at from has to move onto exactly one vertex at to
+            ++shared;
+            const uint32_t w = triangle[corner];
+            const uint32_t t = triangle[target];
+            const auto found = std::find_if(wedgeMap.begin(), wedgeMap.end(),
+                                            [w](const std::pair<uint32_t, uint32_t> &m) { return m.first == w; });
+            if (found == wedgeMap.end())
+                wedgeMap.push_back({w, t});
+            else if (found->second != t)
+                return false;
+        }
+
+        // borders and seams only collapse along themselves
+        if (kinds[from] == Border && shared != 1)
+            return false;
+        if (kinds[from] == Seam && (shared != 2 || wedgeMap.size() != 2))
+            return false;
+        if (kinds[from] == Manifold && shared != 2)
+            return false;
+
+        // vertices at from that no triangle of the edge maps
+        for (uint32_t f = fanOffsets[from]; f < fanOffsets[from + 1]; ++f)
+        {
+            const uint32_t *triangle = triangles.data() + 3 * fans[f];
+            const uint32_t w = triangle[cornerAt(triangle, positionOf, from)];
+            if (std::find_if(wedgeMap.begin(), wedgeMap.end(), [w](const std::pair<uint32_t, uint32_t> &m) {
+                    return m.first == w;
+                }) == wedgeMap.end())
+                return false;
+        }
+
+        // link condition, the only common neighbours are the tips of the shared triangles,
+        // otherwise the collapse pinches the surface
+        std::sort(fromNeighbours.begin(), fromNeighbours.end());
+        fromNeighbours.erase(std::unique(fromNeighbours.begin(), fromNeighbours.end()), fromNeighbours.end());
+        uint32_t common = 0;
+        for (uint32_t f = fanOffsets[to]; f < fanOffsets[to + 1]; ++f)
+        {
+            const uint32_t *triangle = triangles.data() + 3 * fans[f];
+            for (int c = 0; c < 3; ++c)
+            {
+                const uint32_t p = positionOf[triangle[c]];
+                if (p != to && p != from && std::binary_search(fromNeighbours.begin(), fromNeighbours.end(), p))
+                {
+                    ++common;
+                    // counted once
+                    fromNeighbours.erase(std::lower_bound(fromNeighbours.begin(), fromNeighbours.end(), p));
+                }
+            }
+        }
+        if (common != shared)
+            return false;
+
+        // the triangles that stay must not flip
+        for (uint32_t f = fanOffsets[from]; f < fanOffsets[from + 1]; ++f)
+        {
+            const uint32_t *triangle = triangles.data() + 3 * fans[f];
+            if (cornerAt(triangle, positionOf, to) != 3)
+                continue;
+
+            glm::vec3 corners[3];
+            for (int c = 0; c < 3; ++c)
+                corners[c] = positions[positionOf[triangle[c]]];
+            const glm::vec3 before = triangleNormal(corners[0], corners[1], corners[2]);
+            corners[cornerAt(triangle, positionOf, from)] = positions[to];
+            const glm::vec3 after = triangleNormal(corners[0], corners[1], corners[2]);
+            if (glm::dot(before, after) <= 0.25f * glm::length(before) * glm::length(after))
+                return false;
+        }
+        return true;
+    };
+
+    while (triangles.size() > targetIndexCount)
+    {
+        const size_t triangleCount = triangles.size() / 3;
+
+        std::fill(fanOffsets.begin(), fanOffsets.end(), 0);
+        for (uint32_t w : triangles)
+            ++fanOffsets[positionOf[w] + 1];
+        for (size_t p = 0; p < positionCount; ++p)
+            fanOffsets[p + 1] += fanOffsets[p];
+        fans.resize(triangles.size());
+        {
+            std::vector<uint32_t> cursor(fanOffsets.begin(), fanOffsets.end() - 1);
+            for (size_t t = 0; t < triangleCount; ++t)
+            {
+                for (int c = 0; c < 3; ++c)
+                    fans[cursor[positionOf[triangles[3 * t + c]]]++] = static_cast<uint32_t>(t);
+            }
+        }
+
+        // every edge is ranked by the cheaper of its two directions the vertex kinds allow
+        collapses.clear();
+        for (size_t t = 0; t < triangleCount; ++t)
+        {
+            for (int c = 0; c < 3; ++c)
+            {
+                const uint32_t p0 = positionOf[triangles[3 * t + c]];
+                const uint32_t p1 = positionOf[triangles[3 * t + (c + 1) % 3]];
+                const auto allowed = [&](uint32_t from, uint32_t to) {
+                    return kinds[from] == Manifold || (kinds[from] != Locked && kinds[to] != Manifold);
+                };
+
+                Collapse best{0, 0, std::numeric_limits<double>::infinity()};
+                if (allowed(p0, p1))
+                    best = {p0, p1, quadrics[p0].error(positions[p1])};
+                if (allowed(p1, p0))
+                {
+                    const double cost = quadrics[p1].error(positions[p0]);
+                    if (cost < best.cost)
+                        best = {p1, p0, cost};
+                }
+                if (best.cost <= maxCost)
+                    collapses.push_back(best);
+            }
+        }
+        std::sort(collapses.begin(), collapses.end(),
+                  [](const Collapse &a, const Collapse &b) { return a.cost < b.cost; });
+
+        // a collapse removes two triangles inside and one on a border, the pass stops about
+        // where the target is reached
+        const size_t limit = std::max<size_t>(1, (triangleCount - targetIndexCount / 3) / 2);
+        std::fill(dirty.begin(), dirty.end(), 0);
+        std::iota(remap.begin(), remap.end(), 0);
+        size_t applied = 0;
+        for (const Collapse &collapse : collapses)
+        {
+            if (applied >= limit)
+                break;
+            if (dirty[collapse.from] || dirty[collapse.to] || !canCollapse(collapse.from, collapse.to))
+                continue;
+
+            for (const auto &m : wedgeMap)
+                remap[m.first] = m.second;
+            quadrics[collapse.to].add(quadrics[collapse.from]);
+            for (uint32_t f = fanOffsets[collapse.from]; f < fanOffsets[collapse.from + 1]; ++f)
+            {
+                for (int c = 0; c < 3; ++c)
+                    dirty[positionOf[triangles[3 * fans[f] + c]]] = 1;
+            }
+            appliedCost = std::max(appliedCost, collapse.cost);
+            ++applied;
+        }
+        if (applied == 0)
+            break;
+
+        // triangles that lost a corner are gone
+        size_t kept = 0;
+        for (size_t t = 0; t < triangleCount; ++t)
+        {
+            uint32_t triangle[3];
+            for (int c = 0; c < 3; ++c)
+                triangle[c] = remap[triangles[3 * t + c]];
+            const uint32_t p0 = positionOf[triangle[0]], p1 = positionOf[triangle[1]], p2 = positionOf[triangle[2]];
+            if (p0 == p1 || p1 == p2 || p2 == p0)
+                continue;
+            std::copy(triangle, triangle + 3, triangles.begin() + 3 * kept);
+            data[kept] = data[t];
+            ++kept;
+        }
+        triangles.resize(3 * kept);
+        data.resize(kept);
+    }
+
+    result.error = static_cast<float>(std::sqrt(appliedCost));
+    result.milliseconds =
+        std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+    return result;
+}
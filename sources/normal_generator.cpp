@@ -0,0 +1,197 @@
+#include "normal_generator.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+#include "vertex_packing.h"
+
+namespace
+{
+constexpr size_t grainTriangles = 16384;
+
+// angle between a and b, stable for nearly parallel vectors unlike acos
+float angleBetween(const glm::vec3 &a, const glm::vec3 &b)
+{
+    return std::atan2(glm::length(glm::cross(a, b)), glm::dot(a, b));
+}
+
+// any unit vector orthogonal to the unit vector n
+glm::vec3 orthogonal(const glm::vec3 &n)
+{
+    const glm::vec3 axis = std::abs(n.x) < 0.9f ? glm::vec3(1.0f, 0.0f, 0.0f) : glm::vec3(0.0f, 1.0f, 0.0f);
+    return glm::normalize(glm::cross(n, axis));
+}
+
+// for every key the items with that key, items of key k are items[offsets[k]] to items[offsets[k + 1]]
+struct Table
+{
+    std::vector<uint32_t> offsets;
+    std::vector<uint32_t> items;
+};
+
+Table buildTable(const std::vector<uint32_t> &keys, size_t keyCount)
+{
+    Table table;
+    table.offsets.assign(keyCount + 1, 0);
+    for (uint32_t key : keys)
+        ++table.offsets[key + 1];
+    for (size_t k = 0; k < keyCount; ++k)
+        table.offsets[k + 1] += table.offsets[k];
+
+    std::vector<uint32_t> cursor(table.offsets.begin(), table.offsets.end() - 1);
+    table.items.resize(keys.size());
+    for (size_t i = 0; i < keys.size(); ++i)
+        table.items[cursor[keys[i]]++] = static_cast<uint32_t>(i);
+    return table;
+}
+}  // namespace
+
+GeneratedNormals generateObjNormals(const tinyobj::attrib_t &attrib, const std::vector<tinyobj::shape_t> &shapes,
+                                    float creaseAngle, ThreadPool &pool)
+{
+    auto start = std::chrono::high_resolution_clock::now();
+
+    GeneratedNormals result;
+    size_t corners = 0;
+    bool missing = false;
+    for (const auto &shape : shapes)
+    {
+        result.firstCorner.push_back(corners);
+        corners += shape.mesh.indices.size();
+        for (const tinyobj::index_t &index : shape.mesh.indices)
+            missing |= index.normal_index < 0;
+    }
+    if (!missing)
+    {
+        result.firstCorner.clear();
+        return result;
+    }
+
+    // the corners of all shapes in one list, the shapes are triangulated
+    std::vector<uint32_t> positions(corners);
+    std::vector<uint8_t> generate(corners);
+    for (size_t s = 0; s < shapes.size(); ++s)
+    {
+        const auto &indices = shapes[s].mesh.indices;
+        for (size_t c = 0; c < indices.size(); ++c)
+        {
+            positions[result.firstCorner[s] + c] = static_cast<uint32_t>(indices[c].vertex_index);
+            generate[result.firstCorner[s] + c] = indices[c].normal_index < 0;
+            result.generatedCorners += indices[c].normal_index < 0;
+        }
+    }
+    const auto position = [&](size_t corner) {
+        const float *p = &attrib.vertices[3 * positions[corner]];
+        return glm::vec3(p[0], p[1], p[2]);
+    };
+
+    const size_t triangles = corners / 3;
+    std::vector<glm::vec3> faceNormals(triangles);
+    std::vector<float> cornerAngles(corners);
+    pool.parallelFor(0, triangles, grainTriangles, [&](size_t first, size_t last) {
+        for (size_t t = first; t < last; ++t)
+        {
+            const glm::vec3 p[3] = {position(3 * t), position(3 * t + 1), position(3 * t + 2)};
+            const glm::vec3 n = glm::cross(p[1] - p[0], p[2] - p[0]);
+            const float length = glm::length(n);
+            faceNormals[t] = length > 0.0f ? n / length : glm::vec3(0.0f);
+            for (uint32_t k = 0; k < 3; ++k)
+                cornerAngles[3 * t + k] = angleBetween(p[(k + 1) % 3] - p[k], p[(k + 2) % 3] - p[k]);
+        }
+    });
+
+    const Table positionCorners = buildTable(positions, attrib.vertices.size() / 3);
+
+    // every corner sums up the triangles around its position, it only writes its own normal
+    const float minCosine = std::cos(glm::radians(creaseAngle));
+    result.normals.assign(corners, glm::vec3(0.0f));
+    pool.parallelFor(0, triangles, grainTriangles, [&](size_t first, size_t last) {
+        for (size_t c = 3 * first; c < 3 * last; ++c)
+        {
+            if (!generate[c])
+                continue;
+
+            const glm::vec3 &own = faceNormals[c / 3];
+            const bool degenerate = own == glm::vec3(0.0f);
+            glm::vec3 sum(0.0f);
+            const uint32_t position = positions[c];
+            for (uint32_t i = positionCorners.offsets[position]; i < positionCorners.offsets[position + 1]; ++i)
+            {
+                const uint32_t other = positionCorners.items[i];
+                const glm::vec3 &normal = faceNormals[other / 3];
+                if (degenerate || glm::dot(normal, own) >= minCosine)
+                    sum += normal * cornerAngles[other];
+            }
+
+            const float length = glm::length(sum);
+            result.normals[c] = length > 0.0f ? sum / length : degenerate ? glm::vec3(0.0f, 0.0f, 1.0f) : own;
+        }
+    });
+
+    result.milliseconds =
+        std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+    return result;
+}
+
+double generateTangents(std::vector<Vertex> &vertices, const std::vector<uint32_t> &indices, ThreadPool &pool)
+{
+    auto start = std::chrono::high_resolution_clock::now();
+
+    // tangent and bitangent of every triangle, the directions of growing u and v on its plane
+    const size_t triangles = indices.size() / 3;
+    std::vector<glm::vec3> triangleTangents(triangles);
+    std::vector<glm::vec3> triangleBitangents(triangles);
+    pool.parallelFor(0, triangles, grainTriangles, [&](size_t first, size_t last) {
+        for (size_t t = first; t < last; ++t)
+        {
+            const Vertex &v0 = vertices[indices[3 * t]];
+            const Vertex &v1 = vertices[indices[3 * t + 1]];
+            const Vertex &v2 = vertices[indices[3 * t + 2]];
+            const glm::vec3 e1 = v1.pos - v0.pos;
+            const glm::vec3 e2 = v2.pos - v0.pos;
+            const glm::vec2 d1 = v1.texCoord - v0.texCoord;
+            const glm::vec2 d2 = v2.texCoord - v0.texCoord;
+            const float determinant = d1.x * d2.y - d2.x * d1.y;
+            if (std::abs(determinant) > 1e-12f)
+            {
+                triangleTangents[t] = (e1 * d2.y - e2 * d1.y) / determinant;
+                triangleBitangents[t] = (e2 * d1.x - e1 * d2.x) / determinant;
+            }
+            else
+            {
+                triangleTangents[t] = glm::vec3(0.0f);
+                triangleBitangents[t] = glm::vec3(0.0f);
+            }
+        }
+    });
+
+    const Table vertexTriangles = buildTable(indices, vertices.size());
+
+    pool.parallelFor(0, vertices.size(), grainTriangles, [&](size_t first, size_t last) {
+        for (size_t v = first; v < last; ++v)
+        {
+            glm::vec3 tangent(0.0f);
+            glm::vec3 bitangent(0.0f);
+            for (uint32_t i = vertexTriangles.offsets[v]; i < vertexTriangles.offsets[v + 1]; ++i)
+            {
+                tangent += triangleTangents[vertexTriangles.items[i] / 3];
+                bitangent += triangleBitangents[vertexTriangles.items[i] / 3];
+            }
+
+            // Gram-Schmidt against the normal
+            Vertex &vertex = vertices[v];
+            const float normalLength = glm::length(vertex.normal);
+            const glm::vec3 normal =
+                normalLength > 0.0f ? vertex.normal / normalLength : glm::vec3(0.0f, 0.0f, 1.0f);
+            const float summedLength = glm::length(tangent);
+            tangent -= normal * glm::dot(normal, tangent);
+            const float length = glm::length(tangent);
+            tangent = length > 1e-4f * summedLength && length > 0.0f ? tangent / length : orthogonal(normal);
+            const float sign = glm::dot(glm::cross(normal, tangent), bitangent) < 0.0f ? -1.0f : 1.0f;
+            vertex.tangent = packTangent(tangent, sign);
+        }
+    });
+
+    return std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+}
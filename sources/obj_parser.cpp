@@ -0,0 +1,1008 @@
+#include "obj_parser.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+#include <map>
+#include <set>
+
+#include "mapped_file.h"
+
+namespace
+{
+// more chunks than threads even out chunks of different cost (faces are slower than positions)
+constexpr size_t chunksPerThread = 4;
+
+enum class EventType
+{
+    UseMaterial,
+    Group,
+    Object,
+    MaterialLibrary,
+};
+
+// statement whose effect depends on everything before it, replayed in file order while stitching
+struct Event
+{
+    EventType type;
+    size_t face;  // number of faces of the chunk declared before the statement
+    std::string name;
+    std::vector<std::string> files;
+};
+
+enum Attribute : uint8_t
+{
+    Position,
+    Normal,
+    Texcoord,
+};
+
+// negative OBJ indices count back from the attributes read so far, in a chunk they can only be
+// made relative to the start of the chunk until the counts of the preceding chunks are known
+struct RelativeIndex
+{
+    uint32_t corner;
+    Attribute attribute;
+};
+
+struct Chunk
+{
+    const char *begin = nullptr;
+    const char *end = nullptr;
+
+    std::vector<float> positions;
+    std::vector<float> colors;
+    std::vector<float> normals;
+    std::vector<float> texcoords;
+
+    std::vector<tinyobj::index_t> corners;
+    std::vector<uint32_t> faceEnds;  // one past the last corner of every face
+    std::vector<unsigned int> smoothingIds;
+    std::vector<RelativeIndex> relativeIndices;
+    std::vector<Event> events;
+
+    // faces before the first smoothing statement continue the group of the previous chunk
+    size_t inheritedSmoothingFaces = 0;
+    bool smoothingSet = false;
+    unsigned int smoothingId = 0;
+
+    // filled in while stitching
+    size_t positionBase = 0;
+    size_t normalBase = 0;
+    size_t texcoordBase = 0;
+    std::vector<tinyobj::index_t> triangles;
+    std::vector<uint32_t> faceTriangleEnds;  // one past the last triangle of every face
+    size_t degenerateFaces = 0;
+    size_t invalidFaces = 0;
+
+    const char *errorAt = nullptr;
+    std::string error;
+};
+
+inline bool isSpace(char c)
+{
+    return c == ' ' || c == '\t';
+}
+
+inline bool isDigit(char c)
+{
+    return static_cast<unsigned>(c - '0') < 10u;
+}
+
+inline bool spaceAt(const char *p, const char *end)
+{
+    return p < end && isSpace(*p);
+}
+
+inline const char *skipSpaces(const char *p, const char *end)
+{
+    while (p < end && isSpace(*p))
+        ++p;
+    return p;
+}
+
+// end of the current token, tinyobj delimits tokens by spaces, tabs and carriage returns
+inline const char *skipToken(const char *p, const char *end)
+{
+    while (p < end && !isSpace(*p) && *p != '\r')
+        ++p;
+    return p;
+}
+
+// number of leading ASCII digits in eight bytes, checked for all bytes at once
+inline unsigned leadingDigits(uint64_t bytes)
+{
+    const uint64_t x = bytes ^ 0x3030303030303030ull;
+    // a byte is a digit if x < 10, the high bit of every byte is set otherwise
+    const uint64_t nonDigits = (((x & 0x7f7f7f7f7f7f7f7full) + 0x7676767676767676ull) | x) & 0x8080808080808080ull;
+    return nonDigits ? static_cast<unsigned>(__builtin_ctzll(nonDigits)) / 8 : 8;
+}
+
+// value of eight ASCII digits, the first byte in memory is the most significant digit
+inline uint32_t eightDigits(uint64_t bytes)
+{
+    bytes = ((bytes & 0x0f0f0f0f0f0f0f0full) * 2561) >> 8;
+    bytes = ((bytes & 0x00ff00ff00ff00ffull) * 6553601) >> 16;
+    return static_cast<uint32_t>(((bytes & 0x0000ffff0000ffffull) * 42949672960001ull) >> 32);
+}
+
+constexpr uint64_t integerPowersOfTen[] = {1,      10,      100,      1000,      10000,
+                                           100000, 1000000, 10000000, 100000000};
+
+constexpr double powersOfTen[] = {1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+                                  1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22};
+
+constexpr int maxMantissaDigits = 19;
+
+struct Decimal
+{
+    uint64_t mantissa = 0;
+    int digits = 0;    // upper bound of the significant digits in mantissa
+    int exponent = 0;  // decimal
+    bool any = false;
+    bool truncated = false;
+};
+
+// Accumulates a run of digits into the mantissa, eight at a time where possible. Leading zeros
+// are skipped, digits that do not fit any more are dropped and the number marked as truncated.
+const char *readDigits(const char *p, const char *end, bool fraction, Decimal &number)
+{
+    for (;;)
+    {
+        if (end - p >= 8 && number.digits + 8 <= maxMantissaDigits)
+        {
+            uint64_t bytes;
+            memcpy(&bytes, p, sizeof(bytes));
+            const unsigned count = leadingDigits(bytes);
+            if (count == 0)
+                return p;
+
+            // move the digits to the least significant end of the number and pad with '0'
+            if (count < 8)
+                bytes = (bytes << (8 * (8 - count))) | (0x3030303030303030ull >> (8 * count));
+
+            number.mantissa = number.mantissa * integerPowersOfTen[count] + eightDigits(bytes);
+            if (number.mantissa != 0)
+                number.digits += count;
+            if (fraction)
+                number.exponent -= count;
+            number.any = true;
+            p += count;
+            if (count < 8)
+                return p;
+            continue;
+        }
+
+        if (p == end || !isDigit(*p))
+            return p;
+
+        const unsigned digit = static_cast<unsigned>(*p - '0');
+        if (number.digits < maxMantissaDigits)
+        {
+            number.mantissa = number.mantissa * 10 + digit;
+            if (number.mantissa != 0)
+                ++number.digits;
+            if (fraction)
+                --number.exponent;
+        }
+        else
+        {
+            number.truncated = true;
+            if (!fraction)
+                ++number.exponent;
+        }
+        number.any = true;
+        ++p;
+    }
+}
+
+// Parses a decimal floating point number with the grammar tinyobj accepts and returns the position
+// after it, or nullptr if there is none. Mantissas of up to 2^53 with decimal exponents up to 22
+// convert exactly through a single double multiplication or division, which covers practically
+// every number written by exporters. Everything else falls back to strtod.
+const char *parseFloat(const char *p, const char *end, float &value)
+{
+    const char *start = p;
+    bool negative = false;
+    if (p < end && (*p == '+' || *p == '-'))
+    {
+        negative = *p == '-';
+        ++p;
+    }
+
+    Decimal number;
+    p = readDigits(p, end, false, number);
+    if (p < end && *p == '.')
+        p = readDigits(p + 1, end, true, number);
+    if (!number.any)
+        return nullptr;
+
+    if (p < end && (*p == 'e' || *p == 'E'))
+    {
+        ++p;
+        bool negativeExponent = false;
+        if (p < end && (*p == '+' || *p == '-'))
+        {
+            negativeExponent = *p == '-';
+            ++p;
+        }
+        if (p == end || !isDigit(*p))
+            return nullptr;
+
+        int written = 0;
+        for (; p < end && isDigit(*p); ++p)
+        {
+            if (written < 100000)
+                written = written * 10 + (*p - '0');
+        }
+        number.exponent += negativeExponent ? -written : written;
+    }
+
+    double result;
+    if (number.mantissa == 0)
+    {
+        result = 0.0;
+    }
+    else if (!number.truncated && number.mantissa <= (uint64_t(1) << 53) && number.exponent >= -22 &&
+             number.exponent <= 22)
+    {
+        result = static_cast<double>(number.mantissa);
+        result = number.exponent < 0 ? result / powersOfTen[-number.exponent] : result * powersOfTen[number.exponent];
+    }
+    else
+    {
+        std::string text(negative ? start + 1 : start, p);
+        result = std::strtod(text.c_str(), nullptr);
+    }
+
+    value = static_cast<float>(negative ? -result : result);
+    return p;
+}
+
+// Reads the next whitespace separated number of the line ending at end, like tinyobj a malformed one
+// yields the default. Digits never run across a line break, so the number itself is parsed up to
+// limit instead, which lets the eight digit path work up to the very end of the line.
+inline const char *parseReal(const char *p, const char *end, const char *limit, float defaultValue, float &value,
+                             bool *found = nullptr)
+{
+    p = skipSpaces(p, end);
+    const bool parsed = parseFloat(p, limit, value) != nullptr;
+    if (!parsed)
+        value = defaultValue;
+    if (found)
+        *found = parsed;
+    return skipToken(p, end);
+}
+
+// atoi without the leading whitespace, returns 0 if there is no number
+inline const char *parseInt(const char *p, const char *end, int &value)
+{
+    bool negative = false;
+    if (p < end && (*p == '+' || *p == '-'))
+    {
+        negative = *p == '-';
+        ++p;
+    }
+    int64_t result = 0;
+    for (; p < end && isDigit(*p); ++p)
+    {
+        if (result < std::numeric_limits<int>::max())
+            result = result * 10 + (*p - '0');
+    }
+    result = std::min<int64_t>(result, std::numeric_limits<int>::max());
+    value = static_cast<int>(negative ? -result : result);
+    return p;
+}
+
+inline const char *skipIndex(const char *p, const char *end)
+{
+    while (p < end && *p != '/' && !isSpace(*p) && *p != '\r')
+        ++p;
+    return p;
+}
+
+inline std::string readString(const char *&p, const char *end)
+{
+    p = skipSpaces(p, end);
+    const char *start = p;
+    p = skipToken(p, end);
+    return std::string(start, p);
+}
+
+// Parses one vertex reference of a face (v, v/vt, v//vn or v/vt/vn) into corner, indices are made
+// zero based, negative ones are stored relative to the chunk and recorded for the stitching pass.
+bool parseCorner(const char *&p, const char *end, Chunk &chunk)
+{
+    const uint32_t corner = static_cast<uint32_t>(chunk.corners.size());
+    tinyobj::index_t index{-1, -1, -1};
+
+    auto fix = [&](int value, Attribute attribute, int &out) {
+        if (value > 0)
+        {
+            out = value - 1;
+            return true;
+        }
+        if (value == 0)
+            return false;
+
+        const size_t count = attribute == Position ? chunk.positions.size() / 3
+                             : attribute == Normal ? chunk.normals.size() / 3
+                                                   : chunk.texcoords.size() / 2;
+        out = static_cast<int>(count) + value;
+        chunk.relativeIndices.push_back({corner, attribute});
+        return true;
+    };
+
+    int value;
+    p = skipIndex(parseInt(p, end, value), end);
+    if (!fix(value, Position, index.vertex_index))
+        return false;
+
+    if (p < end && *p == '/')
+    {
+        ++p;
+        if (p < end && *p == '/')
+        {
+            // v//vn
+            p = skipIndex(parseInt(p + 1, end, value), end);
+            if (!fix(value, Normal, index.normal_index))
+                return false;
+        }
+        else
+        {
+            p = skipIndex(parseInt(p, end, value), end);
+            if (!fix(value, Texcoord, index.texcoord_index))
+                return false;
+
+            if (p < end && *p == '/')
+            {
+                p = skipIndex(parseInt(p + 1, end, value), end);
+                if (!fix(value, Normal, index.normal_index))
+                    return false;
+            }
+        }
+    }
+
+    chunk.corners.push_back(index);
+    return true;
+}
+
+void parseChunk(Chunk &chunk)
+{
+    // rough guess of 30 bytes per statement keeps reallocations down
+    const size_t statements = static_cast<size_t>(chunk.end - chunk.begin) / 30;
+    chunk.positions.reserve(statements * 3);
+    chunk.colors.reserve(statements * 3);
+    chunk.corners.reserve(statements * 2);
+    chunk.faceEnds.reserve(statements / 2);
+    chunk.smoothingIds.reserve(statements / 2);
+
+    const char *line = chunk.begin;
+    while (line < chunk.end)
+    {
+        const char *newline = static_cast<const char *>(memchr(line, '\n', static_cast<size_t>(chunk.end - line)));
+        const char *end = newline ? newline : chunk.end;
+        const char *next = newline ? newline + 1 : chunk.end;
+        if (end > line && end[-1] == '\r')
+            --end;
+
+        const char *p = skipSpaces(line, end);
+        const char *statement = p;
+        line = next;
+
+        if (p == end || *p == '#')
+            continue;
+
+        if (p[0] == 'v' && spaceAt(p + 1, end))
+        {
+            float x, y, z, r, g, b;
+            bool foundR, foundG, foundB;
+            p = parseReal(p + 2, end, chunk.end, 0.0f, x);
+            p = parseReal(p, end, chunk.end, 0.0f, y);
+            p = parseReal(p, end, chunk.end, 0.0f, z);
+            p = parseReal(p, end, chunk.end, 1.0f, r, &foundR);
+            p = parseReal(p, end, chunk.end, 1.0f, g, &foundG);
+            p = parseReal(p, end, chunk.end, 1.0f, b, &foundB);
+            if (!(foundR && foundG && foundB))
+                r = g = b = 1.0f;
+
+            chunk.positions.insert(chunk.positions.end(), {x, y, z});
+            chunk.colors.insert(chunk.colors.end(), {r, g, b});
+        }
+        else if (p[0] == 'v' && p + 1 < end && p[1] == 'n' && spaceAt(p + 2, end))
+        {
+            float x, y, z;
+            p = parseReal(p + 3, end, chunk.end, 0.0f, x);
+            p = parseReal(p, end, chunk.end, 0.0f, y);
+            p = parseReal(p, end, chunk.end, 0.0f, z);
+            chunk.normals.insert(chunk.normals.end(), {x, y, z});
+        }
+        else if (p[0] == 'v' && p + 1 < end && p[1] == 't' && spaceAt(p + 2, end))
+        {
+            float u, v;
+            p = parseReal(p + 3, end, chunk.end, 0.0f, u);
+            p = parseReal(p, end, chunk.end, 0.0f, v);
+            chunk.texcoords.insert(chunk.texcoords.end(), {u, v});
+        }
+        else if (p[0] == 'f' && spaceAt(p + 1, end))
+        {
+            p = skipSpaces(p + 2, end);
+            while (p < end && *p != '\r')
+            {
+                if (!parseCorner(p, end, chunk))
+                {
+                    chunk.errorAt = statement;
+                    chunk.error = "Failed parse `f' line (e.g. zero value for face index)";
+                    return;
+                }
+                while (p < end && (isSpace(*p) || *p == '\r'))
+                    ++p;
+            }
+
+            if (!chunk.smoothingSet)
+                ++chunk.inheritedSmoothingFaces;
+            chunk.faceEnds.push_back(static_cast<uint32_t>(chunk.corners.size()));
+            chunk.smoothingIds.push_back(chunk.smoothingId);
+        }
+        else if (end - p >= 6 && strncmp(p, "usemtl", 6) == 0)
+        {
+            p += 6;
+            chunk.events.push_back({EventType::UseMaterial, chunk.faceEnds.size(), readString(p, end), {}});
+        }
+        else if (end - p >= 7 && strncmp(p, "mtllib", 6) == 0 && isSpace(p[6]))
+        {
+            Event event{EventType::MaterialLibrary, chunk.faceEnds.size(), {}, {}};
+            p += 7;
+            while (p < end)
+            {
+                std::string file = readString(p, end);
+                if (!file.empty())
+                    event.files.push_back(std::move(file));
+                while (p < end && (isSpace(*p) || *p == '\r'))
+                    ++p;
+            }
+            chunk.events.push_back(std::move(event));
+        }
+        else if (p[0] == 'g' && spaceAt(p + 1, end))
+        {
+            // tinyobj has no multiple group support either and joins the names with spaces
+            std::string name;
+            p += 2;
+            for (;;)
+            {
+                std::string group = readString(p, end);
+                if (group.empty())
+                    break;
+                if (!name.empty())
+                    name += ' ';
+                name += group;
+            }
+            chunk.events.push_back({EventType::Group, chunk.faceEnds.size(), std::move(name), {}});
+        }
+        else if (p[0] == 'o' && spaceAt(p + 1, end))
+        {
+            chunk.events.push_back({EventType::Object, chunk.faceEnds.size(), std::string(p + 2, end), {}});
+        }
+        else if (p[0] == 's' && spaceAt(p + 1, end))
+        {
+            p = skipSpaces(p + 2, end);
+            if (p == end)
+                continue;
+
+            if (end - p >= 3 && strncmp(p, "off", 3) == 0)
+            {
+                chunk.smoothingId = 0;
+            }
+            else
+            {
+                int id;
+                parseInt(p, end, id);
+                chunk.smoothingId = id < 0 ? 0 : static_cast<unsigned int>(id);
+            }
+            chunk.smoothingSet = true;
+        }
+        // everything else is ignored
+    }
+}
+
+// quick point in polygon test from https://wrf.ecse.rpi.edu//Research/Short_Notes/pnpoly.html
+bool pointInTriangle(const float *vx, const float *vy, float x, float y)
+{
+    bool inside = false;
+    for (int i = 0, j = 2; i < 3; j = i++)
+    {
+        if (((vy[i] > y) != (vy[j] > y)) && (x < (vx[j] - vx[i]) * (y - vy[i]) / (vy[j] - vy[i]) + vx[i]))
+            inside = !inside;
+    }
+    return inside;
+}
+
+// Splits a face into triangles with exactly the rules of tinyobj's built in triangulation
+// (shorter diagonal for quads, ear clipping for larger polygons), so that both readers produce
+// identical index lists. Returns the number of triangles appended to out.
+size_t triangulateFace(const tinyobj::index_t *face, size_t count, const std::vector<float> &v,
+                       std::vector<tinyobj::index_t> &out)
+{
+    const size_t before = out.size();
+    auto valid = [&](int index, size_t component) {
+        return index >= 0 && static_cast<size_t>(index) * 3 + component < v.size();
+    };
+
+    if (count == 3)
+    {
+        out.insert(out.end(), face, face + 3);
+    }
+    else if (count == 4)
+    {
+        if (!valid(face[0].vertex_index, 2) || !valid(face[1].vertex_index, 2) || !valid(face[2].vertex_index, 2) ||
+            !valid(face[3].vertex_index, 2))
+            return 0;
+
+        auto distance2 = [&](int a, int b) {
+            const float dx = v[3 * b + 0] - v[3 * a + 0];
+            const float dy = v[3 * b + 1] - v[3 * a + 1];
+            const float dz = v[3 * b + 2] - v[3 * a + 2];
+            return dx * dx + dy * dy + dz * dz;
+        };
+
+        if (distance2(face[0].vertex_index, face[2].vertex_index) <
+            distance2(face[1].vertex_index, face[3].vertex_index))
+            out.insert(out.end(), {face[0], face[1], face[2], face[0], face[2], face[3]});
+        else
+            out.insert(out.end(), {face[0], face[1], face[3], face[1], face[2], face[3]});
+    }
+    else if (count > 4)
+    {
+        // project onto the plane most perpendicular to the first proper corner
+        size_t axes[2] = {1, 2};
+        for (size_t k = 0; k < count; ++k)
+        {
+            const int i0 = face[k].vertex_index;
+            const int i1 = face[(k + 1) % count].vertex_index;
+            const int i2 = face[(k + 2) % count].vertex_index;
+            if (!valid(i0, 2) || !valid(i1, 2) || !valid(i2, 2))
+                continue;
+
+            const float e0x = v[3 * i1 + 0] - v[3 * i0 + 0];
+            const float e0y = v[3 * i1 + 1] - v[3 * i0 + 1];
+            const float e0z = v[3 * i1 + 2] - v[3 * i0 + 2];
+            const float e1x = v[3 * i2 + 0] - v[3 * i1 + 0];
+            const float e1y = v[3 * i2 + 1] - v[3 * i1 + 1];
+            const float e1z = v[3 * i2 + 2] - v[3 * i1 + 2];
+            const float cx = std::fabs(e0y * e1z - e0z * e1y);
+            const float cy = std::fabs(e0z * e1x - e0x * e1z);
+            const float cz = std::fabs(e0x * e1y - e0y * e1x);
+            const float epsilon = std::numeric_limits<float>::epsilon();
+            if (cx > epsilon || cy > epsilon || cz > epsilon)
+            {
+                if (!(cx > cy && cx > cz))
+                {
+                    axes[0] = 0;
+                    if (cz > cx && cz > cy)
+                        axes[1] = 1;
+                }
+                break;
+            }
+        }
+
+        auto projected = [&](int index, float &x, float &y) {
+            if (valid(index, axes[0]) && valid(index, axes[1]))
+            {
+                x = v[3 * index + axes[0]];
+                y = v[3 * index + axes[1]];
+                return true;
+            }
+            x = y = 0.0f;
+            return false;
+        };
+
+        std::vector<tinyobj::index_t> remaining(face, face + count);
+        size_t guess = 0;
+        size_t remainingIterations = remaining.size();
+        size_t previousRemaining = remaining.size();
+
+        while (remaining.size() > 3 && remainingIterations > 0)
+        {
+            const size_t n = remaining.size();
+            if (guess >= n)
+                guess -= n;
+
+            if (previousRemaining != n)
+            {
+                previousRemaining = n;
+                remainingIterations = n;
+            }
+            else
+            {
+                --remainingIterations;
+            }
+
+            tinyobj::index_t ear[3];
+            float vx[3], vy[3];
+            for (size_t k = 0; k < 3; ++k)
+            {
+                ear[k] = remaining[(guess + k) % n];
+                projected(ear[k].vertex_index, vx[k], vy[k]);
+            }
+
+            // skip reflex corners
+            const float e0x = vx[1] - vx[0];
+            const float e0y = vy[1] - vy[0];
+            const float e1x = vx[2] - vx[1];
+            const float e1y = vy[2] - vy[1];
+            const float cross = e0x * e1y - e0y * e1x;
+            const float area = (vx[0] * vy[1] - vy[0] * vx[1]) * 0.5f;
+            if (cross * area < 0.0f)
+            {
+                ++guess;
+                continue;
+            }
+
+            bool overlap = false;
+            for (size_t other = 3; other < n; ++other)
+            {
+                float x, y;
+                if (projected(remaining[(guess + other) % n].vertex_index, x, y) && pointInTriangle(vx, vy, x, y))
+                {
+                    overlap = true;
+                    break;
+                }
+            }
+            if (overlap)
+            {
+                ++guess;
+                continue;
+            }
+
+            out.insert(out.end(), ear, ear + 3);
+            remaining.erase(remaining.begin() + static_cast<std::ptrdiff_t>((guess + 1) % n));
+        }
+
+        if (remaining.size() == 3)
+            out.insert(out.end(), remaining.begin(), remaining.end());
+    }
+
+    return (out.size() - before) / 3;
+}
+
+void triangulateChunk(Chunk &chunk, const std::vector<float> &positions)
+{
+    chunk.triangles.reserve(chunk.corners.size() * 3 / 2);
+    chunk.faceTriangleEnds.reserve(chunk.faceEnds.size());
+
+    uint32_t triangles = 0;
+    uint32_t faceBegin = 0;
+    for (uint32_t faceEnd : chunk.faceEnds)
+    {
+        const size_t count = faceEnd - faceBegin;
+        if (count < 3)
+        {
+            ++chunk.degenerateFaces;
+        }
+        else
+        {
+            const size_t added = triangulateFace(&chunk.corners[faceBegin], count, positions, chunk.triangles);
+            if (added == 0)
+                ++chunk.invalidFaces;
+            triangles += static_cast<uint32_t>(added);
+        }
+        chunk.faceTriangleEnds.push_back(triangles);
+        faceBegin = faceEnd;
+    }
+
+    chunk.corners = {};
+}
+
+// faces [firstFace, lastFace) of one chunk that end up in the same shape with the same material
+struct Run
+{
+    size_t chunk;
+    size_t firstFace;
+    size_t lastFace;
+    int material;
+    size_t shape;
+    size_t firstTriangle;  // in the shape
+};
+
+struct ShapeBuild
+{
+    std::string name;
+    size_t triangles = 0;
+    std::vector<Run> runs;
+};
+
+size_t runTriangles(const std::vector<Chunk> &chunks, const Run &run)
+{
+    const auto &ends = chunks[run.chunk].faceTriangleEnds;
+    const size_t first = run.firstFace == 0 ? 0 : ends[run.firstFace - 1];
+    return ends[run.lastFace - 1] - first;
+}
+}  // namespace
+
+bool ObjParser::parseFromFile(const std::string &path, const std::string &mtlSearchPath)
+{
+    auto start = std::chrono::high_resolution_clock::now();
+
+    objAttrib = {};
+    objShapes.clear();
+    objMaterials.clear();
+    warnings.clear();
+    errors.clear();
+    parseStats = {};
+
+    MappedFile file;
+    if (!file.open(path))
+    {
+        errors = "Cannot open file [" + path + "]\n";
+        return false;
+    }
+
+    std::string searchPath = mtlSearchPath;
+    if (searchPath.empty())
+    {
+        const size_t separator = path.find_last_of("/\\");
+        if (separator != std::string::npos)
+            searchPath = path.substr(0, separator);
+    }
+
+    // cut the file into line aligned chunks
+    const char *data = reinterpret_cast<const char *>(file.data());
+    const char *dataEnd = data + file.size();
+    const size_t chunkCount =
+        std::max<size_t>(1, std::min(file.size() / minChunkBytes, (pool.size() + 1) * chunksPerThread));
+    const size_t chunkTarget = file.size() / chunkCount;
+
+    std::vector<Chunk> chunks;
+    for (const char *begin = data; begin < dataEnd;)
+    {
+        const char *end = dataEnd;
+        if (static_cast<size_t>(dataEnd - begin) > chunkTarget + chunkTarget / 2)
+        {
+            const char *split = begin + chunkTarget;
+            const char *newline = static_cast<const char *>(memchr(split, '\n', static_cast<size_t>(dataEnd - split)));
+            end = newline ? newline + 1 : dataEnd;
+        }
+        chunks.emplace_back();
+        chunks.back().begin = begin;
+        chunks.back().end = end;
+        begin = end;
+    }
+
+    pool.parallelFor(0, chunks.size(), 1, [&](size_t first, size_t last) {
+        for (size_t c = first; c < last; ++c)
+            parseChunk(chunks[c]);
+    });
+
+    for (const auto &chunk : chunks)
+    {
+        if (chunk.errorAt)
+        {
+            const size_t line = std::count(data, chunk.errorAt, '\n') + 1;
+            errors = chunk.error + " line " + std::to_string(line) + ".\n";
+            return false;
+        }
+    }
+
+    // global attribute offsets of the chunks and the smoothing group every chunk starts in
+    size_t positionCount = 0, normalCount = 0, texcoordCount = 0;
+    std::vector<unsigned int> inheritedSmoothing(chunks.size());
+    unsigned int smoothing = 0;
+    for (size_t c = 0; c < chunks.size(); ++c)
+    {
+        auto &chunk = chunks[c];
+        chunk.positionBase = positionCount;
+        chunk.normalBase = normalCount;
+        chunk.texcoordBase = texcoordCount;
+        positionCount += chunk.positions.size() / 3;
+        normalCount += chunk.normals.size() / 3;
+        texcoordCount += chunk.texcoords.size() / 2;
+
+        inheritedSmoothing[c] = smoothing;
+        if (chunk.smoothingSet)
+            smoothing = chunk.smoothingId;
+    }
+
+    objAttrib.vertices.resize(positionCount * 3);
+    objAttrib.colors.resize(positionCount * 3);
+    objAttrib.normals.resize(normalCount * 3);
+    objAttrib.texcoords.resize(texcoordCount * 2);
+
+    pool.parallelFor(0, chunks.size(), 1, [&](size_t first, size_t last) {
+        for (size_t c = first; c < last; ++c)
+        {
+            auto &chunk = chunks[c];
+            std::copy(chunk.positions.begin(), chunk.positions.end(),
+                      objAttrib.vertices.begin() + 3 * chunk.positionBase);
+            std::copy(chunk.colors.begin(), chunk.colors.end(), objAttrib.colors.begin() + 3 * chunk.positionBase);
+            std::copy(chunk.normals.begin(), chunk.normals.end(), objAttrib.normals.begin() + 3 * chunk.normalBase);
+            std::copy(chunk.texcoords.begin(), chunk.texcoords.end(),
+                      objAttrib.texcoords.begin() + 2 * chunk.texcoordBase);
+            chunk.positions = {};
+            chunk.colors = {};
+            chunk.normals = {};
+            chunk.texcoords = {};
+
+            for (const RelativeIndex &relative : chunk.relativeIndices)
+            {
+                auto &corner = chunk.corners[relative.corner];
+                if (relative.attribute == Position)
+                    corner.vertex_index += static_cast<int>(chunk.positionBase);
+                else if (relative.attribute == Normal)
+                    corner.normal_index += static_cast<int>(chunk.normalBase);
+                else
+                    corner.texcoord_index += static_cast<int>(chunk.texcoordBase);
+            }
+            chunk.relativeIndices = {};
+
+            std::fill_n(chunk.smoothingIds.begin(), chunk.inheritedSmoothingFaces, inheritedSmoothing[c]);
+        }
+    });
+
+    // quads are split along the shorter diagonal, so this has to wait for all positions
+    pool.parallelFor(0, chunks.size(), 1, [&](size_t first, size_t last) {
+        for (size_t c = first; c < last; ++c)
+            triangulateChunk(chunks[c], objAttrib.vertices);
+    });
+
+    // replay the order dependent statements to find out which faces go into which shape
+    std::vector<ShapeBuild> builds;
+    ShapeBuild shape;
+    std::vector<Run> pending;
+    std::string name;
+    int material = -1;
+    std::map<std::string, int> materialMap;
+    std::set<std::string> materialFiles;
+    tinyobj::MaterialFileReader readMaterials(searchPath);
+
+    auto flush = [&]() {
+        if (pending.empty())
+            return false;
+        for (Run &run : pending)
+        {
+            run.material = material;
+            shape.triangles += runTriangles(chunks, run);
+            shape.runs.push_back(run);
+        }
+        shape.name = name;
+        pending.clear();
+        return true;
+    };
+
+    auto push = [&]() {
+        if (shape.triangles > 0)
+            builds.push_back(std::move(shape));
+        shape = ShapeBuild();
+    };
+
+    for (size_t c = 0; c < chunks.size(); ++c)
+    {
+        const auto &chunk = chunks[c];
+        size_t face = 0;
+        auto addFaces = [&](size_t upTo) {
+            if (upTo > face)
+                pending.push_back({c, face, upTo, -1, 0, 0});
+            face = upTo;
+        };
+
+        for (const Event &event : chunk.events)
+        {
+            addFaces(event.face);
+            switch (event.type)
+            {
+            case EventType::UseMaterial:
+            {
+                auto found = materialMap.find(event.name);
+                const int id = found != materialMap.end() ? found->second : -1;
+                if (found == materialMap.end())
+                    warnings += "material [ '" + event.name + "' ] not found in .mtl\n";
+                if (id != material)
+                {
+                    flush();
+                    material = id;
+                }
+                break;
+            }
+            case EventType::Group:
+            case EventType::Object:
+                flush();
+                push();
+                name = event.name;
+                break;
+            case EventType::MaterialLibrary:
+            {
+                bool found = false;
+                for (const auto &mtl : event.files)
+                {
+                    if (materialFiles.count(mtl) > 0)
+                    {
+                        found = true;
+                        continue;
+                    }
+                    std::string mtlWarning, mtlError;
+                    const bool ok = readMaterials(mtl, &objMaterials, &materialMap, &mtlWarning, &mtlError);
+                    warnings += mtlWarning;
+                    errors += mtlError;
+                    if (ok)
+                    {
+                        found = true;
+                        materialFiles.insert(mtl);
+                        break;
+                    }
+                }
+                if (!found)
+                    warnings += "Failed to load material file(s). Use default material.\n";
+                break;
+            }
+            }
+        }
+        addFaces(chunk.faceEnds.size());
+    }
+
+    // like tinyobj the last shape is kept even if all of its faces were degenerate
+    if (flush() || shape.triangles > 0)
+        builds.push_back(std::move(shape));
+
+    size_t degenerateFaces = 0, invalidFaces = 0;
+    for (const auto &chunk : chunks)
+    {
+        degenerateFaces += chunk.degenerateFaces;
+        invalidFaces += chunk.invalidFaces;
+    }
+    if (degenerateFaces > 0)
+        warnings += std::to_string(degenerateFaces) + " degenerated faces found.\n";
+    if (invalidFaces > 0)
+        warnings += std::to_string(invalidFaces) + " faces with invalid vertex indices found.\n";
+
+    // copy the triangles of all runs into their shapes
+    std::vector<Run> runs;
+    objShapes.resize(builds.size());
+    for (size_t s = 0; s < builds.size(); ++s)
+    {
+        auto &mesh = objShapes[s].mesh;
+        objShapes[s].name = builds[s].name;
+        mesh.indices.resize(3 * builds[s].triangles);
+        mesh.num_face_vertices.resize(builds[s].triangles, 3);
+        mesh.material_ids.resize(builds[s].triangles);
+        mesh.smoothing_group_ids.resize(builds[s].triangles);
+
+        size_t offset = 0;
+        for (Run run : builds[s].runs)
+        {
+            run.shape = s;
+            run.firstTriangle = offset;
+            offset += runTriangles(chunks, run);
+            runs.push_back(run);
+        }
+    }
+
+    pool.parallelFor(0, runs.size(), 16, [&](size_t first, size_t last) {
+        for (size_t r = first; r < last; ++r)
+        {
+            const Run &run = runs[r];
+            const auto &chunk = chunks[run.chunk];
+            auto &mesh = objShapes[run.shape].mesh;
+
+            size_t triangle = run.firstFace == 0 ? 0 : chunk.faceTriangleEnds[run.firstFace - 1];
+            size_t target = run.firstTriangle;
+            for (size_t face = run.firstFace; face < run.lastFace; ++face)
+            {
+                for (; triangle < chunk.faceTriangleEnds[face]; ++triangle, ++target)
+                {
+                    std::copy_n(chunk.triangles.begin() + 3 * triangle, 3, mesh.indices.begin() + 3 * target);
+                    mesh.material_ids[target] = run.material;
+                    mesh.smoothing_group_ids[target] = chunk.smoothingIds[face];
+                }
+            }
+        }
+    });
+
+    parseStats.bytes = file.size();
+    parseStats.chunks = chunks.size();
+    parseStats.milliseconds =
+        std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+    return true;
+}
@@ -26,3 +26,9 @@ double Options::getAOtMax() {
 uint Options::getAORays() {
     return ui->AOnumRays->value();
 }
+bool Options::getLOD() {
+    return ui->LODcheckBox->isChecked();
+}
+double Options::getLODError() {
+    return ui->LODErrorSpinBox->value();
+}
@@ -12,15 +12,20 @@ void RayTracerApp::run()
 
 void RayTracerApp::initVulkan()
 {
-    createVulkanInstance();
-    setupDebugMessenger();
-    createSurface();
-    pickPhysicalDevice();
-    createLogicalDevice();
-    createSwapChain();
-    createImageViews();
-    createRenderPass();
-    createDescriptorSetLayout();
+    auto &timeline = startupTimeline;
+    timeline.restart();
+
+    timeline.time("device setup", [&]() {
+        createVulkanInstance();
+        setupDebugMessenger();
+        createSurface();
+        pickPhysicalDevice();
+        createLogicalDevice();
+        createSwapChain();
+        createImageViews();
+        createRenderPass();
+        createDescriptorSetLayout();
+    });
 
     opt = std::thread([&]() {
         int argc = 1;
@@ -31,42 +36,84 @@ void RayTracerApp::initVulkan()
         app->exec();
     });
 
+    // Startup task graph. Disk I/O, OBJ parsing, texture decoding and pipeline compilation run on
+    // the thread pool while this thread does the driver work that does not depend on them. Only
+    // this thread records and submits command buffers, workers just create objects and write
+    // mapped memory, which Vulkan allows from any thread.
+    timeline.time("scene description", [&]() { loadSceneDescription(); });
+    auto sceneMeshes = threadPool.submit([&]() {
+        return timeline.time("load meshes", [&]() { return loadSceneMeshes(); });
+    });
+    // textures are streamed, frames render with a placeholder until they are uploaded
+    streamTexture(0, scene.texture(), TextureRole::Colour);
 
-    // createGraphicsPipeline();
-    createRTPipeline();
-    createShaderBindingTable();
+    timeline.time("framebuffers", [&]() {
+        createCommandPools();
+        createDepthResources();
+        createFramebuffers();
+    });
 
-    createCommandPools();
-    createDepthResources();
-    createFramebuffers();
-    createTextureImage();
-    createTextureImageView();
-    createTextureSampler();
+    timeline.time("placeholder texture", [&]() {
+        createPlaceholderTexture();
+        createTextureSampler();
+        createTileCaches();
+    });
+    timeline.time("mip downsampler", [&]() { createMipDownsampler(); });
 
-    loadModel(model, ray_model);
-    // loadRTGeometry(ray_model, std::string(LOW_POLY_MODEL_PATH));
+    timeline.time("uniform buffers", [&]() {
+        createUniformBuffers();
+        createVirtualTextureBuffers();
+        createDescriptorPool();
+    });
 
-    createVertexBuffer();
-    createIndexBuffer();
-    createRTVertexBuffer();
-    createRTIndexBuffer();
-    createRTDataVertexBuffer();
-    createRTDataIndexBuffer();
-    createMaterialsBuffer();
+    // the closest hit shader is specialized for the geometry layout, which is known once the
+    // meshes are placed
+    SceneGeometry loaded = timeline.time("wait meshes", [&]() { return sceneMeshes.get(); });
+    timeline.time("place meshes", [&]() { placeSceneMeshes(loaded, model); });
 
-    createRT_BLAS();
-    createRT_TLAS();
+    // every texture slot gets a descriptor of the bindless array in createDescriptorSets and
+    // bindUploadedTextures, there must not be more than the array holds. Checked before the
+    // pipeline compiles on the pool.
+    static_assert(NO_MATERIAL_TEXTURE + 1 <= MAX_SCENE_TEXTURES, "every material texture needs a descriptor");
+    if (1 + materialTable.textures.size() > MAX_SCENE_TEXTURES)
+    {
+        throw std::runtime_error("the scene has " + std::to_string(materialTable.textures.size()) +
+                                 " material textures, at most " + std::to_string(MAX_SCENE_TEXTURES - 1) +
+                                 " fit into the texture array");
+    }
 
-    createUniformBuffers();
-    createDescriptorPool();
-    createDescriptorSets();
+    auto pipeline = threadPool.submit([&]() { timeline.time("compile pipeline", [&]() { createRTPipeline(); }); });
 
-    // createCommandBuffers();
-    createRTCommandBuffers();
+    // the material textures are known once the materials are packed, the table only holds the
+    // diffuse ones
+    textures.resize(1 + materialTable.textures.size());
+    for (size_t t = 0; t < materialTable.textures.size(); ++t)
+        streamTexture(static_cast<uint32_t>(1 + t), materialTable.textures[t], TextureRole::Colour);
 
-    createSyncObjects();
+    // the upload submits the staging copies itself, so it stays on this thread and spreads the
+    // packing of every window over the pool
+    timeline.time("geometry upload", [&]() {
+        uploadSceneGeometry(loaded);
+        finishGeometryUpload();
+        createMaterialsBuffer();
+    });
+    loaded = {};
 
+    timeline.time("BLAS build", [&]() { createRT_BLAS(); });
+    timeline.time("TLAS build", [&]() { createRT_TLAS(); });
 
+    // createGraphicsPipeline();
+    timeline.time("wait pipeline", [&]() { pipeline.get(); });
+    timeline.time("shader binding table", [&]() { createShaderBindingTable(); });
+
+    timeline.time("descriptor sets", [&]() {
+        createDescriptorSets();
+        // createCommandBuffers();
+        createRTCommandBuffers();
+        createSyncObjects();
+    });
+
+    timeline.report(std::cout);
 }
 
 bool RayTracerApp::hasStencilComponent(VkFormat format)
@@ -184,8 +231,9 @@ void RayTracerApp::updateUniformBuffers(uint32_t currentImage)
     camera.dir = glm::vec4(0, 0, 1, 0) * ubo.view;
     camera.up = glm::vec4(0, 1, 0, 0) * ubo.view;
     ubo.inv_view = glm::inverse(ubo.view);
-    ubo.proj =
-        glm::perspective(glm::radians(45.0f), swapChainExtent.width / (float)swapChainExtent.height, 0.1f, 100.0f);
+    camera.eye = glm::vec3(ubo.inv_view[3]);
+    ubo.proj = glm::perspective(glm::radians(FIELD_OF_VIEW), swapChainExtent.width / (float)swapChainExtent.height,
+                                0.1f, 100.0f);
     // necessary as GLM was designed with openGL in mind
     // and Vulkan reverts the y coord
     ubo.proj[1][1] *= -1;
@@ -199,12 +247,70 @@ void RayTracerApp::updateUniformBuffers(uint32_t currentImage)
     // is turned on
     ubo.ao_opt[3] = static_cast<int>(options->getAO());
 
+    ubo.positionOffset = glm::vec4(vertexQuantization.offset, 0.0f);
+    ubo.positionScale = glm::vec4(vertexQuantization.scale, 0.0f);
+
     void *data;
     vkMapMemory(device, uniformBuffersMemory[currentImage], 0, sizeof(ubo), 0, &data);
     memcpy(data, &ubo, sizeof(ubo));
     vkUnmapMemory(device, uniformBuffersMemory[currentImage]);
 }
 
+// Picks the level of detail of every placed instance from the size of its error on screen, the
+// coarsest level whose error stays below the limit of the options dialog wins. The distance is
+// measured to the bounding sphere, so instances around the camera keep the full resolution.
+// Level changes are rare compared to frames, only when one happens an update of the TLAS is
+// recorded and submitted ahead of the frame, so the fence of the frame guards it.
+void RayTracerApp::updateLevelsOfDetail()
+{
+    // the fence of this frame was waited for, its last update is done
+    if (tlasUpdates[currentFrame] != VK_NULL_HANDLE)
+    {
+        vkFreeCommandBuffers(device, graphicsCommandPool, 1, &tlasUpdates[currentFrame]);
+        tlasUpdates[currentFrame] = VK_NULL_HANDLE;
+    }
+
+    const bool enabled = options->getLOD();
+    const float maxPixels = static_cast<float>(options->getLODError());
+    // pixels one unit covers at distance 1, matches the projection in updateUniformBuffers
+    const float pixelsPerUnit = swapChainExtent.height / (2.0f * std::tan(glm::radians(FIELD_OF_VIEW) / 2.0f));
+
+    bool changed = false;
+    for (PlacedInstance &placed : placedInstances)
+    {
+        const MeshPlacement &placement = meshPlacements[placed.sceneMesh][placed.placement];
+        uint32_t level = 0;
+        if (enabled && placement.levels.size() > 1)
+        {
+            const glm::mat4 &transform = placed.transform;
+            const float scale = std::max({glm::length(glm::vec3(transform[0])), glm::length(glm::vec3(transform[1])),
+                                          glm::length(glm::vec3(transform[2]))});
+            const glm::vec3 center = glm::vec3(transform * glm::vec4(glm::vec3(placement.bounds), 1.0f));
+            const float distance = std::max(glm::length(center - camera.eye) - placement.bounds.w * scale, 0.1f);
+
+            level = static_cast<uint32_t>(placement.levels.size() - 1);
+            while (level > 0 && placement.levels[level].error * scale / distance * pixelsPerUnit > maxPixels)
+                --level;
+        }
+
+        if (level != placed.level)
+        {
+            placed.level = level;
+            writeInstanceSlots(placed);
+            changed = true;
+        }
+    }
+    if (!changed)
+        return;
+
+    // the other frames in flight may still read their own copy of the instances
+    memcpy(mappedInstances + tlasInstances.size() * currentFrame, tlasInstances.data(),
+           sizeof(VkAccelerationStructureInstanceKHR) * tlasInstances.size());
+    tlasUpdates[currentFrame] = beginSingleTimeCommands(graphicsCommandPool);
+    recordTLASBuild(tlasUpdates[currentFrame], VK_BUILD_ACCELERATION_STRUCTURE_MODE_UPDATE_KHR, currentFrame);
+    vkEndCommandBuffer(tlasUpdates[currentFrame]);
+}
+
 void RayTracerApp::setupDebugMessenger()
 {
     if (!enableValidationLayers)
@@ -273,8 +379,15 @@ void RayTracerApp::drawRasterFrame()
     }
     imagesInFlight[imageIndex] = inFlightFences[currentFrame];
 
+    // textures that finished decoding are uploaded, the set of this image is free to update
+    uploadStagedTextures();
+    bindUploadedTextures(imageIndex);
+    // the tiles the last frame of this image asked for are streamed, its page table is refreshed
+    streamVirtualTiles(imageIndex);
+
     // UniformBufferObject
     updateUniformBuffers(imageIndex);
+    updateLevelsOfDetail();
     // 2. execture the command buffer with that image as attachment in the
     //      framebuffer
     VkSubmitInfo submitInfo{};
@@ -289,8 +402,11 @@ void RayTracerApp::drawRasterFrame()
     submitInfo.waitSemaphoreCount = 1;
     submitInfo.pWaitSemaphores = waitSemaphores;
     submitInfo.pWaitDstStageMask = waitStages;
-    submitInfo.commandBufferCount = 1;
-    submitInfo.pCommandBuffers = &commandBuffers[imageIndex];
+    // the TLAS update of this frame, if any, runs first
+    VkCommandBuffer frameCommandBuffers[] = {tlasUpdates[currentFrame], commandBuffers[imageIndex]};
+    const uint32_t skipped = tlasUpdates[currentFrame] == VK_NULL_HANDLE ? 1 : 0;
+    submitInfo.commandBufferCount = 2 - skipped;
+    submitInfo.pCommandBuffers = frameCommandBuffers + skipped;
 
     // signal those after the buffer has finished execution
     VkSemaphore signalSemaphores[] = {renderFinishedSemaphores[currentFrame]};
@@ -360,6 +476,10 @@ void RayTracerApp::cleanupSwapChain()
     {
         vkDestroyBuffer(device, uniformBuffers[i], nullptr);
         vkFreeMemory(device, uniformBuffersMemory[i], nullptr);
+        vkDestroyBuffer(device, pageTableBuffers[i], nullptr);
+        vkFreeMemory(device, pageTableBuffersMemory[i], nullptr);
+        vkDestroyBuffer(device, feedbackBuffers[i], nullptr);
+        vkFreeMemory(device, feedbackBuffersMemory[i], nullptr);
     }
 
     vkDestroyDescriptorPool(device, descriptorPool, nullptr);
@@ -369,41 +489,44 @@ void RayTracerApp::cleanup()
 {
     cleanupSwapChain();
 
+    destroyTextureStreams();
     vkDestroySampler(device, textureSampler, nullptr);
+    vkDestroySampler(device, tileSampler, nullptr);
 
-    vkDestroyImageView(device, textureImageView, nullptr);
+    for (const Texture &texture : textures)
+    {
+        vkDestroyImageView(device, texture.view, nullptr);
+        vkDestroyImage(device, texture.image, nullptr);
+        vkFreeMemory(device, texture.memory, nullptr);
+    }
+    vkDestroyImageView(device, placeholderTexture.view, nullptr);
+    vkDestroyImage(device, placeholderTexture.image, nullptr);
+    vkFreeMemory(device, placeholderTexture.memory, nullptr);
+    for (const Texture &cache : tileCaches)
+    {
+        if (cache.image == VK_NULL_HANDLE)
+            continue;
+        vkDestroyImageView(device, cache.view, nullptr);
+        vkDestroyImage(device, cache.image, nullptr);
+        vkFreeMemory(device, cache.memory, nullptr);
+    }
 
-    vkDestroyImage(device, textureImage, nullptr);
-    vkFreeMemory(device, textureImageMemory, nullptr);
+    vkDestroyPipeline(device, downsamplePipeline, nullptr);
+    vkDestroyPipelineLayout(device, downsamplePipelineLayout, nullptr);
+    vkDestroyDescriptorPool(device, downsampleDescriptorPool, nullptr);
+    vkDestroyDescriptorSetLayout(device, downsampleDescriptorSetLayout, nullptr);
 
     vkDestroyDescriptorSetLayout(device, descriptorSetLayout, nullptr);
-    std::cout << "deleting vertexBuffer" << std::endl;
-    vkDestroyBuffer(device, vertexBuffer, nullptr);
-    vkFreeMemory(device, vertexBufferMemory, nullptr);
-    std::cout << "deleting vertexRTBuffer" << std::endl;
-    vkDestroyBuffer(device, vertexRTBuffer, nullptr);
-    vkFreeMemory(device, vertexRTBufferMemory, nullptr);
-    std::cout << "deleting vertexRTDataBuffer" << std::endl;
-    vkDestroyBuffer(device, vertexRTDataBuffer, nullptr);
-    vkFreeMemory(device, vertexRTDataBufferMemory, nullptr);
+    std::cout << "deleting geometryBuffer" << std::endl;
+    vkDestroyBuffer(device, geometryBuffer, nullptr);
     std::cout << "deleting blasScratchBuffer" << std::endl;
     vkDestroyBuffer(device, blasScratchBuffer, nullptr);
     vkFreeMemory(device, blasScratchBufferMemory, nullptr);
-    std::cout << "deleting indexBuffer" << std::endl;
-    vkDestroyBuffer(device, indexBuffer, nullptr);
-    vkFreeMemory(device, indexBufferMemory, nullptr);
-    std::cout << "deleting indexRTBuffer" << std::endl;
-    vkDestroyBuffer(device, indexRTBuffer, nullptr);
-    vkFreeMemory(device, indexRTBufferMemory, nullptr);
-    std::cout << "deleting indexRTDataBuffer" << std::endl;
-    vkDestroyBuffer(device, indexRTDataBuffer, nullptr);
-    vkFreeMemory(device, indexRTDataBufferMemory, nullptr);
     std::cout << "deleting tlasScratchBuffer" << std::endl;
     vkDestroyBuffer(device, tlasScratchBuffer, nullptr);
     vkFreeMemory(device, tlasScratchBufferMemory, nullptr);
-    std::cout << "deleting materialIndexBuffer" << std::endl;
-    vkDestroyBuffer(device, materialIndexBuffer, nullptr);
-    vkFreeMemory(device, materialIndexBufferMemory, nullptr);
+    std::cout << "deleting geometryMemory" << std::endl;
+    vkFreeMemory(device, geometryMemory, nullptr);
     std::cout << "deleting materialBuffer" << std::endl;
     vkDestroyBuffer(device, materialBuffer, nullptr);
     vkFreeMemory(device, materialBufferMemory, nullptr);
@@ -414,7 +537,8 @@ void RayTracerApp::cleanup()
     vkDestroyBuffer(device, instancesBuffer, nullptr);
     vkFreeMemory(device, instancesBufferMemory, nullptr);
 
-    ExtFun::vkDestroyAccelerationStructureKHR(device, blas, nullptr);
+    for (VkAccelerationStructureKHR blas : blases)
+        ExtFun::vkDestroyAccelerationStructureKHR(device, blas, nullptr);
     vkDestroyBuffer(device, blasBuffer, nullptr);
     vkFreeMemory(device, blasBufferMemory, nullptr);
 
@@ -0,0 +1,224 @@
+#include "scene.h"
+
+#include <fstream>
+#include <sstream>
+
+namespace
+{
+bool readFloats(std::istringstream &line, float *values, int count)
+{
+    for (int i = 0; i < count; ++i)
+    {
+        if (!(line >> values[i]))
+            return false;
+    }
+    return true;
+}
+
+// the transform keywords of an instance, appended to transform in the order they are written
+bool readTransform(std::istringstream &line, glm::mat4 &transform, std::string &error)
+{
+    std::string keyword;
+    while (line >> keyword)
+    {
+        float values[4];
+        glm::mat4 step(1.0f);
+        if (keyword == "translate")
+        {
+            if (!readFloats(line, values, 3))
+            {
+                error = "translate needs x y z";
+                return false;
+            }
+            step = glm::translate(step, {values[0], values[1], values[2]});
+        }
+        else if (keyword == "rotate")
+        {
+            if (!readFloats(line, values, 4))
+            {
+                error = "rotate needs degrees x y z";
+                return false;
+            }
+            step = glm::rotate(step, glm::radians(values[0]), {values[1], values[2], values[3]});
+        }
+        else if (keyword == "scale")
+        {
+            if (!readFloats(line, values, 1))
+            {
+                error = "scale needs s or x y z";
+                return false;
+            }
+            // one factor scales uniformly
+            std::istringstream::pos_type position = line.tellg();
+            if (readFloats(line, values + 1, 2))
+            {
+                step = glm::scale(step, {values[0], values[1], values[2]});
+            }
+            else
+            {
+                line.clear();
+                line.seekg(position);
+                step = glm::scale(step, glm::vec3(values[0]));
+            }
+        }
+        else
+        {
+            error = "unknown transform '" + keyword + "'";
+            return false;
+        }
+        transform = step * transform;
+    }
+    return true;
+}
+}  // namespace
+
+bool SceneDescription::parseFromFile(const std::string &path)
+{
+    sceneMeshes = {{"sphere", ""}, {"plane", ""}};
+    sceneInstances.clear();
+    texturePath.clear();
+    errors.clear();
+
+    std::ifstream file(path);
+    if (!file)
+    {
+        errors = "Cannot open file [" + path + "]";
+        return false;
+    }
+
+    auto findMesh = [this](const std::string &name) {
+        for (size_t mesh = 0; mesh < sceneMeshes.size(); ++mesh)
+        {
+            if (sceneMeshes[mesh].name == name)
+                return static_cast<int64_t>(mesh);
+        }
+        return int64_t(-1);
+    };
+
+    // meshes sharing a file map to the first one declared
+    std::vector<uint32_t> aliases = {SphereMesh, PlaneMesh};
+    size_t uniqueMeshes = BuiltinMeshCount;
+
+    std::string text;
+    size_t lineNumber = 0;
+    while (std::getline(file, text))
+    {
+        ++lineNumber;
+        const std::string at = path + ":" + std::to_string(lineNumber) + ": ";
+
+        const size_t comment = text.find('#');
+        if (comment != std::string::npos)
+            text.erase(comment);
+
+        std::istringstream line(text);
+        std::string statement;
+        if (!(line >> statement))
+            continue;
+
+        if (statement == "mesh")
+        {
+            SceneMesh mesh;
+            if (!(line >> mesh.name >> mesh.path))
+            {
+                errors = at + "mesh needs a name and an OBJ path";
+                return false;
+            }
+            if (findMesh(mesh.name) >= 0)
+            {
+                errors = at + "mesh '" + mesh.name + "' is declared twice";
+                return false;
+            }
+
+            uint32_t alias = static_cast<uint32_t>(sceneMeshes.size());
+            for (size_t other = BuiltinMeshCount; other < sceneMeshes.size(); ++other)
+            {
+                if (sceneMeshes[other].path == mesh.path)
+                {
+                    alias = aliases[other];
+                    break;
+                }
+            }
+            if (alias == sceneMeshes.size() && ++uniqueMeshes > MAX_SCENE_MESHES)
+            {
+                errors = at + "more than " + std::to_string(MAX_SCENE_MESHES) + " meshes";
+                return false;
+            }
+            aliases.push_back(alias);
+            sceneMeshes.push_back(mesh);
+        }
+        else if (statement == "texture")
+        {
+            if (!(line >> texturePath))
+            {
+                errors = at + "texture needs an image path";
+                return false;
+            }
+        }
+        else if (statement == "instance")
+        {
+            std::string meshName;
+            std::string materialName;
+            if (!(line >> meshName >> materialName))
+            {
+                errors = at + "instance needs a mesh and a material";
+                return false;
+            }
+
+            const int64_t mesh = findMesh(meshName);
+            if (mesh < 0)
+            {
+                errors = at + "unknown mesh '" + meshName + "'";
+                return false;
+            }
+
+            SceneInstance instance;
+            instance.mesh = aliases[mesh];
+            if (materialName == "textured")
+                instance.materialId = TexturedMaterial;
+            else if (materialName == "mirror")
+                instance.materialId = MirrorMaterial;
+            else
+            {
+                errors = at + "unknown material '" + materialName + "'";
+                return false;
+            }
+
+            instance.transform = glm::mat4(1.0f);
+            std::string transformError;
+            if (!readTransform(line, instance.transform, transformError))
+            {
+                errors = at + transformError;
+                return false;
+            }
+            sceneInstances.push_back(instance);
+        }
+        else
+        {
+            errors = at + "unknown statement '" + statement + "'";
+            return false;
+        }
+    }
+
+    if (texturePath.empty())
+    {
+        errors = path + ": no texture";
+        return false;
+    }
+
+    // aliases are dropped, the remaining meshes are renumbered in order
+    std::vector<uint32_t> ids(sceneMeshes.size());
+    std::vector<SceneMesh> unique;
+    for (size_t mesh = 0; mesh < sceneMeshes.size(); ++mesh)
+    {
+        if (aliases[mesh] == mesh)
+        {
+            ids[mesh] = static_cast<uint32_t>(unique.size());
+            unique.push_back(sceneMeshes[mesh]);
+        }
+    }
+    for (auto &instance : sceneInstances)
+        instance.mesh = ids[instance.mesh];
+    sceneMeshes = std::move(unique);
+
+    return true;
+}
@@ -157,6 +157,17 @@ bool RayTracerApp::isDeviceSuitable(VkPhysicalDevice device)
     VkPhysicalDeviceFeatures supportedFeatures;
     vkGetPhysicalDeviceFeatures(device, &supportedFeatures);
 
+    // what the bindless texture array needs
+    VkPhysicalDeviceDescriptorIndexingFeatures indexingFeatures{
+        VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_FEATURES};
+    VkPhysicalDeviceFeatures2 features2{VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2};
+    features2.pNext = &indexingFeatures;
+    vkGetPhysicalDeviceFeatures2(device, &features2);
+    const bool bindlessSupported = indexingFeatures.runtimeDescriptorArray &&
+                                   indexingFeatures.shaderSampledImageArrayNonUniformIndexing &&
+                                   indexingFeatures.descriptorBindingPartiallyBound &&
+                                   indexingFeatures.descriptorBindingSampledImageUpdateAfterBind;
+
     QueueFamilyIndices indices = findQueueFamilies(device);
 
     bool extensionsSupported = checkDeviceExtensionSupport(device);
@@ -171,7 +182,7 @@ bool RayTracerApp::isDeviceSuitable(VkPhysicalDevice device)
     }
 
     return indices.isComplete() && extensionsSupported && rtSupported && swapChainAdequate &&
-           supportedFeatures.samplerAnisotropy;
+           supportedFeatures.samplerAnisotropy && bindlessSupported;
 }
 
 bool RayTracerApp::checkDeviceExtensionSupport(VkPhysicalDevice device)
@@ -0,0 +1,339 @@
+#include "shape_instancer.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <unordered_map>
+
+namespace
+{
+// corners further apart than this fraction of the shape diagonal do not match
+constexpr double positionTolerance = 1e-4;
+constexpr double normalTolerance = 1e-2;
+constexpr double texCoordTolerance = 1e-5;
+// principal axes whose eigenvalues are closer than this fraction of the largest one are ambiguous
+constexpr double axisSeparation = 1e-3;
+// a TLAS instance and a BLAS of their own are not worth it for smaller shapes
+constexpr size_t minPrototypeTriangles = 16;
+
+struct ShapeFrame
+{
+    uint64_t topologyHash = 0;
+    glm::dvec3 centroid{0.0};
+    // eigenvalues of the position covariance in decreasing order and their unit eigenvectors
+    double eigenvalues[3] = {};
+    glm::dvec3 axes[3];
+    double diagonal = 0.0;
+    bool axesDefined = false;
+};
+
+uint64_t mix(uint64_t hash, uint64_t value)
+{
+    return (hash ^ value) * 0x100000001b3ull;
+}
+
+glm::dvec3 position(const tinyobj::attrib_t &attrib, int index)
+{
+    return {attrib.vertices[3 * index + 0], attrib.vertices[3 * index + 1], attrib.vertices[3 * index + 2]};
+}
+
+glm::dvec3 normal(const tinyobj::attrib_t &attrib, int index)
+{
+    return {attrib.normals[3 * index + 0], attrib.normals[3 * index + 1], attrib.normals[3 * index + 2]};
+}
+
+// Jacobi eigenvalue iteration on a symmetric 3x3 matrix, a is destroyed
+void eigenSymmetric(double a[3][3], double values[3], glm::dvec3 vectors[3])
+{
+    double v[3][3] = {{1.0, 0.0, 0.0}, {0.0, 1.0, 0.0}, {0.0, 0.0, 1.0}};
+    for (int sweep = 0; sweep < 32; ++sweep)
+    {
+        const double off = a[0][1] * a[0][1] + a[0][2] * a[0][2] + a[1][2] * a[1][2];
+        const double diagonal = a[0][0] * a[0][0] + a[1][1] * a[1][1] + a[2][2] * a[2][2];
+        if (off <= 1e-30 * diagonal || off == 0.0)
+            break;
+
+        for (int p = 0; p < 2; ++p)
+        {
+            for (int q = p + 1; q < 3; ++q)
+            {
+                if (a[p][q] == 0.0)
+                    continue;
+
+                const double theta = (a[q][q] - a[p][p]) / (2.0 * a[p][q]);
+                const double t = (theta >= 0.0 ? 1.0 : -1.0) / (std::abs(theta) + std::sqrt(theta * theta + 1.0));
+                const double c = 1.0 / std::sqrt(t * t + 1.0);
+                const double s = t * c;
+
+                for (int k = 0; k < 3; ++k)
+                {
+                    const double kp = a[k][p];
+                    const double kq = a[k][q];
+                    a[k][p] = c * kp - s * kq;
+                    a[k][q] = s * kp + c * kq;
+                }
+                for (int k = 0; k < 3; ++k)
+                {
+                    const double pk = a[p][k];
+                    const double qk = a[q][k];
+                    a[p][k] = c * pk - s * qk;
+                    a[q][k] = s * pk + c * qk;
+                }
+                for (int k = 0; k < 3; ++k)
+                {
+                    const double kp = v[k][p];
+                    const double kq = v[k][q];
+                    v[k][p] = c * kp - s * kq;
+                    v[k][q] = s * kp + c * kq;
+                }
+            }
+        }
+    }
+
+    int order[3] = {0, 1, 2};
+    std::sort(order, order + 3, [&](int x, int y) { return a[x][x] > a[y][y]; });
+    for (int i = 0; i < 3; ++i)
+    {
+        values[i] = a[order[i]][order[i]];
+        vectors[i] = {v[0][order[i]], v[1][order[i]], v[2][order[i]]};
+    }
+}
+
+ShapeFrame shapeFrame(const tinyobj::attrib_t &attrib, const tinyobj::mesh_t &mesh)
+{
+    ShapeFrame frame;
+
+    // the indices of every attribute are numbered in the order the shape first uses them, so
+    // copies that reference their own vertices hash the same
+    std::unordered_map<int, uint32_t> localIds[3];
+    auto localId = [&](int kind, int index) {
+        if (index < 0)
+            return UINT32_MAX;
+        return localIds[kind].emplace(index, static_cast<uint32_t>(localIds[kind].size())).first->second;
+    };
+
+    uint64_t hash = mix(0xcbf29ce484222325ull, mesh.indices.size());
+    glm::dvec3 minimum(INFINITY);
+    glm::dvec3 maximum(-INFINITY);
+    for (const tinyobj::index_t &index : mesh.indices)
+    {
+        hash = mix(hash, localId(0, index.vertex_index));
+        hash = mix(hash, localId(1, index.normal_index));
+        hash = mix(hash, localId(2, index.texcoord_index));
+
+        const glm::dvec3 pos = position(attrib, index.vertex_index);
+        frame.centroid += pos;
+        minimum = glm::min(minimum, pos);
+        maximum = glm::max(maximum, pos);
+    }
+    for (int material : mesh.material_ids)
+        hash = mix(hash, static_cast<uint32_t>(material));
+    frame.topologyHash = hash;
+
+    if (mesh.indices.empty())
+        return frame;
+
+    frame.centroid /= static_cast<double>(mesh.indices.size());
+    frame.diagonal = glm::length(maximum - minimum);
+
+    double covariance[3][3] = {};
+    for (const tinyobj::index_t &index : mesh.indices)
+    {
+        const glm::dvec3 d = position(attrib, index.vertex_index) - frame.centroid;
+        for (int row = 0; row < 3; ++row)
+        {
+            for (int column = 0; column < 3; ++column)
+                covariance[row][column] += d[row] * d[column];
+        }
+    }
+    for (auto &row : covariance)
+    {
+        for (double &value : row)
+            value /= static_cast<double>(mesh.indices.size());
+    }
+
+    eigenSymmetric(covariance, frame.eigenvalues, frame.axes);
+
+    // the third axis is the cross product of the first two, so only those have to be distinct
+    const double separation = axisSeparation * frame.eigenvalues[0];
+    frame.axesDefined = frame.eigenvalues[0] - frame.eigenvalues[1] > separation &&
+                        frame.eigenvalues[1] - frame.eigenvalues[2] > separation;
+    return frame;
+}
+
+// maps the points of a onto the points of b, both relative to their centroids
+glm::dmat3 frameRotation(const tinyobj::attrib_t &attrib, const tinyobj::mesh_t &a, const ShapeFrame &frameA,
+                         const tinyobj::mesh_t &b, const ShapeFrame &frameB)
+{
+    // the sign of an eigenvector is arbitrary, corresponding corners project onto matching axes
+    // with the same sign
+    double signs[2];
+    for (int axis = 0; axis < 2; ++axis)
+    {
+        double agreement = 0.0;
+        for (size_t corner = 0; corner < a.indices.size(); ++corner)
+        {
+            const double projectionA =
+                glm::dot(position(attrib, a.indices[corner].vertex_index) - frameA.centroid, frameA.axes[axis]);
+            const double projectionB =
+                glm::dot(position(attrib, b.indices[corner].vertex_index) - frameB.centroid, frameB.axes[axis]);
+            agreement += projectionA * projectionB;
+        }
+        signs[axis] = agreement >= 0.0 ? 1.0 : -1.0;
+    }
+
+    // both frames are right handed, which rules out mirrored copies
+    const glm::dvec3 b0 = signs[0] * frameB.axes[0];
+    const glm::dvec3 b1 = signs[1] * frameB.axes[1];
+    const glm::dmat3 fromA =
+        glm::transpose(glm::dmat3(frameA.axes[0], frameA.axes[1], glm::cross(frameA.axes[0], frameA.axes[1])));
+    const glm::dmat3 toB(b0, b1, glm::cross(b0, b1));
+    return toB * fromA;
+}
+
+bool matches(const tinyobj::attrib_t &attrib, const tinyobj::mesh_t &a, const ShapeFrame &frameA,
+             const tinyobj::mesh_t &b, const ShapeFrame &frameB, const glm::dmat3 &rotation)
+{
+    const glm::dvec3 translation = frameB.centroid - rotation * frameA.centroid;
+    const double tolerance = positionTolerance * frameA.diagonal + 1e-7;
+
+    for (size_t corner = 0; corner < a.indices.size(); ++corner)
+    {
+        const tinyobj::index_t &ia = a.indices[corner];
+        const tinyobj::index_t &ib = b.indices[corner];
+
+        const glm::dvec3 moved = rotation * position(attrib, ia.vertex_index) + translation;
+        if (glm::length(moved - position(attrib, ib.vertex_index)) > tolerance)
+            return false;
+
+        if ((ia.normal_index < 0) != (ib.normal_index < 0))
+            return false;
+        if (ia.normal_index >= 0 &&
+            glm::length(rotation * normal(attrib, ia.normal_index) - normal(attrib, ib.normal_index)) > normalTolerance)
+            return false;
+
+        if ((ia.texcoord_index < 0) != (ib.texcoord_index < 0))
+            return false;
+        for (int i = 0; ia.texcoord_index >= 0 && i < 2; ++i)
+        {
+            if (std::abs(attrib.texcoords[2 * ia.texcoord_index + i] - attrib.texcoords[2 * ib.texcoord_index + i]) >
+                texCoordTolerance)
+                return false;
+        }
+    }
+    return true;
+}
+
+// the rigid transform from shape a to shape b if b is a copy of a
+bool findTransform(const tinyobj::attrib_t &attrib, const tinyobj::mesh_t &a, const ShapeFrame &frameA,
+                   const tinyobj::mesh_t &b, const ShapeFrame &frameB, glm::mat4 &transform)
+{
+    if (a.indices.size() != b.indices.size() || a.material_ids != b.material_ids)
+        return false;
+
+    // the eigenvalues do not change under rotation, a cheap test before touching every corner
+    const double spread = std::max(frameA.eigenvalues[0], frameB.eigenvalues[0]);
+    for (int i = 0; i < 3; ++i)
+    {
+        if (std::abs(frameA.eigenvalues[i] - frameB.eigenvalues[i]) > axisSeparation * spread)
+            return false;
+    }
+
+    glm::dmat3 rotation(1.0);
+    if (frameA.axesDefined && frameB.axesDefined)
+        rotation = frameRotation(attrib, a, frameA, b, frameB);
+    if (!matches(attrib, a, frameA, b, frameB, rotation))
+        return false;
+
+    transform = glm::mat4(glm::mat3(rotation));
+    transform[3] = glm::vec4(glm::vec3(frameB.centroid - rotation * frameA.centroid), 1.0f);
+    return true;
+}
+}  // namespace
+
+ShapeInstancing findDuplicateShapes(const tinyobj::attrib_t &attrib, const std::vector<tinyobj::shape_t> &shapes,
+                                    size_t maxPrototypes, ThreadPool &pool)
+{
+    auto start = std::chrono::high_resolution_clock::now();
+
+    ShapeInstancing result;
+    result.stats.shapes = shapes.size();
+
+    std::vector<ShapeFrame> frames(shapes.size());
+    pool.parallelFor(0, shapes.size(), 1, [&](size_t first, size_t last) {
+        for (size_t s = first; s < last; ++s)
+            frames[s] = shapeFrame(attrib, shapes[s].mesh);
+    });
+
+    // every shape is compared against the prototypes with the same topology, in file order so
+    // the first occurrence becomes the prototype
+    struct Candidate
+    {
+        ShapePrototype prototype;
+        std::vector<size_t> copies;
+    };
+    std::vector<Candidate> candidates;
+    std::unordered_map<uint64_t, std::vector<size_t>> byTopology;
+    for (size_t s = 0; s < shapes.size(); ++s)
+    {
+        result.stats.triangles += shapes[s].mesh.indices.size() / 3;
+        if (shapes[s].mesh.indices.empty())
+            continue;
+
+        auto &group = byTopology[frames[s].topologyHash];
+        bool found = false;
+        for (size_t c : group)
+        {
+            Candidate &candidate = candidates[c];
+            const size_t prototype = candidate.prototype.shape;
+            glm::mat4 transform;
+            if (findTransform(attrib, shapes[prototype].mesh, frames[prototype], shapes[s].mesh, frames[s], transform))
+            {
+                candidate.prototype.transforms.push_back(transform);
+                candidate.copies.push_back(s);
+                found = true;
+                break;
+            }
+        }
+        if (!found)
+        {
+            group.push_back(candidates.size());
+            candidates.push_back({{s, {glm::mat4(1.0f)}}, {s}});
+        }
+    }
+
+    // the prototypes that remove the most triangles are kept, the copies of the others are
+    // flattened like unique shapes
+    auto savedTriangles = [&](const Candidate &candidate) {
+        const size_t triangles = shapes[candidate.prototype.shape].mesh.indices.size() / 3;
+        return (candidate.copies.size() - 1) * triangles;
+    };
+    std::stable_sort(candidates.begin(), candidates.end(), [&](const Candidate &x, const Candidate &y) {
+        return savedTriangles(x) > savedTriangles(y);
+    });
+
+    std::vector<bool> instanced(shapes.size(), false);
+    for (auto &candidate : candidates)
+    {
+        const size_t triangles = shapes[candidate.prototype.shape].mesh.indices.size() / 3;
+        if (candidate.copies.size() < 2 || triangles < minPrototypeTriangles ||
+            result.prototypes.size() == maxPrototypes)
+            continue;
+
+        for (size_t s : candidate.copies)
+            instanced[s] = true;
+        result.stats.duplicateShapes += candidate.copies.size() - 1;
+        result.stats.duplicateTriangles += savedTriangles(candidate);
+        result.prototypes.push_back(std::move(candidate.prototype));
+    }
+
+    for (size_t s = 0; s < shapes.size(); ++s)
+    {
+        if (!instanced[s])
+            result.uniqueShapes.push_back(s);
+    }
+
+    result.stats.milliseconds =
+        std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+    return result;
+}
@@ -0,0 +1,79 @@
+#include "startup_timeline.h"
+
+#include <algorithm>
+#include <iomanip>
+
+StartupTimeline::Phase::Phase(StartupTimeline &timeline, std::string name)
+    : timeline(timeline), name(std::move(name)), begin(timeline.now())
+{
+}
+
+StartupTimeline::Phase::~Phase()
+{
+    timeline.record(std::move(name), begin);
+}
+
+StartupTimeline::StartupTimeline()
+{
+    restart();
+}
+
+void StartupTimeline::restart()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    start = std::chrono::high_resolution_clock::now();
+    owner = std::this_thread::get_id();
+    records.clear();
+}
+
+double StartupTimeline::now() const
+{
+    return std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+}
+
+void StartupTimeline::record(std::string name, double begin)
+{
+    const double end = now();
+    std::lock_guard<std::mutex> lock(mutex);
+    records.push_back({std::move(name), std::this_thread::get_id(), begin, end});
+}
+
+void StartupTimeline::report(std::ostream &out) const
+{
+    std::vector<Record> sorted;
+    std::vector<std::thread::id> threads;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        sorted = records;
+        threads.push_back(owner);
+    }
+    std::stable_sort(sorted.begin(), sorted.end(), [](const Record &a, const Record &b) { return a.begin < b.begin; });
+
+    // thread 0 called restart, the others are numbered in the order they show up
+    size_t nameWidth = 0;
+    double busy = 0.0;
+    double total = 0.0;
+    for (const Record &record : sorted)
+    {
+        if (std::find(threads.begin(), threads.end(), record.thread) == threads.end())
+            threads.push_back(record.thread);
+        nameWidth = std::max(nameWidth, record.name.size());
+        busy += record.end - record.begin;
+        total = std::max(total, record.end);
+    }
+
+    const auto flags = out.flags();
+    const auto precision = out.precision();
+    out << std::fixed << std::setprecision(1);
+    out << "startup took " << total << " ms, its " << sorted.size() << " phases add up to " << busy << " ms on "
+        << threads.size() << " threads" << std::endl;
+    for (const Record &record : sorted)
+    {
+        const size_t thread = std::find(threads.begin(), threads.end(), record.thread) - threads.begin();
+        out << "  " << std::left << std::setw(static_cast<int>(nameWidth)) << record.name << std::right << " "
+            << std::setw(8) << record.begin << " .. " << std::setw(8) << record.end << " ms " << std::setw(8)
+            << record.end - record.begin << " ms  thread " << thread << std::endl;
+    }
+    out.flags(flags);
+    out.precision(precision);
+}
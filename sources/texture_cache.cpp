@@ -0,0 +1,302 @@
+#include "texture_cache.h"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+
+namespace
+{
+constexpr char cacheMagic[8] = {'R', 'T', 'X', 'T', 'E', 'X', 'R', '\0'};
+constexpr uint32_t cacheVersion = 3;
+constexpr uint64_t sectionAlignment = 16;
+constexpr size_t grainTexels = 16384;
+
+struct Section
+{
+    uint64_t offset;
+    uint64_t size;
+};
+
+struct TextureCacheHeader
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t levelCount;
+    TextureFormat format;
+    uint32_t reserved;
+
+    // the source image when the cache was written
+    uint64_t sourceSize;
+    int64_t sourceModified;
+    uint64_t sourceHash;
+
+    Section pixels;
+    Section levels;
+};
+
+uint64_t alignUp(uint64_t value, uint64_t alignment)
+{
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+bool sectionInFile(const Section &section, size_t fileSize)
+{
+    return section.offset % sectionAlignment == 0 && section.offset <= fileSize &&
+           section.size <= fileSize - section.offset;
+}
+
+const std::array<float, 256> &srgbToLinear()
+{
+    static const std::array<float, 256> table = []() {
+        std::array<float, 256> values;
+        for (size_t i = 0; i < values.size(); ++i)
+        {
+            const float c = static_cast<float>(i) / 255.0f;
+            values[i] = c <= 0.04045f ? c / 12.92f : std::pow((c + 0.055f) / 1.055f, 2.4f);
+        }
+        return values;
+    }();
+    return table;
+}
+
+uint8_t linearToSrgb(float linear)
+{
+    const float l = std::min(1.0f, std::max(0.0f, linear));
+    const float c = l <= 0.0031308f ? l * 12.92f : 1.055f * std::pow(l, 1.0f / 2.4f) - 0.055f;
+    return static_cast<uint8_t>(std::lround(c * 255.0f));
+}
+
+uint8_t toUnorm8(float f)
+{
+    return static_cast<uint8_t>(std::lround(std::min(1.0f, std::max(0.0f, f)) * 255.0f));
+}
+
+// source texels covered by a destination texel along one axis and their coverage, a level of
+// half the size covers two texels, or up to four partially when the source size is odd
+struct Taps
+{
+    uint32_t first;
+    uint32_t count;
+    float weights[4];
+};
+
+std::vector<Taps> boxTaps(uint32_t sourceSize, uint32_t size)
+{
+    const double ratio = static_cast<double>(sourceSize) / size;
+    std::vector<Taps> taps(size);
+    for (uint32_t i = 0; i < size; ++i)
+    {
+        const double begin = i * ratio;
+        const double end = (i + 1) * ratio;
+        Taps &tap = taps[i];
+        tap.first = static_cast<uint32_t>(begin);
+        tap.count = 0;
+        for (uint32_t j = tap.first; j < sourceSize && j < end && tap.count < 4; ++j)
+        {
+            const double overlap = std::min<double>(j + 1, end) - std::max<double>(j, begin);
+            tap.weights[tap.count++] = static_cast<float>(overlap / ratio);
+        }
+    }
+    return taps;
+}
+}  // namespace
+
+uint64_t textureLevelSize(TextureFormat format, uint32_t width, uint32_t height)
+{
+    const uint64_t blocks = uint64_t((width + 3) / 4) * ((height + 3) / 4);
+    switch (format)
+    {
+    case TextureFormat::RGBA8:
+        return uint64_t(width) * height * 4;
+    case TextureFormat::BC1:
+        return blocks * 8;
+    default:
+        return blocks * 16;
+    }
+}
+
+MipChain buildMipChain(const uint8_t *pixels, uint32_t width, uint32_t height, bool srgb, ThreadPool &pool)
+{
+    MipChain chain;
+    uint64_t size = 0;
+    for (uint32_t w = width, h = height;; w = std::max(1u, w / 2), h = std::max(1u, h / 2))
+    {
+        chain.levels.push_back({size, w, h});
+        size += uint64_t(w) * h * 4;
+        if (w == 1 && h == 1)
+            break;
+    }
+
+    chain.pixels.resize(size);
+    std::copy_n(pixels, uint64_t(width) * height * 4, chain.pixels.begin());
+
+    std::array<float, 256> unorm;
+    for (size_t i = 0; i < unorm.size(); ++i)
+        unorm[i] = static_cast<float>(i) / 255.0f;
+    const std::array<float, 256> &linear = srgb ? srgbToLinear() : unorm;
+    for (size_t l = 1; l < chain.levels.size(); ++l)
+    {
+        const TextureLevel &source = chain.levels[l - 1];
+        const TextureLevel &level = chain.levels[l];
+        const uint8_t *src = chain.pixels.data() + source.offset;
+        uint8_t *dst = chain.pixels.data() + level.offset;
+        const std::vector<Taps> columns = boxTaps(source.width, level.width);
+        const std::vector<Taps> rows = boxTaps(source.height, level.height);
+
+        const size_t grainRows = std::max<size_t>(1, grainTexels / level.width);
+        pool.parallelFor(0, level.height, grainRows, [&](size_t first, size_t last) {
+            for (size_t y = first; y < last; ++y)
+            {
+                const Taps &row = rows[y];
+                for (uint32_t x = 0; x < level.width; ++x)
+                {
+                    const Taps &column = columns[x];
+                    float sum[4] = {0.0f, 0.0f, 0.0f, 0.0f};
+                    for (uint32_t j = 0; j < row.count; ++j)
+                    {
+                        const uint8_t *texel = src + (uint64_t(row.first + j) * source.width + column.first) * 4;
+                        for (uint32_t i = 0; i < column.count; ++i, texel += 4)
+                        {
+                            const float weight = row.weights[j] * column.weights[i];
+                            sum[0] += weight * linear[texel[0]];
+                            sum[1] += weight * linear[texel[1]];
+                            sum[2] += weight * linear[texel[2]];
+                            sum[3] += weight * (texel[3] / 255.0f);
+                        }
+                    }
+
+                    uint8_t *out = dst + (y * level.width + x) * 4;
+                    out[0] = srgb ? linearToSrgb(sum[0]) : toUnorm8(sum[0]);
+                    out[1] = srgb ? linearToSrgb(sum[1]) : toUnorm8(sum[1]);
+                    out[2] = srgb ? linearToSrgb(sum[2]) : toUnorm8(sum[2]);
+                    out[3] = toUnorm8(sum[3]);
+                }
+            }
+        });
+    }
+    return chain;
+}
+
+bool TextureCache::open(const std::string &cachePath, const std::string &sourcePath, bool compressed)
+{
+    close();
+    if (!file.open(cachePath))
+        return false;
+
+    const auto *header = reinterpret_cast<const TextureCacheHeader *>(file.data());
+    bool valid = file.size() >= sizeof(TextureCacheHeader) &&
+                 memcmp(header->magic, cacheMagic, sizeof(cacheMagic)) == 0 && header->version == cacheVersion &&
+                 header->levelCount > 0 && header->format <= TextureFormat::BC7 &&
+                 (header->format != TextureFormat::RGBA8) == compressed;
+
+    valid = valid && sectionInFile(header->pixels, file.size()) && sectionInFile(header->levels, file.size()) &&
+            header->levels.size == header->levelCount * sizeof(TextureLevel);
+    if (valid)
+    {
+        for (const TextureLevel &level : levels())
+        {
+            const uint64_t levelSize = textureLevelSize(header->format, level.width, level.height);
+            valid = valid && level.offset <= header->pixels.size && levelSize <= header->pixels.size - level.offset;
+        }
+    }
+
+    // like the mesh cache the source is checked by size and modification time first and only
+    // hashed again when those differ
+    FileStamp stamp;
+    valid = valid && getFileStamp(sourcePath, stamp);
+    if (valid && (stamp.size != header->sourceSize || stamp.modified != header->sourceModified))
+    {
+        uint64_t hash;
+        valid = hashFile(sourcePath, hash) && hash == header->sourceHash;
+    }
+
+    if (!valid)
+        close();
+    return valid;
+}
+
+void TextureCache::close()
+{
+    file.close();
+}
+
+TextureFormat TextureCache::format() const
+{
+    if (!file.isOpen())
+        return TextureFormat::RGBA8;
+    return reinterpret_cast<const TextureCacheHeader *>(file.data())->format;
+}
+
+const uint8_t *TextureCache::pixels() const
+{
+    if (!file.isOpen())
+        return nullptr;
+    return file.data() + reinterpret_cast<const TextureCacheHeader *>(file.data())->pixels.offset;
+}
+
+uint64_t TextureCache::pixelSize() const
+{
+    if (!file.isOpen())
+        return 0;
+    return reinterpret_cast<const TextureCacheHeader *>(file.data())->pixels.size;
+}
+
+std::vector<TextureLevel> TextureCache::levels() const
+{
+    std::vector<TextureLevel> levels;
+    if (!file.isOpen())
+        return levels;
+
+    const auto *header = reinterpret_cast<const TextureCacheHeader *>(file.data());
+    levels.resize(header->levelCount);
+    memcpy(levels.data(), file.data() + header->levels.offset, header->levels.size);
+    return levels;
+}
+
+bool TextureCache::write(const std::string &cachePath, const std::string &sourcePath, const MipChain &chain)
+{
+    FileStamp stamp;
+    uint64_t hash;
+    if (!getFileStamp(sourcePath, stamp) || !hashFile(sourcePath, hash))
+        return false;
+
+    TextureCacheHeader header{};
+    memcpy(header.magic, cacheMagic, sizeof(cacheMagic));
+    header.version = cacheVersion;
+    header.levelCount = static_cast<uint32_t>(chain.levels.size());
+    header.format = chain.format;
+    header.sourceSize = stamp.size;
+    header.sourceModified = stamp.modified;
+    header.sourceHash = hash;
+
+    header.pixels.offset = alignUp(sizeof(TextureCacheHeader), sectionAlignment);
+    header.pixels.size = chain.pixels.size();
+    header.levels.offset = alignUp(header.pixels.offset + header.pixels.size, sectionAlignment);
+    header.levels.size = chain.levels.size() * sizeof(TextureLevel);
+
+    // written to a temporary file first so a crash never leaves a torn cache behind
+    const std::string tempPath = cachePath + ".tmp";
+    {
+        std::ofstream out(tempPath, std::ios::binary | std::ios::trunc);
+        if (!out.is_open())
+            return false;
+
+        const char padding[sectionAlignment] = {};
+        out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+        out.write(padding, static_cast<std::streamsize>(header.pixels.offset - sizeof(header)));
+        out.write(reinterpret_cast<const char *>(chain.pixels.data()),
+                  static_cast<std::streamsize>(header.pixels.size));
+        out.write(padding,
+                  static_cast<std::streamsize>(header.levels.offset - header.pixels.offset - header.pixels.size));
+        out.write(reinterpret_cast<const char *>(chain.levels.data()),
+                  static_cast<std::streamsize>(header.levels.size));
+
+        if (!out.good())
+            return false;
+    }
+
+    return std::rename(tempPath.c_str(), cachePath.c_str()) == 0;
+}
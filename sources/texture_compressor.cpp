@@ -0,0 +1,716 @@
+#include "texture_compressor.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <limits>
+#include <vector>
+
+namespace
+{
+constexpr size_t grainBlocks = 1024;
+constexpr int powerIterations = 8;
+constexpr int refineIterations = 2;
+
+// BC7 interpolation weights of 4 bit indices
+constexpr int bc7Weights[16] = {0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64};
+
+// the 16 texels of a 4x4 block, one array per channel so the loops over a block vectorize
+struct Block
+{
+    float channels[4][16];
+};
+
+// texels past the edge of a level repeat its last row or column
+Block loadBlock(const uint8_t *pixels, uint32_t width, uint32_t height, uint32_t bx, uint32_t by)
+{
+    Block block;
+    for (uint32_t i = 0; i < 16; ++i)
+    {
+        const uint32_t x = std::min(bx * 4 + i % 4, width - 1);
+        const uint32_t y = std::min(by * 4 + i / 4, height - 1);
+        const uint8_t *texel = pixels + (uint64_t(y) * width + x) * 4;
+        for (int c = 0; c < 4; ++c)
+            block.channels[c][i] = texel[c];
+    }
+    return block;
+}
+
+int clampByte(float value)
+{
+    return std::min(255, std::max(0, static_cast<int>(std::lround(value))));
+}
+
+// mean and principal axis of the first channelCount channels, the axis is zero for flat blocks
+void principalAxis(const Block &block, int channelCount, float mean[4], float axis[4])
+{
+    for (int c = 0; c < channelCount; ++c)
+    {
+        float sum = 0.0f;
+        for (int i = 0; i < 16; ++i)
+            sum += block.channels[c][i];
+        mean[c] = sum / 16.0f;
+    }
+
+    float covariance[4][4] = {};
+    for (int a = 0; a < channelCount; ++a)
+    {
+        for (int b = a; b < channelCount; ++b)
+        {
+            float sum = 0.0f;
+            for (int i = 0; i < 16; ++i)
+                sum += (block.channels[a][i] - mean[a]) * (block.channels[b][i] - mean[b]);
+            covariance[a][b] = covariance[b][a] = sum;
+        }
+    }
+
+    // power iteration from the row of the channel with the largest spread
+    int widest = 0;
+    for (int c = 1; c < channelCount; ++c)
+        widest = covariance[c][c] > covariance[widest][widest] ? c : widest;
+    for (int c = 0; c < 4; ++c)
+        axis[c] = c < channelCount ? covariance[widest][c] : 0.0f;
+    for (int iteration = 0; iteration < powerIterations; ++iteration)
+    {
+        float next[4] = {};
+        float length = 0.0f;
+        for (int a = 0; a < channelCount; ++a)
+        {
+            for (int b = 0; b < channelCount; ++b)
+                next[a] += covariance[a][b] * axis[b];
+            length += next[a] * next[a];
+        }
+        length = std::sqrt(length);
+        for (int c = 0; c < channelCount; ++c)
+            axis[c] = length > 0.0f ? next[c] / length : 0.0f;
+    }
+}
+
+// endpoints at the extremes of the block along its principal axis
+void axisEndpoints(const Block &block, int channelCount, float low[4], float high[4])
+{
+    float mean[4], axis[4];
+    principalAxis(block, channelCount, mean, axis);
+    float minimum = 0.0f, maximum = 0.0f;
+    for (int i = 0; i < 16; ++i)
+    {
+        float t = 0.0f;
+        for (int c = 0; c < channelCount; ++c)
+            t += (block.channels[c][i] - mean[c]) * axis[c];
+        minimum = std::min(minimum, t);
+        maximum = std::max(maximum, t);
+    }
+    for (int c = 0; c < channelCount; ++c)
+    {
+        low[c] = mean[c] + axis[c] * minimum;
+        high[c] = mean[c] + axis[c] * maximum;
+    }
+}
+
+// least squares endpoints for fixed interpolation weights, weight 0 is the low and 1 the high
+// endpoint, returns false when every texel has the same weight
+bool fitEndpoints(const Block &block, int channelCount, const float weights[16], float low[4], float high[4])
+{
+    float aa = 0.0f, ab = 0.0f, bb = 0.0f;
+    float ax[4] = {}, bx[4] = {};
+    for (int i = 0; i < 16; ++i)
+    {
+        const float b = weights[i];
+        const float a = 1.0f - b;
+        aa += a * a;
+        ab += a * b;
+        bb += b * b;
+        for (int c = 0; c < channelCount; ++c)
+        {
+            ax[c] += a * block.channels[c][i];
+            bx[c] += b * block.channels[c][i];
+        }
+    }
+
+    const float determinant = aa * bb - ab * ab;
+    if (std::abs(determinant) < 1e-6f)
+        return false;
+    for (int c = 0; c < channelCount; ++c)
+    {
+        low[c] = std::min(255.0f, std::max(0.0f, (bb * ax[c] - ab * bx[c]) / determinant));
+        high[c] = std::min(255.0f, std::max(0.0f, (aa * bx[c] - ab * ax[c]) / determinant));
+    }
+    return true;
+}
+
+// little endian bit stream of the BC7 blocks
+class BitWriter
+{
+public:
+    explicit BitWriter(uint8_t *out) : out(out) { std::fill(out, out + 16, 0); }
+
+    void put(uint32_t value, uint32_t bits)
+    {
+        for (uint32_t b = 0; b < bits; ++b, ++position)
+            out[position / 8] |= ((value >> b) & 1u) << (position % 8);
+    }
+
+private:
+    uint8_t *out;
+    uint32_t position = 0;
+};
+
+class BitReader
+{
+public:
+    explicit BitReader(const uint8_t *in) : in(in) {}
+
+    uint32_t get(uint32_t bits)
+    {
+        uint32_t value = 0;
+        for (uint32_t b = 0; b < bits; ++b, ++position)
+            value |= ((in[position / 8] >> (position % 8)) & 1u) << b;
+        return value;
+    }
+
+private:
+    const uint8_t *in;
+    uint32_t position = 0;
+};
+
+//----------------------------------------------------------------------------- BC1
+
+uint16_t pack565(const float colour[3])
+{
+    const int r = std::min(31, std::max(0, static_cast<int>(std::lround(colour[0] * 31.0f / 255.0f))));
+    const int g = std::min(63, std::max(0, static_cast<int>(std::lround(colour[1] * 63.0f / 255.0f))));
+    const int b = std::min(31, std::max(0, static_cast<int>(std::lround(colour[2] * 31.0f / 255.0f))));
+    return static_cast<uint16_t>((r << 11) | (g << 5) | b);
+}
+
+void unpack565(uint16_t packed, int colour[3])
+{
+    const int r = packed >> 11, g = (packed >> 5) & 63, b = packed & 31;
+    colour[0] = (r << 3) | (r >> 2);
+    colour[1] = (g << 2) | (g >> 4);
+    colour[2] = (b << 3) | (b >> 2);
+}
+
+// the four colour palette when c0 > c1, or the colour block of BC3 which always has four
+void bc1Palette(uint16_t c0, uint16_t c1, bool fourColours, int palette[4][3])
+{
+    unpack565(c0, palette[0]);
+    unpack565(c1, palette[1]);
+    for (int c = 0; c < 3; ++c)
+    {
+        if (fourColours)
+        {
+            palette[2][c] = (2 * palette[0][c] + palette[1][c] + 1) / 3;
+            palette[3][c] = (palette[0][c] + 2 * palette[1][c] + 1) / 3;
+        }
+        else
+        {
+            palette[2][c] = (palette[0][c] + palette[1][c] + 1) / 2;
+            palette[3][c] = 0;
+        }
+    }
+}
+
+struct ColourCandidate
+{
+    uint16_t c0;
+    uint16_t c1;
+    uint8_t indices[16];
+    float error;
+};
+
+// orders and quantizes the endpoints and picks the nearest palette entry of every texel
+ColourCandidate bc1Candidate(const Block &block, const float high[3], const float low[3])
+{
+    ColourCandidate candidate;
+    candidate.c0 = pack565(high);
+    candidate.c1 = pack565(low);
+    if (candidate.c0 < candidate.c1)
+        std::swap(candidate.c0, candidate.c1);
+
+    // equal endpoints switch the decoder to three colours, index 0 is the colour in both modes
+    const int entries = candidate.c0 == candidate.c1 ? 1 : 4;
+    int palette[4][3];
+    bc1Palette(candidate.c0, candidate.c1, true, palette);
+
+    candidate.error = 0.0f;
+    for (int i = 0; i < 16; ++i)
+    {
+        float best = std::numeric_limits<float>::max();
+        for (int p = 0; p < entries; ++p)
+        {
+            float error = 0.0f;
+            for (int c = 0; c < 3; ++c)
+            {
+                const float d = block.channels[c][i] - palette[p][c];
+                error += d * d;
+            }
+            if (error < best)
+            {
+                best = error;
+                candidate.indices[i] = static_cast<uint8_t>(p);
+            }
+        }
+        candidate.error += best;
+    }
+    return candidate;
+}
+
+void encodeColourBlock(const Block &block, uint8_t out[8])
+{
+    float low[4], high[4];
+    axisEndpoints(block, 3, low, high);
+    ColourCandidate best = bc1Candidate(block, high, low);
+
+    // the weight of c1 of every palette entry, c0 is the high endpoint
+    static const float paletteWeights[4] = {0.0f, 1.0f, 1.0f / 3.0f, 2.0f / 3.0f};
+    for (int iteration = 0; iteration < refineIterations && best.c0 != best.c1; ++iteration)
+    {
+        float weights[16];
+        for (int i = 0; i < 16; ++i)
+            weights[i] = 1.0f - paletteWeights[best.indices[i]];
+        if (!fitEndpoints(block, 3, weights, low, high))
+            break;
+        const ColourCandidate refined = bc1Candidate(block, high, low);
+        if (refined.error >= best.error)
+            break;
+        best = refined;
+    }
+
+    uint32_t indices = 0;
+    for (int i = 0; i < 16; ++i)
+        indices |= uint32_t(best.indices[i]) << (2 * i);
+    out[0] = static_cast<uint8_t>(best.c0);
+    out[1] = static_cast<uint8_t>(best.c0 >> 8);
+    out[2] = static_cast<uint8_t>(best.c1);
+    out[3] = static_cast<uint8_t>(best.c1 >> 8);
+    for (int b = 0; b < 4; ++b)
+        out[4 + b] = static_cast<uint8_t>(indices >> (8 * b));
+}
+
+void decodeColourBlock(const uint8_t in[8], bool alwaysFourColours, uint8_t texels[64])
+{
+    const uint16_t c0 = static_cast<uint16_t>(in[0] | (in[1] << 8));
+    const uint16_t c1 = static_cast<uint16_t>(in[2] | (in[3] << 8));
+    int palette[4][3];
+    bc1Palette(c0, c1, alwaysFourColours || c0 > c1, palette);
+    const uint32_t indices = in[4] | (in[5] << 8) | (in[6] << 16) | (uint32_t(in[7]) << 24);
+    for (int i = 0; i < 16; ++i)
+    {
+        const uint32_t p = (indices >> (2 * i)) & 3u;
+        for (int c = 0; c < 3; ++c)
+            texels[4 * i + c] = static_cast<uint8_t>(palette[p][c]);
+    }
+}
+
+//----------------------------------------------------------------------------- BC4
+
+void bc4Palette(int a0, int a1, int palette[8])
+{
+    palette[0] = a0;
+    palette[1] = a1;
+    if (a0 > a1)
+    {
+        for (int k = 2; k < 8; ++k)
+            palette[k] = ((8 - k) * a0 + (k - 1) * a1 + 3) / 7;
+    }
+    else
+    {
+        for (int k = 2; k < 6; ++k)
+            palette[k] = ((6 - k) * a0 + (k - 1) * a1 + 2) / 5;
+        palette[6] = 0;
+        palette[7] = 255;
+    }
+}
+
+// the eight value mode between the smallest and largest value of the channel
+void encodeChannelBlock(const float values[16], uint8_t out[8])
+{
+    int low = 255, high = 0;
+    for (int i = 0; i < 16; ++i)
+    {
+        low = std::min(low, clampByte(values[i]));
+        high = std::max(high, clampByte(values[i]));
+    }
+    int palette[8];
+    bc4Palette(high, low, palette);
+    const int entries = high > low ? 8 : 1;
+
+    uint64_t indices = 0;
+    for (int i = 0; i < 16; ++i)
+    {
+        int best = 0;
+        float bestError = std::numeric_limits<float>::max();
+        for (int p = 0; p < entries; ++p)
+        {
+            const float error = std::abs(values[i] - palette[p]);
+            if (error < bestError)
+            {
+                bestError = error;
+                best = p;
+            }
+        }
+        indices |= uint64_t(best) << (3 * i);
+    }
+
+    out[0] = static_cast<uint8_t>(high);
+    out[1] = static_cast<uint8_t>(low);
+    for (int b = 0; b < 6; ++b)
+        out[2 + b] = static_cast<uint8_t>(indices >> (8 * b));
+}
+
+void decodeChannelBlock(const uint8_t in[8], uint8_t *texels, int stride)
+{
+    int palette[8];
+    bc4Palette(in[0], in[1], palette);
+    uint64_t indices = 0;
+    for (int b = 0; b < 6; ++b)
+        indices |= uint64_t(in[2 + b]) << (8 * b);
+    for (int i = 0; i < 16; ++i)
+        texels[stride * i] = static_cast<uint8_t>(palette[(indices >> (3 * i)) & 7u]);
+}
+
+//----------------------------------------------------------------------------- BC7 mode 6
+
+struct Bc7Endpoint
+{
+    // 7 bit values, the endpoint is value << 1 | pBit
+    int values[4];
+    int pBit;
+
+    int channel(int c) const { return (values[c] << 1) | pBit; }
+};
+
+// the parity bit shared by the four channels that keeps the endpoint closest
+Bc7Endpoint quantizeBc7Endpoint(const float endpoint[4])
+{
+    Bc7Endpoint best{};
+    float bestError = std::numeric_limits<float>::max();
+    for (int pBit = 0; pBit < 2; ++pBit)
+    {
+        Bc7Endpoint quantized{};
+        quantized.pBit = pBit;
+        float error = 0.0f;
+        for (int c = 0; c < 4; ++c)
+        {
+            quantized.values[c] =
+                std::min(127, std::max(0, static_cast<int>(std::lround((endpoint[c] - pBit) / 2.0f))));
+            const float d = endpoint[c] - quantized.channel(c);
+            error += d * d;
+        }
+        if (error < bestError)
+        {
+            bestError = error;
+            best = quantized;
+        }
+    }
+    return best;
+}
+
+struct Bc7Candidate
+{
+    Bc7Endpoint endpoints[2];
+    uint8_t indices[16];
+    float error;
+};
+
+Bc7Candidate bc7Candidate(const Block &block, const float low[4], const float high[4])
+{
+    Bc7Candidate candidate;
+    candidate.endpoints[0] = quantizeBc7Endpoint(low);
+    candidate.endpoints[1] = quantizeBc7Endpoint(high);
+
+    int palette[16][4];
+    for (int w = 0; w < 16; ++w)
+    {
+        for (int c = 0; c < 4; ++c)
+        {
+            palette[w][c] = ((64 - bc7Weights[w]) * candidate.endpoints[0].channel(c) +
+                             bc7Weights[w] * candidate.endpoints[1].channel(c) + 32) >>
+                            6;
+        }
+    }
+
+    candidate.error = 0.0f;
+    for (int i = 0; i < 16; ++i)
+    {
+        float best = std::numeric_limits<float>::max();
+        for (int w = 0; w < 16; ++w)
+        {
+            float error = 0.0f;
+            for (int c = 0; c < 4; ++c)
+            {
+                const float d = block.channels[c][i] - palette[w][c];
+                error += d * d;
+            }
+            if (error < best)
+            {
+                best = error;
+                candidate.indices[i] = static_cast<uint8_t>(w);
+            }
+        }
+        candidate.error += best;
+    }
+    return candidate;
+}
+
+void encodeBc7Block(const Block &block, uint8_t out[16])
+{
+    float low[4], high[4];
+    axisEndpoints(block, 4, low, high);
+    Bc7Candidate best = bc7Candidate(block, low, high);
+
+    for (int iteration = 0; iteration < refineIterations; ++iteration)
+    {
+        float weights[16];
+        for (int i = 0; i < 16; ++i)
+            weights[i] = bc7Weights[best.indices[i]] / 64.0f;
+        if (!fitEndpoints(block, 4, weights, low, high))
+            break;
+        const Bc7Candidate refined = bc7Candidate(block, low, high);
+        if (refined.error >= best.error)
+            break;
+        best = refined;
+    }
+
+    // the top bit of the first index is implied zero, swapping the endpoints clears it
+    if (best.indices[0] & 8)
+    {
+        std::swap(best.endpoints[0], best.endpoints[1]);
+        for (uint8_t &index : best.indices)
+            index = static_cast<uint8_t>(15 - index);
+    }
+
+    BitWriter bits(out);
+    bits.put(1u << 6, 7);
+    for (int c = 0; c < 4; ++c)
+    {
+        bits.put(static_cast<uint32_t>(best.endpoints[0].values[c]), 7);
+        bits.put(static_cast<uint32_t>(best.endpoints[1].values[c]), 7);
+    }
+    bits.put(static_cast<uint32_t>(best.endpoints[0].pBit), 1);
+    bits.put(static_cast<uint32_t>(best.endpoints[1].pBit), 1);
+    bits.put(best.indices[0], 3);
+    for (int i = 1; i < 16; ++i)
+        bits.put(best.indices[i], 4);
+}
+
+// only mode 6 is written, blocks of other modes decode to zero
+void decodeBc7Block(const uint8_t in[16], uint8_t texels[64])
+{
+    BitReader bits(in);
+    if (bits.get(7) != (1u << 6))
+    {
+        std::fill(texels, texels + 64, 0);
+        return;
+    }
+
+    int endpoints[2][4];
+    for (int c = 0; c < 4; ++c)
+    {
+        endpoints[0][c] = static_cast<int>(bits.get(7)) << 1;
+        endpoints[1][c] = static_cast<int>(bits.get(7)) << 1;
+    }
+    const int p0 = static_cast<int>(bits.get(1));
+    const int p1 = static_cast<int>(bits.get(1));
+    for (int c = 0; c < 4; ++c)
+    {
+        endpoints[0][c] |= p0;
+        endpoints[1][c] |= p1;
+    }
+
+    for (int i = 0; i < 16; ++i)
+    {
+        const int w = bc7Weights[bits.get(i == 0 ? 3 : 4)];
+        for (int c = 0; c < 4; ++c)
+            texels[4 * i + c] = static_cast<uint8_t>(((64 - w) * endpoints[0][c] + w * endpoints[1][c] + 32) >> 6);
+    }
+}
+
+//----------------------------------------------------------------------------- chains
+
+size_t blockBytes(TextureFormat format)
+{
+    return format == TextureFormat::BC1 ? 8 : 16;
+}
+
+void encodeBlock(TextureFormat format, const Block &block, uint8_t *out)
+{
+    switch (format)
+    {
+    case TextureFormat::BC1:
+        encodeColourBlock(block, out);
+        break;
+    case TextureFormat::BC3:
+        encodeChannelBlock(block.channels[3], out);
+        encodeColourBlock(block, out + 8);
+        break;
+    case TextureFormat::BC5:
+        encodeChannelBlock(block.channels[0], out);
+        encodeChannelBlock(block.channels[1], out + 8);
+        break;
+    default:
+        encodeBc7Block(block, out);
+        break;
+    }
+}
+
+// RGBA8 texels of a block, the channels a format does not store are 0 and alpha 255
+void decodeBlock(TextureFormat format, const uint8_t *in, uint8_t texels[64])
+{
+    std::fill(texels, texels + 64, 0);
+    for (int i = 0; i < 16; ++i)
+        texels[4 * i + 3] = 255;
+    switch (format)
+    {
+    case TextureFormat::BC1:
+        decodeColourBlock(in, false, texels);
+        break;
+    case TextureFormat::BC3:
+        decodeChannelBlock(in, texels + 3, 4);
+        decodeColourBlock(in + 8, true, texels);
+        break;
+    case TextureFormat::BC5:
+        decodeChannelBlock(in, texels, 4);
+        decodeChannelBlock(in + 8, texels + 1, 4);
+        break;
+    default:
+        decodeBc7Block(in, texels);
+        break;
+    }
+}
+
+MipChain encodeChain(const MipChain &chain, TextureFormat format, ThreadPool &pool)
+{
+    MipChain compressed;
+    compressed.format = format;
+    uint64_t size = 0;
+    for (const TextureLevel &level : chain.levels)
+    {
+        compressed.levels.push_back({size, level.width, level.height});
+        size += textureLevelSize(format, level.width, level.height);
+    }
+    compressed.pixels.resize(size);
+
+    for (size_t l = 0; l < chain.levels.size(); ++l)
+    {
+        const TextureLevel &level = chain.levels[l];
+        const uint8_t *pixels = chain.pixels.data() + level.offset;
+        uint8_t *blocks = compressed.pixels.data() + compressed.levels[l].offset;
+        const uint32_t blocksWide = (level.width + 3) / 4;
+        const uint32_t blocksHigh = (level.height + 3) / 4;
+        pool.parallelFor(0, blocksHigh, std::max<size_t>(1, grainBlocks / blocksWide), [&](size_t first, size_t last) {
+            for (size_t by = first; by < last; ++by)
+            {
+                for (uint32_t bx = 0; bx < blocksWide; ++bx)
+                {
+                    const Block block = loadBlock(pixels, level.width, level.height, bx, static_cast<uint32_t>(by));
+                    encodeBlock(format, block, blocks + (by * blocksWide + bx) * blockBytes(format));
+                }
+            }
+        });
+    }
+    return compressed;
+}
+
+// of the top level over the first channelCount channels
+double topLevelPsnr(const MipChain &chain, const MipChain &compressed, int channelCount, ThreadPool &pool)
+{
+    const TextureLevel &level = chain.levels[0];
+    const uint32_t blocksWide = (level.width + 3) / 4;
+    const uint32_t blocksHigh = (level.height + 3) / 4;
+    std::vector<double> rowErrors(blocksHigh, 0.0);
+    pool.parallelFor(0, blocksHigh, std::max<size_t>(1, grainBlocks / blocksWide), [&](size_t first, size_t last) {
+        for (size_t by = first; by < last; ++by)
+        {
+            double error = 0.0;
+            for (uint32_t bx = 0; bx < blocksWide; ++bx)
+            {
+                uint8_t texels[64];
+                decodeBlock(compressed.format,
+                            compressed.pixels.data() + (by * blocksWide + bx) * blockBytes(compressed.format), texels);
+                for (uint32_t i = 0; i < 16; ++i)
+                {
+                    const uint32_t x = bx * 4 + i % 4;
+                    const uint32_t y = static_cast<uint32_t>(by) * 4 + i / 4;
+                    if (x >= level.width || y >= level.height)
+                        continue;
+                    const uint8_t *original = chain.pixels.data() + (uint64_t(y) * level.width + x) * 4;
+                    for (int c = 0; c < channelCount; ++c)
+                    {
+                        const double d = double(original[c]) - texels[4 * i + c];
+                        error += d * d;
+                    }
+                }
+            }
+            rowErrors[by] = error;
+        }
+    });
+
+    double error = 0.0;
+    for (double rowError : rowErrors)
+        error += rowError;
+    const double meanError = error / (double(level.width) * level.height * channelCount);
+    if (meanError <= 0.0)
+        return std::numeric_limits<double>::infinity();
+    return 10.0 * std::log10(255.0 * 255.0 / meanError);
+}
+}  // namespace
+
+TextureContent classifyTexture(const uint8_t *pixels, uint32_t width, uint32_t height, TextureRole role)
+{
+    if (role == TextureRole::NormalMap)
+        return TextureContent::NormalMap;
+
+    const uint64_t texels = uint64_t(width) * height;
+    for (uint64_t i = 0; i < texels; ++i)
+    {
+        if (pixels[4 * i + 3] < 255)
+            return TextureContent::ColourAlpha;
+    }
+    return TextureContent::Colour;
+}
+
+const char *textureFormatName(TextureFormat format)
+{
+    switch (format)
+    {
+    case TextureFormat::RGBA8:
+        return "RGBA8";
+    case TextureFormat::BC1:
+        return "BC1";
+    case TextureFormat::BC3:
+        return "BC3";
+    case TextureFormat::BC5:
+        return "BC5";
+    case TextureFormat::BC7:
+        return "BC7";
+    }
+    return "unknown";
+}
+
+MipChain compressMipChain(const MipChain &chain, TextureContent content, double minPsnr, ThreadPool &pool,
+                          TextureCompressionStats &stats)
+{
+    auto start = std::chrono::high_resolution_clock::now();
+
+    const int channelCount = content == TextureContent::NormalMap ? 2 : content == TextureContent::Colour ? 3 : 4;
+    TextureFormat format = content == TextureContent::NormalMap     ? TextureFormat::BC5
+                           : content == TextureContent::ColourAlpha ? TextureFormat::BC3
+                                                                    : TextureFormat::BC1;
+    MipChain compressed = encodeChain(chain, format, pool);
+    double psnr = topLevelPsnr(chain, compressed, channelCount, pool);
+    if (content != TextureContent::NormalMap && psnr < minPsnr)
+    {
+        compressed = encodeChain(chain, TextureFormat::BC7, pool);
+        psnr = topLevelPsnr(chain, compressed, channelCount, pool);
+    }
+
+    stats.format = compressed.format;
+    stats.psnr = psnr;
+    stats.uncompressedBytes = chain.pixels.size();
+    stats.compressedBytes = compressed.pixels.size();
+    stats.milliseconds =
+        std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+    return compressed;
+}
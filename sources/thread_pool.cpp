@@ -0,0 +1,126 @@
+#include "thread_pool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <exception>
+
+ThreadPool::ThreadPool(unsigned threadCount)
+{
+    threadCount = std::max(1u, threadCount);
+    workers.reserve(threadCount);
+    for (unsigned i = 0; i < threadCount; ++i)
+    {
+        workers.emplace_back([this]() { workerLoop(); });
+    }
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(tasksMutex);
+        stopping = true;
+    }
+    tasksAvailable.notify_all();
+    for (auto &worker : workers)
+    {
+        worker.join();
+    }
+}
+
+void ThreadPool::enqueue(std::function<void()> task)
+{
+    {
+        std::lock_guard<std::mutex> lock(tasksMutex);
+        tasks.push(std::move(task));
+    }
+    tasksAvailable.notify_one();
+}
+
+void ThreadPool::workerLoop()
+{
+    for (;;)
+    {
+        std::function<void()> task;
+        {
+            std::unique_lock<std::mutex> lock(tasksMutex);
+            tasksAvailable.wait(lock, [this]() { return stopping || !tasks.empty(); });
+            if (stopping && tasks.empty())
+                return;
+            task = std::move(tasks.front());
+            tasks.pop();
+        }
+        task();
+    }
+}
+
+void ThreadPool::parallelFor(size_t begin, size_t end, size_t grainSize,
+                             const std::function<void(size_t, size_t)> &body)
+{
+    if (begin >= end)
+        return;
+
+    grainSize = std::max<size_t>(1, grainSize);
+    const size_t rangeCount = (end - begin + grainSize - 1) / grainSize;
+
+    if (rangeCount == 1)
+    {
+        body(begin, end);
+        return;
+    }
+
+    // ranges are handed out through an atomic counter, so helpers that start late simply find
+    // nothing left to do and the caller only ever waits for ranges somebody is already running.
+    // After a range throws the remaining ones are only counted, the first exception is rethrown
+    // on the calling thread.
+    struct Shared
+    {
+        std::atomic<size_t> nextRange{0};
+        std::atomic<bool> failed{false};
+        size_t finishedRanges = 0;
+        std::exception_ptr error;
+        std::mutex mutex;
+        std::condition_variable finished;
+    };
+    auto shared = std::make_shared<Shared>();
+
+    auto runRanges = [shared, begin, end, grainSize, rangeCount, &body]() {
+        size_t done = 0;
+        for (size_t range = shared->nextRange++; range < rangeCount; range = shared->nextRange++)
+        {
+            const size_t rangeBegin = begin + range * grainSize;
+            ++done;
+            if (shared->failed)
+                continue;
+            try
+            {
+                body(rangeBegin, std::min(end, rangeBegin + grainSize));
+            }
+            catch (...)
+            {
+                std::lock_guard<std::mutex> lock(shared->mutex);
+                if (!shared->error)
+                    shared->error = std::current_exception();
+                shared->failed = true;
+            }
+        }
+        if (done > 0)
+        {
+            std::lock_guard<std::mutex> lock(shared->mutex);
+            shared->finishedRanges += done;
+            if (shared->finishedRanges == rangeCount)
+                shared->finished.notify_all();
+        }
+    };
+
+    const size_t helpers = std::min(workers.size(), rangeCount - 1);
+    for (size_t i = 0; i < helpers; ++i)
+    {
+        enqueue(runRanges);
+    }
+    runRanges();
+
+    std::unique_lock<std::mutex> lock(shared->mutex);
+    shared->finished.wait(lock, [&]() { return shared->finishedRanges == rangeCount; });
+    if (shared->error)
+        std::rethrow_exception(shared->error);
+}
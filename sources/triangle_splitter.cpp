@@ -0,0 +1,386 @@
+#include "triangle_splitter.h"
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <unordered_map>
+#include <unordered_set>
+
+namespace
+{
+// every round halves the longest edge of the oversized triangles, this many rounds shrink any
+// edge far below the precision of a float
+constexpr uint32_t maxRounds = 64;
+
+constexpr uint32_t sahBins = 16;
+constexpr size_t sahMaxLeafTriangles = 4;
+
+struct PositionKey
+{
+    uint32_t bits[3];
+
+    bool operator==(const PositionKey &other) const { return memcmp(bits, other.bits, sizeof(bits)) == 0; }
+};
+
+struct PositionKeyHash
+{
+    size_t operator()(const PositionKey &key) const
+    {
+        return (key.bits[0] * 73856093u) ^ (key.bits[1] * 19349663u) ^ (key.bits[2] * 83492791u);
+    }
+};
+
+uint64_t edgeKey(uint32_t a, uint32_t b)
+{
+    return a < b ? (static_cast<uint64_t>(a) << 32) | b : (static_cast<uint64_t>(b) << 32) | a;
+}
+
+float triangleDiagonal(const glm::vec3 &a, const glm::vec3 &b, const glm::vec3 &c)
+{
+    return glm::length(glm::max(glm::max(a, b), c) - glm::min(glm::min(a, b), c));
+}
+
+struct Box
+{
+    glm::vec3 lo = glm::vec3(std::numeric_limits<float>::max());
+    glm::vec3 hi = glm::vec3(-std::numeric_limits<float>::max());
+
+    void grow(const glm::vec3 &p)
+    {
+        lo = glm::min(lo, p);
+        hi = glm::max(hi, p);
+    }
+
+    void grow(const Box &box)
+    {
+        lo = glm::min(lo, box.lo);
+        hi = glm::max(hi, box.hi);
+    }
+
+    double area() const
+    {
+        if (lo.x > hi.x)
+            return 0.0;
+        const glm::dvec3 d = glm::dvec3(hi) - glm::dvec3(lo);
+        return 2.0 * (d.x * d.y + d.y * d.z + d.z * d.x);
+    }
+};
+}  // namespace
+
+float medianTriangleDiagonal(const Vertex *vertices, const uint32_t *indices, size_t indexCount,
+                             size_t maxSamples)
+{
+    const size_t triangles = indexCount / 3;
+    if (triangles == 0 || maxSamples == 0)
+        return 0.0f;
+
+    const size_t stride = std::max<size_t>(1, triangles / maxSamples);
+    std::vector<float> diagonals;
+    diagonals.reserve(triangles / stride + 1);
+    for (size_t t = 0; t < triangles; t += stride)
+    {
+        diagonals.push_back(triangleDiagonal(vertices[indices[3 * t]].pos, vertices[indices[3 * t + 1]].pos,
+                                             vertices[indices[3 * t + 2]].pos));
+    }
+    auto median = diagonals.begin() + diagonals.size() / 2;
+    std::nth_element(diagonals.begin(), median, diagonals.end());
+    return *median;
+}
+
+size_t countLargeTriangles(const Vertex *vertices, const uint32_t *indices, size_t indexCount, float maxDiagonal)
+{
+    size_t count = 0;
+    for (size_t t = 0; t < indexCount / 3; ++t)
+    {
+        count += triangleDiagonal(vertices[indices[3 * t]].pos, vertices[indices[3 * t + 1]].pos,
+                                  vertices[indices[3 * t + 2]].pos) > maxDiagonal;
+    }
+    return count;
+}
+
+TriangleSplitStats splitLargeTriangles(std::vector<Vertex> &vertices, std::vector<uint32_t> &indices,
+                                       std::vector<uint32_t> &triangleData, float maxDiagonal)
+{
+    auto start = std::chrono::high_resolution_clock::now();
+
+    TriangleSplitStats stats;
+    stats.triangles = indices.size() / 3;
+    stats.outputTriangles = stats.triangles;
+    if (!(maxDiagonal > 0.0f) || indices.empty())
+        return stats;
+
+    // vertices at the same position share an id, so edges are split on both sides of a seam
+    std::vector<uint32_t> positionIds(vertices.size());
+    {
+        std::unordered_map<PositionKey, uint32_t, PositionKeyHash> ids;
+        ids.reserve(vertices.size());
+        for (size_t v = 0; v < vertices.size(); ++v)
+        {
+            PositionKey key;
+            memcpy(key.bits, &vertices[v].pos, sizeof(key.bits));
+            positionIds[v] = ids.emplace(key, static_cast<uint32_t>(ids.size())).first->second;
+        }
+    }
+    uint32_t positionCount = positionIds.empty() ? 0 : *std::max_element(positionIds.begin(), positionIds.end()) + 1;
+
+    // the midpoint of an edge gets one position and one vertex per pair of vertices on it
+    std::unordered_map<uint64_t, uint32_t> midpointPositions;
+    std::unordered_map<uint64_t, uint32_t> midpointVertices;
+    const auto midpoint = [&](uint32_t a, uint32_t b) {
+        const auto found = midpointVertices.find(edgeKey(a, b));
+        if (found != midpointVertices.end())
+            return found->second;
+
+        // interpolated from the endpoint with the lower position id, so the vertices on both
+        // sides of a seam land on bitwise the same position
+        if (positionIds[b] < positionIds[a] || (positionIds[b] == positionIds[a] && b < a))
+            std::swap(a, b);
+        const Vertex &va = vertices[a];
+        const Vertex &vb = vertices[b];
+        Vertex vertex = va;
+        vertex.pos = (va.pos + vb.pos) * 0.5f;
+        const glm::vec3 normal = va.normal + vb.normal;
+        const float length = glm::length(normal);
+        vertex.normal = length > 0.0f ? normal / length : va.normal;
+        vertex.texCoord = (va.texCoord + vb.texCoord) * 0.5f;
+
+        const uint32_t position =
+            midpointPositions.emplace(edgeKey(positionIds[a], positionIds[b]), positionCount).first->second;
+        positionCount += position == positionCount;
+
+        const uint32_t index = static_cast<uint32_t>(vertices.size());
+        vertices.push_back(vertex);
+        positionIds.push_back(position);
+        midpointVertices.emplace(edgeKey(a, b), index);
+        return index;
+    };
+
+    std::unordered_set<uint64_t> splitEdges;
+    std::vector<uint32_t> nextIndices;
+    std::vector<uint32_t> nextTriangleData;
+    for (uint32_t round = 0; round < maxRounds; ++round)
+    {
+        // the longest edge of every oversized triangle is split
+        splitEdges.clear();
+        for (size_t t = 0; t < indices.size() / 3; ++t)
+        {
+            const uint32_t *corner = &indices[3 * t];
+            const glm::vec3 &a = vertices[corner[0]].pos;
+            const glm::vec3 &b = vertices[corner[1]].pos;
+            const glm::vec3 &c = vertices[corner[2]].pos;
+            if (triangleDiagonal(a, b, c) <= maxDiagonal)
+                continue;
+
+            stats.oversizedTriangles += round == 0;
+            const std::array<float, 3> lengths = {glm::dot(b - a, b - a), glm::dot(c - b, c - b),
+                                                  glm::dot(a - c, a - c)};
+            const uint32_t e =
+                static_cast<uint32_t>(std::max_element(lengths.begin(), lengths.end()) - lengths.begin());
+            splitEdges.insert(edgeKey(positionIds[corner[e]], positionIds[corner[(e + 1) % 3]]));
+        }
+        if (splitEdges.empty())
+            break;
+
+        // every triangle splits all of its edges that are split anywhere, into two, three or four
+        // triangles with the winding of the original
+        nextIndices.clear();
+        nextTriangleData.clear();
+        nextIndices.reserve(indices.size() * 2);
+        nextTriangleData.reserve(triangleData.size() * 2);
+        const auto emit = [&](uint32_t a, uint32_t b, uint32_t c, uint32_t data) {
+            nextIndices.insert(nextIndices.end(), {a, b, c});
+            nextTriangleData.push_back(data);
+        };
+        for (size_t t = 0; t < indices.size() / 3; ++t)
+        {
+            const uint32_t *corner = &indices[3 * t];
+            const uint32_t data = triangleData[t];
+            bool split[3];
+            uint32_t splitCount = 0;
+            for (uint32_t e = 0; e < 3; ++e)
+            {
+                split[e] = splitEdges.count(edgeKey(positionIds[corner[e]], positionIds[corner[(e + 1) % 3]])) > 0;
+                splitCount += split[e];
+            }
+
+            if (splitCount == 0)
+            {
+                emit(corner[0], corner[1], corner[2], data);
+            }
+            else if (splitCount == 1)
+            {
+                // edge ab is split
+                const uint32_t e = split[0] ? 0 : split[1] ? 1 : 2;
+                const uint32_t a = corner[e], b = corner[(e + 1) % 3], c = corner[(e + 2) % 3];
+                const uint32_t m = midpoint(a, b);
+                emit(a, m, c, data);
+                emit(m, b, c, data);
+            }
+            else if (splitCount == 2)
+            {
+                // edges ab and bc are split, ca is not
+                const uint32_t e = !split[2] ? 0 : !split[0] ? 1 : 2;
+                const uint32_t a = corner[e], b = corner[(e + 1) % 3], c = corner[(e + 2) % 3];
+                const uint32_t mab = midpoint(a, b);
+                const uint32_t mbc = midpoint(b, c);
+                emit(mab, b, mbc, data);
+                // the quad that is left is cut along its shorter diagonal
+                const glm::vec3 &pa = vertices[a].pos;
+                const glm::vec3 &pc = vertices[c].pos;
+                const glm::vec3 &pab = vertices[mab].pos;
+                const glm::vec3 &pbc = vertices[mbc].pos;
+                if (glm::dot(pbc - pa, pbc - pa) <= glm::dot(pc - pab, pc - pab))
+                {
+                    emit(a, mab, mbc, data);
+                    emit(a, mbc, c, data);
+                }
+                else
+                {
+                    emit(a, mab, c, data);
+                    emit(mab, mbc, c, data);
+                }
+            }
+            else
+            {
+                const uint32_t a = corner[0], b = corner[1], c = corner[2];
+                const uint32_t mab = midpoint(a, b);
+                const uint32_t mbc = midpoint(b, c);
+                const uint32_t mca = midpoint(c, a);
+                emit(a, mab, mca, data);
+                emit(mab, b, mbc, data);
+                emit(mca, mbc, c, data);
+                emit(mab, mbc, mca, data);
+            }
+        }
+        indices.swap(nextIndices);
+        triangleData.swap(nextTriangleData);
+    }
+
+    stats.outputTriangles = indices.size() / 3;
+    stats.milliseconds =
+        std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+    return stats;
+}
+
+double estimateSahCost(const Vertex *vertices, const uint32_t *indices, size_t indexCount)
+{
+    const size_t triangles = indexCount / 3;
+    if (triangles == 0)
+        return 0.0;
+
+    std::vector<Box> boxes(triangles);
+    std::vector<glm::vec3> centroids(triangles);
+    std::vector<uint32_t> order(triangles);
+    Box root;
+    for (size_t t = 0; t < triangles; ++t)
+    {
+        for (uint32_t k = 0; k < 3; ++k)
+            boxes[t].grow(vertices[indices[3 * t + k]].pos);
+        centroids[t] = (boxes[t].lo + boxes[t].hi) * 0.5f;
+        order[t] = static_cast<uint32_t>(t);
+        root.grow(boxes[t]);
+    }
+    const double rootArea = root.area();
+    if (!(rootArea > 0.0))
+        return static_cast<double>(triangles);
+
+    // top down build, every node is split at the best of sahBins planes along any axis or
+    // becomes a leaf when no split is cheaper than testing all of its triangles
+    struct Node
+    {
+        size_t begin;
+        size_t end;
+        Box box;
+    };
+    std::vector<Node> stack = {{0, triangles, root}};
+    double cost = 0.0;
+    while (!stack.empty())
+    {
+        const Node node = stack.back();
+        stack.pop_back();
+        const size_t count = node.end - node.begin;
+        const double area = node.box.area();
+
+        Box centroidBox;
+        for (size_t i = node.begin; i < node.end; ++i)
+            centroidBox.grow(centroids[order[i]]);
+
+        double bestCost = static_cast<double>(count);
+        uint32_t bestAxis = 0;
+        uint32_t bestBin = 0;
+        for (uint32_t axis = 0; axis < 3 && count > sahMaxLeafTriangles && area > 0.0; ++axis)
+        {
+            const float lo = centroidBox.lo[axis];
+            const float extent = centroidBox.hi[axis] - lo;
+            if (!(extent > 0.0f))
+                continue;
+
+            std::array<Box, sahBins> bins;
+            std::array<size_t, sahBins> binCounts{};
+            for (size_t i = node.begin; i < node.end; ++i)
+            {
+                const uint32_t t = order[i];
+                const uint32_t bin =
+                    std::min(sahBins - 1, static_cast<uint32_t>((centroids[t][axis] - lo) / extent * sahBins));
+                bins[bin].grow(boxes[t]);
+                ++binCounts[bin];
+            }
+
+            // areas and counts right of every plane, then swept from the left
+            std::array<double, sahBins> rightAreas{};
+            std::array<size_t, sahBins> rightCounts{};
+            Box right;
+            size_t rightCount = 0;
+            for (uint32_t b = sahBins - 1; b > 0; --b)
+            {
+                right.grow(bins[b]);
+                rightCount += binCounts[b];
+                rightAreas[b] = right.area();
+                rightCounts[b] = rightCount;
+            }
+            Box left;
+            size_t leftCount = 0;
+            for (uint32_t b = 1; b < sahBins; ++b)
+            {
+                left.grow(bins[b - 1]);
+                leftCount += binCounts[b - 1];
+                if (leftCount == 0 || rightCounts[b] == 0)
+                    continue;
+                const double splitCost = 1.0 + (left.area() * leftCount + rightAreas[b] * rightCounts[b]) / area;
+                if (splitCost < bestCost)
+                {
+                    bestCost = splitCost;
+                    bestAxis = axis;
+                    bestBin = b;
+                }
+            }
+        }
+
+        if (bestBin == 0)
+        {
+            cost += area / rootArea * static_cast<double>(count);
+            continue;
+        }
+
+        const float lo = centroidBox.lo[bestAxis];
+        const float extent = centroidBox.hi[bestAxis] - lo;
+        const auto middle = std::partition(order.begin() + node.begin, order.begin() + node.end, [&](uint32_t t) {
+            return std::min(sahBins - 1, static_cast<uint32_t>((centroids[t][bestAxis] - lo) / extent * sahBins)) <
+                   bestBin;
+        });
+        const size_t split = middle - order.begin();
+        Box leftBox, rightBox;
+        for (size_t i = node.begin; i < split; ++i)
+            leftBox.grow(boxes[order[i]]);
+        for (size_t i = split; i < node.end; ++i)
+            rightBox.grow(boxes[order[i]]);
+
+        cost += area / rootArea;
+        stack.push_back({node.begin, split, leftBox});
+        stack.push_back({split, node.end, rightBox});
+    }
+    return cost;
+}
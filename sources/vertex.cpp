@@ -2,7 +2,8 @@
 
 bool Vertex::operator==(const Vertex &other) const
 {
-    return pos == other.pos && normal == other.normal && texCoord == other.texCoord;
+    return pos == other.pos && normal == other.normal && texCoord == other.texCoord && materialId == other.materialId &&
+           tangent == other.tangent;
 }
 
 bool Vertex::operator<(const Vertex &other) const
@@ -17,7 +18,7 @@ bool Vertex::operator<(const Vertex &other) const
         if (v2[i] < v1[i])
             return true;
     }
-    return false;
+    return other.materialId < materialId;
 }
 
 VkVertexInputBindingDescription Vertex::getBindingDescription()
@@ -52,7 +53,7 @@ std::array<VkVertexInputAttributeDescription, 3> Vertex::getAttributeDescription
 }
 
 Vertex::Vertex(const glm::vec3 &pos, const glm::vec3 &normal, const glm::vec2 &texCoord, const uint32_t materialId)
-    : pos(pos), normal(normal), texCoord(texCoord), materialId(materialId) {}
+    : pos(pos), normal(normal), texCoord(texCoord), materialId(materialId), tangent(0) {}
 
 Vertex::Vertex()
-    : pos({0, 0, 0}), normal(0, 0, 1), texCoord(0, 0), materialId(0) {}
+    : pos({0, 0, 0}), normal(0, 0, 1), texCoord(0, 0), materialId(0), tangent(0) {}
@@ -0,0 +1,214 @@
+#include "vertex_packing.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace
+{
+uint32_t floatBits(float f)
+{
+    uint32_t bits;
+    memcpy(&bits, &f, sizeof(bits));
+    return bits;
+}
+
+// IEEE half with round to nearest even, what unpackHalf2x16 reads back
+uint32_t toHalf(float f)
+{
+    const uint32_t bits = floatBits(f);
+    const uint32_t sign = (bits >> 16) & 0x8000u;
+    const uint32_t absolute = bits & 0x7fffffffu;
+
+    if (absolute >= 0x7f800000u)
+    {
+        // inf stays inf, nan stays a quiet nan
+        return sign | 0x7c00u | (absolute > 0x7f800000u ? 0x200u : 0u);
+    }
+    if (absolute >= 0x477ff000u)
+    {
+        // rounds to a value above the largest half
+        return sign | 0x7c00u;
+    }
+    if (absolute < 0x38800000u)
+    {
+        // subnormal half, shift the mantissa with the implicit one into place
+        if (absolute < 0x33000000u)
+            return sign;
+        const uint32_t exponent = absolute >> 23;
+        const uint32_t mantissa = (absolute & 0x7fffffu) | 0x800000u;
+        const uint32_t shift = 126 - exponent;
+        uint32_t half = mantissa >> shift;
+        const uint32_t rest = mantissa & ((1u << shift) - 1);
+        const uint32_t halfway = 1u << (shift - 1);
+        if (rest > halfway || (rest == halfway && (half & 1)))
+            ++half;
+        return sign | half;
+    }
+
+    // normal half, rebias the exponent and round the 13 dropped mantissa bits
+    uint32_t half = (absolute - 0x38000000u) >> 13;
+    const uint32_t rest = absolute & 0x1fffu;
+    if (rest > 0x1000u || (rest == 0x1000u && (half & 1)))
+        ++half;
+    return sign | half;
+}
+
+uint32_t toSnorm16(float f)
+{
+    const float clamped = std::min(1.0f, std::max(-1.0f, f));
+    return static_cast<uint32_t>(static_cast<int32_t>(std::lround(clamped * 32767.0f))) & 0xffffu;
+}
+
+uint32_t toUnorm16(float f)
+{
+    const float clamped = std::min(1.0f, std::max(0.0f, f));
+    return static_cast<uint32_t>(std::lround(clamped * 65535.0f));
+}
+
+// normal in the [-1, 1] square, the lower hemisphere is folded over the diagonals
+glm::vec2 octahedral(const glm::vec3 &normal)
+{
+    const float length = std::abs(normal.x) + std::abs(normal.y) + std::abs(normal.z);
+    if (!(length > 0.0f))
+        return glm::vec2(0.0f);
+
+    float x = normal.x / length;
+    float y = normal.y / length;
+    if (normal.z < 0.0f)
+    {
+        const float foldedX = (1.0f - std::abs(y)) * (x >= 0.0f ? 1.0f : -1.0f);
+        const float foldedY = (1.0f - std::abs(x)) * (y >= 0.0f ? 1.0f : -1.0f);
+        x = foldedX;
+        y = foldedY;
+    }
+    return glm::vec2(x, y);
+}
+
+uint32_t octahedralNormal(const glm::vec3 &normal)
+{
+    const glm::vec2 e = octahedral(normal);
+    return toSnorm16(e.x) | (toSnorm16(e.y) << 16);
+}
+
+uint32_t halfTexCoord(const glm::vec2 &texCoord)
+{
+    return toHalf(texCoord.x) | (toHalf(texCoord.y) << 16);
+}
+
+uint32_t quantize(float value, float offset, float scale)
+{
+    return scale > 0.0f ? toUnorm16((value - offset) / (scale * 65535.0f)) : 0;
+}
+}  // namespace
+
+uint32_t packTangent(const glm::vec3 &tangent, float bitangentSign)
+{
+    const glm::vec2 e = octahedral(tangent) * 0.5f + 0.5f;
+    const uint32_t x = static_cast<uint32_t>(std::lround(std::min(1.0f, std::max(0.0f, e.x)) * 32767.0f));
+    const uint32_t y = static_cast<uint32_t>(std::lround(std::min(1.0f, std::max(0.0f, e.y)) * 32767.0f));
+    return x | (y << 15) | (bitangentSign < 0.0f ? 0x80000000u : 0u);
+}
+
+glm::vec4 unpackTangent(uint32_t packed)
+{
+    glm::vec3 t((packed & 0x7fffu) / 32767.0f * 2.0f - 1.0f, ((packed >> 15) & 0x7fffu) / 32767.0f * 2.0f - 1.0f, 0.0f);
+    t.z = 1.0f - std::abs(t.x) - std::abs(t.y);
+    // unfold the lower hemisphere
+    const float fold = std::max(-t.z, 0.0f);
+    t.x += t.x >= 0.0f ? -fold : fold;
+    t.y += t.y >= 0.0f ? -fold : fold;
+    return glm::vec4(glm::normalize(t), (packed & 0x80000000u) ? -1.0f : 1.0f);
+}
+
+size_t rtVertexStride(RTVertexFormat format)
+{
+    switch (format)
+    {
+    case RTVertexFormat::Packed:
+        return 6 * sizeof(uint32_t);
+    case RTVertexFormat::Quantized:
+        return 4 * sizeof(uint32_t);
+    case RTVertexFormat::Full:
+    default:
+        return sizeof(Vertex);
+    }
+}
+
+PositionQuantization positionQuantization(const glm::vec3 &minimum, const glm::vec3 &maximum)
+{
+    PositionQuantization quantization;
+    quantization.offset = minimum;
+    quantization.scale = glm::max(maximum - minimum, glm::vec3(0.0f)) / 65535.0f;
+    return quantization;
+}
+
+void packVertices(RTVertexFormat format, const PositionQuantization &quantization, const Vertex *vertices,
+                  size_t count, void *output)
+{
+    if (format == RTVertexFormat::Full)
+    {
+        memcpy(output, vertices, count * sizeof(Vertex));
+        return;
+    }
+
+    // built in registers and stored with one memcpy, output is usually write combined memory
+    uint32_t *out = static_cast<uint32_t *>(output);
+    for (size_t i = 0; i < count; ++i)
+    {
+        const Vertex &vertex = vertices[i];
+        const uint32_t materialId = std::min<uint32_t>(vertex.materialId, 0xffffu);
+
+        if (format == RTVertexFormat::Packed)
+        {
+            const uint32_t packed[6] = {floatBits(vertex.pos.x),          floatBits(vertex.pos.y),
+                                        floatBits(vertex.pos.z),          octahedralNormal(vertex.normal),
+                                        halfTexCoord(vertex.texCoord), materialId};
+            memcpy(out, packed, sizeof(packed));
+            out += 6;
+        }
+        else
+        {
+            const uint32_t x = quantize(vertex.pos.x, quantization.offset.x, quantization.scale.x);
+            const uint32_t y = quantize(vertex.pos.y, quantization.offset.y, quantization.scale.y);
+            const uint32_t z = quantize(vertex.pos.z, quantization.offset.z, quantization.scale.z);
+            const uint32_t packed[4] = {x | (y << 16), z | (materialId << 16), octahedralNormal(vertex.normal),
+                                        halfTexCoord(vertex.texCoord)};
+            memcpy(out, packed, sizeof(packed));
+            out += 4;
+        }
+    }
+}
+
+float triangleLodConstant(const Vertex &v0, const Vertex &v1, const Vertex &v2)
+{
+    const glm::vec2 uv1 = v1.texCoord - v0.texCoord;
+    const glm::vec2 uv2 = v2.texCoord - v0.texCoord;
+    const float texCoordArea = std::abs(uv1.x * uv2.y - uv1.y * uv2.x);
+    const float area = glm::length(glm::cross(v1.pos - v0.pos, v2.pos - v0.pos));
+    // degenerate triangles and texture coordinates sample the top level
+    if (!(texCoordArea > 0.0f) || !(area > 0.0f))
+        return -64.0f;
+    return 0.5f * std::log2(texCoordArea / area);
+}
+
+void packTriangles(const Vertex *vertices, const uint32_t *indices, const uint32_t *materials,
+                   const uint32_t *materialRemap, size_t count, TriangleRecord *output)
+{
+    for (size_t t = 0; t < count; ++t)
+    {
+        const Vertex &v0 = vertices[indices[3 * t]];
+        const Vertex &v1 = vertices[indices[3 * t + 1]];
+        const Vertex &v2 = vertices[indices[3 * t + 2]];
+        const uint32_t material =
+            materials[t] == static_cast<uint32_t>(-1) ? materials[t] : materialRemap[materials[t]];
+
+        // built in registers and stored with one memcpy like the vertices
+        const TriangleRecord record = {
+            {octahedralNormal(v0.normal), octahedralNormal(v1.normal), octahedralNormal(v2.normal)},
+            material,
+            {halfTexCoord(v0.texCoord), halfTexCoord(v1.texCoord), halfTexCoord(v2.texCoord)},
+            triangleLodConstant(v0, v1, v2)};
+        memcpy(output + t, &record, sizeof(record));
+    }
+}
@@ -0,0 +1,179 @@
+#include "vertex_welder.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace
+{
+// murmur3 finalizer, spreads the bits of the combined key over the whole word
+inline uint32_t mix(uint32_t h)
+{
+    h ^= h >> 16;
+    h *= 0x85ebca6bu;
+    h ^= h >> 13;
+    h *= 0xc2b2ae35u;
+    h ^= h >> 16;
+    return h;
+}
+
+inline uint32_t combine(uint32_t seed, uint32_t value)
+{
+    return mix(seed ^ (value + 0x9e3779b9u + (seed << 6) + (seed >> 2)));
+}
+
+inline uint32_t floatBits(float f)
+{
+    // adding 0 turns -0.0 into +0.0 so that values comparing equal also hash equal
+    f += 0.0f;
+    uint32_t bits;
+    memcpy(&bits, &f, sizeof(bits));
+    return bits;
+}
+
+size_t nextPowerOfTwo(size_t n)
+{
+    size_t p = 1;
+    while (p < n)
+        p <<= 1;
+    return p;
+}
+}  // namespace
+
+VertexWelder::VertexWelder(std::vector<Vertex> &vertices, float positionEpsilon, size_t expectedVertices)
+    : output(vertices), epsilon(positionEpsilon), inverseEpsilon(positionEpsilon > 0.0f ? 1.0f / positionEpsilon : 0.0f)
+{
+    // keep the load factor at or below 0.5
+    rehash(nextPowerOfTwo(std::max<size_t>(16, 2 * std::max(expectedVertices, output.size()))));
+}
+
+VertexWelder::Cell VertexWelder::cellOf(const glm::vec3 &pos) const
+{
+    // floor keeps positions at most one cell size apart in neighbouring cells
+    return {static_cast<int64_t>(std::floor(double(pos.x) * inverseEpsilon)),
+            static_cast<int64_t>(std::floor(double(pos.y) * inverseEpsilon)),
+            static_cast<int64_t>(std::floor(double(pos.z) * inverseEpsilon))};
+}
+
+uint32_t VertexWelder::hashVertex(const Vertex &vertex, const Cell &cell) const
+{
+    uint32_t h = 0;
+    if (epsilon > 0.0f)
+    {
+        for (int64_t c : {cell.x, cell.y, cell.z})
+        {
+            h = combine(h, static_cast<uint32_t>(c));
+            h = combine(h, static_cast<uint32_t>(static_cast<uint64_t>(c) >> 32));
+        }
+    }
+    else
+    {
+        h = combine(h, floatBits(vertex.pos.x));
+        h = combine(h, floatBits(vertex.pos.y));
+        h = combine(h, floatBits(vertex.pos.z));
+    }
+    h = combine(h, floatBits(vertex.normal.x));
+    h = combine(h, floatBits(vertex.normal.y));
+    h = combine(h, floatBits(vertex.normal.z));
+    h = combine(h, floatBits(vertex.texCoord.x));
+    h = combine(h, floatBits(vertex.texCoord.y));
+    h = combine(h, vertex.materialId);
+    return h;
+}
+
+bool VertexWelder::equalAttributes(const Vertex &a, const Vertex &b) const
+{
+    return a.normal == b.normal && a.texCoord == b.texCoord && a.materialId == b.materialId;
+}
+
+uint32_t VertexWelder::findWithin(const Vertex &vertex, const Cell &cell) const
+{
+    uint32_t closest = emptySlot;
+    float closestDistance = epsilon * epsilon;
+    for (int64_t dz = -1; dz <= 1; ++dz)
+    {
+        for (int64_t dy = -1; dy <= 1; ++dy)
+        {
+            for (int64_t dx = -1; dx <= 1; ++dx)
+            {
+                const uint32_t h = hashVertex(vertex, {cell.x + dx, cell.y + dy, cell.z + dz});
+                for (size_t slot = h & mask; slots[slot].index != emptySlot; slot = (slot + 1) & mask)
+                {
+                    const Vertex &candidate = output[slots[slot].index];
+                    if (slots[slot].hash != h || !equalAttributes(candidate, vertex))
+                        continue;
+                    const glm::vec3 offset = candidate.pos - vertex.pos;
+                    const float distance = glm::dot(offset, offset);
+                    // ties go to the vertex seen first
+                    if (distance < closestDistance ||
+                        (distance == closestDistance && slots[slot].index < closest))
+                    {
+                        closest = slots[slot].index;
+                        closestDistance = distance;
+                    }
+                }
+            }
+        }
+    }
+    return closest;
+}
+
+void VertexWelder::rehash(size_t slotCount)
+{
+    slots.assign(slotCount, Slot{0, emptySlot});
+    mask = slotCount - 1;
+
+    for (uint32_t i = 0; i < output.size(); ++i)
+    {
+        const uint32_t h = hashVertex(output[i], cellOf(output[i].pos));
+        size_t slot = h & mask;
+        while (slots[slot].index != emptySlot)
+            slot = (slot + 1) & mask;
+        slots[slot] = {h, i};
+    }
+}
+
+uint32_t VertexWelder::weld(const Vertex &vertex, bool *inserted)
+{
+    const Cell cell = epsilon > 0.0f ? cellOf(vertex.pos) : Cell{0, 0, 0};
+    const uint32_t h = hashVertex(vertex, cell);
+    size_t slot = h & mask;
+
+    if (epsilon > 0.0f)
+    {
+        const uint32_t found = findWithin(vertex, cell);
+        if (found != emptySlot)
+        {
+            if (inserted)
+                *inserted = false;
+            return found;
+        }
+        while (slots[slot].index != emptySlot)
+            slot = (slot + 1) & mask;
+    }
+    else
+    {
+        while (slots[slot].index != emptySlot)
+        {
+            if (slots[slot].hash == h && equalAttributes(output[slots[slot].index], vertex) &&
+                output[slots[slot].index].pos == vertex.pos)
+            {
+                if (inserted)
+                    *inserted = false;
+                return slots[slot].index;
+            }
+            slot = (slot + 1) & mask;
+        }
+    }
+
+    const uint32_t index = static_cast<uint32_t>(output.size());
+    output.push_back(vertex);
+    slots[slot] = {h, index};
+
+    if (2 * output.size() > slots.size())
+        rehash(2 * slots.size());
+
+    if (inserted)
+        *inserted = true;
+    return index;
+}
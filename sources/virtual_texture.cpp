@@ -0,0 +1,219 @@
+#include "virtual_texture.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace
+{
+// a tile has to go unrequested for this many frames before its physical tile is reused, and a
+// request that was not repeated for as long is dropped
+constexpr uint64_t evictAfterFrames = 8;
+
+uint32_t tilesAlong(uint32_t texels)
+{
+    return (texels + VIRTUAL_TILE_TEXELS - 1) / VIRTUAL_TILE_TEXELS;
+}
+
+uint32_t wrap(int64_t value, uint32_t size)
+{
+    const int64_t wrapped = value % size;
+    return static_cast<uint32_t>(wrapped < 0 ? wrapped + size : wrapped);
+}
+}  // namespace
+
+uint32_t tiledLevelCount(const std::vector<TextureLevel> &levels)
+{
+    uint32_t count = 0;
+    while (count < levels.size() &&
+           std::max(levels[count].width, levels[count].height) > VIRTUAL_TILE_TEXELS)
+        ++count;
+    return count;
+}
+
+uint64_t virtualTileSize(TextureFormat format)
+{
+    return textureLevelSize(format, VIRTUAL_TILE_SIZE, VIRTUAL_TILE_SIZE);
+}
+
+void gatherTile(const uint8_t *pixels, TextureFormat format, const TextureLevel &level, uint32_t tileX,
+                uint32_t tileY, uint8_t *out)
+{
+    // texels are copied as 1x1 blocks of 4 bytes, the block formats as 4x4 blocks
+    const bool blocks = format != TextureFormat::RGBA8;
+    const uint32_t blockTexels = blocks ? 4 : 1;
+    const uint64_t blockBytes = blocks ? textureLevelSize(format, 4, 4) : 4;
+    const uint32_t levelBlocksWide = (level.width + blockTexels - 1) / blockTexels;
+    const uint32_t levelBlocksHigh = (level.height + blockTexels - 1) / blockTexels;
+    const uint32_t tileBlocks = VIRTUAL_TILE_SIZE / blockTexels;
+    const int64_t firstX = int64_t(tileX) * VIRTUAL_TILE_TEXELS / blockTexels - VIRTUAL_TILE_BORDER / blockTexels;
+    const int64_t firstY = int64_t(tileY) * VIRTUAL_TILE_TEXELS / blockTexels - VIRTUAL_TILE_BORDER / blockTexels;
+
+    const uint8_t *source = pixels + level.offset;
+    for (uint32_t y = 0; y < tileBlocks; ++y)
+    {
+        const uint8_t *row = source + uint64_t(wrap(firstY + y, levelBlocksHigh)) * levelBlocksWide * blockBytes;
+        for (uint32_t x = 0; x < tileBlocks; ++x, out += blockBytes)
+            memcpy(out, row + uint64_t(wrap(firstX + x, levelBlocksWide)) * blockBytes, blockBytes);
+    }
+}
+
+VirtualTextureTable::VirtualTextureTable(uint32_t slotCount, uint32_t cacheTiles, uint32_t pageCapacity)
+    : cacheTiles(cacheTiles), pageCapacity(pageCapacity), firstPageWord(4 * slotCount),
+      table(firstPageWord + pageCapacity, 0u)
+{
+    for (PhysicalCache &cache : caches)
+        cache.entries.assign(cacheTiles * cacheTiles, 0u);
+}
+
+bool VirtualTextureTable::add(uint32_t slot, TextureFormat format, std::shared_ptr<const uint8_t> pixels,
+                              const std::vector<TextureLevel> &levels, uint32_t tiledLevels)
+{
+    if (tiledLevels == 0 || 4 * slot >= firstPageWord || levels[0].width > 0xffff || levels[0].height > 0xffff)
+        return false;
+
+    uint32_t tileCount = 0;
+    for (uint32_t l = 0; l < tiledLevels; ++l)
+        tileCount += tilesAlong(levels[l].width) * tilesAlong(levels[l].height);
+    if (tileCount > pageCapacity - pageCount)
+        return false;
+
+    const uint32_t texture = static_cast<uint32_t>(sources.size());
+    sources.push_back(
+        {format, std::move(pixels), std::vector<TextureLevel>(levels.begin(), levels.begin() + tiledLevels)});
+    for (uint32_t l = 0; l < tiledLevels; ++l)
+    {
+        for (uint32_t y = 0; y < tilesAlong(levels[l].height); ++y)
+        {
+            for (uint32_t x = 0; x < tilesAlong(levels[l].width); ++x)
+            {
+                Tile tile;
+                tile.texture = texture;
+                tile.level = static_cast<uint8_t>(l);
+                tile.tileX = static_cast<uint16_t>(x);
+                tile.tileY = static_cast<uint16_t>(y);
+                tiles.push_back(tile);
+            }
+        }
+    }
+
+    table[4 * slot] = pageCount;
+    table[4 * slot + 1] = levels[0].width | (levels[0].height << 16);
+    table[4 * slot + 2] = tiledLevels | (static_cast<uint32_t>(format) << 8);
+    pageCount += tileCount;
+    ++tableVersion;
+    return true;
+}
+
+void VirtualTextureTable::request(const uint32_t *entries, size_t count)
+{
+    for (size_t i = 0; i < count; ++i)
+    {
+        if (entries[i] >= pageCount)
+            continue;
+        Tile &tile = tiles[entries[i]];
+        tile.lastRequested = frame;
+        if (tile.state == TileState::Absent)
+        {
+            tile.state = TileState::Requested;
+            requested.push_back(entries[i]);
+        }
+    }
+}
+
+std::vector<TileLoad> VirtualTextureTable::schedule(uint32_t budget, uint64_t safeVersion)
+{
+    // requests that were not repeated lately are for tiles that went out of view
+    requested.erase(std::remove_if(requested.begin(), requested.end(),
+                                   [&](uint32_t entry) {
+                                       Tile &tile = tiles[entry];
+                                       if (tile.lastRequested + evictAfterFrames >= frame)
+                                           return false;
+                                       tile.state = TileState::Absent;
+                                       return true;
+                                   }),
+                    requested.end());
+
+    std::sort(requested.begin(), requested.end(), [&](uint32_t a, uint32_t b) {
+        if (tiles[a].level != tiles[b].level)
+            return tiles[a].level > tiles[b].level;
+        return tiles[a].lastRequested > tiles[b].lastRequested;
+    });
+
+    std::vector<TileLoad> loads;
+    std::vector<uint32_t> waiting;
+    for (uint32_t entry : requested)
+    {
+        Tile &tile = tiles[entry];
+        const Source &source = sources[tile.texture];
+        uint32_t physical;
+        if (loads.size() == budget || !allocatePhysical(source.format, safeVersion, physical))
+        {
+            waiting.push_back(entry);
+            continue;
+        }
+
+        tile.state = TileState::Loading;
+        tile.physical = physical;
+        caches[static_cast<uint32_t>(source.format)].entries[physical] = entry;
+        loads.push_back({entry, source.format, physical, source.pixels, source.levels[tile.level], tile.tileX,
+                         tile.tileY});
+    }
+    requested.swap(waiting);
+
+    ++frame;
+    return loads;
+}
+
+void VirtualTextureTable::makeResident(const TileLoad &load)
+{
+    Tile &tile = tiles[load.entry];
+    tile.state = TileState::Resident;
+    table[firstPageWord + load.entry] = load.physical + 1;
+    ++tableVersion;
+    ++resident;
+}
+
+bool VirtualTextureTable::allocatePhysical(TextureFormat format, uint64_t safeVersion, uint32_t &physical)
+{
+    PhysicalCache &cache = caches[static_cast<uint32_t>(format)];
+    if (cache.unused < cache.entries.size())
+    {
+        physical = cache.unused++;
+        return true;
+    }
+
+    auto freed = std::find_if(cache.freed.begin(), cache.freed.end(),
+                              [&](const FreedTile &tile) { return tile.version <= safeVersion; });
+    if (freed != cache.freed.end())
+    {
+        physical = freed->physical;
+        cache.freed.erase(freed);
+        return true;
+    }
+
+    // evict the tile that went unrequested the longest, its physical tile is free once the frames
+    // in flight are done with it
+    uint32_t oldest = 0;
+    bool found = false;
+    for (uint32_t p = 0; p < cache.entries.size(); ++p)
+    {
+        const Tile &tile = tiles[cache.entries[p]];
+        if (tile.state == TileState::Resident && tile.physical == p &&
+            tile.lastRequested + evictAfterFrames < frame &&
+            (!found || tile.lastRequested < tiles[cache.entries[oldest]].lastRequested))
+        {
+            oldest = p;
+            found = true;
+        }
+    }
+    if (found)
+    {
+        Tile &tile = tiles[cache.entries[oldest]];
+        tile.state = TileState::Absent;
+        table[firstPageWord + cache.entries[oldest]] = 0;
+        ++tableVersion;
+        --resident;
+        cache.freed.push_back({oldest, tableVersion});
+    }
+    return false;
+}
@@ -40,7 +40,7 @@ void RayTracerApp::endSingleTimeCommands(VkCommandPool commandPool, VkCommandBuf
     vkFreeCommandBuffers(device, commandPool, 1, &commandBuffer);
 }
 
-uint32_t RayTracerApp::findMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties)
+bool RayTracerApp::tryFindMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties, uint32_t &typeIndex)
 {
     VkPhysicalDeviceMemoryProperties memProperties;
     vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memProperties);
@@ -49,11 +49,21 @@ uint32_t RayTracerApp::findMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags
     {
         if (typeFilter & (1 << i) && (memProperties.memoryTypes[i].propertyFlags & properties) == properties)
         {
-            return i;
+            typeIndex = i;
+            return true;
         }
     }
+    return false;
+}
 
-    throw std::runtime_error("failed to find suitable memory type!");
+uint32_t RayTracerApp::findMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties)
+{
+    uint32_t typeIndex;
+    if (!tryFindMemoryType(typeFilter, properties, typeIndex))
+    {
+        throw std::runtime_error("failed to find suitable memory type!");
+    }
+    return typeIndex;
 }
 
 void RayTracerApp::copyBuffer(VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize size)
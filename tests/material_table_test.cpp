@@ -0,0 +1,65 @@
+// Checks the texture indices of buildMaterialTable: identical texture paths share an index, and
+// once NO_MATERIAL_TEXTURE textures are indexed further textures are dropped, so the table never
+// holds more textures than there are descriptors for.
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "material_table.h"
+
+namespace
+{
+int failures = 0;
+
+void check(bool condition, const char *what)
+{
+    if (!condition)
+    {
+        std::fprintf(stderr, "failed: %s\n", what);
+        ++failures;
+    }
+}
+
+uint32_t textureOf(const MaterialTable &table, size_t material)
+{
+    return (table.materials[table.remap[material]].parameters >> 16) & 0xfffu;
+}
+}  // namespace
+
+int main()
+{
+    // every material has a texture of its own and a colour of its own, so none are merged
+    const size_t count = NO_MATERIAL_TEXTURE + 10;
+    std::vector<tinyobj::material_t> materials(count + 1);
+    for (size_t m = 0; m < count; ++m)
+    {
+        materials[m].diffuse[0] = static_cast<float>(m) / count;
+        materials[m].diffuse_texname = "texture" + std::to_string(m) + ".png";
+    }
+    // a texture that is already indexed keeps its index past the limit
+    materials[count].diffuse_texname = materials[7].diffuse_texname;
+    const std::vector<std::string> folders(materials.size(), "textures/");
+
+    const MaterialTable table = buildMaterialTable(materials, folders);
+
+    check(table.textures.size() == NO_MATERIAL_TEXTURE, "at most NO_MATERIAL_TEXTURE textures");
+    check(table.textures[7] == "textures/texture7.png", "textures are resolved against their folder");
+    check(table.droppedTextures == 10, "dropped textures are counted");
+
+    bool indexed = true;
+    for (size_t m = 0; m < NO_MATERIAL_TEXTURE; ++m)
+        indexed = indexed && textureOf(table, m) == m;
+    check(indexed, "textures are indexed in first use order");
+
+    bool dropped = true;
+    for (size_t m = NO_MATERIAL_TEXTURE; m < count; ++m)
+        dropped = dropped && textureOf(table, m) == NO_MATERIAL_TEXTURE;
+    check(dropped, "materials past the limit have no texture");
+    check(textureOf(table, count) == 7, "a known texture is found past the limit");
+
+    if (failures > 0)
+        return 1;
+    std::printf("material table indexes %zu textures and drops the rest\n", table.textures.size());
+    return 0;
+}
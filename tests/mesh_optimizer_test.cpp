@@ -0,0 +1,117 @@
+// Checks optimizeMesh on a shuffled grid: the optimized mesh holds the same triangles with the
+// same materials, only reordered and with renumbered vertices, and the vertex reuse measured by
+// analyzeVertexFetch does not get worse.
+
+#include <algorithm>
+#include <array>
+#include <cstdio>
+#include <random>
+#include <vector>
+
+#include "mesh_optimizer.h"
+
+namespace
+{
+// the vertex stride of the closest hit vertex buffer for the full vertex format
+constexpr size_t vertexStride = sizeof(Vertex);
+
+int failures = 0;
+
+void check(bool condition, const char *what)
+{
+    if (!condition)
+    {
+        std::fprintf(stderr, "failed: %s\n", what);
+        ++failures;
+    }
+}
+
+// a triangle by the positions of its corners, rotated so the smallest corner is first, and its
+// material. The winding is kept.
+using TriangleKey = std::array<float, 10>;
+
+std::vector<TriangleKey> triangleKeys(const std::vector<Vertex> &vertices, const std::vector<uint32_t> &indices,
+                                      const std::vector<uint32_t> &materials)
+{
+    std::vector<TriangleKey> keys;
+    for (size_t t = 0; t < indices.size() / 3; ++t)
+    {
+        std::array<std::array<float, 3>, 3> corners;
+        for (int c = 0; c < 3; ++c)
+        {
+            const glm::vec3 &pos = vertices[indices[3 * t + c]].pos;
+            corners[c] = {pos.x, pos.y, pos.z};
+        }
+        std::rotate(corners.begin(), std::min_element(corners.begin(), corners.end()), corners.end());
+
+        TriangleKey key;
+        for (int c = 0; c < 3; ++c)
+            std::copy(corners[c].begin(), corners[c].end(), key.begin() + 3 * c);
+        key[9] = static_cast<float>(materials[t]);
+        keys.push_back(key);
+    }
+    std::sort(keys.begin(), keys.end());
+    return keys;
+}
+}  // namespace
+
+int main()
+{
+    // a 64 by 64 quad grid, every row of quads has its own material
+    constexpr uint32_t size = 64;
+    std::vector<Vertex> vertices;
+    for (uint32_t y = 0; y <= size; ++y)
+    {
+        for (uint32_t x = 0; x <= size; ++x)
+            vertices.emplace_back(glm::vec3(x, y, 0.0f), glm::vec3(0.0f, 0.0f, 1.0f), glm::vec2(0.0f), 0);
+    }
+
+    std::vector<std::array<uint32_t, 4>> triangles;
+    for (uint32_t y = 0; y < size; ++y)
+    {
+        for (uint32_t x = 0; x < size; ++x)
+        {
+            const uint32_t corner = y * (size + 1) + x;
+            triangles.push_back({corner, corner + 1, corner + size + 2, y % 5});
+            triangles.push_back({corner, corner + size + 2, corner + size + 1, y % 5});
+        }
+    }
+    // an unreferenced vertex is dropped
+    vertices.emplace_back(glm::vec3(-1.0f), glm::vec3(0.0f, 0.0f, 1.0f), glm::vec2(0.0f), 0);
+
+    std::mt19937 random(7);
+    std::shuffle(triangles.begin(), triangles.end(), random);
+    std::vector<uint32_t> indices;
+    std::vector<uint32_t> materials;
+    for (const auto &triangle : triangles)
+    {
+        indices.insert(indices.end(), triangle.begin(), triangle.begin() + 3);
+        materials.push_back(triangle[3]);
+    }
+
+    const std::vector<TriangleKey> before = triangleKeys(vertices, indices, materials);
+    const VertexFetchStats shuffled = analyzeVertexFetch(indices.data(), indices.size(), vertices.size(), vertexStride);
+
+    ThreadPool pool(4);
+    const MeshOptimizeStats stats = optimizeMesh(vertices, indices, materials, vertexStride, pool);
+
+    check(materials.size() == indices.size() / 3, "one material per triangle");
+    check(triangleKeys(vertices, indices, materials) == before, "same triangles with the same materials");
+    check(vertices.size() == (size + 1) * (size + 1), "unreferenced vertices are dropped");
+    check(stats.removedVertices == 1, "removed vertices are counted");
+
+    check(stats.before.acmr == shuffled.acmr, "the statistics before are taken from the input");
+    check(stats.after.acmr <= stats.before.acmr, "ACMR does not get worse");
+    check(stats.after.linesPerTriangle <= stats.before.linesPerTriangle, "cache lines do not get worse");
+
+    // reoptimizing an optimized mesh does not make it worse either
+    const MeshOptimizeStats again = optimizeMesh(vertices, indices, materials, vertexStride, pool);
+    check(again.after.acmr <= again.before.acmr, "ACMR does not get worse on an ordered mesh");
+    check(triangleKeys(vertices, indices, materials) == before, "same triangles after optimizing twice");
+
+    if (failures > 0)
+        return 1;
+    std::printf("mesh optimizer: ACMR %.2f -> %.2f, cache lines per triangle %.2f -> %.2f\n", stats.before.acmr,
+                stats.after.acmr, stats.before.linesPerTriangle, stats.after.linesPerTriangle);
+    return 0;
+}
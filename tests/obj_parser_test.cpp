@@ -0,0 +1,174 @@
+// Checks that ObjParser reads the bundled models into the same attrib / shapes / materials as
+// tinyobj::ObjReader, every float bit for bit. The directory holding the models is passed as the
+// only argument.
+
+#include <algorithm>
+#include <cstring>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "obj_parser.h"
+#include "thread_pool.h"
+#include "tiny_obj_loader.h"
+
+namespace
+{
+int failures = 0;
+
+void fail(const std::string &model, const std::string &what)
+{
+    std::fprintf(stderr, "%s: %s\n", model.c_str(), what.c_str());
+    ++failures;
+}
+
+// the fast float parser has to round like strtod, so values are compared exactly, 0 and -0 differ
+bool same(float a, float b)
+{
+    return std::memcmp(&a, &b, sizeof(float)) == 0;
+}
+
+void compareFloats(const std::string &model, const std::string &name, const std::vector<float> &parsed,
+                   const std::vector<float> &reference)
+{
+    if (parsed.size() != reference.size())
+    {
+        fail(model, name + " count " + std::to_string(parsed.size()) + " != " + std::to_string(reference.size()));
+        return;
+    }
+    for (size_t i = 0; i < parsed.size(); ++i)
+    {
+        if (!same(parsed[i], reference[i]))
+        {
+            fail(model, name + "[" + std::to_string(i) + "] " + std::to_string(parsed[i]) +
+                            " != " + std::to_string(reference[i]));
+            return;
+        }
+    }
+}
+
+template <typename T>
+void compareCounts(const std::string &model, const std::string &name, const std::vector<T> &parsed,
+                   const std::vector<T> &reference)
+{
+    if (parsed.size() != reference.size())
+        fail(model, name + " count " + std::to_string(parsed.size()) + " != " + std::to_string(reference.size()));
+}
+
+void compareShapes(const std::string &model, const std::vector<tinyobj::shape_t> &parsed,
+                   const std::vector<tinyobj::shape_t> &reference)
+{
+    compareCounts(model, "shape", parsed, reference);
+    for (size_t s = 0; s < std::min(parsed.size(), reference.size()); ++s)
+    {
+        const tinyobj::mesh_t &a = parsed[s].mesh;
+        const tinyobj::mesh_t &b = reference[s].mesh;
+        const std::string shape = "shape " + std::to_string(s) + " ";
+
+        if (parsed[s].name != reference[s].name)
+            fail(model, shape + "name " + parsed[s].name + " != " + reference[s].name);
+        compareCounts(model, shape + "index", a.indices, b.indices);
+        compareCounts(model, shape + "face", a.num_face_vertices, b.num_face_vertices);
+        compareCounts(model, shape + "material id", a.material_ids, b.material_ids);
+
+        for (size_t i = 0; i < std::min(a.indices.size(), b.indices.size()); ++i)
+        {
+            if (a.indices[i].vertex_index != b.indices[i].vertex_index ||
+                a.indices[i].normal_index != b.indices[i].normal_index ||
+                a.indices[i].texcoord_index != b.indices[i].texcoord_index)
+            {
+                fail(model, shape + "index " + std::to_string(i) + " differs");
+                break;
+            }
+        }
+        if (a.num_face_vertices != b.num_face_vertices)
+            fail(model, shape + "face sizes differ");
+        if (a.material_ids != b.material_ids)
+            fail(model, shape + "material ids differ");
+        if (a.smoothing_group_ids != b.smoothing_group_ids)
+            fail(model, shape + "smoothing groups differ");
+    }
+}
+
+void compareMaterials(const std::string &model, const std::vector<tinyobj::material_t> &parsed,
+                      const std::vector<tinyobj::material_t> &reference)
+{
+    compareCounts(model, "material", parsed, reference);
+    for (size_t m = 0; m < std::min(parsed.size(), reference.size()); ++m)
+    {
+        const tinyobj::material_t &a = parsed[m];
+        const tinyobj::material_t &b = reference[m];
+        const std::string material = "material " + std::to_string(m) + " ";
+
+        if (a.name != b.name || a.diffuse_texname != b.diffuse_texname || a.bump_texname != b.bump_texname ||
+            a.normal_texname != b.normal_texname)
+            fail(model, material + "names differ");
+        for (int c = 0; c < 3; ++c)
+        {
+            if (!same(a.ambient[c], b.ambient[c]) || !same(a.diffuse[c], b.diffuse[c]) ||
+                !same(a.specular[c], b.specular[c]) || !same(a.emission[c], b.emission[c]))
+                fail(model, material + "colours differ");
+        }
+        if (!same(a.shininess, b.shininess) || !same(a.ior, b.ior) || !same(a.dissolve, b.dissolve) ||
+            a.illum != b.illum)
+            fail(model, material + "parameters differ");
+    }
+}
+
+void compareModel(const std::string &directory, const std::string &model, ThreadPool &pool, size_t minChunkBytes)
+{
+    const std::string path = directory + "/" + model;
+
+    tinyobj::ObjReader reader;
+    if (!reader.ParseFromFile(path))
+    {
+        fail(model, "tinyobjloader: " + reader.Error());
+        return;
+    }
+
+    ObjParser parser(pool, minChunkBytes);
+    if (!parser.parseFromFile(path))
+    {
+        fail(model, "ObjParser: " + parser.error());
+        return;
+    }
+
+    const tinyobj::attrib_t &a = parser.attrib();
+    const tinyobj::attrib_t &b = reader.GetAttrib();
+    compareFloats(model, "position", a.vertices, b.vertices);
+    compareFloats(model, "normal", a.normals, b.normals);
+    compareFloats(model, "texcoord", a.texcoords, b.texcoords);
+    compareFloats(model, "colour", a.colors, b.colors);
+    compareShapes(model, parser.shapes(), reader.GetShapes());
+    compareMaterials(model, parser.materials(), reader.GetMaterials());
+}
+}  // namespace
+
+int main(int argc, char **argv)
+{
+    if (argc != 2)
+    {
+        std::fprintf(stderr, "usage: %s <models directory>\n", argv[0]);
+        return 2;
+    }
+
+    // the models are smaller than the default chunk size, small chunks make the parser stitch
+    // statements, relative indices and materials across chunk boundaries
+    for (unsigned threads : {1u, std::max(std::thread::hardware_concurrency(), 2u)})
+    {
+        ThreadPool pool(threads);
+        for (size_t minChunkBytes : {ObjParser::defaultMinChunkBytes, size_t(4096)})
+        {
+            for (const char *model : {"viking_room.obj", "Windmill.obj", "low.obj"})
+                compareModel(argv[1], model, pool, minChunkBytes);
+        }
+    }
+
+    if (failures > 0)
+    {
+        std::fprintf(stderr, "%d mismatches\n", failures);
+        return 1;
+    }
+    std::printf("ObjParser matches tinyobjloader\n");
+    return 0;
+}
@@ -0,0 +1,83 @@
+// Checks that the block format of a texture follows the role its material gives it: colour that
+// happens to look like a normal map stays in an sRGB colour format, only normal maps become BC5.
+
+#include <cstdio>
+#include <vector>
+
+#include "texture_cache.h"
+#include "texture_compressor.h"
+#include "thread_pool.h"
+
+namespace
+{
+// MIN_TEXTURE_PSNR of headers/constants.h, which needs the Vulkan headers
+constexpr double minPsnr = 36.0;
+constexpr uint32_t size = 64;
+
+int failures = 0;
+
+void check(bool condition, const char *what)
+{
+    if (!condition)
+    {
+        std::fprintf(stderr, "failed: %s\n", what);
+        ++failures;
+    }
+}
+
+bool isColourFormat(TextureFormat format)
+{
+    return format == TextureFormat::BC1 || format == TextureFormat::BC3 || format == TextureFormat::BC7;
+}
+
+// a sky blue gradient, every texel decodes to a unit vector pointing out of the surface
+std::vector<uint8_t> blueTexture(uint8_t alpha)
+{
+    std::vector<uint8_t> pixels(4 * size * size);
+    for (uint32_t y = 0; y < size; ++y)
+    {
+        for (uint32_t x = 0; x < size; ++x)
+        {
+            uint8_t *texel = &pixels[4 * (y * size + x)];
+            texel[0] = static_cast<uint8_t>(112 + x / 2);
+            texel[1] = static_cast<uint8_t>(120 + y / 4);
+            texel[2] = 250;
+            texel[3] = alpha;
+        }
+    }
+    return pixels;
+}
+
+TextureFormat compress(const std::vector<uint8_t> &pixels, TextureRole role, ThreadPool &pool)
+{
+    const TextureContent content = classifyTexture(pixels.data(), size, size, role);
+    const MipChain chain = buildMipChain(pixels.data(), size, size, content != TextureContent::NormalMap, pool);
+    TextureCompressionStats stats;
+    return compressMipChain(chain, content, minPsnr, pool, stats).format;
+}
+}  // namespace
+
+int main()
+{
+    ThreadPool pool;
+
+    const std::vector<uint8_t> opaque = blueTexture(255);
+    check(classifyTexture(opaque.data(), size, size, TextureRole::Colour) == TextureContent::Colour,
+          "blue diffuse texture is colour");
+    const TextureFormat diffuse = compress(opaque, TextureRole::Colour, pool);
+    check(isColourFormat(diffuse), "blue diffuse texture is stored in an sRGB colour format");
+    check(diffuse != TextureFormat::BC5, "blue diffuse texture keeps its blue channel");
+
+    const std::vector<uint8_t> translucent = blueTexture(200);
+    check(classifyTexture(translucent.data(), size, size, TextureRole::Colour) == TextureContent::ColourAlpha,
+          "blue diffuse texture with alpha is colour with alpha");
+    const TextureFormat withAlpha = compress(translucent, TextureRole::Colour, pool);
+    check(withAlpha == TextureFormat::BC3 || withAlpha == TextureFormat::BC7, "alpha is kept");
+
+    check(compress(opaque, TextureRole::NormalMap, pool) == TextureFormat::BC5, "normal map is stored as BC5");
+
+    if (failures > 0)
+        return 1;
+    std::printf("texture formats follow the material role\n");
+    return 0;
+}
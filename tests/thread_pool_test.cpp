@@ -0,0 +1,81 @@
+// Checks that parallelFor covers every element once and that an exception thrown by the body on
+// a worker reaches the calling thread instead of terminating the program.
+
+#include <atomic>
+#include <cstdio>
+#include <stdexcept>
+#include <vector>
+
+#include "thread_pool.h"
+
+namespace
+{
+int failures = 0;
+
+void check(bool condition, const char *what)
+{
+    if (!condition)
+    {
+        std::fprintf(stderr, "failed: %s\n", what);
+        ++failures;
+    }
+}
+}  // namespace
+
+int main()
+{
+    ThreadPool pool(4);
+
+    std::vector<std::atomic<int>> visits(10000);
+    pool.parallelFor(0, visits.size(), 64, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i)
+            ++visits[i];
+    });
+    bool once = true;
+    for (const std::atomic<int> &count : visits)
+        once = once && count == 1;
+    check(once, "every element is visited once");
+
+    // every range throws, so whichever thread runs first, workers throw as well
+    for (int round = 0; round < 100; ++round)
+    {
+        bool caught = false;
+        try
+        {
+            pool.parallelFor(0, 1000, 10, [](size_t, size_t) { throw std::runtime_error("range failed"); });
+        }
+        catch (const std::runtime_error &)
+        {
+            caught = true;
+        }
+        check(caught, "the exception of a range is rethrown");
+    }
+
+    // only a range that the caller is unlikely to run throws
+    bool caught = false;
+    try
+    {
+        pool.parallelFor(0, 1000, 1, [](size_t begin, size_t) {
+            if (begin == 999)
+                throw std::runtime_error("last range failed");
+        });
+    }
+    catch (const std::runtime_error &)
+    {
+        caught = true;
+    }
+    check(caught, "the exception of the last range is rethrown");
+
+    // the pool still works afterwards
+    std::atomic<size_t> sum{0};
+    pool.parallelFor(0, 100, 7, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i)
+            sum += i;
+    });
+    check(sum == 4950, "the pool keeps working after an exception");
+
+    if (failures > 0)
+        return 1;
+    std::printf("parallelFor rethrows on the calling thread\n");
+    return 0;
+}
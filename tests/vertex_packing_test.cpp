@@ -0,0 +1,288 @@
+// Packs random vertices and triangles in every closest hit format and decodes them the way
+// shaders/vertex_packing.h does. Positions have to come back within half a quantization step,
+// normals and texture coordinates within the precision of their format and materials unchanged.
+// Both closest hit layouts have to resolve the same material, and so the same albedo.
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <vector>
+
+#include "vertex_packing.h"
+
+namespace
+{
+int failures = 0;
+
+void check(bool condition, const char *what)
+{
+    if (!condition)
+    {
+        std::fprintf(stderr, "failed: %s\n", what);
+        ++failures;
+    }
+}
+
+float fromHalf(uint32_t half)
+{
+    const float sign = (half & 0x8000u) ? -1.0f : 1.0f;
+    const int exponent = static_cast<int>((half >> 10) & 0x1fu);
+    const float mantissa = static_cast<float>(half & 0x3ffu);
+    if (exponent == 0)
+        return sign * std::ldexp(mantissa, -24);
+    return sign * std::ldexp(1024.0f + mantissa, exponent - 25);
+}
+
+glm::vec2 unpackHalf2x16(uint32_t packed)
+{
+    return glm::vec2(fromHalf(packed & 0xffffu), fromHalf(packed >> 16));
+}
+
+float fromSnorm16(uint32_t bits)
+{
+    return std::max(static_cast<float>(static_cast<int16_t>(bits)) / 32767.0f, -1.0f);
+}
+
+// OctahedralDecode of shaders/vertex_packing.h
+glm::vec3 octahedralDecode(uint32_t packed)
+{
+    glm::vec3 n(fromSnorm16(packed & 0xffffu), fromSnorm16(packed >> 16), 0.0f);
+    n.z = 1.0f - std::abs(n.x) - std::abs(n.y);
+    const float t = std::max(-n.z, 0.0f);
+    n.x += n.x >= 0.0f ? -t : t;
+    n.y += n.y >= 0.0f ? -t : t;
+    return glm::normalize(n);
+}
+
+float uintBitsToFloat(uint32_t bits)
+{
+    float f;
+    std::memcpy(&f, &bits, sizeof(f));
+    return f;
+}
+
+// a step of a 16 bit octahedral coordinate moves a unit normal by at most about 1e-4
+bool normalClose(const glm::vec3 &decoded, const glm::vec3 &normal)
+{
+    return glm::length(decoded - normal) <= 2e-4f;
+}
+
+// half keeps 11 significant bits
+bool texCoordClose(const glm::vec2 &decoded, const glm::vec2 &texCoord)
+{
+    const glm::vec2 error = glm::abs(decoded - texCoord);
+    const glm::vec2 limit = glm::abs(texCoord) * std::ldexp(1.0f, -11) + std::ldexp(1.0f, -25);
+    return error.x <= limit.x && error.y <= limit.y;
+}
+
+std::vector<Vertex> randomVertices(size_t count, std::mt19937 &random)
+{
+    std::uniform_real_distribution<float> position(-250.0f, 250.0f);
+    std::uniform_real_distribution<float> direction(-1.0f, 1.0f);
+    std::uniform_real_distribution<float> texCoord(-4.0f, 4.0f);
+    std::uniform_int_distribution<uint32_t> material(0, 0xffffu);
+
+    std::vector<Vertex> vertices(count);
+    for (Vertex &vertex : vertices)
+    {
+        vertex.pos = {position(random), position(random), position(random)};
+        do
+            vertex.normal = {direction(random), direction(random), direction(random)};
+        while (glm::length(vertex.normal) < 0.1f);
+        vertex.normal = glm::normalize(vertex.normal);
+        vertex.texCoord = {texCoord(random), texCoord(random)};
+        vertex.materialId = material(random);
+    }
+    // the poles and the folded edges of the octahedron
+    vertices[0].normal = {0.0f, 0.0f, 1.0f};
+    vertices[1].normal = {0.0f, 0.0f, -1.0f};
+    vertices[2].normal = {1.0f, 0.0f, 0.0f};
+    vertices[3].normal = {0.0f, -1.0f, 0.0f};
+    return vertices;
+}
+
+void checkPacked(const std::vector<Vertex> &vertices)
+{
+    std::vector<uint32_t> packed(vertices.size() * rtVertexStride(RTVertexFormat::Packed) / sizeof(uint32_t));
+    packVertices(RTVertexFormat::Packed, {}, vertices.data(), vertices.size(), packed.data());
+
+    bool positions = true, normals = true, texCoords = true, materials = true;
+    for (size_t i = 0; i < vertices.size(); ++i)
+    {
+        const uint32_t *v = &packed[6 * i];
+        const glm::vec3 pos(uintBitsToFloat(v[0]), uintBitsToFloat(v[1]), uintBitsToFloat(v[2]));
+        positions = positions && pos == vertices[i].pos;
+        normals = normals && normalClose(octahedralDecode(v[3]), vertices[i].normal);
+        texCoords = texCoords && texCoordClose(unpackHalf2x16(v[4]), vertices[i].texCoord);
+        materials = materials && v[5] == vertices[i].materialId;
+    }
+    check(positions, "packed positions are exact");
+    check(normals, "packed normals");
+    check(texCoords, "packed texture coordinates");
+    check(materials, "packed materials");
+}
+
+void checkQuantized(const std::vector<Vertex> &vertices)
+{
+    glm::vec3 minimum = vertices[0].pos;
+    glm::vec3 maximum = vertices[0].pos;
+    for (const Vertex &vertex : vertices)
+    {
+        minimum = glm::min(minimum, vertex.pos);
+        maximum = glm::max(maximum, vertex.pos);
+    }
+    const PositionQuantization quantization = positionQuantization(minimum, maximum);
+
+    std::vector<uint32_t> packed(vertices.size() * rtVertexStride(RTVertexFormat::Quantized) / sizeof(uint32_t));
+    packVertices(RTVertexFormat::Quantized, quantization, vertices.data(), vertices.size(), packed.data());
+
+    // half a step, and the float rounding of offset + scale * q
+    const glm::vec3 limit = quantization.scale * 0.5f + (glm::abs(minimum) + glm::abs(maximum)) * 1e-6f;
+    bool positions = true, normals = true, texCoords = true, materials = true;
+    for (size_t i = 0; i < vertices.size(); ++i)
+    {
+        const uint32_t *v = &packed[4 * i];
+        const glm::vec3 q(v[0] & 0xffffu, v[0] >> 16, v[1] & 0xffffu);
+        const glm::vec3 error = glm::abs(quantization.offset + quantization.scale * q - vertices[i].pos);
+        positions = positions && error.x <= limit.x && error.y <= limit.y && error.z <= limit.z;
+        materials = materials && (v[1] >> 16) == vertices[i].materialId;
+        normals = normals && normalClose(octahedralDecode(v[2]), vertices[i].normal);
+        texCoords = texCoords && texCoordClose(unpackHalf2x16(v[3]), vertices[i].texCoord);
+    }
+    check(positions, "quantized positions within half a step");
+    check(normals, "quantized normals");
+    check(texCoords, "quantized texture coordinates");
+    check(materials, "quantized materials");
+
+    // a flat model has a zero scale along one axis and decodes to the offset there
+    std::vector<Vertex> flat = vertices;
+    for (Vertex &vertex : flat)
+        vertex.pos.y = 3.0f;
+    const PositionQuantization flatQuantization =
+        positionQuantization(glm::vec3(minimum.x, 3.0f, minimum.z), glm::vec3(maximum.x, 3.0f, maximum.z));
+    packVertices(RTVertexFormat::Quantized, flatQuantization, flat.data(), flat.size(), packed.data());
+    bool flatPositions = true;
+    for (size_t i = 0; i < flat.size(); ++i)
+    {
+        const float y = flatQuantization.offset.y + flatQuantization.scale.y * (packed[4 * i] >> 16);
+        flatPositions = flatPositions && y == 3.0f;
+    }
+    check(flatPositions, "quantized positions of a flat model");
+}
+
+// albedo the closest hit shader computes for a triangle, the records are read as uvec4 like
+// triangleBuffer. With RT_TRIANGLE_RECORDS the material comes from DecodeTriangle, with the vertex
+// formats from TriangleMaterial, both have to find the same one.
+glm::vec3 shaderAlbedo(const std::vector<TriangleRecord> &records, size_t triangle, bool triangleRecords,
+                       const std::vector<glm::vec3> &diffuse, const glm::vec3 &sceneTexture)
+{
+    const uint32_t *data = reinterpret_cast<const uint32_t *>(records.data());
+    const uint32_t *normals = data + 4 * (2 * triangle + 0);
+    const uint32_t material = triangleRecords ? normals[3] : data[8 * triangle + 3];
+    return material == static_cast<uint32_t>(-1) ? sceneTexture : diffuse[material];
+}
+
+void checkAlbedo(const std::vector<TriangleRecord> &records, const std::vector<uint32_t> &materials,
+                 const std::vector<uint32_t> &remap)
+{
+    std::vector<glm::vec3> diffuse(*std::max_element(remap.begin(), remap.end()) + 1);
+    for (size_t m = 0; m < diffuse.size(); ++m)
+        diffuse[m] = glm::vec3(static_cast<float>(m), 0.5f, 1.0f / (m + 1));
+    const glm::vec3 sceneTexture(-1.0f);
+
+    bool same = true, expected = true;
+    for (size_t t = 0; t < records.size(); ++t)
+    {
+        const glm::vec3 recordAlbedo = shaderAlbedo(records, t, true, diffuse, sceneTexture);
+        const glm::vec3 vertexAlbedo = shaderAlbedo(records, t, false, diffuse, sceneTexture);
+        same = same && recordAlbedo == vertexAlbedo;
+        const glm::vec3 source =
+            materials[t] == static_cast<uint32_t>(-1) ? sceneTexture : diffuse[remap[materials[t]]];
+        expected = expected && vertexAlbedo == source;
+    }
+    check(same, "triangle records and vertex formats give the same albedo");
+    check(expected, "the albedo is the one of the triangle material");
+}
+
+void checkTriangles(const std::vector<Vertex> &vertices, std::mt19937 &random)
+{
+    const size_t count = vertices.size() / 2;
+    std::uniform_int_distribution<uint32_t> index(0, static_cast<uint32_t>(vertices.size() - 1));
+    std::vector<uint32_t> indices(3 * count);
+    for (uint32_t &i : indices)
+        i = index(random);
+
+    // every fifth triangle has no material, the others one of 8 remapped into the table
+    const std::vector<uint32_t> remap = {7, 3, 3, 0, 12, 5, 9, 1};
+    std::vector<uint32_t> materials(count);
+    for (size_t t = 0; t < count; ++t)
+        materials[t] = t % 5 == 0 ? static_cast<uint32_t>(-1) : static_cast<uint32_t>(t % remap.size());
+
+    std::vector<TriangleRecord> records(count);
+    packTriangles(vertices.data(), indices.data(), materials.data(), remap.data(), count, records.data());
+
+    bool normals = true, texCoords = true, materialIds = true, lods = true;
+    for (size_t t = 0; t < count; ++t)
+    {
+        const TriangleRecord &record = records[t];
+        for (int c = 0; c < 3; ++c)
+        {
+            const Vertex &vertex = vertices[indices[3 * t + c]];
+            normals = normals && normalClose(octahedralDecode(record.normals[c]), vertex.normal);
+            texCoords = texCoords && texCoordClose(unpackHalf2x16(record.texCoords[c]), vertex.texCoord);
+        }
+        const uint32_t expected = materials[t] == static_cast<uint32_t>(-1) ? materials[t] : remap[materials[t]];
+        materialIds = materialIds && record.material == expected;
+        const float lod = triangleLodConstant(vertices[indices[3 * t]], vertices[indices[3 * t + 1]],
+                                              vertices[indices[3 * t + 2]]);
+        lods = lods && std::memcmp(&record.lodConstant, &lod, sizeof(float)) == 0;
+    }
+    check(normals, "triangle record normals");
+    check(texCoords, "triangle record texture coordinates");
+    check(materialIds, "triangle record materials are remapped, none stays -1");
+    check(lods, "triangle record LOD constants");
+
+    checkAlbedo(records, materials, remap);
+}
+
+void checkTangents(std::mt19937 &random)
+{
+    std::uniform_real_distribution<float> direction(-1.0f, 1.0f);
+    bool tangents = true;
+    for (int i = 0; i < 10000; ++i)
+    {
+        glm::vec3 tangent(direction(random), direction(random), direction(random));
+        if (glm::length(tangent) < 0.1f)
+            continue;
+        tangent = glm::normalize(tangent);
+        const float sign = i % 2 ? 1.0f : -1.0f;
+        const glm::vec4 decoded = unpackTangent(packTangent(tangent, sign));
+        // 15 bits per octahedral coordinate in [0, 1], four times the step of the normals
+        tangents = tangents && glm::length(glm::vec3(decoded) - tangent) <= 8e-4f && decoded.w == sign;
+    }
+    check(tangents, "packed tangents");
+}
+}  // namespace
+
+int main()
+{
+    std::mt19937 random(5);
+    const std::vector<Vertex> vertices = randomVertices(20000, random);
+
+    std::vector<Vertex> full(vertices.size());
+    packVertices(RTVertexFormat::Full, {}, vertices.data(), vertices.size(), full.data());
+    check(std::memcmp(full.data(), vertices.data(), vertices.size() * sizeof(Vertex)) == 0,
+          "full vertices are copied");
+
+    checkPacked(vertices);
+    checkQuantized(vertices);
+    checkTriangles(vertices, random);
+    checkTangents(random);
+
+    if (failures > 0)
+        return 1;
+    std::printf("packed vertices and triangles decode within their precision\n");
+    return 0;
+}
@@ -0,0 +1,88 @@
+// Checks the epsilon weld of VertexWelder: vertices within the epsilon on either side of a grid
+// cell boundary are merged, merged vertices never end up further than the epsilon from the
+// vertex they were merged into, and only vertices with equal attributes are merged.
+
+#include <cstdio>
+#include <vector>
+
+#include "vertex_welder.h"
+
+namespace
+{
+constexpr float epsilon = 0.01f;
+
+int failures = 0;
+
+void check(bool condition, const char *what)
+{
+    if (!condition)
+    {
+        std::fprintf(stderr, "failed: %s\n", what);
+        ++failures;
+    }
+}
+
+Vertex at(float x, float y = 0.0f, float z = 0.0f, uint32_t materialId = 0)
+{
+    return Vertex({x, y, z}, {0.0f, 0.0f, 1.0f}, {0.0f, 0.0f}, materialId);
+}
+}  // namespace
+
+int main()
+{
+    {
+        std::vector<Vertex> output;
+        VertexWelder welder(output, epsilon);
+        // 0.0099 and 0.0101 lie in neighbouring cells
+        check(welder.weld(at(0.0099f)) == welder.weld(at(0.0101f)), "merge across a cell boundary");
+        check(welder.weld(at(0.0099f, 0.0099f, 0.0099f)) == welder.weld(at(0.0101f, 0.0101f, 0.0101f)),
+              "merge across a cell corner");
+        check(welder.weld(at(0.5f)) != welder.weld(at(0.5f + 2.0f * epsilon)), "keep vertices further apart");
+        check(welder.weld(at(1.0f, 0.0f, 0.0f, 1)) != welder.weld(at(1.0f, 0.0f, 0.0f, 2)),
+              "keep vertices of different materials");
+        check(welder.weld(at(1e12f, -1e12f)) != welder.weld(at(-1e12f, 1e12f)), "large coordinates do not overflow");
+    }
+
+    {
+        // a row of vertices 0.6 epsilon apart, each within the epsilon of the previous one
+        std::vector<Vertex> output;
+        VertexWelder welder(output, epsilon);
+        std::vector<Vertex> input;
+        for (int i = 0; i < 50; ++i)
+            input.push_back(at(2.0f + 0.6f * epsilon * i));
+        bool within = true;
+        for (const Vertex &vertex : input)
+        {
+            const Vertex &merged = output[welder.weld(vertex)];
+            within = within && glm::length(merged.pos - vertex.pos) <= epsilon;
+        }
+        check(within, "no vertex moves further than the epsilon");
+        check(output.size() > 1, "merges do not chain along the row");
+    }
+
+    {
+        // the loader pre-merges blocks exactly and applies the epsilon once
+        std::vector<Vertex> block;
+        VertexWelder blockWelder(block, 0.0f);
+        const std::vector<Vertex> input = {at(3.0f), at(3.0f), at(3.0f + 0.9f * epsilon), at(3.0f + 1.8f * epsilon)};
+        std::vector<uint32_t> blockIndices;
+        for (const Vertex &vertex : input)
+            blockIndices.push_back(blockWelder.weld(vertex));
+        check(block.size() == 3, "exact weld only merges equal vertices");
+
+        std::vector<Vertex> output;
+        VertexWelder welder(output, epsilon);
+        std::vector<uint32_t> remap;
+        for (const Vertex &vertex : block)
+            remap.push_back(welder.weld(vertex));
+        bool within = true;
+        for (size_t i = 0; i < input.size(); ++i)
+            within = within && glm::length(output[remap[blockIndices[i]]].pos - input[i].pos) <= epsilon;
+        check(within, "two stage weld keeps every vertex within the epsilon");
+    }
+
+    if (failures > 0)
+        return 1;
+    std::printf("vertices are welded within the epsilon\n");
+    return 0;
+}